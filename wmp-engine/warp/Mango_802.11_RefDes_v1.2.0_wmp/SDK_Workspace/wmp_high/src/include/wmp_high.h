@@ -94,7 +94,9 @@ extern char*  last_access_point_ssid;
 extern char  apmode_default_ssid[];
 extern char default_AP_SSID[];
 #define		 MAX_PER_FLOW_QUEUE	150
+#ifndef MAX_ASSOCIATIONS
 #define MAX_ASSOCIATIONS               8
+#endif
 extern station_info associations[MAX_ASSOCIATIONS+1];
 
 #define ASSOCIATION_ALLOW_NONE          0x0
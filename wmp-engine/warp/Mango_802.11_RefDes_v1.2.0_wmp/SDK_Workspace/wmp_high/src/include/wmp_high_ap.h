@@ -12,20 +12,46 @@
 #include "wlan_mac_util.h"
 #include "string.h"
 #include "wmp_high.h"
+#include "wlan_mac_queue.h"
 
 #define BEACON_INTERVAL_MS             (100)
 #define BEACON_INTERVAL_US             (BEACON_INTERVAL_MS*1000)
 
 #define LTG_ID_TO_AID(ltg_id) (ltg_id)
 
+// TX scheduling modes of check_tx_queue_ap()
+#define TX_SCHED_ROUND_ROBIN           0   // one MPDU per queue in turn
+#define TX_SCHED_DRR                   1   // deficit round robin over MPDU bytes
+
+// One scheduler queue per AID; queue 0 is the broadcast / management queue
+#define TX_SCHED_NUM_QUEUES            (MAX_ASSOCIATIONS + 1)
+#define TX_SCHED_DEFAULT_QUANTUM       PQUEUE_MAX_FRAME_SIZE
+#define TX_SCHED_DEFAULT_WEIGHT        1
+
+typedef struct{
+	u32 quantum;          // bytes credited to the queue every round ...
+	u8  weight;           // ... times this weight
+	u32 deficit;          // bytes the queue may still send in this round
+	u32 num_tx;           // MPDUs handed to CPU_LOW
+	u32 num_tx_bytes;
+	u32 num_drop;         // MPDUs refused because the queue was full
+	u32 max_depth;        // high water mark of the queue
+} tx_sched_queue;
+
 
 void wmp_high_util_update_beacon_template();
+void reset_associations();
 int ethernet_receive_ap(packet_bd_list* tx_queue_list, u8* eth_dest, u8* eth_src, u16 tx_length);
 void mpdu_transmit_done_ap(tx_frame_info* tx_mpdu);
 void mpdu_rx_process_ap(void* pkt_buf_addr, u8 rate, u16 length);
 void bad_fcs_rx_process_ap(void* pkt_buf_addr, u8 rate, u16 length);
 void check_tx_queue_ap();
 void ltg_event_ap(u32 id, void* callback_arg);
+void ap_tx_sched_set_mode(u8 mode);
+int  ap_tx_sched_set_quantum(u16 queue_sel, u32 quantum, u8 weight);
+int  ap_tx_sched_get_stats(u16 queue_sel, tx_sched_queue* stats);
+void ap_tx_sched_reset_stats();
+void print_tx_sched_stats();
 void deauthenticate_stations();
 u32  deauthenticate_station( u32 association_index );
 
@@ -10,10 +10,21 @@
 
 #include "xil_types.h"
 
+#define WMP_HIGH_FSM_SLOT_NONE			0xFF
+#define WMP_HIGH_FSM_SLOT_ID_NONE		0xFFFF
+
+/*
+ * Every slot is either on the LRU list (used) or on the
+ * free list, linked through prev/next. Used slots are also
+ * chained through hash_next in the bucket of their id.
+ */
 struct wmp_high_fsm_slot_info {
 	u16 id;
 	u8 used;
 	u64 timestamp;
+	u8 prev;
+	u8 next;
+	u8 hash_next;
 };
 
 void wmp_high_fsm_slots_handler_init();
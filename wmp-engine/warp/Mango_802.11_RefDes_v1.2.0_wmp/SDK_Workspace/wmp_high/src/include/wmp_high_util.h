@@ -12,6 +12,7 @@
 #include "wlan_mac_packet_types.h"
 #include "string.h"
 #include "wmp_high.h"
+#include "wmp_fsm.h"
 
 #define WMP4WARP_ETHER_TYPE			0x108 /* big endian */
 
@@ -53,6 +54,10 @@ struct wmp_high_util_tx_buf_info {
 extern wlan_mac_hw_info   	hw_info;
 
 #define WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD	15
+//Responses are built in the first quarter, frames pushed on IPC replies (READ_VAR_REP,
+// READ_VARS_REP, TELEMETRY) in the second; the upper half holds the IPC rings (IPC_RING_BASEADDR)
+#define WMP_HIGH_UTIL_WMP_CMD_BUF_SIZE			(PKT_BUF_SIZE/4)
+#define WMP_HIGH_UTIL_WMP_PUSH_BUF_OFFSET		WMP_HIGH_UTIL_WMP_CMD_BUF_SIZE
 
 #define WMP4WARP_ECHO_REQ_CMD   		0x0001
 #define WMP4WARP_ECHO_REP_CMD   		0x0002
@@ -68,12 +73,47 @@ extern wlan_mac_hw_info   	hw_info;
 #define WMP4WARP_RUN_ABS_CONF        	0x000c
 #define WMP4WARP_READ_VAR               0x000d
 #define WMP4WARP_READ_VAR_REP           0x000e
+#define WMP4WARP_READ_VARS              0x000f
+#define WMP4WARP_READ_VARS_REP          0x0010
+#define WMP4WARP_SUBSCRIBE              0x0011
+#define WMP4WARP_SUBSCRIBE_CONF         0x0012
+#define WMP4WARP_TELEMETRY              0x0013
+#define WMP4WARP_FSM_LOAD_FRAG          0x0014
+#define WMP4WARP_FSM_LOAD_ACK           0x0015
+
+//Variables in one READ_VARS, READ_VARS_REP, SUBSCRIBE or TELEMETRY
+#define WMP4WARP_MAX_VARS               32
+
+//wmp4warp_header_subscribe flags: besides every period_us (0 for none), push a sample when
+// CPU_LOW switches XFSM, and skip the periodic samples where no variable changed
+#define WMP4WARP_SUBSCRIBE_ON_SWITCH    0x0001
+#define WMP4WARP_SUBSCRIBE_ON_CHANGE    0x0002
+
+//wmp4warp_header_var_set trigger
+#define WMP4WARP_TRIGGER_REQUEST        0x00
+#define WMP4WARP_TRIGGER_PERIOD         0x01
+#define WMP4WARP_TRIGGER_SWITCH         0x02
+
+//Minimum subscription period, the resolution of the fine scheduler
+#define WMP4WARP_MIN_PERIOD_US          FAST_TIMER_DUR_US
+
+//Byte code accepted by FSM_LOAD_FRAG, no more than one FSM slot can hold, and the number
+// of fragments it may be cut into
+#define WMP4WARP_FSM_IMAGE_MAX_SIZE     WMP_FSM_BYTE_CODE_MAX_SIZE
+#define WMP4WARP_FSM_MAX_FRAGS          32
+
+//wmp4warp_header_fsm_load_ack status
+#define WMP4WARP_FSM_LOAD_PENDING       0x0000
+#define WMP4WARP_FSM_LOAD_DONE          0x0001
+#define WMP4WARP_FSM_LOAD_BAD_CRC       0x0002	/* the host has to start a new transfer */
+#define WMP4WARP_FSM_LOAD_FAILED        0x0003
 
 #define WMP_CMD_FRAME_MAX_SIZE	1500
 
 struct __attribute__((__packed__)) wmp4warp_header_common {
      u16   cmd_id;
      u8	mac_addr[6];
+     u16   seq;	/* echoed unchanged in the reply */
 };
 
 struct __attribute__((__packed__)) wmp4warp_header_fsm_load {
@@ -85,6 +125,28 @@ struct __attribute__((__packed__)) wmp4warp_header_fsm_load_conf {
      u16   fsm_id;
 };
 
+//Fragment frag_seq of a byte code of image_l bytes, cut in fragments of frag_size bytes (the
+// last one may be shorter). xfer_id tells transfers apart, image_crc is the CRC-32 of the image
+struct __attribute__((__packed__)) wmp4warp_header_fsm_load_frag {
+     u16   fsm_id;
+     u16   xfer_id;
+     u16   image_l;
+     u16   frag_size;
+     u16   frag_seq;
+     u16   frag_l;
+     u32   image_crc;
+};
+
+//Sent for every fragment: every fragment before next_seq has been received. crc is the
+// CRC-32 of the reassembled image once all fragments are in
+struct __attribute__((__packed__)) wmp4warp_header_fsm_load_ack {
+     u16   fsm_id;
+     u16   xfer_id;
+     u16   next_seq;
+     u16   status;
+     u32   crc;
+};
+
 struct __attribute__((__packed__)) wmp4warp_header_fsm_del {
      u16   fsm_id;
 };
@@ -106,6 +168,39 @@ struct __attribute__((__packed__)) wmp4warp_header_read_var_rep {
      u16   var_value;
 };
 
+struct __attribute__((__packed__)) wmp4warp_header_read_vars {
+     u16   num_vars;
+     u8    var_id[WMP4WARP_MAX_VARS];
+};
+
+//Body of READ_VARS_REP and TELEMETRY. ts is the CPU_HIGH time (us) at which the variables
+// were requested from CPU_LOW; sample counts the samples taken for a subscription, so that
+// the host sees the ones that were skipped
+struct __attribute__((__packed__)) wmp4warp_header_var_set {
+     u64   ts;
+     u32   sample;
+     u8    trigger;
+     u8    slot;	/* XFSM slot for WMP4WARP_TRIGGER_SWITCH */
+     u8    num_vars;
+     u8    reserved;
+     u8    var_id[WMP4WARP_MAX_VARS];
+     u16   var_value[WMP4WARP_MAX_VARS];
+};
+
+//num_vars 0 cancels the subscription
+struct __attribute__((__packed__)) wmp4warp_header_subscribe {
+     u32   period_us;
+     u16   flags;
+     u16   num_vars;
+     u8    var_id[WMP4WARP_MAX_VARS];
+};
+
+struct __attribute__((__packed__)) wmp4warp_header_subscribe_conf {
+     u32   period_us;	/* after clamping to WMP4WARP_MIN_PERIOD_US */
+     u16   flags;
+     u16   num_vars;
+};
+
 struct __attribute__((__packed__)) wmp4warp_header_run {
         u16   fsm_id;
         u64   ts;
@@ -131,6 +226,8 @@ struct __attribute__((__packed__)) wmp4warp_header_run_abs_conf {
 #define WMP4WARP_ECHO_REP_L     		(MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)))
 #define WMP4WARP_FSM_LOAD_L     		(MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_fsm_load)))
 #define WMP4WARP_FSM_LOAD_CONF_L        (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_fsm_load_conf)))
+#define WMP4WARP_FSM_LOAD_FRAG_L        (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_fsm_load_frag)))
+#define WMP4WARP_FSM_LOAD_ACK_L         (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_fsm_load_ack)))
 #define WMP4WARP_FSM_DEL_L     			(MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_fsm_del)))
 #define WMP4WARP_FSM_DEL_CONF_L        	(MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_fsm_del_conf)))
 #define WMP4WARP_TS_REQ_L               (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)))
@@ -141,6 +238,11 @@ struct __attribute__((__packed__)) wmp4warp_header_run_abs_conf {
 #define WMP4WARP_RUN_ABS_CONF_L         (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_run_abs_conf)))
 #define WMP4WARP_READ_VAR_L             (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_read_var)))
 #define WMP4WARP_READ_VAR_REP_L         (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_read_var_rep)))
+#define WMP4WARP_READ_VARS_L            (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_read_vars)))
+#define WMP4WARP_READ_VARS_REP_L        (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_var_set)))
+#define WMP4WARP_SUBSCRIBE_L            (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_subscribe)))
+#define WMP4WARP_SUBSCRIBE_CONF_L       (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_subscribe_conf)))
+#define WMP4WARP_TELEMETRY_L            (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_var_set)))
 
 
 extern u8 wmp_cmd_resp[WMP_CMD_FRAME_MAX_SIZE];
@@ -150,7 +252,9 @@ void wmp_high_util_create_fake_assoc(station_info *access_point);
 u32 get_wmp_tx_buf_info(int index);
 void set_wmp_tx_buf_info(int index, u32 flag_val);
 void wmp_high_util_update_beacon_template();
-void wmp_high_util_handle_wmp_cmd_from_ethernet(ethernet_header* eth_hdr);
+void wmp_high_util_handle_wmp_cmd_from_ethernet(ethernet_header* eth_hdr, u32 eth_rx_len);
+void wmp_high_util_read_var_done(u32 var_id, u16 var_value);
+void wmp_high_util_telemetry_fsm_switch(u8 slot);
 
 
 #endif /* WMP_HIGH_UTIL_H_ */
@@ -255,7 +255,7 @@ void uart_rx(u8 rxByte){
 				ipc_msg_to_low.msg_id = IPC_MBOX_MSG_ID(IPC_MBOX_MODE);
 				ipc_msg_to_low.num_payload_words = 0;
 				ipc_msg_to_low.arg0 = modeofoperation;
-				ipc_mailbox_write_msg(&ipc_msg_to_low);
+				ipc_ring_write_msg(&ipc_msg_to_low);
 				wlan_mac_util_set_eth_encap_mode(ENCAP_MODE_STA);
 				access_point_ssid = wlan_realloc(access_point_ssid, strlen(default_AP_SSID)+1);
 				strcpy(access_point_ssid,default_AP_SSID);
@@ -287,15 +287,9 @@ void uart_rx(u8 rxByte){
 				ipc_msg_to_low.msg_id = IPC_MBOX_MSG_ID(IPC_MBOX_MODE);
 				ipc_msg_to_low.num_payload_words = 0;
 				ipc_msg_to_low.arg0 = modeofoperation;
-				ipc_mailbox_write_msg(&ipc_msg_to_low);
+				ipc_ring_write_msg(&ipc_msg_to_low);
 				wlan_mac_util_set_eth_encap_mode(ENCAP_MODE_AP);
-				bzero(&(associations[0]), sizeof(station_info)*(MAX_ASSOCIATIONS+1));
-
-				for(i = 0; i < MAX_ASSOCIATIONS; i++){
-					associations[i].AID = (1+i); //7.3.1.8 of 802.11-2007
-					memset((void*)(&(associations[i].addr[0])), 0xFF,6);
-					associations[i].seq = 0; //seq
-				}
+				reset_associations();
 				max_queue_size = min((queue_total_size()- eth_bd_total_size()) / (next_free_assoc_index+1),MAX_PER_FLOW_QUEUE);
 				if (strlen(last_access_point_ssid) > 0) {
 					access_point_ssid = wlan_realloc(access_point_ssid, strlen(last_access_point_ssid)+1);
@@ -477,6 +471,9 @@ void uart_rx(u8 rxByte){
 				case ASCII_r:
 					//Reset statistics
 					reset_station_statistics();
+					wlan_eth_tx_reset_stats();
+					wlan_eth_rx_reset_stats();
+					ipc_ring_reset_stats();
 				break;
 				case ASCII_1:
 					if(access_point.AID != 0){
@@ -671,7 +668,7 @@ void uart_rx(u8 rxByte){
 							ipc_msg_to_low.payload_ptr = &(ipc_msg_to_low_payload[0]);
 							init_ipc_config(config_rf_ifc,ipc_msg_to_low_payload,ipc_config_rf_ifc);
 							config_rf_ifc->channel = mac_param_chan;
-							ipc_mailbox_write_msg(&ipc_msg_to_low);
+							ipc_ring_write_msg(&ipc_msg_to_low);
 
 
 							xil_printf("\nAttempting to join %s\n", ap_list[ap_sel].ssid);
@@ -809,6 +806,10 @@ void print_station_status(u8 manual_call){
 	void* ltg_pyld_callback_arg;
 
 	u32 ltg_type;
+	eth_tx_stats tx_stats;
+	eth_rx_stats rx_stats;
+	ipc_ring_stats ipc_stats;
+	u32 i;
 
 
 	if((manual_call == 1 && print_scheduled == 0) || (manual_call == 0 && print_scheduled == 1)){
@@ -859,6 +860,25 @@ void print_station_status(u8 manual_call){
 					xil_printf("     - # Tx Retry: %d\n", access_point.num_retry);
 					xil_printf("     - # Rx MPDUs: %d (%d bytes)\n", access_point.num_rx_success, access_point.num_rx_bytes);
 				}
+			wlan_eth_tx_get_stats(&tx_stats);
+			xil_printf(" Eth Tx: %d frames (%d complete), %d/%d BDs in flight (max %d)\n", tx_stats.num_sent, tx_stats.num_completed,
+				tx_stats.num_in_flight, ETH_A_NUM_TX_BD, tx_stats.max_in_flight);
+			xil_printf("     - # ring stalls: %d, # sync sends: %d, # errors: %d\n", tx_stats.num_ring_stalls, tx_stats.num_sync, tx_stats.num_errors);
+			wlan_eth_rx_get_stats(&rx_stats);
+			xil_printf(" Eth Rx: %d frames in %d polls (max %d per poll, budget %d reached %d times)\n", rx_stats.num_frames, rx_stats.num_polls,
+				rx_stats.max_frames_per_poll, ETH_A_RX_BUDGET, rx_stats.num_budget_exhausted);
+			xil_printf("     - # ring full: %d, # refill starved: %d, # not queued: %d\n", rx_stats.num_ring_full, rx_stats.num_refill_starved, rx_stats.num_not_queued);
+			ipc_ring_get_stats(&ipc_stats);
+			xil_printf(" IPC Tx: %d ring msgs, %d doorbells, %d mailbox msgs (%d ring full, %d timeouts)\n", ipc_stats.num_sent, ipc_stats.num_doorbells,
+				ipc_stats.num_mailbox, ipc_stats.num_ring_full, ipc_stats.num_wait_timeouts);
+			xil_printf(" IPC Rx: %d ring msgs in %d doorbells (max %d), # errors: %d\n", ipc_stats.num_received, ipc_stats.num_drains,
+				ipc_stats.max_batch, ipc_stats.num_errors);
+			for(i = 0; i < IPC_MBOX_NUM_MSG_TYPES; i++){
+				if(ipc_stats.latency[i].count > 0){
+					xil_printf("     - msg %d: %d, latency %d us avg, %d us max\n", i, ipc_stats.latency[i].count,
+						ipc_stats.latency[i].sum / ipc_stats.latency[i].count, ipc_stats.latency[i].max);
+				}
+			}
 			xil_printf("---------------------------------------------------\n");
 			xil_printf("\n");
 			xil_printf("[r] - reset statistics\n\n");
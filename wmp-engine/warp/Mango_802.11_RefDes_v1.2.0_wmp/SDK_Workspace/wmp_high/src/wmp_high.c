@@ -122,7 +122,6 @@ int main(){
 
 	/* WMP_START */
 	wlan_ipc_msg ipc_msg_to_low;
-	u32 i;
 	/* WMP_END */
 
 	//This function should be executed first. It will zero out memory, and if that
@@ -135,15 +134,8 @@ int main(){
 	ap_list = NULL;
 
 	/* WMP_START */
-	next_free_assoc_index = 0;
 	beacon_interval = BEACON_INTERVAL_MS;
-	bzero(&(associations[0]), sizeof(station_info)*(MAX_ASSOCIATIONS+1));
-
-	for(i = 0; i < MAX_ASSOCIATIONS; i++){
-		associations[i].AID = (1+i); //7.3.1.8 of 802.11-2007
-		memset((void*)(&(associations[i].addr[0])), 0xFF,6);
-		associations[i].seq = 0; //seq
-	}
+	reset_associations();
 	if (modeofoperation == MODEOFOPERATION_STA) {
 		max_queue_size = MAX_PER_FLOW_QUEUE;
 	} else if (modeofoperation == MODEOFOPERATION_AP) {
@@ -280,7 +272,7 @@ int main(){
 	ipc_msg_to_low.msg_id = IPC_MBOX_MSG_ID(IPC_MBOX_MODE);
 	ipc_msg_to_low.num_payload_words = 0;
 	ipc_msg_to_low.arg0 = modeofoperation;
-	ipc_mailbox_write_msg(&ipc_msg_to_low);
+	ipc_ring_write_msg(&ipc_msg_to_low);
 
 	if (modeofoperation == MODEOFOPERATION_STA) {
 		if( strlen(default_AP_SSID) > 0 ) {
@@ -309,6 +301,7 @@ int main(){
 #ifdef USE_WARPNET_WLAN_EXP
 		interrupt_stop();
 		transport_poll( WLAN_EXP_ETH );
+		node_log_stream_poll();
 		interrupt_start();
 #endif
 	}
@@ -320,7 +313,6 @@ int main(){
 /* WMP_START */
 void check_tx_queue(){
 
-	static u32 station_index = 0;
 	u8 i;
 
 	if (modeofoperation == MODEOFOPERATION_STA) {
@@ -337,27 +329,7 @@ void check_tx_queue(){
 			}
 		}
 	} else if (modeofoperation == MODEOFOPERATION_AP) {
-		if (pause_queue == 0) {
-			if( is_cpu_low_ready() ){
-				for(i = 0; i < (next_free_assoc_index+1); i++){
-					station_index = (station_index+1)%(next_free_assoc_index+1);
-
-					if(station_index == next_free_assoc_index){
-						//Check Broadcast Queue
-
-						if(wlan_mac_poll_tx_queue(0)){
-							return;
-						}
-					} else {
-						//Check Station Queue
-						if(wlan_mac_poll_tx_queue(associations[station_index].AID)){
-							return;
-						}
-					}
-				}
-
-			}
-		}
+		check_tx_queue_ap();
 	}
 
 }
@@ -778,7 +750,7 @@ void mpdu_rx_process(void* pkt_buf_addr, u8 rate, u16 length) {
 					ipc_msg_to_low.num_payload_words = (sizeof(ipc_msg_to_low_payload)/sizeof(u32));
 					memcpy(ipc_msg_to_low_payload, access_point.addr, 6);
 					ipc_msg_to_low.payload_ptr       = (u32 *)&(ipc_msg_to_low_payload[0]);
-					ipc_mailbox_write_msg(&ipc_msg_to_low);
+					ipc_ring_write_msg(&ipc_msg_to_low);
 					/* WMP_END */
 
 					xil_printf("Association succeeded\n");
@@ -24,36 +24,192 @@
 #include "wlan_mac_eth_util.h"
 #include "wlan_mac_ltg.h"
 #include "wlan_mac_ipc.h"
+#include "wlan_mac_queue.h"
+
+extern u8 pause_queue;
+
+// TX scheduler
+//   State is kept per queue, i.e. per AID, so it follows a station when
+//   remove_station() moves its association entry. tx_sched_pos walks the
+//   packed association table; position next_free_assoc_index stands for the
+//   broadcast queue.
+//
+static tx_sched_queue tx_sched[TX_SCHED_NUM_QUEUES];
+static u8  tx_sched_mode = TX_SCHED_DRR;
+static u32 tx_sched_pos;
+static u8  tx_sched_turn_open;
+static u16 tx_sched_turn_queue;
+
+static void tx_sched_clear_queue( u16 queue_sel ) {
+	tx_sched[queue_sel].deficit      = 0;
+	tx_sched[queue_sel].num_tx       = 0;
+	tx_sched[queue_sel].num_tx_bytes = 0;
+	tx_sched[queue_sel].num_drop     = 0;
+	tx_sched[queue_sel].max_depth    = 0;
+}
+
+static void tx_sched_init(){
+	u32 i;
+
+	for(i = 0; i < TX_SCHED_NUM_QUEUES; i++){
+		tx_sched[i].quantum = TX_SCHED_DEFAULT_QUANTUM;
+		tx_sched[i].weight  = TX_SCHED_DEFAULT_WEIGHT;
+		tx_sched_clear_queue(i);
+	}
+
+	tx_sched_pos        = 0;
+	tx_sched_turn_open  = 0;
+	tx_sched_turn_queue = 0;
+}
+
+// Soft per-queue limit applied by every enqueue path; refused MPDUs count as drops
+static int tx_sched_admit( u16 queue_sel ) {
+	u32 depth = queue_num_queued(queue_sel);
+
+	if(depth >= max_queue_size){
+		(tx_sched[queue_sel].num_drop)++;
+		return 0;
+	}
+
+	if((depth + 1) > tx_sched[queue_sel].max_depth){
+		tx_sched[queue_sel].max_depth = depth + 1;
+	}
+	return 1;
+}
+
+// Association index
+//   associations[0 .. next_free_assoc_index-1] stay packed so the TX round
+//   robin only walks live stations. assoc_hash chains those entries by MAC
+//   address and assoc_aid_index maps an AID to its entry; both are kept up
+//   to date by assoc_insert() and remove_station().
+//
+#define ASSOC_INDEX_NONE               0xFF
+#define ASSOC_HASH_N                   (2 * MAX_ASSOCIATIONS)
+#define ASSOC_HASH(addr)               (((addr)[3] * 7 + (addr)[4] * 31 + (addr)[5]) % ASSOC_HASH_N)
+
+// Same number of stations the table accepted before it was indexed
+#define ASSOC_MAX_STATIONS             (MAX_ASSOCIATIONS - 2)
+
+static u8 assoc_hash[ASSOC_HASH_N];
+static u8 assoc_hash_next[MAX_ASSOCIATIONS];
+static u8 assoc_aid_index[MAX_ASSOCIATIONS + 1];
+
+static void assoc_hash_add( u32 station_index ) {
+	u8* bucket = &(assoc_hash[ASSOC_HASH(associations[station_index].addr)]);
+
+	assoc_hash_next[station_index] = *bucket;
+	*bucket = station_index;
+}
+
+static void assoc_hash_del( u32 station_index ) {
+	u8* link = &(assoc_hash[ASSOC_HASH(associations[station_index].addr)]);
+
+	while( *link != ASSOC_INDEX_NONE ) {
+		if( *link == station_index ) {
+			*link = assoc_hash_next[station_index];
+			break;
+		}
+		link = &(assoc_hash_next[*link]);
+	}
+	assoc_hash_next[station_index] = ASSOC_INDEX_NONE;
+}
+
+static u32 assoc_addr_to_index( u8* addr ) {
+	u8 idx;
+
+	for( idx = assoc_hash[ASSOC_HASH(addr)]; idx != ASSOC_INDEX_NONE; idx = assoc_hash_next[idx] ) {
+		if(wlan_addr_eq(associations[idx].addr, addr)) {
+			return idx;
+		}
+	}
+	return ASSOC_INDEX_NONE;
+}
+
+static u32 assoc_aid_to_index( u32 aid ) {
+	if( ( aid == 0 ) || ( aid > MAX_ASSOCIATIONS ) || ( assoc_aid_index[aid] >= next_free_assoc_index ) ) {
+		return ASSOC_INDEX_NONE;
+	}
+	return assoc_aid_index[aid];
+}
+
+// Take the first free entry (which keeps the AID it was given at reset) for addr
+static u32 assoc_insert( u8* addr ) {
+	u32 station_index;
+
+	if( next_free_assoc_index >= ASSOC_MAX_STATIONS ) {
+		return ASSOC_INDEX_NONE;
+	}
+
+	station_index = next_free_assoc_index++;
+
+	memcpy(&(associations[station_index].addr[0]), addr, 6);
+	associations[station_index].seq = 0;
+	assoc_hash_add(station_index);
+
+	tx_sched_clear_queue(associations[station_index].AID);
+
+	max_queue_size = min((queue_total_size()- eth_bd_total_size()) / (next_free_assoc_index+1),MAX_PER_FLOW_QUEUE);
+
+	return station_index;
+}
+
+void reset_associations(){
+	u32 i;
+
+	next_free_assoc_index = 0;
+
+	bzero(&(associations[0]), sizeof(station_info)*(MAX_ASSOCIATIONS+1));
+
+	for(i = 0; i < MAX_ASSOCIATIONS; i++){
+		associations[i].AID = (1+i); //7.3.1.8 of 802.11-2007
+		memset((void*)(&(associations[i].addr[0])), 0xFF,6);
+		associations[i].seq = 0; //seq
+
+		assoc_hash_next[i] = ASSOC_INDEX_NONE;
+		assoc_aid_index[associations[i].AID] = i;
+	}
+
+	for(i = 0; i < ASSOC_HASH_N; i++){
+		assoc_hash[i] = ASSOC_INDEX_NONE;
+	}
+
+	tx_sched_init();
+}
 
 static void remove_station( unsigned int station_index ) {
+	u32 last;
 
-	// If there are stations in the association table and the station to remove
-	//   is in the association table, then remove it.
+	// If the station to remove is in the association table, then remove it.
 
 #ifdef _DEBUG
 	xil_printf("next_free_assoc_index = %d \n", next_free_assoc_index);
 #endif
 
-	if( ( next_free_assoc_index > 0 ) && ( station_index < MAX_ASSOCIATIONS ) ) {
+	if( station_index < next_free_assoc_index ) {
 
 		// Decrement global variable
 		next_free_assoc_index--;
+		last = next_free_assoc_index;
 
 		max_queue_size = min((queue_total_size()- eth_bd_total_size()) / (next_free_assoc_index+1),MAX_PER_FLOW_QUEUE);
 
 		// Clear Association Address
+		assoc_hash_del(station_index);
+		tx_sched[associations[station_index].AID].deficit = 0;
 		memcpy(&(associations[station_index].addr[0]), bcast_addr, 6);
 
-		// If this station is not the last in the table, then re-pack
-		if( station_index < next_free_assoc_index ) {
-			//Copy from current index to the swap space
-			memcpy(&(associations[MAX_ASSOCIATIONS]), &(associations[station_index]), sizeof(station_info));
+		// If this station is not the last in the table, then swap it with the
+		//   last one so the table stays packed. The freed entry keeps its AID.
+		if( station_index < last ) {
+			assoc_hash_del(last);
 
-			//Shift later entries back into the freed association entry
-			memcpy(&(associations[station_index]), &(associations[station_index+1]), (next_free_assoc_index - station_index)*sizeof(station_info));
+			memcpy(&(associations[MAX_ASSOCIATIONS]), &(associations[station_index]), sizeof(station_info));
+			memcpy(&(associations[station_index]), &(associations[last]), sizeof(station_info));
+			memcpy(&(associations[last]), &(associations[MAX_ASSOCIATIONS]), sizeof(station_info));
 
-			//Copy from swap space to current free index
-			memcpy(&(associations[next_free_assoc_index]), &(associations[MAX_ASSOCIATIONS]), sizeof(station_info));
+			assoc_hash_add(station_index);
+			assoc_aid_index[associations[station_index].AID] = station_index;
+			assoc_aid_index[associations[last].AID] = last;
 		}
 	}
 }
@@ -88,7 +244,7 @@ void wmp_high_util_update_beacon_template()
 	ipc_msg_to_low.msg_id = IPC_MBOX_MSG_ID(IPC_MBOX_UPDATE);
 	ipc_msg_to_low.num_payload_words = 0;
 	ipc_msg_to_low.arg0 = WMP_IPC_MBOX_UPDATE_BEACON_TEMPLATE_INVALID;
-	ipc_mailbox_write_msg(&ipc_msg_to_low);
+	ipc_ring_write_msg(&ipc_msg_to_low);
 
 	if (lock_pkt_buf_tx(TX_BUFFER_BEACON) == PKT_BUF_MUTEX_SUCCESS) {
 		setup_tx_header( &tx_80211_header_common, bcast_addr, eeprom_mac_addr );
@@ -114,7 +270,7 @@ void wmp_high_util_update_beacon_template()
         ipc_msg_to_low.msg_id = IPC_MBOX_MSG_ID(IPC_MBOX_UPDATE);
 		ipc_msg_to_low.num_payload_words = 0;
 		ipc_msg_to_low.arg0 = WMP_IPC_MBOX_UPDATE_BEACON_TEMPLATE;
-		ipc_mailbox_write_msg(&ipc_msg_to_low);
+		ipc_ring_write_msg(&ipc_msg_to_low);
 	} else {
 		warp_printf(PL_WARNING, "TX template update delayed\n", TX_BUFFER_BEACON);
 		wlan_mac_schedule_event(SCHEDULE_COARSE, 100000, (void*)wmp_high_util_update_beacon_template);
@@ -127,14 +283,13 @@ int ethernet_receive_ap(packet_bd_list* tx_queue_list, u8* eth_dest, u8* eth_src
 	packet_bd* tx_queue = tx_queue_list->first;
 
 	u32 i;
-	u8 is_associated = 0;
 
 	setup_tx_header( &tx_header_common, (u8*)(&(eth_dest[0])), (u8*)(&(eth_src[0])) );
 
 	wlan_create_data_frame((void*)((tx_packet_buffer*)(tx_queue->buf_ptr))->frame, &tx_header_common, MAC_FRAME_CTRL2_FLAG_FROM_DS);
 
 	if(wlan_addr_eq(bcast_addr, eth_dest)){
-		if(queue_num_queued(0) < max_queue_size){
+		if(tx_sched_admit(0)){
 			setup_tx_queue ( tx_queue, NULL, tx_length, 0, 0 );
 
 			enqueue_after_end(0, tx_queue_list);
@@ -146,14 +301,9 @@ int ethernet_receive_ap(packet_bd_list* tx_queue_list, u8* eth_dest, u8* eth_src
 	} else {
 		//Check associations
 		//Is this packet meant for a station we are associated with?
-		for(i=0; i < next_free_assoc_index; i++) {
-			if(wlan_addr_eq(associations[i].addr, eth_dest)) {
-				is_associated = 1;
-				break;
-			}
-		}
-		if(is_associated) {
-			if(queue_num_queued(associations[i].AID) < max_queue_size){
+		i = assoc_addr_to_index(eth_dest);
+		if(i != ASSOC_INDEX_NONE) {
+			if(tx_sched_admit(associations[i].AID)){
 				setup_tx_queue ( tx_queue, (void*)&(associations[i]), tx_length, MAX_RETRY,
 								 (TX_MPDU_FLAGS_FILL_DURATION | TX_MPDU_FLAGS_REQ_TO) );
 
@@ -198,15 +348,13 @@ void mpdu_transmit_done_ap(tx_frame_info* tx_mpdu){
 
 
 	if(tx_mpdu->AID != 0){
-		for(i=0; i<next_free_assoc_index; i++){
-			if( (associations[i].AID) == (tx_mpdu->AID) ) {
+		i = assoc_aid_to_index(tx_mpdu->AID);
+		if(i != ASSOC_INDEX_NONE) {
 
-				if(tx_event_log_entry != NULL) tx_event_log_entry->AID = associations[i].AID;
+			if(tx_event_log_entry != NULL) tx_event_log_entry->AID = associations[i].AID;
 
-				//Process this TX MPDU DONE event to update any statistics used in rate adaptation
-				wlan_mac_util_process_tx_done(tx_mpdu, &(associations[i]));
-				break;
-			}
+			//Process this TX MPDU DONE event to update any statistics used in rate adaptation
+			wlan_mac_util_process_tx_done(tx_mpdu, &(associations[i]));
 		}
 	}
 }
@@ -215,7 +363,7 @@ void mpdu_rx_process_ap(void* pkt_buf_addr, u8 rate, u16 length) {
 	void * mpdu = pkt_buf_addr + PHY_RX_PKT_BUF_MPDU_OFFSET;
 	u8* mpdu_ptr_u8 = (u8*)mpdu;
 	u16 tx_length;
-	u8 send_response, allow_association, allow_disassociation, new_association;
+	u8 send_response, allow_association, new_association;
 	mac_header_80211* rx_80211_header;
 	rx_80211_header = (mac_header_80211*)((void *)mpdu_ptr_u8);
 	u16 rx_seq;
@@ -269,34 +417,31 @@ void mpdu_rx_process_ap(void* pkt_buf_addr, u8 rate, u16 length) {
 		}
 	}
 
-	for(i=0; i < next_free_assoc_index; i++) {
-		if(wlan_addr_eq(associations[i].addr, (rx_80211_header->address_2))) {
-			is_associated = 1;
-			associated_station = &(associations[i]);
-			rx_seq = ((rx_80211_header->sequence_control)>>4)&0xFFF;
+	i = assoc_addr_to_index(rx_80211_header->address_2);
+	if(i != ASSOC_INDEX_NONE) {
+		is_associated = 1;
+		associated_station = &(associations[i]);
+		rx_seq = ((rx_80211_header->sequence_control)>>4)&0xFFF;
 
-			if(rate != WLAN_MAC_RATE_1M){
-				if(rx_event_log_entry != NULL) ((rx_ofdm_event*)rx_event_log_entry)->AID = associations[i].AID;
-			} else {
-				if(rx_event_log_entry != NULL) ((rx_dsss_event*)rx_event_log_entry)->AID = associations[i].AID;
-			}
+		if(rate != WLAN_MAC_RATE_1M){
+			if(rx_event_log_entry != NULL) ((rx_ofdm_event*)rx_event_log_entry)->AID = associations[i].AID;
+		} else {
+			if(rx_event_log_entry != NULL) ((rx_dsss_event*)rx_event_log_entry)->AID = associations[i].AID;
+		}
 
-			//Check if duplicate
-			associations[i].rx_timestamp = get_usec_timestamp();
-			associations[i].last_rx_power = mpdu_info->rx_power;
+		//Check if duplicate
+		associations[i].rx_timestamp = get_usec_timestamp();
+		associations[i].last_rx_power = mpdu_info->rx_power;
 
-			if( (associations[i].seq != 0)  && (associations[i].seq == rx_seq) ) {
-				//Received seq num matched previously received seq num for this STA; ignore the MPDU and return
+		if( (associations[i].seq != 0)  && (associations[i].seq == rx_seq) ) {
+			//Received seq num matched previously received seq num for this STA; ignore the MPDU and return
 #ifdef WLAN_MAC_EVENTS_LOG_CHAN_EST
-				if(rate != WLAN_MAC_RATE_1M) wlan_mac_cdma_finish_transfer();
+			if(rate != WLAN_MAC_RATE_1M) wlan_mac_cdma_finish_transfer();
 #endif
-				return;
-
-			} else {
-				associations[i].seq = rx_seq;
-			}
+			return;
 
-			break;
+		} else {
+			associations[i].seq = rx_seq;
 		}
 	}
 
@@ -339,29 +484,26 @@ void mpdu_rx_process_ap(void* pkt_buf_addr, u8 rate, u16 length) {
 						 	}
 
 					} else {
-						for(i=0; i < next_free_assoc_index; i++) {
-							if(wlan_addr_eq(associations[i].addr, (rx_80211_header->address_3))) {
-								queue_checkout(&checkout,1);
-
-								if(checkout.length == 1){ //There was at least 1 free queue element
-									tx_queue = checkout.first;
-									setup_tx_header( &tx_header_common, rx_80211_header->address_3, rx_80211_header->address_2);
-									mpdu_ptr_u8 = (u8*)((tx_packet_buffer*)(tx_queue->buf_ptr))->frame;
-									tx_length = wlan_create_data_frame((void*)((tx_packet_buffer*)(tx_queue->buf_ptr))->frame, &tx_header_common, MAC_FRAME_CTRL2_FLAG_FROM_DS);
-									mpdu_ptr_u8 += sizeof(mac_header_80211);
-									memcpy(mpdu_ptr_u8, (void*)rx_80211_header + sizeof(mac_header_80211), mpdu_info->length - sizeof(mac_header_80211));
-									setup_tx_queue ( tx_queue, (void*)&(associations[i]), mpdu_info->length, MAX_RETRY,
-										 				         (TX_MPDU_FLAGS_FILL_DURATION | TX_MPDU_FLAGS_REQ_TO) );
+						i = assoc_addr_to_index(rx_80211_header->address_3);
+						if(i != ASSOC_INDEX_NONE) {
+							queue_checkout(&checkout,1);
 
-									enqueue_after_end(associations[i].AID,  &checkout);
+							if(checkout.length == 1){ //There was at least 1 free queue element
+								tx_queue = checkout.first;
+								setup_tx_header( &tx_header_common, rx_80211_header->address_3, rx_80211_header->address_2);
+								mpdu_ptr_u8 = (u8*)((tx_packet_buffer*)(tx_queue->buf_ptr))->frame;
+								tx_length = wlan_create_data_frame((void*)((tx_packet_buffer*)(tx_queue->buf_ptr))->frame, &tx_header_common, MAC_FRAME_CTRL2_FLAG_FROM_DS);
+								mpdu_ptr_u8 += sizeof(mac_header_80211);
+								memcpy(mpdu_ptr_u8, (void*)rx_80211_header + sizeof(mac_header_80211), mpdu_info->length - sizeof(mac_header_80211));
+								setup_tx_queue ( tx_queue, (void*)&(associations[i]), mpdu_info->length, MAX_RETRY,
+									 				         (TX_MPDU_FLAGS_FILL_DURATION | TX_MPDU_FLAGS_REQ_TO) );
 
-									check_tx_queue();
-									#ifndef ALLOW_ETH_TX_OF_WIRELESS_TX
-									eth_send = 0;
-									#endif
-								}
+								enqueue_after_end(associations[i].AID,  &checkout);
 
-								break;
+								check_tx_queue();
+								#ifndef ALLOW_ETH_TX_OF_WIRELESS_TX
+								eth_send = 0;
+								#endif
 							}
 						}
 					}
@@ -514,27 +656,22 @@ void mpdu_rx_process_ap(void* pkt_buf_addr, u8 rate, u16 length) {
 		case (MAC_FRAME_CTRL1_SUBTYPE_REASSOC_REQ): //Re-association Request
 		case (MAC_FRAME_CTRL1_SUBTYPE_ASSOC_REQ): //Association Request
 			if(wlan_addr_eq(rx_80211_header->address_3, eeprom_mac_addr)) {
-				for(i=0; i <= next_free_assoc_index; i++) {
-					if(wlan_addr_eq((associations[i].addr), bcast_addr)) {
+				allow_association = 0;
+
+				i = assoc_addr_to_index(rx_80211_header->address_2);
+				if(i != ASSOC_INDEX_NONE) {
+					allow_association = 1;
+					new_association = 0;
+				} else {
+					i = assoc_insert(rx_80211_header->address_2);
+					if(i != ASSOC_INDEX_NONE) {
 						allow_association = 1;
 						new_association = 1;
-
-						if(next_free_assoc_index < (MAX_ASSOCIATIONS-2)) {
-							next_free_assoc_index++;
-							max_queue_size = min((queue_total_size()- eth_bd_total_size()) / (next_free_assoc_index+1),MAX_PER_FLOW_QUEUE);
-						}
-						break;
-
-					} else if(wlan_addr_eq((associations[i].addr), rx_80211_header->address_2)) {
-						allow_association = 1;
-						new_association = 0;
-						break;
 					}
 				}
 
 				if(allow_association) {
 					//Keep track of this association of this association
-					memcpy(&(associations[i].addr[0]), rx_80211_header->address_2, 6);
 					associations[i].tx_rate = default_unicast_rate; //Default tx_rate for this station. Rate adaptation may change this value.
 					associations[i].num_tx_total = 0;
 					associations[i].num_tx_success = 0;
@@ -576,14 +713,9 @@ void mpdu_rx_process_ap(void* pkt_buf_addr, u8 rate, u16 length) {
 
 		case (MAC_FRAME_CTRL1_SUBTYPE_DISASSOC): //Disassociation
 				if(wlan_addr_eq(rx_80211_header->address_3, eeprom_mac_addr)) {
-					for(i=0;i<next_free_assoc_index;i++){
-						if(wlan_addr_eq(associations[i].addr, rx_80211_header->address_2)) {
-								allow_disassociation = 1;
-							break;
-						}
-					}
+					i = assoc_addr_to_index(rx_80211_header->address_2);
 
-					if(allow_disassociation) {
+					if(i != ASSOC_INDEX_NONE) {
 						remove_station( i );
 						xil_printf("\n\nDisassociation:\n");
 						print_associations();
@@ -609,10 +741,96 @@ void bad_fcs_rx_process_ap(void* pkt_buf_addr, u8 rate, u16 length) {
 	bad_fcs_event_log_entry->rate = rate;
 }
 
+static void tx_sched_next_turn(){
+	tx_sched_turn_open = 0;
+	tx_sched_pos = (tx_sched_pos+1)%(next_free_assoc_index+1);
+}
+
+static int tx_sched_poll_drr(){
+	packet_bd_list dequeue;
+	packet_bd* head;
+	tx_sched_queue* q;
+	u16 queue_sel;
+	u32 length;
+	u32 i;
+	u8 backlogged;
+
+	// Every pass over a backlogged table credits each busy queue once more,
+	//   so this ends even if the quanta are smaller than the MPDUs.
+	do {
+		backlogged = 0;
+
+		for(i = 0; i < (next_free_assoc_index+1); i++){
+			if(tx_sched_pos > next_free_assoc_index){
+				// The association table shrank under us
+				tx_sched_pos = 0;
+				tx_sched_turn_open = 0;
+			}
+
+			queue_sel = (tx_sched_pos == next_free_assoc_index) ? 0 : associations[tx_sched_pos].AID;
+			q         = &(tx_sched[queue_sel]);
+			head      = queue_first(queue_sel);
+
+			if(head == NULL){
+				// Idle queues do not bank credit
+				q->deficit = 0;
+				tx_sched_next_turn();
+				continue;
+			}
+
+			backlogged = 1;
+
+			if(!tx_sched_turn_open || (tx_sched_turn_queue != queue_sel)){
+				q->deficit += q->quantum * q->weight;
+				tx_sched_turn_open  = 1;
+				tx_sched_turn_queue = queue_sel;
+			}
+
+			length = ((tx_packet_buffer*)(head->buf_ptr))->frame_info.length;
+
+			if(length > q->deficit){
+				tx_sched_next_turn();
+				continue;
+			}
+
+			q->deficit -= length;
+			(q->num_tx)++;
+			(q->num_tx_bytes) += length;
+
+			dequeue_from_beginning(&dequeue, queue_sel, 1);
+			mpdu_transmit(dequeue.first);
+			queue_checkin(&dequeue);
+			wlan_eth_dma_update();
+
+			if(queue_num_queued(queue_sel) == 0){
+				q->deficit = 0;
+				tx_sched_next_turn();
+			}
+			return 1;
+		}
+	} while(backlogged);
+
+	return 0;
+}
+
 void check_tx_queue_ap(){
 
 	static u32 station_index = 0;
 	u32 i;
+
+	if(pause_queue){
+		return;
+	}
+
+	if(tx_sched_mode == TX_SCHED_DRR){
+		// CPU_LOW takes one MPDU at a time; only dequeue once the TX packet
+		//   buffer can take it, so mpdu_transmit() never has to drop the frame.
+		if(is_tx_buffer_empty()){
+			tx_sched_poll_drr();
+		}
+		return;
+	}
+
 	if( is_cpu_low_ready() ){
 		for(i = 0; i < (next_free_assoc_index+1); i++){
 			station_index = (station_index+1)%(next_free_assoc_index+1);
@@ -620,11 +838,13 @@ void check_tx_queue_ap(){
 			if(station_index == next_free_assoc_index){
 				//Check Broadcast Queue
 				if(wlan_mac_poll_tx_queue(0)){
+					(tx_sched[0].num_tx)++;
 					return;
 				}
 			} else {
 				//Check Station Queue
 				if(wlan_mac_poll_tx_queue(associations[station_index].AID)){
+					(tx_sched[associations[station_index].AID].num_tx)++;
 					return;
 				}
 			}
@@ -633,6 +853,77 @@ void check_tx_queue_ap(){
 	}
 }
 
+void ap_tx_sched_set_mode(u8 mode){
+	u32 i;
+
+	if((mode != TX_SCHED_ROUND_ROBIN) && (mode != TX_SCHED_DRR)){
+		return;
+	}
+
+	tx_sched_mode      = mode;
+	tx_sched_turn_open = 0;
+
+	for(i = 0; i < TX_SCHED_NUM_QUEUES; i++){
+		tx_sched[i].deficit = 0;
+	}
+}
+
+int ap_tx_sched_set_quantum(u16 queue_sel, u32 quantum, u8 weight){
+	if((queue_sel >= TX_SCHED_NUM_QUEUES) || (quantum == 0) || (weight == 0)){
+		return -1;
+	}
+
+	tx_sched[queue_sel].quantum = quantum;
+	tx_sched[queue_sel].weight  = weight;
+
+	return 0;
+}
+
+int ap_tx_sched_get_stats(u16 queue_sel, tx_sched_queue* stats){
+	if(queue_sel >= TX_SCHED_NUM_QUEUES){
+		return -1;
+	}
+
+	memcpy(stats, &(tx_sched[queue_sel]), sizeof(tx_sched_queue));
+
+	return 0;
+}
+
+void ap_tx_sched_reset_stats(){
+	u32 i;
+
+	for(i = 0; i < TX_SCHED_NUM_QUEUES; i++){
+		tx_sched_clear_queue(i);
+	}
+	tx_sched_turn_open = 0;
+}
+
+void print_tx_sched_stats(){
+	u32 i;
+	u32 total_bytes = 0;
+	u32 total_tx = 0;
+	u32 share;
+
+	for(i = 0; i < TX_SCHED_NUM_QUEUES; i++){
+		total_bytes += tx_sched[i].num_tx_bytes;
+		total_tx    += tx_sched[i].num_tx;
+	}
+
+	xil_printf("\n   TX Scheduler (%s)\n", (tx_sched_mode == TX_SCHED_DRR) ? "DRR" : "round robin");
+	xil_printf("|-ID-|-Queued-|-Max-|-Drops--|--Tx MPDUs-|-Share--|\n");
+	for(i = 0; i < TX_SCHED_NUM_QUEUES; i++){
+		// Share of bytes in DRR mode, of MPDUs in round robin mode (which does not count bytes), per mille
+		if(tx_sched_mode == TX_SCHED_DRR){
+			share = total_bytes ? (u32)(((u64)(tx_sched[i].num_tx_bytes) * 1000) / total_bytes) : 0;
+		} else {
+			share = total_tx ? (u32)(((u64)(tx_sched[i].num_tx) * 1000) / total_tx) : 0;
+		}
+		xil_printf("| %02x | %6d | %3d | %6d | %9d | %3d.%d%% |\n", i, queue_num_queued(i), tx_sched[i].max_depth,
+				tx_sched[i].num_drop, tx_sched[i].num_tx, share/10, share%10);
+	}
+	xil_printf("|------------------------------------------------|\n");
+}
+
 void ltg_event_ap(u32 id, void* callback_arg){
 	u32 i;
 	packet_bd_list checkout;
@@ -654,47 +945,46 @@ void ltg_event_ap(u32 id, void* callback_arg){
 
 	}
 
-	for(i=0; i < next_free_assoc_index; i++){
-		if((u32)(associations[i].AID) == LTG_ID_TO_AID(id)){
-			//The AID <-> LTG ID connection is arbitrary. In this design, we use the LTG_ID_TO_AID
-			//macro to map multiple different LTG IDs onto an AID for a specific station. This allows
-			//multiple LTG flows to target a single user in the network.
+	i = assoc_aid_to_index(LTG_ID_TO_AID(id));
+	if(i != ASSOC_INDEX_NONE){
+		//The AID <-> LTG ID connection is arbitrary. In this design, we use the LTG_ID_TO_AID
+		//macro to map multiple different LTG IDs onto an AID for a specific station. This allows
+		//multiple LTG flows to target a single user in the network.
 
-			//We implement a soft limit on the size of the queue allowed for any
-			//given station. This avoids the scenario where multiple backlogged
-			//LTG flows favor a single user and starve everyone else.
-			if(queue_num_queued(associations[i].AID) < max_queue_size){
-				//Send a Data packet to this station
-				//Checkout 1 element from the queue;
-				queue_checkout(&checkout,1);
+		//We implement a soft limit on the size of the queue allowed for any
+		//given station. This avoids the scenario where multiple backlogged
+		//LTG flows favor a single user and starve everyone else.
+		if(tx_sched_admit(associations[i].AID)){
+			//Send a Data packet to this station
+			//Checkout 1 element from the queue;
+			queue_checkout(&checkout,1);
 
-				if(checkout.length == 1){ //There was at least 1 free queue element
-					tx_queue = checkout.first;
+			if(checkout.length == 1){ //There was at least 1 free queue element
+				tx_queue = checkout.first;
 
-					setup_tx_header( &tx_header_common, associations[i].addr, eeprom_mac_addr );
+				setup_tx_header( &tx_header_common, associations[i].addr, eeprom_mac_addr );
 
-					mpdu_ptr_u8 = (u8*)((tx_packet_buffer*)(tx_queue->buf_ptr))->frame;
-					tx_length = wlan_create_data_frame((void*)((tx_packet_buffer*)(tx_queue->buf_ptr))->frame, &tx_header_common, MAC_FRAME_CTRL2_FLAG_FROM_DS);
+				mpdu_ptr_u8 = (u8*)((tx_packet_buffer*)(tx_queue->buf_ptr))->frame;
+				tx_length = wlan_create_data_frame((void*)((tx_packet_buffer*)(tx_queue->buf_ptr))->frame, &tx_header_common, MAC_FRAME_CTRL2_FLAG_FROM_DS);
 
-					mpdu_ptr_u8 += sizeof(mac_header_80211);
-					llc_hdr = (llc_header*)(mpdu_ptr_u8);
+				mpdu_ptr_u8 += sizeof(mac_header_80211);
+				llc_hdr = (llc_header*)(mpdu_ptr_u8);
 
-					//Prepare the MPDU LLC header
-					llc_hdr->dsap = LLC_SNAP;
-					llc_hdr->ssap = LLC_SNAP;
-					llc_hdr->control_field = LLC_CNTRL_UNNUMBERED;
-					bzero((void *)(llc_hdr->org_code), 3); //Org Code 0x000000: Encapsulated Ethernet
-					llc_hdr->type = LLC_TYPE_CUSTOM;
+				//Prepare the MPDU LLC header
+				llc_hdr->dsap = LLC_SNAP;
+				llc_hdr->ssap = LLC_SNAP;
+				llc_hdr->control_field = LLC_CNTRL_UNNUMBERED;
+				bzero((void *)(llc_hdr->org_code), 3); //Org Code 0x000000: Encapsulated Ethernet
+				llc_hdr->type = LLC_TYPE_CUSTOM;
 
-					tx_length += sizeof(llc_header);
-					tx_length += payload_length;
+				tx_length += sizeof(llc_header);
+				tx_length += payload_length;
 
-					setup_tx_queue ( tx_queue, (void*)&(associations[i]), tx_length, MAX_RETRY,
-									 (TX_MPDU_FLAGS_FILL_DURATION | TX_MPDU_FLAGS_REQ_TO) );
+				setup_tx_queue ( tx_queue, (void*)&(associations[i]), tx_length, MAX_RETRY,
+								 (TX_MPDU_FLAGS_FILL_DURATION | TX_MPDU_FLAGS_REQ_TO) );
 
-					enqueue_after_end(associations[i].AID, &checkout);
-					check_tx_queue();
-				}
+				enqueue_after_end(associations[i].AID, &checkout);
+				check_tx_queue();
 			}
 		}
 	}
@@ -707,7 +997,7 @@ void deauthenticate_stations(){
 	//   are not unnecessary copies when compacting the assocation table.
 	//
 	for( i = next_free_assoc_index; i > 0; i--) {
-		deauthenticate_station( i );
+		deauthenticate_station( i - 1 );
 	}
 }
 
@@ -718,7 +1008,7 @@ u32  deauthenticate_station( u32 association_index ) {
 	u32            tx_length;
 	u32            aid;
 
-	if ( association_index > next_free_assoc_index ) {
+	if ( association_index >= next_free_assoc_index ) {
 		return -1;
 	}
 
@@ -13,21 +13,156 @@
 
 #include "xmutex.h"
 
+/*
+ * Slot indexes are u8 and WMP_HIGH_FSM_SLOT_NONE marks
+ * the end of a list.
+ */
+#if WMP_FSM_BUFFER_MUTEX_N >= WMP_HIGH_FSM_SLOT_NONE
+#error "WMP_FSM_BUFFER_MUTEX_N does not fit the slot directory"
+#endif
+
+#define WMP_HIGH_FSM_SLOTS_HASH_N		(2 * WMP_FSM_BUFFER_MUTEX_N)
+#define WMP_HIGH_FSM_SLOTS_HASH(id)		(((id) ^ ((id) >> 8)) % WMP_HIGH_FSM_SLOTS_HASH_N)
+
+struct wmp_high_fsm_slot_list {
+	u8 head;
+	u8 tail;
+};
 
 static u8 wmp_high_fsm_slots_handler_last_written;
 static struct wmp_high_fsm_slot_info slot_info[WMP_FSM_BUFFER_MUTEX_N];
 
+/* most recently used slot at the head */
+static struct wmp_high_fsm_slot_list slot_lru;
+static struct wmp_high_fsm_slot_list slot_free;
+static u8 slot_hash[WMP_HIGH_FSM_SLOTS_HASH_N];
+
+static void slot_list_remove(struct wmp_high_fsm_slot_list *list, u8 idx)
+{
+	if (slot_info[idx].prev != WMP_HIGH_FSM_SLOT_NONE)
+		slot_info[slot_info[idx].prev].next = slot_info[idx].next;
+	else
+		list->head = slot_info[idx].next;
+
+	if (slot_info[idx].next != WMP_HIGH_FSM_SLOT_NONE)
+		slot_info[slot_info[idx].next].prev = slot_info[idx].prev;
+	else
+		list->tail = slot_info[idx].prev;
+
+	slot_info[idx].prev = WMP_HIGH_FSM_SLOT_NONE;
+	slot_info[idx].next = WMP_HIGH_FSM_SLOT_NONE;
+}
+
+static void slot_list_push_head(struct wmp_high_fsm_slot_list *list, u8 idx)
+{
+	slot_info[idx].prev = WMP_HIGH_FSM_SLOT_NONE;
+	slot_info[idx].next = list->head;
+
+	if (list->head != WMP_HIGH_FSM_SLOT_NONE)
+		slot_info[list->head].prev = idx;
+	else
+		list->tail = idx;
+
+	list->head = idx;
+}
+
+static void slot_list_push_tail(struct wmp_high_fsm_slot_list *list, u8 idx)
+{
+	slot_info[idx].next = WMP_HIGH_FSM_SLOT_NONE;
+	slot_info[idx].prev = list->tail;
+
+	if (list->tail != WMP_HIGH_FSM_SLOT_NONE)
+		slot_info[list->tail].next = idx;
+	else
+		list->head = idx;
+
+	list->tail = idx;
+}
+
+static u8 slot_lookup(u16 id)
+{
+	u8 idx;
+
+	for (idx = slot_hash[WMP_HIGH_FSM_SLOTS_HASH(id)];
+			idx != WMP_HIGH_FSM_SLOT_NONE; idx = slot_info[idx].hash_next) {
+		if (slot_info[idx].id == id)
+			return idx;
+	}
+
+	return WMP_HIGH_FSM_SLOT_NONE;
+}
+
+static void slot_unhash(u8 idx)
+{
+	u8 *link = &slot_hash[WMP_HIGH_FSM_SLOTS_HASH(slot_info[idx].id)];
+
+	while (*link != WMP_HIGH_FSM_SLOT_NONE) {
+		if (*link == idx) {
+			*link = slot_info[idx].hash_next;
+			break;
+		}
+		link = &slot_info[*link].hash_next;
+	}
+
+	slot_info[idx].hash_next = WMP_HIGH_FSM_SLOT_NONE;
+}
+
+/*
+ * Forget the FSM stored in a used slot and give the
+ * slot back to the free list.
+ */
+static void slot_release(u8 idx)
+{
+	slot_unhash(idx);
+	slot_list_remove(&slot_lru, idx);
+	slot_list_push_tail(&slot_free, idx);
+
+	slot_info[idx].used = 0;
+	slot_info[idx].timestamp = 0;
+	slot_info[idx].id = WMP_HIGH_FSM_SLOT_ID_NONE;
+}
+
+/*
+ * Only the slot CPU_LOW is running (and the one being switched
+ * to) are locked, so the walks below stop after a couple of
+ * entries whatever the number of slots.
+ */
+static u8 slot_first_unlocked(u8 idx, int forward)
+{
+	struct wmp_common_sw_reg *container_cmn = wmp_common_sw_reg_get_container();
+	struct wmp_fsm *wmp_fsm = wmp_common_sw_reg_get_fsm(container_cmn);
+
+	while (idx != WMP_HIGH_FSM_SLOT_NONE) {
+		if (!XMutex_IsLocked(&(wmp_fsm->fsm_mutex), idx))
+			break;
+		idx = forward ? slot_info[idx].next : slot_info[idx].prev;
+	}
+
+	return idx;
+}
+
 void wmp_high_fsm_slots_handler_init()
 {
 	int i;
 
 	wmp_high_fsm_slots_handler_last_written = 0;
 
+	slot_lru.head = slot_lru.tail = WMP_HIGH_FSM_SLOT_NONE;
+	slot_free.head = slot_free.tail = WMP_HIGH_FSM_SLOT_NONE;
+
+	for (i = 0; i < WMP_HIGH_FSM_SLOTS_HASH_N; i++)
+		slot_hash[i] = WMP_HIGH_FSM_SLOT_NONE;
+
 	for (i = 0; i < WMP_FSM_BUFFER_MUTEX_N; i++) {
-		slot_info[i].id = 0xFFFF;
+		slot_info[i].id = WMP_HIGH_FSM_SLOT_ID_NONE;
 		slot_info[i].timestamp = 0;
 		slot_info[i].used = 0;
+		slot_info[i].hash_next = WMP_HIGH_FSM_SLOT_NONE;
 	}
+
+	/* hand slots out in the order of the previous round robin, starting after slot 0 */
+	for (i = 1; i <= WMP_FSM_BUFFER_MUTEX_N; i++)
+		slot_list_push_tail(&slot_free, i % WMP_FSM_BUFFER_MUTEX_N);
 }
 
 void wmp_high_fsm_slots_handler_set_last_written(u8 idx)
@@ -37,161 +172,104 @@ void wmp_high_fsm_slots_handler_set_last_written(u8 idx)
 
 void wmp_high_fsm_slots_handler_set_slot_used(u8 idx, u16 id)
 {
+	u8 old = slot_lookup(id);
+
+	/* an id lives in one slot only */
+	if (old != WMP_HIGH_FSM_SLOT_NONE && old != idx)
+		slot_release(old);
+
+	if (slot_info[idx].used) {
+		slot_list_remove(&slot_lru, idx);
+		if (slot_info[idx].id != id)
+			slot_unhash(idx);
+	} else {
+		slot_list_remove(&slot_free, idx);
+	}
+
+	if (!slot_info[idx].used || slot_info[idx].id != id) {
+		u8 *bucket = &slot_hash[WMP_HIGH_FSM_SLOTS_HASH(id)];
+
+		slot_info[idx].hash_next = *bucket;
+		*bucket = idx;
+	}
+
 	slot_info[idx].id = id;
 	slot_info[idx].timestamp = get_usec_timestamp();
 	slot_info[idx].used = 1;
+
+	slot_list_push_head(&slot_lru, idx);
 }
 
 /*
- * For now we look for the first unused slot starting
- * from wmp_high_fsm_slots_handler_last_written.
- *
- * Extend this function to implement a more
- * complex logic.
+ * First free slot CPU_LOW is not holding; if every free
+ * slot is locked, the least recently used unlocked one.
+ * The slot is not reserved until set_slot_used().
  */
 u8 wmp_high_fsm_slots_handler_next_slot()
 {
-	u8 k;
-	struct wmp_common_sw_reg *container_cmn = wmp_common_sw_reg_get_container();
-	struct wmp_fsm *wmp_fsm = wmp_common_sw_reg_get_fsm(container_cmn);
+	u8 idx = slot_first_unlocked(slot_free.head, 1);
 
-	for (k = 0; k < WMP_FSM_BUFFER_MUTEX_N; k ++) {
-		if (!XMutex_IsLocked(&(wmp_fsm->fsm_mutex),
-				((wmp_high_fsm_slots_handler_last_written + k + 1) % WMP_FSM_BUFFER_MUTEX_N)))
-			break;
-	}
+	if (idx == WMP_HIGH_FSM_SLOT_NONE)
+		idx = slot_first_unlocked(slot_lru.tail, 0);
 
-	return (u8)((wmp_high_fsm_slots_handler_last_written + k + 1) % WMP_FSM_BUFFER_MUTEX_N);
+	return idx;
 }
 
 u8 wmp_high_fsm_slots_handler_free_lru_slot()
 {
-	u8 k;
-	u8 index;
-	u8 lru_idx = 0;
-	u64 mintimestamp = 0xFFFFFFFFFFFFFFFFL;
-	struct wmp_common_sw_reg *container_cmn = wmp_common_sw_reg_get_container();
-	struct wmp_fsm *wmp_fsm = wmp_common_sw_reg_get_fsm(container_cmn);
-
-	for (k = 0; k < WMP_FSM_BUFFER_MUTEX_N; k ++) {
-		index = ((wmp_high_fsm_slots_handler_last_written + k + 1) % WMP_FSM_BUFFER_MUTEX_N);
-		if (!XMutex_IsLocked(&(wmp_fsm->fsm_mutex), index)) {
-			if (slot_info[index].timestamp < mintimestamp) {
-				mintimestamp = slot_info[index].timestamp;
-				lru_idx = index;
-			}
-		}
-	}
+	u8 lru_idx = slot_first_unlocked(slot_lru.tail, 0);
 
-	slot_info[index].used = 0;
-	slot_info[index].timestamp = 0;
-	slot_info[index].id = 0xFFFF;
+	if (lru_idx != WMP_HIGH_FSM_SLOT_NONE)
+		slot_release(lru_idx);
 
 	return lru_idx;
 }
 
 u8 wmp_high_fsm_slots_handler_delete_slot(u16 id)
 {
-	u8 k;
-	u8 index;
 	struct wmp_common_sw_reg *container_cmn = wmp_common_sw_reg_get_container();
 	struct wmp_fsm *wmp_fsm = wmp_common_sw_reg_get_fsm(container_cmn);
+	u8 index = slot_lookup(id);
 
-	for (k = 0; k < WMP_FSM_BUFFER_MUTEX_N; k ++) {
-		index = ((wmp_high_fsm_slots_handler_last_written + k + 1) % WMP_FSM_BUFFER_MUTEX_N);
-		if (!XMutex_IsLocked(&(wmp_fsm->fsm_mutex), index) && (slot_info[index].id == id))
-			break;
-	}
-
-	if (k == WMP_FSM_BUFFER_MUTEX_N) {
-		return 0xFF;
-	}
+	if (index == WMP_HIGH_FSM_SLOT_NONE || XMutex_IsLocked(&(wmp_fsm->fsm_mutex), index))
+		return WMP_HIGH_FSM_SLOT_NONE;
 
-	slot_info[index].used = 0;
-	slot_info[index].timestamp = 0;
-	slot_info[index].id = 0xFFFF;
+	slot_release(index);
 
 	return index;
 }
 
 u8 wmp_high_fsm_slots_handler_is_fsm_currently_running(u16 id)
 {
-	u8 k;
-	u8 index;
 	struct wmp_common_sw_reg *container_cmn = wmp_common_sw_reg_get_container();
 	struct wmp_fsm *wmp_fsm = wmp_common_sw_reg_get_fsm(container_cmn);
+	u8 index = slot_lookup(id);
 
-	for (k = 0; k < WMP_FSM_BUFFER_MUTEX_N; k ++) {
-		index = ((wmp_high_fsm_slots_handler_last_written + k + 1) % WMP_FSM_BUFFER_MUTEX_N);
-		if (slot_info[index].id == id) {
-			break;
-		}
-	}
-
-	if (k == WMP_FSM_BUFFER_MUTEX_N) {
+	if (index == WMP_HIGH_FSM_SLOT_NONE)
 		return 0;
-	}
 
-	if (!XMutex_IsLocked(&(wmp_fsm->fsm_mutex), index)) {
+	if (!XMutex_IsLocked(&(wmp_fsm->fsm_mutex), index))
 		return 0;
-	}
 
 	return 1;
 }
 
 u8 wmp_high_fsm_slots_handler_id_to_slot(u16 id)
 {
-	u8 k;
-	u8 index;
-
-	for (k = 0; k < WMP_FSM_BUFFER_MUTEX_N; k ++) {
-		index = ((wmp_high_fsm_slots_handler_last_written + k + 1) % WMP_FSM_BUFFER_MUTEX_N);
-		if (slot_info[index].id == id) {
-			break;
-		}
-	}
-
-	if (k == WMP_FSM_BUFFER_MUTEX_N) {
-		return 0xFF;
-	}
-
-	return index;
+	return slot_lookup(id);
 }
 
 u8 wmp_high_fsm_slots_handler_slot_exist(u16 id)
 {
-	u8 k;
-	u8 index;
-
-	for (k = 0; k < WMP_FSM_BUFFER_MUTEX_N; k ++) {
-		index = ((wmp_high_fsm_slots_handler_last_written + k + 1) % WMP_FSM_BUFFER_MUTEX_N);
-		if ((slot_info[index].id == id))
-			break;
-	}
-
-	if (k == WMP_FSM_BUFFER_MUTEX_N) {
-		return 0;
-	}
-
-	return 1;
+	return slot_lookup(id) != WMP_HIGH_FSM_SLOT_NONE;
 }
 
 u8 wmp_high_fsm_slots_handler_first_not_used_slot()
 {
-	u8 k;
-	u8 index;
-	struct wmp_common_sw_reg *container_cmn = wmp_common_sw_reg_get_container();
-	struct wmp_fsm *wmp_fsm = wmp_common_sw_reg_get_fsm(container_cmn);
-
-	for (k = 0; k < WMP_FSM_BUFFER_MUTEX_N; k ++) {
-		index = ((wmp_high_fsm_slots_handler_last_written + k + 1) % WMP_FSM_BUFFER_MUTEX_N);
-		if (!XMutex_IsLocked(&(wmp_fsm->fsm_mutex), index) && !slot_info[index].used)
-			break;
-	}
+	u8 index = slot_first_unlocked(slot_free.head, 1);
 
-	if (k == WMP_FSM_BUFFER_MUTEX_N) {
+	if (index == WMP_HIGH_FSM_SLOT_NONE)
 		return wmp_high_fsm_slots_handler_free_lru_slot();
-	}
 
-	return (u8)((wmp_high_fsm_slots_handler_last_written + k + 1) % WMP_FSM_BUFFER_MUTEX_N);
+	return index;
 }
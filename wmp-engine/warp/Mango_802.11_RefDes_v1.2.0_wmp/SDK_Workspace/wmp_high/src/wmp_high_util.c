@@ -18,6 +18,7 @@
 #include "xparameters.h"
 
 #include "xintc.h"
+#include "mb_interface.h"
 #include "wlan_mac_eth_util.h"
 
 /************************************************************
@@ -213,6 +214,74 @@ static struct wmp_high_util_tx_buf_info wmp_tx_buf_info[TX_BUFFER_NUM];
 
 u8 wmp_cmd_resp[WMP_CMD_FRAME_MAX_SIZE];
 
+//CPU_LOW serves IPC_MBOX_READVAR one variable at a time and in order. A batch collects the
+// replies to one READ_VAR, READ_VARS or telemetry sample; its requests are queued on the IPC
+// ring back to back, so that they share doorbells, and batches complete in the order they
+// were issued
+#define WMP_HIGH_UTIL_READ_BATCH_NUM			4
+//A batch still waiting for CPU_LOW after this long is dropped when the FIFO is full
+#define WMP_HIGH_UTIL_READ_BATCH_TIMEOUT_US		100000
+
+struct wmp_high_util_read_batch {
+	u16 reply_cmd;
+	u8  mac_addr[6];
+	u16 seq;
+	u8  trigger;
+	u8  slot;
+	u32 sample;
+	u64 ts;
+	u8  num_vars;
+	u8  num_done;
+	u8  var_id[WMP4WARP_MAX_VARS];
+	u16 var_value[WMP4WARP_MAX_VARS];
+};
+
+static struct wmp_high_util_read_batch read_batch[WMP_HIGH_UTIL_READ_BATCH_NUM];
+static u8 read_batch_head;
+static u8 read_batch_count;
+//Replies CPU_LOW still owes to dropped batches; they come before those of the next batch
+static u32 read_batch_stale;
+
+//Telemetry subscription of a single host. sample counts the samples taken, pushed or not
+struct wmp_high_util_subscription {
+	u8  active;
+	u8  mac_addr[6];
+	u16 seq;
+	u32 period_us;
+	u16 flags;
+	u8  num_vars;
+	u8  var_id[WMP4WARP_MAX_VARS];
+	u8  has_last;
+	u16 last_value[WMP4WARP_MAX_VARS];
+	u32 sample;
+	u64 next;
+	u32 sched_id;
+};
+
+static struct wmp_high_util_subscription subscription = { .sched_id = SCHEDULE_FAILED };
+
+//Reassembly of a fragmented FSM_LOAD. Fragments are accepted in any order; the byte code is
+// parsed into its slot once every fragment is in and the CRC matches, since wmp_fsm_write
+// needs it whole
+struct wmp_high_util_fsm_xfer {
+	u8  active;
+	u16 xfer_id;
+	u16 fsm_id;
+	u16 image_l;
+	u16 frag_size;
+	u16 num_frags;
+	u16 next_seq;
+	u16 status;
+	u32 received;	/* one bit per fragment */
+	u32 crc;
+	u8  image[WMP4WARP_FSM_IMAGE_MAX_SIZE];
+};
+
+static struct wmp_high_util_fsm_xfer fsm_xfer;
+
+//Batches and the subscription are touched by the Ethernet command handlers, the fine
+// scheduler and the IPC handler, so they are only changed under wlan_mac_irq_lock()
+
 void wmp_high_fsm_init()
 {
 	struct wmp_common_sw_reg *container_cmn = wmp_common_sw_reg_get_container();
@@ -264,7 +333,7 @@ void wmp_high_fsm_init()
 	ipc_msg_to_low.num_payload_words = (sizeof(ipc_msg_to_low_payload)/sizeof(u32));
 	ipc_msg_to_low_payload[0] = 0;
 	ipc_msg_to_low.payload_ptr       = (u32 *)&(ipc_msg_to_low_payload[0]);
-	ipc_mailbox_write_msg(&ipc_msg_to_low);
+	ipc_ring_write_msg(&ipc_msg_to_low);
 
 
 	for (i = 0; i < TX_BUFFER_NUM; i++) {
@@ -327,11 +396,12 @@ static void wmp_high_util_send_echo_rep(ethernet_header* eth_hdr)
 	eth_hdr_resp->type = WMP4WARP_ETHER_TYPE;
 
 	w4w_cmn_hdr_resp->cmd_id = WMP4WARP_ECHO_REP_CMD;
+	w4w_cmn_hdr_resp->seq = w4w_cmn_hdr_req->seq;
 	memcpy(w4w_cmn_hdr_resp->mac_addr, hw_info.hw_addr_wlan,
 			sizeof(w4w_cmn_hdr_resp->mac_addr));
 
 	memset((void *)(RX_PKT_BUF_TO_ADDR(WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD)),
-				0, PKT_BUF_SIZE);
+				0, WMP_HIGH_UTIL_WMP_CMD_BUF_SIZE);
 
 	memcpy((void *)(RX_PKT_BUF_TO_ADDR(WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD)),
 			wmp_cmd_resp, WMP4WARP_ECHO_REP_L);
@@ -343,64 +413,83 @@ static void wmp_high_util_send_echo_rep(ethernet_header* eth_hdr)
 	}
 }
 
-static void wmp_high_util_handle_fsm_load(ethernet_header* eth_hdr)
+//Writes byte code fsm of FSM fsm_id into the slot it already has, or into a free one.
+// A running FSM is left untouched
+static int wmp_high_util_load_fsm(u16 fsm_id, u8 *fsm)
 {
-	ethernet_header *eth_hdr_resp = (ethernet_header *) wmp_cmd_resp;
-	struct wmp4warp_header_common *w4w_cmn_hdr_resp =
-			(struct wmp4warp_header_common *) (wmp_cmd_resp + sizeof(ethernet_header));
-	struct wmp4warp_header_common *w4w_cmn_hdr_req =
-				(struct wmp4warp_header_common *) ((u8 *)(eth_hdr) + sizeof(ethernet_header));
-	struct wmp4warp_header_fsm_load *fsm_load_hdr =
-			(struct wmp4warp_header_fsm_load *) ((u8 *)(eth_hdr) +
-					sizeof(ethernet_header) + sizeof(struct wmp4warp_header_common));
-	struct wmp4warp_header_fsm_load_conf *fsm_load_hdr_resp =
-				(struct wmp4warp_header_fsm_load_conf *) ((u8 *)(wmp_cmd_resp) +
-						sizeof(ethernet_header) + sizeof(struct wmp4warp_header_common));
-	int status;
-
-	if (!wmp_high_fsm_slots_handler_is_fsm_currently_running(fsm_load_hdr->fsm_id)) {
+	if (!wmp_high_fsm_slots_handler_is_fsm_currently_running(fsm_id)) {
 		struct wmp_common_sw_reg *container_cmn = wmp_common_sw_reg_get_container();
 		struct wmp_fsm *wmp_fsm = wmp_common_sw_reg_get_fsm(container_cmn);
 		u8 next_slot;
 		int ret;
 
-		if (wmp_high_fsm_slots_handler_slot_exist(fsm_load_hdr->fsm_id)) {
-			next_slot = wmp_high_fsm_slots_handler_id_to_slot(fsm_load_hdr->fsm_id);
+		if (wmp_high_fsm_slots_handler_slot_exist(fsm_id)) {
+			next_slot = wmp_high_fsm_slots_handler_id_to_slot(fsm_id);
 		} else {
 			next_slot = wmp_high_fsm_slots_handler_first_not_used_slot();
 		}
 
+		if (next_slot == WMP_HIGH_FSM_SLOT_NONE) {
+			xil_printf("ERROR no FSM slot available!\n");
+			return -1;
+		}
+
 		ret = wmp_fsm_acquire(wmp_fsm, next_slot);
 
 		if (ret == XST_FAILURE) {
 			xil_printf("ERROR during FSM slot %d acquisition!\n", next_slot);
-			return;
+			return -1;
 		}
 
-		ret = wmp_fsm_write(wmp_fsm,
-				((u8 *)(eth_hdr) + sizeof(ethernet_header) +
-						sizeof(struct wmp4warp_header_common) +
-						sizeof(struct wmp4warp_header_fsm_load)));
+		ret = wmp_fsm_write(wmp_fsm, fsm);
 
 		if (ret) {
 			xil_printf("WMP_HIGH_FSM_INIT ERROR: fsm write fails!\n");
-			return;
+			// the slot has been cleared, so it no longer holds a previous version of fsm_id
+			wmp_fsm_release(wmp_fsm);
+			wmp_high_fsm_slots_handler_delete_slot(fsm_id);
+			return -1;
 		}
 
 		wmp_high_fsm_slots_handler_set_last_written(next_slot);
-		wmp_high_fsm_slots_handler_set_slot_used(next_slot, fsm_load_hdr->fsm_id);
+		wmp_high_fsm_slots_handler_set_slot_used(next_slot, fsm_id);
 
 		ret = wmp_fsm_release(wmp_fsm);
 
-		wmp_high_printf(WMP_HIGH_PL_INFO, "Load FSM (ID %d) into slot %d\n", fsm_load_hdr->fsm_id, next_slot);
+		wmp_high_printf(WMP_HIGH_PL_INFO, "Load FSM (ID %d) into slot %d\n", fsm_id, next_slot);
 
 		if (ret == XST_FAILURE) {
 			xil_printf("ERROR during FSM slot %d release!\n", next_slot);
-			return;
+			return -1;
 		}
 
 	}
 
+	return 0;
+}
+
+static void wmp_high_util_handle_fsm_load(ethernet_header* eth_hdr)
+{
+	ethernet_header *eth_hdr_resp = (ethernet_header *) wmp_cmd_resp;
+	struct wmp4warp_header_common *w4w_cmn_hdr_resp =
+			(struct wmp4warp_header_common *) (wmp_cmd_resp + sizeof(ethernet_header));
+	struct wmp4warp_header_common *w4w_cmn_hdr_req =
+				(struct wmp4warp_header_common *) ((u8 *)(eth_hdr) + sizeof(ethernet_header));
+	struct wmp4warp_header_fsm_load *fsm_load_hdr =
+			(struct wmp4warp_header_fsm_load *) ((u8 *)(eth_hdr) +
+					sizeof(ethernet_header) + sizeof(struct wmp4warp_header_common));
+	struct wmp4warp_header_fsm_load_conf *fsm_load_hdr_resp =
+				(struct wmp4warp_header_fsm_load_conf *) ((u8 *)(wmp_cmd_resp) +
+						sizeof(ethernet_header) + sizeof(struct wmp4warp_header_common));
+	int status;
+
+	if (wmp_high_util_load_fsm(fsm_load_hdr->fsm_id,
+			((u8 *)(eth_hdr) + sizeof(ethernet_header) +
+					sizeof(struct wmp4warp_header_common) +
+					sizeof(struct wmp4warp_header_fsm_load)))) {
+		return;
+	}
+
 	memcpy(eth_hdr_resp->address_destination, w4w_cmn_hdr_req->mac_addr,
 			sizeof(eth_hdr_resp->address_destination));
 	memcpy(eth_hdr_resp->address_source, hw_info.hw_addr_wlan,
@@ -408,13 +497,14 @@ static void wmp_high_util_handle_fsm_load(ethernet_header* eth_hdr)
 	eth_hdr_resp->type = WMP4WARP_ETHER_TYPE;
 
 	w4w_cmn_hdr_resp->cmd_id = WMP4WARP_FSM_LOAD_CONF;
+	w4w_cmn_hdr_resp->seq = w4w_cmn_hdr_req->seq;
 	memcpy(w4w_cmn_hdr_resp->mac_addr, hw_info.hw_addr_wlan,
 			sizeof(w4w_cmn_hdr_resp->mac_addr));
 
 	fsm_load_hdr_resp->fsm_id = fsm_load_hdr->fsm_id;
 
 	memset((void *)(RX_PKT_BUF_TO_ADDR(WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD)),
-			0, PKT_BUF_SIZE);
+			0, WMP_HIGH_UTIL_WMP_CMD_BUF_SIZE);
 
 	memcpy((void *)(RX_PKT_BUF_TO_ADDR(WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD)),
 			wmp_cmd_resp, WMP4WARP_FSM_LOAD_CONF_L);
@@ -428,6 +518,151 @@ static void wmp_high_util_handle_fsm_load(ethernet_header* eth_hdr)
 
 }
 
+static u32 wmp_high_util_crc32(const u8 *data, u32 len)
+{
+	u32 crc = 0xFFFFFFFF;
+	int k;
+
+	while (len--) {
+		crc ^= *data++;
+		for (k = 0; k < 8; k++) {
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+		}
+	}
+
+	return ~crc;
+}
+
+static void wmp_high_util_send_fsm_load_ack(ethernet_header* eth_hdr, u16 next_seq, u16 load_status,
+		u32 crc)
+{
+	ethernet_header *eth_hdr_resp = (ethernet_header *) wmp_cmd_resp;
+	struct wmp4warp_header_common *w4w_cmn_hdr_resp =
+			(struct wmp4warp_header_common *) (wmp_cmd_resp + sizeof(ethernet_header));
+	struct wmp4warp_header_common *w4w_cmn_hdr_req =
+				(struct wmp4warp_header_common *) ((u8 *)(eth_hdr) + sizeof(ethernet_header));
+	struct wmp4warp_header_fsm_load_frag *frag_hdr =
+			(struct wmp4warp_header_fsm_load_frag *) ((u8 *)(eth_hdr) +
+					sizeof(ethernet_header) + sizeof(struct wmp4warp_header_common));
+	struct wmp4warp_header_fsm_load_ack *ack_hdr_resp =
+				(struct wmp4warp_header_fsm_load_ack *) ((u8 *)(wmp_cmd_resp) +
+						sizeof(ethernet_header) + sizeof(struct wmp4warp_header_common));
+	int status;
+
+	memcpy(eth_hdr_resp->address_destination, w4w_cmn_hdr_req->mac_addr,
+			sizeof(eth_hdr_resp->address_destination));
+	memcpy(eth_hdr_resp->address_source, hw_info.hw_addr_wlan,
+			sizeof(eth_hdr_resp->address_source));
+	eth_hdr_resp->type = WMP4WARP_ETHER_TYPE;
+
+	w4w_cmn_hdr_resp->cmd_id = WMP4WARP_FSM_LOAD_ACK;
+	w4w_cmn_hdr_resp->seq = w4w_cmn_hdr_req->seq;
+	memcpy(w4w_cmn_hdr_resp->mac_addr, hw_info.hw_addr_wlan,
+			sizeof(w4w_cmn_hdr_resp->mac_addr));
+
+	ack_hdr_resp->fsm_id = frag_hdr->fsm_id;
+	ack_hdr_resp->xfer_id = frag_hdr->xfer_id;
+	ack_hdr_resp->next_seq = next_seq;
+	ack_hdr_resp->status = load_status;
+	ack_hdr_resp->crc = crc;
+
+	memset((void *)(RX_PKT_BUF_TO_ADDR(WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD)),
+			0, WMP_HIGH_UTIL_WMP_CMD_BUF_SIZE);
+
+	memcpy((void *)(RX_PKT_BUF_TO_ADDR(WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD)),
+			wmp_cmd_resp, WMP4WARP_FSM_LOAD_ACK_L);
+
+	status = wlan_eth_dma_send((void *)(RX_PKT_BUF_TO_ADDR(WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD)),
+			WMP4WARP_FSM_LOAD_ACK_L);
+	if(status != 0) {
+		wmp_high_printf(WMP_HIGH_PL_ERROR, "Error in wlan_mac_send_eth! Err = %d\n", status);
+	}
+}
+
+static void wmp_high_util_handle_fsm_load_frag(ethernet_header* eth_hdr, u32 eth_rx_len)
+{
+	struct wmp4warp_header_fsm_load_frag *frag_hdr =
+			(struct wmp4warp_header_fsm_load_frag *) ((u8 *)(eth_hdr) +
+					sizeof(ethernet_header) + sizeof(struct wmp4warp_header_common));
+	u8 *frag = (u8 *)(frag_hdr) + sizeof(struct wmp4warp_header_fsm_load_frag);
+	u16 num_frags;
+	u16 frag_l;
+
+	if (eth_rx_len < WMP4WARP_FSM_LOAD_FRAG_L) {
+		wmp_high_printf(WMP_HIGH_PL_ERROR, "%s: short frame (%d bytes)\n", __FUNCTION__, eth_rx_len);
+		return;
+	}
+
+	if (frag_hdr->image_l == 0 || frag_hdr->image_l > WMP4WARP_FSM_IMAGE_MAX_SIZE ||
+			frag_hdr->frag_size == 0) {
+		wmp_high_printf(WMP_HIGH_PL_ERROR, "%s: invalid FSM image (%d bytes in fragments of %d)\n",
+				__FUNCTION__, frag_hdr->image_l, frag_hdr->frag_size);
+		wmp_high_util_send_fsm_load_ack(eth_hdr, 0, WMP4WARP_FSM_LOAD_FAILED, 0);
+		return;
+	}
+
+	num_frags = (frag_hdr->image_l + frag_hdr->frag_size - 1) / frag_hdr->frag_size;
+	frag_l = (frag_hdr->frag_seq == num_frags - 1) ?
+			frag_hdr->image_l - frag_hdr->frag_seq * frag_hdr->frag_size : frag_hdr->frag_size;
+
+	//The fragment has to be in the frame, not just in the image
+	if (num_frags > WMP4WARP_FSM_MAX_FRAGS || frag_hdr->frag_seq >= num_frags ||
+			frag_hdr->frag_l != frag_l || frag_l > eth_rx_len - WMP4WARP_FSM_LOAD_FRAG_L) {
+		wmp_high_printf(WMP_HIGH_PL_ERROR, "%s: invalid fragment %d of %d (%d bytes)\n",
+				__FUNCTION__, frag_hdr->frag_seq, num_frags, frag_hdr->frag_l);
+		wmp_high_util_send_fsm_load_ack(eth_hdr, 0, WMP4WARP_FSM_LOAD_FAILED, 0);
+		return;
+	}
+
+	if (!fsm_xfer.active || fsm_xfer.xfer_id != frag_hdr->xfer_id ||
+			fsm_xfer.fsm_id != frag_hdr->fsm_id) {
+		//A new transfer drops whatever was left of the previous one
+		fsm_xfer.active = 1;
+		fsm_xfer.xfer_id = frag_hdr->xfer_id;
+		fsm_xfer.fsm_id = frag_hdr->fsm_id;
+		fsm_xfer.image_l = frag_hdr->image_l;
+		fsm_xfer.frag_size = frag_hdr->frag_size;
+		fsm_xfer.num_frags = num_frags;
+		fsm_xfer.received = 0;
+		fsm_xfer.next_seq = 0;
+		fsm_xfer.status = WMP4WARP_FSM_LOAD_PENDING;
+		fsm_xfer.crc = 0;
+	} else if (fsm_xfer.image_l != frag_hdr->image_l || fsm_xfer.frag_size != frag_hdr->frag_size) {
+		wmp_high_printf(WMP_HIGH_PL_ERROR, "%s: fragment %d does not match transfer %d\n",
+				__FUNCTION__, frag_hdr->frag_seq, fsm_xfer.xfer_id);
+		wmp_high_util_send_fsm_load_ack(eth_hdr, fsm_xfer.next_seq, WMP4WARP_FSM_LOAD_FAILED, 0);
+		return;
+	}
+
+	//Duplicates, including those sent after the transfer is over, only get an ack
+	if (fsm_xfer.status == WMP4WARP_FSM_LOAD_PENDING &&
+			!(fsm_xfer.received & (1u << frag_hdr->frag_seq))) {
+		memcpy(fsm_xfer.image + frag_hdr->frag_seq * fsm_xfer.frag_size, frag, frag_l);
+		fsm_xfer.received |= (1u << frag_hdr->frag_seq);
+
+		while (fsm_xfer.next_seq < fsm_xfer.num_frags &&
+				(fsm_xfer.received & (1u << fsm_xfer.next_seq))) {
+			fsm_xfer.next_seq++;
+		}
+
+		if (fsm_xfer.next_seq == fsm_xfer.num_frags) {
+			fsm_xfer.crc = wmp_high_util_crc32(fsm_xfer.image, fsm_xfer.image_l);
+
+			if (fsm_xfer.crc != frag_hdr->image_crc) {
+				wmp_high_printf(WMP_HIGH_PL_ERROR, "FSM (ID %d) image CRC 0x%08X, expected 0x%08X\n",
+						fsm_xfer.fsm_id, fsm_xfer.crc, frag_hdr->image_crc);
+				fsm_xfer.status = WMP4WARP_FSM_LOAD_BAD_CRC;
+			} else if (wmp_high_util_load_fsm(fsm_xfer.fsm_id, fsm_xfer.image)) {
+				fsm_xfer.status = WMP4WARP_FSM_LOAD_FAILED;
+			} else {
+				fsm_xfer.status = WMP4WARP_FSM_LOAD_DONE;
+			}
+		}
+	}
+
+	wmp_high_util_send_fsm_load_ack(eth_hdr, fsm_xfer.next_seq, fsm_xfer.status, fsm_xfer.crc);
+}
+
 static void wmp_high_util_handle_fsm_del(ethernet_header* eth_hdr)
 {
 	ethernet_header *eth_hdr_resp = (ethernet_header *) wmp_cmd_resp;
@@ -461,13 +696,14 @@ static void wmp_high_util_handle_fsm_del(ethernet_header* eth_hdr)
 	eth_hdr_resp->type = WMP4WARP_ETHER_TYPE;
 
 	w4w_cmn_hdr_resp->cmd_id = WMP4WARP_FSM_DEL_CONF;
+	w4w_cmn_hdr_resp->seq = w4w_cmn_hdr_req->seq;
 	memcpy(w4w_cmn_hdr_resp->mac_addr, hw_info.hw_addr_wlan,
 			sizeof(w4w_cmn_hdr_resp->mac_addr));
 
 	fsm_del_hdr_resp->fsm_id = fsm_del_hdr->fsm_id;
 
 	memset((void *)(RX_PKT_BUF_TO_ADDR(WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD)),
-			0, PKT_BUF_SIZE);
+			0, WMP_HIGH_UTIL_WMP_CMD_BUF_SIZE);
 
 	memcpy((void *)(RX_PKT_BUF_TO_ADDR(WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD)),
 			wmp_cmd_resp, WMP4WARP_FSM_DEL_CONF_L);
@@ -496,34 +732,357 @@ static void wmp_high_util_handle_ts_req(ethernet_header* eth_hdr)
 	eth_hdr_resp->type = WMP4WARP_ETHER_TYPE;
 
 	w4w_cmn_hdr_resp->cmd_id = WMP4WARP_TS_REP;
+	w4w_cmn_hdr_resp->seq = w4w_cmn_hdr_req->seq;
 	memcpy(w4w_cmn_hdr_resp->mac_addr, hw_info.hw_addr_wlan,
 			sizeof(w4w_cmn_hdr_resp->mac_addr));
 
 
 	memset((void *)(RX_PKT_BUF_TO_ADDR(WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD)),
-			0, PKT_BUF_SIZE);
+			0, WMP_HIGH_UTIL_WMP_CMD_BUF_SIZE);
 
 	memcpy((void *)(RX_PKT_BUF_TO_ADDR(WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD)),
 			wmp_cmd_resp, WMP4WARP_TS_REP_L);
 
 	ipc_msg_to_low.msg_id = IPC_MBOX_MSG_ID(IPC_MBOX_TIMESTAMP);
-	ipc_mailbox_write_msg(&ipc_msg_to_low);
+	ipc_msg_to_low.arg0 = 0;
+	ipc_msg_to_low.num_payload_words = 0;
+	ipc_ring_write_msg(&ipc_msg_to_low);
 
 	wmp_high_printf(WMP_HIGH_PL_INFO, "Timestamp required to CPU_LOW\n");
 }
 
-static void wmp_high_util_handle_read_var(ethernet_header* eth_hdr)
+//Drops the oldest batch, of which CPU_LOW has answered 'answered' variables so far
+static void wmp_high_util_read_batch_drop(u8 answered)
+{
+	struct wmp_high_util_read_batch *batch = &read_batch[read_batch_head];
+
+	read_batch_stale += batch->num_vars - answered;
+	read_batch_head = (read_batch_head + 1) % WMP_HIGH_UTIL_READ_BATCH_NUM;
+	read_batch_count--;
+}
+
+static int wmp_high_util_read_vars(u16 reply_cmd, u8 *mac_addr, u16 seq, u8 trigger, u8 slot,
+		u32 sample, u8 num_vars, u8 *var_id)
 {
 	wlan_ipc_msg ipc_msg_to_low;
-	ethernet_header *eth_hdr_resp = (ethernet_header *) wmp_cmd_resp;
+	struct wmp_high_util_read_batch *batch;
+	u64 now = get_usec_timestamp();
+	u32 msr;
+	int i;
+
+	msr = wlan_mac_irq_lock();
+
+	if (read_batch_count == WMP_HIGH_UTIL_READ_BATCH_NUM) {
+		batch = &read_batch[read_batch_head];
+		if (now - batch->ts < WMP_HIGH_UTIL_READ_BATCH_TIMEOUT_US) {
+			wlan_mac_irq_unlock(msr);
+			return -1;
+		}
+		wmp_high_printf(WMP_HIGH_PL_ERROR, "Dropped read of %d variables, CPU_LOW answered %d\n",
+				batch->num_vars, batch->num_done);
+		wmp_high_util_read_batch_drop(batch->num_done);
+	}
+
+	batch = &read_batch[(read_batch_head + read_batch_count) % WMP_HIGH_UTIL_READ_BATCH_NUM];
+	read_batch_count++;
+
+	batch->reply_cmd = reply_cmd;
+	memcpy(batch->mac_addr, mac_addr, sizeof(batch->mac_addr));
+	batch->seq = seq;
+	batch->trigger = trigger;
+	batch->slot = slot;
+	batch->sample = sample;
+	batch->ts = now;
+	batch->num_vars = num_vars;
+	batch->num_done = 0;
+	memcpy(batch->var_id, var_id, num_vars);
+
+	//Still under the lock, so that the requests of two batches never interleave
+	ipc_msg_to_low.msg_id = IPC_MBOX_MSG_ID(IPC_MBOX_READVAR);
+	ipc_msg_to_low.num_payload_words = 0;
+	for (i = 0; i < num_vars; i++) {
+		ipc_msg_to_low.arg0 = var_id[i];
+		ipc_ring_write_msg(&ipc_msg_to_low);
+	}
+
+	wlan_mac_irq_unlock(msr);
+
+	return 0;
+}
+
+static void wmp_high_util_send_var_set(struct wmp_high_util_read_batch *batch)
+{
+	u8 *frame = (u8 *)(RX_PKT_BUF_TO_ADDR(WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD)) +
+			WMP_HIGH_UTIL_WMP_PUSH_BUF_OFFSET;
+	ethernet_header *eth_hdr_resp = (ethernet_header *) frame;
 	struct wmp4warp_header_common *w4w_cmn_hdr_resp =
-			(struct wmp4warp_header_common *) (wmp_cmd_resp + sizeof(ethernet_header));
+			(struct wmp4warp_header_common *) (frame + sizeof(ethernet_header));
+	u8 *body = frame + sizeof(ethernet_header) + sizeof(struct wmp4warp_header_common);
+	u32 length;
+	int status;
+
+	memcpy(eth_hdr_resp->address_destination, batch->mac_addr,
+			sizeof(eth_hdr_resp->address_destination));
+	memcpy(eth_hdr_resp->address_source, hw_info.hw_addr_wlan,
+			sizeof(eth_hdr_resp->address_source));
+	eth_hdr_resp->type = WMP4WARP_ETHER_TYPE;
+
+	w4w_cmn_hdr_resp->cmd_id = batch->reply_cmd;
+	w4w_cmn_hdr_resp->seq = batch->seq;
+	memcpy(w4w_cmn_hdr_resp->mac_addr, hw_info.hw_addr_wlan,
+			sizeof(w4w_cmn_hdr_resp->mac_addr));
+
+	if (batch->reply_cmd == WMP4WARP_READ_VAR_REP) {
+		struct wmp4warp_header_read_var_rep *read_hdr_resp =
+				(struct wmp4warp_header_read_var_rep *) body;
+
+		read_hdr_resp->var_id = batch->var_id[0];
+		read_hdr_resp->var_value = batch->var_value[0];
+		length = WMP4WARP_READ_VAR_REP_L;
+	} else {
+		struct wmp4warp_header_var_set *var_set_hdr =
+				(struct wmp4warp_header_var_set *) body;
+
+		memset(var_set_hdr, 0, sizeof(struct wmp4warp_header_var_set));
+		var_set_hdr->ts = batch->ts;
+		var_set_hdr->sample = batch->sample;
+		var_set_hdr->trigger = batch->trigger;
+		var_set_hdr->slot = batch->slot;
+		var_set_hdr->num_vars = batch->num_vars;
+		memcpy(var_set_hdr->var_id, batch->var_id, batch->num_vars);
+		memcpy(var_set_hdr->var_value, batch->var_value, batch->num_vars * sizeof(u16));
+		length = WMP4WARP_READ_VARS_REP_L;
+	}
+
+	//wlan_eth_dma_send copies the frame, the push buffer is free again once it returns
+	status = wlan_eth_dma_send(frame, length);
+	if(status != 0) {
+		wmp_high_printf(WMP_HIGH_PL_ERROR, "Error in wlan_mac_send_eth! Err = %d\n", status);
+	}
+}
+
+//Whether a completed telemetry batch is pushed to the subscriber
+static int wmp_high_util_telemetry_filter(struct wmp_high_util_read_batch *batch)
+{
+	int changed = 0;
+	int i;
+
+	if (!subscription.active || batch->seq != subscription.seq ||
+			batch->num_vars != subscription.num_vars) {
+		return 0;
+	}
+
+	for (i = 0; i < batch->num_vars; i++) {
+		if (!subscription.has_last || batch->var_value[i] != subscription.last_value[i]) {
+			changed = 1;
+		}
+		subscription.last_value[i] = batch->var_value[i];
+	}
+	subscription.has_last = 1;
+
+	if ((subscription.flags & WMP4WARP_SUBSCRIBE_ON_CHANGE) &&
+			batch->trigger == WMP4WARP_TRIGGER_PERIOD && !changed) {
+		return 0;
+	}
+
+	return 1;
+}
+
+void wmp_high_util_read_var_done(u32 var_id, u16 var_value)
+{
+	struct wmp_high_util_read_batch *batch;
+	u32 msr;
+
+	msr = wlan_mac_irq_lock();
+
+	if (read_batch_stale) {
+		//Late reply to a dropped batch
+		read_batch_stale--;
+		wlan_mac_irq_unlock(msr);
+		return;
+	}
+
+	if (read_batch_count == 0) {
+		wlan_mac_irq_unlock(msr);
+		wmp_high_printf(WMP_HIGH_PL_ERROR, "Unexpected value of variable %d from CPU_LOW\n", var_id);
+		return;
+	}
+
+	batch = &read_batch[read_batch_head];
+	if (batch->var_id[batch->num_done] != var_id) {
+		//Out of step with CPU_LOW: give up on this batch, this reply being one of its own,
+		// and let its remaining replies go by so that the next batch starts afresh
+		wmp_high_printf(WMP_HIGH_PL_ERROR, "Variable %d from CPU_LOW, expected %d\n",
+				var_id, batch->var_id[batch->num_done]);
+		wmp_high_util_read_batch_drop(batch->num_done + 1);
+		wlan_mac_irq_unlock(msr);
+		return;
+	}
+
+	batch->var_value[batch->num_done++] = var_value;
+
+	if (batch->num_done == batch->num_vars) {
+		if (batch->reply_cmd != WMP4WARP_TELEMETRY || wmp_high_util_telemetry_filter(batch)) {
+			wmp_high_util_send_var_set(batch);
+		}
+		read_batch_head = (read_batch_head + 1) % WMP_HIGH_UTIL_READ_BATCH_NUM;
+		read_batch_count--;
+	}
+
+	wlan_mac_irq_unlock(msr);
+}
+
+static void wmp_high_util_handle_read_var(ethernet_header* eth_hdr)
+{
 	struct wmp4warp_header_common *w4w_cmn_hdr_req =
 				(struct wmp4warp_header_common *) ((u8 *)(eth_hdr) + sizeof(ethernet_header));
 	struct wmp4warp_header_read_var *read_hdr =
 				(struct wmp4warp_header_read_var *) ((u8 *)(eth_hdr) +
 						sizeof(ethernet_header) + sizeof(struct wmp4warp_header_common));
+	u8 var_id = read_hdr->var_id;
+
+	if (wmp_high_util_read_vars(WMP4WARP_READ_VAR_REP, w4w_cmn_hdr_req->mac_addr,
+			w4w_cmn_hdr_req->seq, WMP4WARP_TRIGGER_REQUEST, 0, 0, 1, &var_id)) {
+		wmp_high_printf(WMP_HIGH_PL_ERROR, "Too many reads pending, variable %d not read\n", var_id);
+		return;
+	}
+
+	wmp_high_printf(WMP_HIGH_PL_INFO, "Value of variable %d required to CPU_LOW\n", read_hdr->var_id);
+}
+
+static void wmp_high_util_handle_read_vars(ethernet_header* eth_hdr)
+{
+	struct wmp4warp_header_common *w4w_cmn_hdr_req =
+				(struct wmp4warp_header_common *) ((u8 *)(eth_hdr) + sizeof(ethernet_header));
+	struct wmp4warp_header_read_vars *read_hdr =
+				(struct wmp4warp_header_read_vars *) ((u8 *)(eth_hdr) +
+						sizeof(ethernet_header) + sizeof(struct wmp4warp_header_common));
+
+	if (read_hdr->num_vars == 0 || read_hdr->num_vars > WMP4WARP_MAX_VARS) {
+		wmp_high_printf(WMP_HIGH_PL_ERROR, "%s: invalid number of variables (%d)\n",
+				__FUNCTION__, read_hdr->num_vars);
+		return;
+	}
+
+	if (wmp_high_util_read_vars(WMP4WARP_READ_VARS_REP, w4w_cmn_hdr_req->mac_addr,
+			w4w_cmn_hdr_req->seq, WMP4WARP_TRIGGER_REQUEST, 0, 0,
+			read_hdr->num_vars, read_hdr->var_id)) {
+		wmp_high_printf(WMP_HIGH_PL_ERROR, "Too many reads pending, %d variables not read\n",
+				read_hdr->num_vars);
+		return;
+	}
+
+	wmp_high_printf(WMP_HIGH_PL_DEBUG, "Value of %d variables required to CPU_LOW\n", read_hdr->num_vars);
+}
+
+static void wmp_high_util_telemetry_sample(u8 trigger, u8 slot)
+{
+	subscription.sample++;
+	if (wmp_high_util_read_vars(WMP4WARP_TELEMETRY, subscription.mac_addr, subscription.seq,
+			trigger, slot, subscription.sample, subscription.num_vars, subscription.var_id)) {
+		wmp_high_printf(WMP_HIGH_PL_DEBUG, "Telemetry sample %d skipped\n", subscription.sample);
+	}
+}
 
+//Samples are taken on a fixed grid of period_us from the subscription; when the fine scheduler
+// falls behind, the missed points are skipped (and counted) rather than taken late
+static void wmp_high_util_telemetry_tick()
+{
+	u64 now;
+	u64 missed;
+	u32 msr;
+
+	msr = wlan_mac_irq_lock();
+
+	subscription.sched_id = SCHEDULE_FAILED;
+	if (!subscription.active || subscription.period_us == 0) {
+		wlan_mac_irq_unlock(msr);
+		return;
+	}
+
+	wmp_high_util_telemetry_sample(WMP4WARP_TRIGGER_PERIOD, 0);
+
+	now = get_usec_timestamp();
+	subscription.next += subscription.period_us;
+	if (subscription.next <= now) {
+		missed = (now - subscription.next) / subscription.period_us + 1;
+		subscription.sample += (u32)missed;
+		subscription.next += missed * subscription.period_us;
+	}
+
+	subscription.sched_id = wlan_mac_schedule_event(SCHEDULE_FINE,
+			(u32)(subscription.next - now), (void*)wmp_high_util_telemetry_tick);
+
+	wlan_mac_irq_unlock(msr);
+}
+
+void wmp_high_util_telemetry_fsm_switch(u8 slot)
+{
+	u32 msr;
+
+	msr = wlan_mac_irq_lock();
+	if (subscription.active && (subscription.flags & WMP4WARP_SUBSCRIBE_ON_SWITCH)) {
+		wmp_high_util_telemetry_sample(WMP4WARP_TRIGGER_SWITCH, slot);
+	}
+	wlan_mac_irq_unlock(msr);
+}
+
+static void wmp_high_util_handle_subscribe(ethernet_header* eth_hdr)
+{
+	ethernet_header *eth_hdr_resp = (ethernet_header *) wmp_cmd_resp;
+	struct wmp4warp_header_common *w4w_cmn_hdr_resp =
+			(struct wmp4warp_header_common *) (wmp_cmd_resp + sizeof(ethernet_header));
+	struct wmp4warp_header_common *w4w_cmn_hdr_req =
+				(struct wmp4warp_header_common *) ((u8 *)(eth_hdr) + sizeof(ethernet_header));
+	struct wmp4warp_header_subscribe *sub_hdr =
+			(struct wmp4warp_header_subscribe *) ((u8 *)(eth_hdr) +
+					sizeof(ethernet_header) + sizeof(struct wmp4warp_header_common));
+	struct wmp4warp_header_subscribe_conf *sub_hdr_resp =
+				(struct wmp4warp_header_subscribe_conf *) ((u8 *)(wmp_cmd_resp) +
+						sizeof(ethernet_header) + sizeof(struct wmp4warp_header_common));
+	u32 period_us = sub_hdr->period_us;
+	u32 msr;
+	int status;
+
+	if (sub_hdr->num_vars > WMP4WARP_MAX_VARS) {
+		wmp_high_printf(WMP_HIGH_PL_ERROR, "%s: invalid number of variables (%d)\n",
+				__FUNCTION__, sub_hdr->num_vars);
+		return;
+	}
+
+	if (period_us != 0 && period_us < WMP4WARP_MIN_PERIOD_US) {
+		period_us = WMP4WARP_MIN_PERIOD_US;
+	}
+
+	msr = wlan_mac_irq_lock();
+
+	wlan_mac_remove_schedule(SCHEDULE_FINE, subscription.sched_id);
+	subscription.sched_id = SCHEDULE_FAILED;
+
+	subscription.active = (sub_hdr->num_vars != 0);
+	memcpy(subscription.mac_addr, w4w_cmn_hdr_req->mac_addr, sizeof(subscription.mac_addr));
+	subscription.seq = w4w_cmn_hdr_req->seq;
+	subscription.period_us = period_us;
+	subscription.flags = sub_hdr->flags;
+	subscription.num_vars = sub_hdr->num_vars;
+	memcpy(subscription.var_id, sub_hdr->var_id, sub_hdr->num_vars);
+	subscription.has_last = 0;
+	subscription.sample = 0;
+
+	if (subscription.active && period_us != 0) {
+		subscription.next = get_usec_timestamp() + period_us;
+		subscription.sched_id = wlan_mac_schedule_event(SCHEDULE_FINE, period_us,
+				(void*)wmp_high_util_telemetry_tick);
+	}
+
+	wlan_mac_irq_unlock(msr);
+
+	if (subscription.active) {
+		wmp_high_printf(WMP_HIGH_PL_INFO, "Telemetry of %d variables every %d us (flags 0x%04X)\n",
+				sub_hdr->num_vars, period_us, sub_hdr->flags);
+	} else {
+		wmp_high_printf(WMP_HIGH_PL_INFO, "Telemetry stopped\n");
+	}
 
 	memcpy(eth_hdr_resp->address_destination, w4w_cmn_hdr_req->mac_addr,
 			sizeof(eth_hdr_resp->address_destination));
@@ -531,22 +1090,26 @@ static void wmp_high_util_handle_read_var(ethernet_header* eth_hdr)
 			sizeof(eth_hdr_resp->address_source));
 	eth_hdr_resp->type = WMP4WARP_ETHER_TYPE;
 
-	w4w_cmn_hdr_resp->cmd_id = WMP4WARP_READ_VAR_REP;
+	w4w_cmn_hdr_resp->cmd_id = WMP4WARP_SUBSCRIBE_CONF;
+	w4w_cmn_hdr_resp->seq = w4w_cmn_hdr_req->seq;
 	memcpy(w4w_cmn_hdr_resp->mac_addr, hw_info.hw_addr_wlan,
 			sizeof(w4w_cmn_hdr_resp->mac_addr));
 
+	sub_hdr_resp->period_us = period_us;
+	sub_hdr_resp->flags = sub_hdr->flags;
+	sub_hdr_resp->num_vars = sub_hdr->num_vars;
 
 	memset((void *)(RX_PKT_BUF_TO_ADDR(WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD)),
-			0, PKT_BUF_SIZE);
+			0, WMP_HIGH_UTIL_WMP_CMD_BUF_SIZE);
 
 	memcpy((void *)(RX_PKT_BUF_TO_ADDR(WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD)),
-			wmp_cmd_resp, WMP4WARP_READ_VAR_REP_L);
-
-	ipc_msg_to_low.msg_id = IPC_MBOX_MSG_ID(IPC_MBOX_READVAR);
-	ipc_msg_to_low.arg0 = read_hdr->var_id;
-	ipc_mailbox_write_msg(&ipc_msg_to_low);
+			wmp_cmd_resp, WMP4WARP_SUBSCRIBE_CONF_L);
 
-	wmp_high_printf(WMP_HIGH_PL_INFO, "Value of variable %d required to CPU_LOW\n", read_hdr->var_id);
+	status = wlan_eth_dma_send((void *)(RX_PKT_BUF_TO_ADDR(WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD)),
+			WMP4WARP_SUBSCRIBE_CONF_L);
+	if(status != 0) {
+		wmp_high_printf(WMP_HIGH_PL_ERROR, "Error in wlan_mac_send_eth! Err = %d\n", status);
+	}
 }
 
 static void wmp_high_util_handle_run(ethernet_header* eth_hdr)
@@ -579,7 +1142,7 @@ static void wmp_high_util_handle_run(ethernet_header* eth_hdr)
 	ipc_msg_to_low.num_payload_words = (sizeof(ipc_msg_to_low_payload)/sizeof(u32));
 	ipc_msg_to_low_payload[0] = run_hdr->ts;
 	ipc_msg_to_low.payload_ptr       = (u32 *)&(ipc_msg_to_low_payload[0]);
-	ipc_mailbox_write_msg(&ipc_msg_to_low);
+	ipc_ring_write_msg(&ipc_msg_to_low);
 
 	wmp_high_printf(WMP_HIGH_PL_INFO, "FSM (ID %d) scheduled in 0x%08X%08X us\n", run_hdr->fsm_id,
 			(u32)((run_hdr->ts & 0xFFFFFFFF00000000) >> 32), (u32)(run_hdr->ts & 0xFFFFFFFF));
@@ -594,6 +1157,7 @@ static void wmp_high_util_handle_run(ethernet_header* eth_hdr)
 	eth_hdr_resp->type = WMP4WARP_ETHER_TYPE;
 
 	w4w_cmn_hdr_resp->cmd_id = WMP4WARP_RUN_CONF;
+	w4w_cmn_hdr_resp->seq = w4w_cmn_hdr_req->seq;
 	memcpy(w4w_cmn_hdr_resp->mac_addr, hw_info.hw_addr_wlan,
 			sizeof(w4w_cmn_hdr_resp->mac_addr));
 
@@ -601,7 +1165,7 @@ static void wmp_high_util_handle_run(ethernet_header* eth_hdr)
 	run_hdr_resp->ts = run_hdr->ts;
 
 	memset((void *)(RX_PKT_BUF_TO_ADDR(WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD)),
-			0, PKT_BUF_SIZE);
+			0, WMP_HIGH_UTIL_WMP_CMD_BUF_SIZE);
 
 	memcpy((void *)(RX_PKT_BUF_TO_ADDR(WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD)),
 			wmp_cmd_resp, WMP4WARP_RUN_CONF_L);
@@ -643,7 +1207,7 @@ static void wmp_high_util_handle_run_abs(ethernet_header* eth_hdr)
 	ipc_msg_to_low.num_payload_words = (sizeof(ipc_msg_to_low_payload)/sizeof(u32));
 	ipc_msg_to_low_payload[0] = run_hdr->ts;
 	ipc_msg_to_low.payload_ptr       = (u32 *)&(ipc_msg_to_low_payload[0]);
-	ipc_mailbox_write_msg(&ipc_msg_to_low);
+	ipc_ring_write_msg(&ipc_msg_to_low);
 
 	wmp_high_printf(WMP_HIGH_PL_INFO, "FSM (ID %d) scheduled at 0x%08X%08X us\n", run_hdr->fsm_id,
 			(u32)((run_hdr->ts & 0xFFFFFFFF00000000) >> 32), (u32)(run_hdr->ts & 0xFFFFFFFF));
@@ -658,6 +1222,7 @@ static void wmp_high_util_handle_run_abs(ethernet_header* eth_hdr)
 	eth_hdr_resp->type = WMP4WARP_ETHER_TYPE;
 
 	w4w_cmn_hdr_resp->cmd_id = WMP4WARP_RUN_ABS_CONF;
+	w4w_cmn_hdr_resp->seq = w4w_cmn_hdr_req->seq;
 	memcpy(w4w_cmn_hdr_resp->mac_addr, hw_info.hw_addr_wlan,
 			sizeof(w4w_cmn_hdr_resp->mac_addr));
 
@@ -665,7 +1230,7 @@ static void wmp_high_util_handle_run_abs(ethernet_header* eth_hdr)
 	run_hdr_resp->ts = run_hdr->ts;
 
 	memset((void *)(RX_PKT_BUF_TO_ADDR(WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD)),
-			0, PKT_BUF_SIZE);
+			0, WMP_HIGH_UTIL_WMP_CMD_BUF_SIZE);
 
 	memcpy((void *)(RX_PKT_BUF_TO_ADDR(WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD)),
 			wmp_cmd_resp, WMP4WARP_RUN_ABS_CONF_L);
@@ -677,7 +1242,7 @@ static void wmp_high_util_handle_run_abs(ethernet_header* eth_hdr)
 	}
 }
 
-void wmp_high_util_handle_wmp_cmd_from_ethernet(ethernet_header* eth_hdr)
+void wmp_high_util_handle_wmp_cmd_from_ethernet(ethernet_header* eth_hdr, u32 eth_rx_len)
 {
 	struct wmp4warp_header_common *w4w_hdr_cmn =
 			(struct wmp4warp_header_common *)((u8 *)(eth_hdr) + sizeof(ethernet_header));
@@ -691,6 +1256,9 @@ void wmp_high_util_handle_wmp_cmd_from_ethernet(ethernet_header* eth_hdr)
 	case WMP4WARP_FSM_LOAD:
 		wmp_high_util_handle_fsm_load(eth_hdr);
 	break;
+	case WMP4WARP_FSM_LOAD_FRAG:
+		wmp_high_util_handle_fsm_load_frag(eth_hdr, eth_rx_len);
+	break;
 	case WMP4WARP_FSM_DEL:
 		wmp_high_util_handle_fsm_del(eth_hdr);
 	break;
@@ -700,6 +1268,12 @@ void wmp_high_util_handle_wmp_cmd_from_ethernet(ethernet_header* eth_hdr)
 	case WMP4WARP_READ_VAR:
 		wmp_high_util_handle_read_var(eth_hdr);
 	break;
+	case WMP4WARP_READ_VARS:
+		wmp_high_util_handle_read_vars(eth_hdr);
+	break;
+	case WMP4WARP_SUBSCRIBE:
+		wmp_high_util_handle_subscribe(eth_hdr);
+	break;
 	case WMP4WARP_RUN:
 		wmp_high_util_handle_run(eth_hdr);
 	break;
@@ -0,0 +1,349 @@
+/*
+ * assocbench.c
+ *
+ * Host unit and benchmark test of the AP association table
+ * (assoc_* and remove_station in wmp_high_ap.c), built once per
+ * table size (MAX_ASSOCIATIONS, see the Makefile). wmp_high_ap.c
+ * is included whole so that its static functions can be driven;
+ * the packet queues are simulated below and the rest of CPU_HIGH
+ * is stubbed in host_ap_stubs.c.
+ *
+ * Random insert/remove/lookup sequences are checked against a
+ * reference model after every operation, including the swap
+ * remove invariant: every entry is indexed under its own AID and
+ * a station keeps its AID for as long as it is associated. Then,
+ * for 1 to ASSOC_MAX_STATIONS stations (NODE_WLAN_MAX_ASSN with
+ * the real table), the cost of an address lookup, an AID lookup,
+ * a remove+insert pair and a DRR poll is measured, with every
+ * queue backlogged and with only the broadcast queue backlogged.
+ *
+ * usage: ./assocbench-8 [-n iterations] [-s seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "host_stubs.h"
+
+#include "../wmp_high/src/wmp_high_ap.c"
+
+station_info associations[MAX_ASSOCIATIONS+1];
+u32 next_free_assoc_index;
+u32 max_queue_size;
+u8 bcast_addr[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+u8 pause_queue;
+
+static int failures;
+
+#define CHECK(cond, ...)									\
+	do {											\
+		if (!(cond)) {									\
+			printf("FAIL line %d: ", __LINE__);					\
+			printf(__VA_ARGS__);							\
+			printf("\n");								\
+			failures++;								\
+		}										\
+	} while (0)
+
+// Packet queues
+//   Every queue holds sim_depth[q] MPDUs of sim_length bytes. The buffer
+//   descriptors are never really moved: dequeue only lowers the depth.
+//
+static u32 sim_depth[TX_SCHED_NUM_QUEUES];
+static u32 sim_length = 1500;
+static u32 sim_sent[TX_SCHED_NUM_QUEUES];
+static packet_bd sim_bd[TX_SCHED_NUM_QUEUES];
+static tx_packet_buffer sim_buf;
+
+packet_bd* queue_first(u16 queue_sel) {
+	if(sim_depth[queue_sel] == 0){
+		return NULL;
+	}
+	sim_bd[queue_sel].buf_ptr = &sim_buf;
+	sim_bd[queue_sel].metadata_ptr = (void*)(unsigned long)queue_sel;
+	sim_buf.frame_info.length = sim_length;
+	return &(sim_bd[queue_sel]);
+}
+
+u32 queue_num_queued(u16 queue_sel) {
+	return sim_depth[queue_sel];
+}
+
+void dequeue_from_beginning(packet_bd_list* new_list, u16 queue_sel, u16 num_packet_bd) {
+	new_list->first = queue_first(queue_sel);
+	new_list->last = new_list->first;
+	new_list->length = 1;
+	sim_depth[queue_sel]--;
+}
+
+void queue_checkin(packet_bd_list* ring) {
+}
+
+void mpdu_transmit(packet_bd* tx_queue) {
+	sim_sent[(unsigned long)tx_queue->metadata_ptr]++;
+}
+
+int is_tx_buffer_empty() {
+	return 1;
+}
+
+int queue_total_size() {
+	return 300;
+}
+
+int eth_bd_total_size() {
+	return 100;
+}
+
+void wlan_eth_dma_update() {
+}
+
+// Reference model: the AID each associated address holds
+//
+#define ADDR_POOL_N                    (4 * MAX_ASSOCIATIONS)
+
+static u8 model_addr[ADDR_POOL_N][6];
+static u32 model_aid[ADDR_POOL_N];      // 0 if not associated
+static u32 model_count;
+
+static void make_addr(u8* addr, u32 n) {
+	// Only the last bytes feed ASSOC_HASH; consecutive n share buckets
+	addr[0] = 0x40;
+	addr[1] = 0xD8;
+	addr[2] = 0x55;
+	addr[3] = n / ASSOC_HASH_N;
+	addr[4] = 0;
+	addr[5] = n % ASSOC_HASH_N;
+}
+
+static void model_reset() {
+	u32 n;
+
+	reset_associations();
+	for(n = 0; n < ADDR_POOL_N; n++){
+		make_addr(model_addr[n], n);
+		model_aid[n] = 0;
+	}
+	model_count = 0;
+}
+
+static void check_table(const char* after) {
+	u8 seen[MAX_ASSOCIATIONS + 1];
+	u32 n, i, aid;
+
+	CHECK(next_free_assoc_index == model_count, "%s: %lu stations, expected %lu", after,
+			next_free_assoc_index, model_count);
+
+	// Every AID is held by exactly one entry, and indexed under it
+	memset(seen, 0, sizeof(seen));
+	for(i = 0; i < MAX_ASSOCIATIONS; i++){
+		aid = associations[i].AID;
+		CHECK(aid >= 1 && aid <= MAX_ASSOCIATIONS && !seen[aid], "%s: entry %lu has AID %lu", after, i, aid);
+		if(aid >= 1 && aid <= MAX_ASSOCIATIONS){
+			seen[aid] = 1;
+			CHECK(assoc_aid_index[aid] == i, "%s: AID %lu indexed at %u, held by %lu", after, aid,
+					assoc_aid_index[aid], i);
+		}
+		if(i >= next_free_assoc_index){
+			CHECK(wlan_addr_eq(associations[i].addr, bcast_addr), "%s: free entry %lu has an address", after, i);
+			CHECK(assoc_aid_to_index(aid) == ASSOC_INDEX_NONE, "%s: free AID %lu resolves", after, aid);
+		}
+	}
+
+	for(n = 0; n < ADDR_POOL_N; n++){
+		i = assoc_addr_to_index(model_addr[n]);
+		if(model_aid[n] == 0){
+			CHECK(i == ASSOC_INDEX_NONE, "%s: address %lu found at %lu", after, n, i);
+			continue;
+		}
+		CHECK(i < next_free_assoc_index, "%s: address %lu not found", after, n);
+		if(i < next_free_assoc_index){
+			CHECK(associations[i].AID == model_aid[n], "%s: address %lu moved from AID %lu to %u", after, n,
+					model_aid[n], associations[i].AID);
+			CHECK(assoc_aid_to_index(model_aid[n]) == i, "%s: AID %lu does not resolve to entry %lu", after,
+					model_aid[n], i);
+		}
+	}
+}
+
+static void checked_insert(u32 n) {
+	u32 i;
+
+	if(model_aid[n]){
+		return;
+	}
+
+	i = assoc_insert(model_addr[n]);
+
+	if(model_count == ASSOC_MAX_STATIONS){
+		CHECK(i == ASSOC_INDEX_NONE, "insert into a full table returned %lu", i);
+		return;
+	}
+
+	CHECK(i == model_count, "insert of %lu at %lu, expected %lu", n, i, model_count);
+	if(i < MAX_ASSOCIATIONS){
+		model_aid[n] = associations[i].AID;
+		model_count++;
+	}
+}
+
+static void checked_remove(u32 n) {
+	if(model_aid[n] == 0){
+		return;
+	}
+
+	remove_station(assoc_addr_to_index(model_addr[n]));
+	model_aid[n] = 0;
+	model_count--;
+}
+
+static void test_random(u32 iterations) {
+	u32 k, n;
+
+	model_reset();
+	check_table("reset");
+
+	for(k = 0; k < iterations; k++){
+		n = rand() % ADDR_POOL_N;
+
+		if(rand() % 2){
+			checked_insert(n);
+		} else {
+			checked_remove(n);
+		}
+
+		check_table("random");
+		if(failures){
+			printf("after %lu random operations\n", k + 1);
+			return;
+		}
+	}
+}
+
+// DRR: with equal quanta and MPDU lengths, backlogged queues share evenly
+static void test_drr() {
+	u32 n, q, polls;
+
+	model_reset();
+	for(n = 0; n < ASSOC_MAX_STATIONS; n++){
+		checked_insert(n);
+	}
+
+	memset(sim_sent, 0, sizeof(sim_sent));
+	for(q = 0; q < TX_SCHED_NUM_QUEUES; q++){
+		sim_depth[q] = 1000;
+	}
+
+	polls = 100 * (ASSOC_MAX_STATIONS + 1);
+	for(n = 0; n < polls; n++){
+		CHECK(tx_sched_poll_drr() == 1, "DRR idle with every queue backlogged");
+	}
+
+	for(q = 0; q < TX_SCHED_NUM_QUEUES; q++){
+		if(q == 0 || assoc_aid_to_index(q) != ASSOC_INDEX_NONE){
+			CHECK(sim_sent[q] >= 99 && sim_sent[q] <= 101, "queue %lu sent %lu of %lu", q, sim_sent[q], polls);
+		}
+		sim_depth[q] = 0;
+	}
+
+	CHECK(tx_sched_poll_drr() == 0, "DRR sent from empty queues");
+}
+
+static void bench_stations(u32 stations, u32 iterations) {
+	u64 start, addr_ns, aid_ns, churn_ns, drr_busy_ns, drr_bcast_ns;
+	volatile u32 sink = 0;
+	u32 k, n, q, next;
+
+	model_reset();
+	for(n = 0; n < stations; n++){
+		checked_insert(n);
+	}
+
+	start = host_now_ns();
+	for(k = 0; k < iterations; k++){
+		sink += assoc_addr_to_index(model_addr[k % stations]);
+	}
+	addr_ns = host_now_ns() - start;
+
+	start = host_now_ns();
+	for(k = 0; k < iterations; k++){
+		sink += assoc_aid_to_index(associations[k % stations].AID);
+	}
+	aid_ns = host_now_ns() - start;
+
+	// One station leaves and another associates, as on a roaming network
+	next = stations;
+	start = host_now_ns();
+	for(k = 0; k < iterations; k++){
+		remove_station(assoc_addr_to_index(model_addr[(next - stations) % ADDR_POOL_N]));
+		sink += assoc_insert(model_addr[next % ADDR_POOL_N]);
+		next++;
+	}
+	churn_ns = host_now_ns() - start;
+
+	for(q = 0; q < TX_SCHED_NUM_QUEUES; q++){
+		sim_depth[q] = iterations + 1;
+	}
+	start = host_now_ns();
+	for(k = 0; k < iterations; k++){
+		sink += tx_sched_poll_drr();
+	}
+	drr_busy_ns = host_now_ns() - start;
+
+	// Only broadcast traffic: every poll walks the idle station queues
+	for(q = 0; q < TX_SCHED_NUM_QUEUES; q++){
+		sim_depth[q] = 0;
+	}
+	sim_depth[0] = iterations + 1;
+	start = host_now_ns();
+	for(k = 0; k < iterations; k++){
+		sink += tx_sched_poll_drr();
+	}
+	drr_bcast_ns = host_now_ns() - start;
+	sim_depth[0] = 0;
+
+	printf("%8lu %9.1f %9.1f %9.1f %9.1f %9.1f\n", stations,
+			(double)addr_ns / iterations, (double)aid_ns / iterations, (double)churn_ns / iterations,
+			(double)drr_busy_ns / iterations, (double)drr_bcast_ns / iterations);
+}
+
+int main(int argc, char *argv[]) {
+	u32 iterations = 200000;
+	u32 seed = 1;
+	u32 stations;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:s:h")) != -1) {
+		switch (c) {
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 's':
+			seed = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n iterations] [-s seed]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	srand(seed);
+	printf("%d entries (%d stations), %lu iterations, seed %lu\n", MAX_ASSOCIATIONS, ASSOC_MAX_STATIONS,
+			iterations, seed);
+
+	test_random(iterations);
+	test_drr();
+	if(failures){
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("table matches the reference model, DRR shares evenly\n");
+
+	printf("%8s %9s %9s %9s %9s %9s\n", "stations", "addr ns", "aid ns", "churn ns", "drr ns", "bcast ns");
+	for(stations = 1; stations <= ASSOC_MAX_STATIONS; stations++){
+		bench_stations(stations, iterations);
+	}
+
+	return 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * host_ap_stubs.c
+ *
+ * The rest of CPU_HIGH as seen from wmp_high_ap.c, for assocbench.
+ * None of it is reached by the association table or the DRR
+ * scheduler; it only has to link. Compiled without the firmware
+ * headers so that one empty definition fits every prototype.
+ */
+
+/* Variables owned by wmp_high.c and the framework */
+char access_point_ssid[64];
+char allow_assoc[64];
+char beacon_interval[64];
+char default_unicast_rate[64];
+char eeprom_mac_addr[64];
+char last_access_point_ssid[64];
+char mac_param_chan[64];
+char tx_header_common[64];
+
+int check_tx_queue() { return 0; }
+int enqueue_after_end() { return 0; }
+void* get_next_empty_bad_fcs_event() { return 0; }
+void* get_next_empty_rx_dsss_event() { return 0; }
+void* get_next_empty_rx_ofdm_event() { return 0; }
+void* get_next_empty_tx_event() { return 0; }
+int ipc_ring_write_msg() { return 0; }
+int is_cpu_low_ready() { return 0; }
+int lock_pkt_buf_tx() { return 0; }
+int purge_queue() { return 0; }
+int queue_checkout() { return 0; }
+int setup_tx_header() { return 0; }
+int setup_tx_queue() { return 0; }
+int unlock_pkt_buf_tx() { return 0; }
+int wlan_create_association_response_frame() { return 0; }
+int wlan_create_auth_frame() { return 0; }
+int wlan_create_beacon_probe_frame() { return 0; }
+int wlan_create_data_frame() { return 0; }
+int wlan_create_deauth_frame() { return 0; }
+int wlan_mac_cdma_finish_transfer() { return 0; }
+int wlan_mac_cdma_start_transfer() { return 0; }
+int wlan_mac_poll_tx_queue() { return 0; }
+int wlan_mac_schedule_event() { return 0; }
+int wlan_mac_util_process_tx_done() { return 0; }
+int wlan_mpdu_eth_send() { return 0; }
+void* wlan_realloc() { return 0; }
+int write_hex_display() { return 0; }
+int xil_printf() { return 0; }
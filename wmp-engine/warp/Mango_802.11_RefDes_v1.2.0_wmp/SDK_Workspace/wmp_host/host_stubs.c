@@ -0,0 +1,55 @@
+/*
+ * host_stubs.c
+ *
+ * See host_stubs.h. The fsm_buffer mutexes are a bitmap that
+ * the tests set and clear in place of CPU_LOW.
+ */
+
+#include <time.h>
+
+#include "wmp_common_sw_reg.h"
+
+#include "host_stubs.h"
+
+unsigned long host_mutex_probes;
+
+static struct wmp_common_sw_reg host_container;
+static u8 host_mutex_locked[256];
+static u64 host_usec;
+
+struct wmp_common_sw_reg *wmp_common_sw_reg_get_container()
+{
+	return &host_container;
+}
+
+int XMutex_IsLocked(XMutex *InstancePtr, u8 MutexNumber)
+{
+	host_mutex_probes++;
+
+	return host_mutex_locked[MutexNumber];
+}
+
+void host_mutex_lock(u8 idx)
+{
+	host_mutex_locked[idx] = 1;
+}
+
+void host_mutex_unlock(u8 idx)
+{
+	host_mutex_locked[idx] = 0;
+}
+
+/* every call is a different microsecond, so that timestamps order the calls */
+u64 get_usec_timestamp()
+{
+	return ++host_usec;
+}
+
+u64 host_now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
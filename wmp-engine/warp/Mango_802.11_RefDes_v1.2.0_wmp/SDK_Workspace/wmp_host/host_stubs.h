@@ -0,0 +1,23 @@
+/*
+ * host_stubs.h
+ *
+ * Stand-ins for the BSP and CPU_HIGH services used by the
+ * firmware units that wmp_host compiles for the host: the
+ * XMutex of the fsm_buffer BRAM, the software register
+ * container and the microsecond timer.
+ */
+
+#ifndef HOST_STUBS_H_
+#define HOST_STUBS_H_
+
+#include "xil_types.h"
+
+/* XMutex_IsLocked calls since start, to count the cost of an operation without a clock */
+extern unsigned long host_mutex_probes;
+
+void host_mutex_lock(u8 idx);
+void host_mutex_unlock(u8 idx);
+
+u64 host_now_ns();
+
+#endif /* HOST_STUBS_H_ */
@@ -0,0 +1,454 @@
+/*
+ * slotsbench.c
+ *
+ * Host unit and benchmark test of the FSM slot directory
+ * (wmp_high_fsm_slots_handler.c), built once per number of
+ * slots (WMP_FSM_BUFFER_MUTEX_N, see the Makefile).
+ *
+ * The fixed cases check the id->slot lookup, the LRU victim
+ * of a full directory, locked slots and free list reuse. Then
+ * random FSM_LOAD/RUN/FSM_DEL sequences, issued the way
+ * wmp_high_util.c issues them, are checked against a linear
+ * reference model after every operation. Last, the cost of a
+ * lookup, of RUN and of an FSM_LOAD that evicts is measured;
+ * probes/op counts XMutex_IsLocked calls, which does not
+ * depend on the machine.
+ *
+ * usage: ./slotsbench-32 [-n iterations] [-s seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "wmp_high_fsm_slots_handler.h"
+#include "wmp_fsm.h"
+
+#include "host_stubs.h"
+
+#define SLOTS_N				WMP_FSM_BUFFER_MUTEX_N
+#define SLOT_NONE			WMP_HIGH_FSM_SLOT_NONE
+/* ids are drawn from a space larger than the directory, so that loads evict */
+#define ID_SPACE			(4 * SLOTS_N)
+
+static int failures;
+
+#define CHECK(cond, ...)									\
+	do {											\
+		if (!(cond)) {									\
+			printf("FAIL line %d: ", __LINE__);					\
+			printf(__VA_ARGS__);							\
+			printf("\n");								\
+			failures++;								\
+		}										\
+	} while (0)
+
+/* Reference model: what every slot holds, and when it was last used */
+static u16 model_id[SLOTS_N];
+static u8 model_used[SLOTS_N];
+static u64 model_stamp[SLOTS_N];
+static u64 model_clock;
+static u8 model_running;
+
+static void reset()
+{
+	int i;
+
+	for (i = 0; i < SLOTS_N; i++) {
+		model_used[i] = 0;
+		host_mutex_unlock(i);
+	}
+	model_running = SLOT_NONE;
+
+	wmp_high_fsm_slots_handler_init();
+}
+
+static u8 model_slot(u16 id)
+{
+	int i;
+
+	for (i = 0; i < SLOTS_N; i++) {
+		if (model_used[i] && model_id[i] == id)
+			return i;
+	}
+
+	return SLOT_NONE;
+}
+
+static void model_set(u8 slot, u16 id)
+{
+	model_id[slot] = id;
+	model_used[slot] = 1;
+	model_stamp[slot] = ++model_clock;
+}
+
+/* least recently used slot CPU_LOW does not hold */
+static u8 model_lru()
+{
+	u8 lru = SLOT_NONE;
+	int i;
+
+	for (i = 0; i < SLOTS_N; i++) {
+		if (model_used[i] && i != model_running &&
+				(lru == SLOT_NONE || model_stamp[i] < model_stamp[lru]))
+			lru = i;
+	}
+
+	return lru;
+}
+
+static int model_has_free()
+{
+	int i;
+
+	for (i = 0; i < SLOTS_N; i++) {
+		if (!model_used[i] && i != model_running)
+			return 1;
+	}
+
+	return 0;
+}
+
+static void check_directory(const char *after)
+{
+	u16 id;
+
+	for (id = 0; id < ID_SPACE; id++) {
+		u8 expected = model_slot(id);
+
+		CHECK(wmp_high_fsm_slots_handler_id_to_slot(id) == expected,
+				"%s: id %d in slot %d, expected %d", after, id,
+				wmp_high_fsm_slots_handler_id_to_slot(id), expected);
+		CHECK(wmp_high_fsm_slots_handler_slot_exist(id) == (expected != SLOT_NONE),
+				"%s: slot_exist(%d) wrong", after, id);
+	}
+}
+
+/* FSM_LOAD, as wmp_high_util_load_fsm */
+static u8 fsm_load(u16 id)
+{
+	u8 slot;
+
+	if (wmp_high_fsm_slots_handler_is_fsm_currently_running(id))
+		return SLOT_NONE;
+
+	if (wmp_high_fsm_slots_handler_slot_exist(id))
+		slot = wmp_high_fsm_slots_handler_id_to_slot(id);
+	else
+		slot = wmp_high_fsm_slots_handler_first_not_used_slot();
+
+	if (slot == SLOT_NONE)
+		return SLOT_NONE;
+
+	wmp_high_fsm_slots_handler_set_last_written(slot);
+	wmp_high_fsm_slots_handler_set_slot_used(slot, id);
+
+	return slot;
+}
+
+/* RUN, as wmp_high_util_handle_run, with CPU_LOW taking the slot mutex */
+static u8 fsm_run(u16 id)
+{
+	u8 slot;
+
+	if (!wmp_high_fsm_slots_handler_slot_exist(id) ||
+			wmp_high_fsm_slots_handler_is_fsm_currently_running(id))
+		return SLOT_NONE;
+
+	slot = wmp_high_fsm_slots_handler_id_to_slot(id);
+
+	if (model_running != SLOT_NONE)
+		host_mutex_unlock(model_running);
+	host_mutex_lock(slot);
+	model_running = slot;
+
+	wmp_high_fsm_slots_handler_set_slot_used(slot, id);
+
+	return slot;
+}
+
+/* FSM_LOAD checked against the model */
+static void checked_load(u16 id)
+{
+	u8 expected = model_slot(id);
+	u8 victim = SLOT_NONE;
+	u8 slot;
+
+	if (expected != SLOT_NONE && expected == model_running) {
+		CHECK(fsm_load(id) == SLOT_NONE, "load of running id %d accepted", id);
+		return;
+	}
+
+	if (expected == SLOT_NONE && !model_has_free())
+		victim = expected = model_lru();
+
+	slot = fsm_load(id);
+
+	if (expected != SLOT_NONE) {
+		CHECK(slot == expected, "load %d went to slot %d, expected %d", id, slot, expected);
+	} else if (model_has_free()) {
+		CHECK(slot < SLOTS_N && !model_used[slot] && slot != model_running,
+				"load %d went to slot %d, which is not free", id, slot);
+	} else {
+		CHECK(slot == SLOT_NONE, "load %d accepted with every slot locked", id);
+	}
+
+	if (slot == SLOT_NONE || slot >= SLOTS_N)
+		return;
+
+	if (victim != SLOT_NONE)
+		model_used[victim] = 0;
+	model_set(slot, id);
+}
+
+static void checked_run(u16 id)
+{
+	u8 expected = model_slot(id);
+	u8 slot;
+
+	if (expected == model_running)
+		expected = SLOT_NONE;
+
+	slot = fsm_run(id);
+	CHECK(slot == expected, "run %d in slot %d, expected %d", id, slot, expected);
+
+	if (slot != SLOT_NONE && slot < SLOTS_N)
+		model_set(slot, id);
+}
+
+static void checked_delete(u16 id)
+{
+	u8 expected = model_slot(id);
+	u8 slot;
+
+	if (expected == SLOT_NONE)
+		return;
+	if (expected == model_running)
+		expected = SLOT_NONE;
+
+	slot = wmp_high_fsm_slots_handler_delete_slot(id);
+	CHECK(slot == expected, "delete %d freed slot %d, expected %d", id, slot, expected);
+
+	if (slot != SLOT_NONE && slot < SLOTS_N)
+		model_used[slot] = 0;
+}
+
+static void fill(u16 first_id)
+{
+	int i;
+
+	for (i = 0; i < SLOTS_N; i++)
+		checked_load(first_id + i);
+}
+
+static void test_fixed()
+{
+	u8 slot, lru_slot, last_slot;
+	int i;
+
+	reset();
+	check_directory("init");
+
+	/* slots are handed out in the order of the old round robin, after slot 0 */
+	CHECK(fsm_load(7) == 1 % SLOTS_N, "first load not in slot 1");
+	model_set(1 % SLOTS_N, 7);
+	CHECK(fsm_load(7) == 1 % SLOTS_N, "reload of id 7 moved it");
+	model_set(1 % SLOTS_N, 7);
+	check_directory("first load");
+
+	/* full directory, then touch every id but the first one loaded */
+	reset();
+	fill(0);
+	check_directory("fill");
+	for (i = 1; i < SLOTS_N; i++)
+		checked_run(i);
+
+	/*
+	 * Id 0 is the LRU. The old free_lru_slot cleared the last slot
+	 * it scanned instead of the victim: the evicted slot must be
+	 * the one of id 0, and only id 0 may go.
+	 */
+	lru_slot = model_slot(0);
+	last_slot = model_slot(SLOTS_N - 1);
+	slot = fsm_load(ID_SPACE - 1);
+	CHECK(slot == lru_slot, "eviction took slot %d, LRU is slot %d", slot, lru_slot);
+	CHECK(!wmp_high_fsm_slots_handler_slot_exist(0), "evicted id 0 still mapped");
+	CHECK(wmp_high_fsm_slots_handler_id_to_slot(SLOTS_N - 1) == last_slot,
+			"id %d lost its slot on eviction", SLOTS_N - 1);
+	model_used[lru_slot] = 0;
+	model_set(lru_slot, ID_SPACE - 1);
+	check_directory("eviction");
+
+	/* the running FSM is never the victim, even when it is the LRU */
+	reset();
+	fill(0);
+	checked_run(0);
+	for (i = SLOTS_N - 1; i >= 1; i--) {
+		wmp_high_fsm_slots_handler_set_slot_used(model_slot(i), i);
+		model_set(model_slot(i), i);
+	}
+	/* id 0 runs and is now the LRU; the next one is id SLOTS_N - 1 */
+	if (SLOTS_N > 1) {
+		lru_slot = model_slot(SLOTS_N - 1);
+		CHECK(fsm_load(ID_SPACE - 1) == lru_slot, "running slot evicted or wrong victim");
+		CHECK(wmp_high_fsm_slots_handler_slot_exist(0), "running id 0 evicted");
+		model_used[lru_slot] = 0;
+		model_set(lru_slot, ID_SPACE - 1);
+	}
+	check_directory("locked LRU");
+
+	/* a deleted slot is reused before anything is evicted */
+	reset();
+	fill(0);
+	slot = model_slot(SLOTS_N / 2);
+	checked_delete(SLOTS_N / 2);
+	check_directory("delete");
+	CHECK(fsm_load(ID_SPACE - 2) == slot, "freed slot %d not reused", slot);
+	model_set(slot, ID_SPACE - 2);
+	check_directory("reuse");
+
+	/* the running FSM cannot be deleted */
+	checked_run(1);
+	CHECK(wmp_high_fsm_slots_handler_is_fsm_currently_running(1), "id 1 not running");
+	CHECK(wmp_high_fsm_slots_handler_delete_slot(1) == SLOT_NONE, "running id 1 deleted");
+	check_directory("delete running");
+
+	/* an id stored in a new slot leaves its old one */
+	slot = model_slot(2);
+	wmp_high_fsm_slots_handler_delete_slot(3);
+	model_used[model_slot(3)] = 0;
+	last_slot = wmp_high_fsm_slots_handler_first_not_used_slot();
+	wmp_high_fsm_slots_handler_set_slot_used(last_slot, 2);
+	model_used[slot] = 0;
+	model_set(last_slot, 2);
+	check_directory("move");
+	CHECK(fsm_load(ID_SPACE - 3) == slot, "slot %d left by id 2 not freed", slot);
+	model_set(slot, ID_SPACE - 3);
+
+	/* nothing to hand out when CPU_LOW holds every slot */
+	for (i = 0; i < SLOTS_N; i++)
+		host_mutex_lock(i);
+	CHECK(wmp_high_fsm_slots_handler_first_not_used_slot() == SLOT_NONE,
+			"slot handed out with every slot locked");
+	CHECK(wmp_high_fsm_slots_handler_next_slot() == SLOT_NONE,
+			"next slot with every slot locked");
+	for (i = 0; i < SLOTS_N; i++)
+		host_mutex_unlock(i);
+	host_mutex_lock(model_running);
+	check_directory("all locked");
+}
+
+static void test_random(unsigned int iterations)
+{
+	unsigned int n;
+	u16 id;
+
+	reset();
+
+	for (n = 0; n < iterations; n++) {
+		id = rand() % ID_SPACE;
+
+		switch (rand() % 8) {
+		case 0:
+			checked_delete(id);
+			break;
+		case 1:
+		case 2:
+		case 3:
+			checked_run(id);
+			break;
+		default:
+			checked_load(id);
+			break;
+		}
+
+		/* the full check is O(ID_SPACE * SLOTS_N), so not after every operation */
+		if (n % 64 == 0 || failures)
+			check_directory("random");
+		if (failures) {
+			printf("after %u random operations\n", n + 1);
+			return;
+		}
+	}
+}
+
+static void bench(unsigned int iterations)
+{
+	u64 start, lookup_ns, run_ns, load_ns;
+	unsigned long lookup_probes, run_probes, load_probes;
+	volatile u8 sink = 0;
+	unsigned int n;
+	u16 next_id;
+
+	reset();
+	fill(0);
+
+	host_mutex_probes = 0;
+	start = host_now_ns();
+	for (n = 0; n < iterations; n++)
+		sink += wmp_high_fsm_slots_handler_id_to_slot(n % SLOTS_N);
+	lookup_ns = host_now_ns() - start;
+	lookup_probes = host_mutex_probes;
+
+	host_mutex_probes = 0;
+	start = host_now_ns();
+	for (n = 0; n < iterations; n++)
+		sink += fsm_run(n % SLOTS_N);
+	run_ns = host_now_ns() - start;
+	run_probes = host_mutex_probes;
+
+	/* every load is a new id, so every load evicts */
+	next_id = SLOTS_N;
+	host_mutex_probes = 0;
+	start = host_now_ns();
+	for (n = 0; n < iterations; n++) {
+		sink += fsm_load(next_id);
+		next_id = (next_id + 1) % 0x8000;
+	}
+	load_ns = host_now_ns() - start;
+	load_probes = host_mutex_probes;
+
+	printf("%-10s %9s %9s\n", "op", "ns/op", "probes/op");
+	printf("%-10s %9.1f %9.2f\n", "lookup", (double)lookup_ns / iterations,
+			(double)lookup_probes / iterations);
+	printf("%-10s %9.1f %9.2f\n", "run", (double)run_ns / iterations,
+			(double)run_probes / iterations);
+	printf("%-10s %9.1f %9.2f\n", "load", (double)load_ns / iterations,
+			(double)load_probes / iterations);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int iterations = 200000;
+	unsigned int seed = 1;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:s:h")) != -1) {
+		switch (c) {
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 's':
+			seed = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n iterations] [-s seed]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	srand(seed);
+	printf("%d slots, %u iterations, seed %u\n", SLOTS_N, iterations, seed);
+
+	test_fixed();
+	test_random(iterations);
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("directory matches the reference model\n");
+
+	bench(iterations);
+
+	return 0;
+}
@@ -49,6 +49,7 @@
 #define IPC_MBOX_TIMESTAMP			15
 #define IPC_MBOX_ASSOC_BEACON_MAC	16
 #define IPC_MBOX_READVAR			17
+#define IPC_MBOX_RING_DOORBELL		18
 
 /* WMP_START */
 #define WMP_IPC_MBOX_UPDATE_BEACON_TEMPLATE			0x00
@@ -56,7 +57,7 @@
 /* WMP_END */
 
 #define IPC_MBOX_MSG_ID(id) (IPC_MBOX_MSG_ID_DELIM | ((id) & 0xFFF))
-#define IPC_MBOX_MSG_ID_TO_MSG(id) (id) & 0xFFF
+#define IPC_MBOX_MSG_ID_TO_MSG(id) ((id) & 0xFFF)
 
 //These config structs need to be an integer # of u32
 typedef struct{
@@ -96,6 +97,66 @@ typedef struct {
 } wlan_ipc_msg;
 
 
+//IPC rings
+// Each CPU writes its messages to a single producer, single consumer ring in shared
+// BRAM, in the upper half of the Rx pkt buffer reserved for wmp commands. A record is
+// the msg header word, the producer's timestamp and the payload, which the consumer
+// processes in place. Only the first message written to an empty ring sends a mailbox
+// IPC_MBOX_RING_DOORBELL; the consumer drains everything up to the head on each doorbell.
+// A ring is used once its consumer has set its magic, so a CPU without ring support keeps
+// receiving plain mailbox messages. A message that finds the ring full waits up to
+// IPC_RING_WAIT_USEC for room. Messages longer than IPC_RING_MAX_PAYLOAD_WORDS, or still
+// without room, go through the mailbox once the consumer is idle, so that they keep their
+// place among the ring messages.
+#define IPC_RING_PKT_BUF				(NUM_RX_PKT_BUFS - 1)
+#define IPC_RING_BASEADDR				(RX_PKT_BUF_TO_ADDR(IPC_RING_PKT_BUF) + (PKT_BUF_SIZE/2))
+
+#define IPC_RING_MAGIC					0x49504352
+#define IPC_RING_NUM_WORDS				128 //must be a power of 2
+#define IPC_RING_MAX_PAYLOAD_WORDS		16
+#define IPC_RING_RECORD_HDR_WORDS		2
+#define IPC_RING_WAIT_USEC				1000
+
+//Header of the record filling the end of the ring when the next one does not fit there
+#define IPC_RING_PAD					0xFFF
+
+#define IPC_MBOX_NUM_MSG_TYPES			(IPC_MBOX_RING_DOORBELL + 1)
+
+typedef struct {
+	u32          magic;		//Set by the consumer once the ring is initialized
+	volatile u32 head;		//Written by the producer only; free-running word index
+	volatile u32 tail;		//Written by the consumer only
+	volatile u32 doorbell;	//Set by the producer when it sends a doorbell, cleared by the consumer
+	volatile u32 draining;	//Set by the consumer while it drains the ring
+	u32          reserved[3];
+	u32          words[IPC_RING_NUM_WORDS];
+} ipc_ring;
+
+#define IPC_RING_HIGH_TO_LOW			((ipc_ring*)(IPC_RING_BASEADDR))
+#define IPC_RING_LOW_TO_HIGH			((ipc_ring*)(IPC_RING_BASEADDR + sizeof(ipc_ring)))
+
+//Delivery latency of one message type, in microseconds of the ring timestamp
+typedef struct {
+	u32 count;
+	u32 sum;
+	u32 max;
+} ipc_ring_latency;
+
+//IPC ring counters, see ipc_ring_get_stats()
+typedef struct {
+	u32 num_sent;			//Messages written to the Tx ring
+	u32 num_doorbells;		//Doorbells sent; num_sent/num_doorbells is the mean batch
+	u32 num_mailbox;		//Messages sent through the mailbox instead (no ring, too long, ring full)
+	u32 num_ring_full;		//Messages that had to wait for room in the ring
+	u32 num_wait_timeouts;	//Waits that gave up after IPC_RING_WAIT_USEC
+	u32 num_received;		//Messages read from the Rx ring
+	u32 num_drains;			//Doorbells handled
+	u32 max_batch;			//Most messages read on one doorbell
+	u32 num_errors;			//Rx ring contents discarded as invalid
+	ipc_ring_latency latency[IPC_MBOX_NUM_MSG_TYPES];
+} ipc_ring_stats;
+
+
 
 // Hardware information struct to share data between the 
 //   low and high CPUs
@@ -123,8 +184,8 @@ typedef struct {
 
 
 int wlan_lib_init ();
-inline int ipc_mailbox_read_isempty();
-inline int wlan_lib_mac_rate_to_mbps (u8 rate);
+int ipc_mailbox_read_isempty();
+int wlan_lib_mac_rate_to_mbps (u8 rate);
 int lock_pkt_buf_tx(u8 pkt_buf_ind);
 int lock_pkt_buf_rx(u8 pkt_buf_ind);
 int unlock_pkt_buf_tx(u8 pkt_buf_ind);
@@ -134,6 +195,11 @@ int status_pkt_buf_rx(u8 pkt_buf_ind, u32* Locked, u32 *Owner);
 
 int ipc_mailbox_read_msg(wlan_ipc_msg* msg);
 int ipc_mailbox_write_msg(wlan_ipc_msg* msg);
+void ipc_ring_init(ipc_ring* rx_ring, ipc_ring* tx_ring, u32(*timestamp)());
+int ipc_ring_write_msg(wlan_ipc_msg* msg);
+int ipc_ring_drain(void(*process)(wlan_ipc_msg*));
+void ipc_ring_get_stats(ipc_ring_stats* stats);
+void ipc_ring_reset_stats();
 void nullCallback(void* param);
 
 
@@ -11,6 +11,8 @@
 #ifndef WLAN_MAC_MISC_UTIL_H_
 #define WLAN_MAC_MISC_UTIL_H_
 
+#include "mb_interface.h"
+
 typedef int (*function_ptr_t)();
 
 #define max(A,B) (((A)>(B))?(A):(B))
@@ -30,6 +32,23 @@ typedef int (*function_ptr_t)();
 
 #define wlan_addr_eq(addr1, addr2) (memcmp((void*)(addr1), (void*)(addr2), 6)==0)
 
+#ifndef MSR_IE_MASK
+#define MSR_IE_MASK		0x00000002
+#endif
+
+//Critical section against the interrupt handlers. Safe to nest and to enter from interrupt
+// context: interrupts are only re-enabled if they were enabled when the lock was taken
+static inline u32 wlan_mac_irq_lock(){
+	u32 msr = mfmsr();
+	microblaze_disable_interrupts();
+	return msr;
+}
+static inline void wlan_mac_irq_unlock(u32 msr){
+	if(msr & MSR_IE_MASK){
+		microblaze_enable_interrupts();
+	}
+}
+
 
 typedef struct{
 	u8 state;
@@ -10,11 +10,13 @@
 
 #include "stdlib.h"
 #include "stdio.h"
+#include "string.h"
 
 #include "xstatus.h"
 #include "xmutex.h"
 #include "xmbox.h"
 #include "xparameters.h"
+#include "mb_interface.h"
 
 #ifdef XPAR_INTC_0_DEVICE_ID
 #include "xintc.h"
@@ -43,6 +45,12 @@ function_ptr_t mailbox_rx_callback;
 
 void nullCallback(void* param){};
 
+//IPC rings of this CPU, see ipc_ring_init()
+static ipc_ring*      ipc_rx_ring;
+static ipc_ring*      ipc_tx_ring;
+static u32          (*ipc_ring_timestamp)();
+static ipc_ring_stats ipc_ring_counters;
+
 
 
 
@@ -337,3 +345,204 @@ int ipc_mailbox_read_msg(wlan_ipc_msg* msg) {
 
 	return IPC_MBOX_SUCCESS;
 }
+
+
+/************** Inter-processor Message Rings ************/
+
+//The consumer of rx_ring resets it and marks it ready; tx_ring is used as soon as the other
+// CPU does the same with it. timestamp returns the microsecond time stamped into each record,
+// from a counter both CPUs read for the latencies to be meaningful
+void ipc_ring_init(ipc_ring* rx_ring, ipc_ring* tx_ring, u32(*timestamp)()){
+	rx_ring->magic = 0;
+	rx_ring->head = 0;
+	rx_ring->tail = 0;
+	rx_ring->doorbell = 0;
+	rx_ring->draining = 0;
+	rx_ring->magic = IPC_RING_MAGIC;
+
+	ipc_rx_ring = rx_ring;
+	ipc_tx_ring = tx_ring;
+	ipc_ring_timestamp = timestamp;
+
+	ipc_ring_reset_stats();
+}
+
+int ipc_ring_write_msg(wlan_ipc_msg* msg) {
+	wlan_ipc_msg doorbell;
+	ipc_ring* ring = ipc_tx_ring;
+	u32* record;
+	u32 msr, head, offset, pad, length, start, i;
+	u8 waited = 0;
+	int status;
+
+	//Check that msg points to a valid IPC message
+	if( ((msg->msg_id) & IPC_MBOX_MSG_ID_DELIM) != IPC_MBOX_MSG_ID_DELIM) {
+		return IPC_MBOX_INVALID_MSG;
+	}
+
+	msr = wlan_mac_irq_lock();
+
+	if(ring == NULL || ring->magic != IPC_RING_MAGIC) {
+		ipc_ring_counters.num_mailbox++;
+		status = ipc_mailbox_write_msg(msg);
+		wlan_mac_irq_unlock(msr);
+		return status;
+	}
+
+	length = IPC_RING_RECORD_HDR_WORDS + msg->num_payload_words;
+	start  = ipc_ring_timestamp();
+
+	while(1) {
+		if((msg->num_payload_words) <= IPC_RING_MAX_PAYLOAD_WORDS) {
+			//A record never wraps: when it does not fit before the end of the ring, the end is padded
+			head   = ring->head;
+			offset = head & (IPC_RING_NUM_WORDS - 1);
+			pad    = (offset + length > IPC_RING_NUM_WORDS) ? (IPC_RING_NUM_WORDS - offset) : 0;
+
+			if((head - ring->tail) + pad + length <= IPC_RING_NUM_WORDS) {
+				break;
+			}
+			if(!waited) {
+				ipc_ring_counters.num_ring_full++;
+				waited = 1;
+			}
+		} else if(ring->doorbell == 0 && ring->draining == 0) {
+			//No doorbell pending and no drain running: every record has been processed,
+			// and the next one will be announced by a doorbell queued after this message
+			ipc_ring_counters.num_mailbox++;
+			status = ipc_mailbox_write_msg(msg);
+			wlan_mac_irq_unlock(msr);
+			return status;
+		}
+
+		if((ipc_ring_timestamp() - start) > IPC_RING_WAIT_USEC) {
+			ipc_ring_counters.num_wait_timeouts++;
+			ipc_ring_counters.num_mailbox++;
+			status = ipc_mailbox_write_msg(msg);
+			wlan_mac_irq_unlock(msr);
+			return status;
+		}
+
+		//Let the interrupts of this CPU in while waiting, the other CPU may be waiting on them
+		wlan_mac_irq_unlock(msr);
+		msr = wlan_mac_irq_lock();
+	}
+
+	if(pad) {
+		ring->words[offset] = IPC_MBOX_MSG_ID(IPC_RING_PAD);
+		head  += pad;
+		offset = 0;
+	}
+
+	record = &(ring->words[offset]);
+	record[0] = *((u32*)msg);
+	record[1] = ipc_ring_timestamp();
+	for(i = 0; i < (msg->num_payload_words); i++) {
+		record[IPC_RING_RECORD_HDR_WORDS + i] = msg->payload_ptr[i];
+	}
+
+	//The record must be complete before it is published, and published before the doorbell is
+	// checked: a doorbell still pending means the consumer has not read the head yet
+	ring->head = head + length;
+	ipc_ring_counters.num_sent++;
+
+	if(ring->doorbell == 0) {
+		ring->doorbell = 1;
+
+		doorbell.msg_id            = IPC_MBOX_MSG_ID(IPC_MBOX_RING_DOORBELL);
+		doorbell.num_payload_words = 0;
+		doorbell.arg0              = 0;
+		ipc_mailbox_write_msg(&doorbell);
+		ipc_ring_counters.num_doorbells++;
+	}
+
+	wlan_mac_irq_unlock(msr);
+
+	return IPC_MBOX_SUCCESS;
+}
+
+//Called on each IPC_MBOX_RING_DOORBELL; process gets every message of the Rx ring, with its
+// payload_ptr into the ring. Returns the number of messages processed
+int ipc_ring_drain(void(*process)(wlan_ipc_msg*)) {
+	wlan_ipc_msg msg;
+	ipc_ring* ring = ipc_rx_ring;
+	u32* record;
+	u32 head, tail, offset, length, type, latency;
+	int num_msgs = 0;
+
+	if(ring == NULL || ring->magic != IPC_RING_MAGIC) {
+		return 0;
+	}
+
+	//Cleared before the head is read, so a record published after that sends a new doorbell
+	ring->draining = 1;
+	ring->doorbell = 0;
+	head = ring->head;
+	tail = ring->tail;
+
+	while(tail != head) {
+		offset = tail & (IPC_RING_NUM_WORDS - 1);
+		record = &(ring->words[offset]);
+
+		*((u32*)&msg) = record[0];
+
+		if(IPC_MBOX_MSG_ID_TO_MSG(msg.msg_id) == IPC_RING_PAD) {
+			tail += IPC_RING_NUM_WORDS - offset;
+			continue;
+		}
+
+		length = IPC_RING_RECORD_HDR_WORDS + msg.num_payload_words;
+		if( ((msg.msg_id) & IPC_MBOX_MSG_ID_DELIM) != IPC_MBOX_MSG_ID_DELIM ||
+				(msg.num_payload_words) > IPC_RING_MAX_PAYLOAD_WORDS ||
+				offset + length > IPC_RING_NUM_WORDS || length > (head - tail)) {
+			//Nothing to resynchronize on; drop what the producer has published
+			ipc_ring_counters.num_errors++;
+			tail = head;
+			break;
+		}
+
+		type = IPC_MBOX_MSG_ID_TO_MSG(msg.msg_id);
+		if(type < IPC_MBOX_NUM_MSG_TYPES) {
+			latency = ipc_ring_timestamp() - record[1];
+			ipc_ring_counters.latency[type].count++;
+			ipc_ring_counters.latency[type].sum += latency;
+			if(latency > ipc_ring_counters.latency[type].max) {
+				ipc_ring_counters.latency[type].max = latency;
+			}
+		}
+
+		msg.payload_ptr = &(record[IPC_RING_RECORD_HDR_WORDS]);
+		process(&msg);
+		num_msgs++;
+
+		//The payload is processed in place, so its words are only released now
+		tail += length;
+		ring->tail = tail;
+	}
+	ring->tail = tail;
+	ring->draining = 0;
+
+	ipc_ring_counters.num_drains++;
+	ipc_ring_counters.num_received += num_msgs;
+	if((u32)num_msgs > ipc_ring_counters.max_batch) {
+		ipc_ring_counters.max_batch = num_msgs;
+	}
+
+	return num_msgs;
+}
+
+void ipc_ring_get_stats(ipc_ring_stats* stats){
+	u32 msr;
+
+	msr = wlan_mac_irq_lock();
+	memcpy(stats, &ipc_ring_counters, sizeof(ipc_ring_stats));
+	wlan_mac_irq_unlock(msr);
+}
+
+void ipc_ring_reset_stats(){
+	u32 msr;
+
+	msr = wlan_mac_irq_lock();
+	bzero(&ipc_ring_counters, sizeof(ipc_ring_stats));
+	wlan_mac_irq_unlock(msr);
+}
@@ -52,6 +52,25 @@
 #define NODE_LOG_GET_EVENTS            54
 #define NODE_LOG_ADD_EVENT             55
 #define NODE_LOG_ENABLE_EVENT          56
+#define NODE_LOG_GET_EVENT_IDS         57
+#define NODE_LOG_GET_EVENTS_BY_ID      58
+#define NODE_LOG_STREAM_START          59
+#define NODE_LOG_STREAM_ACK            60
+#define NODE_LOG_STREAM_STOP           61
+#define NODE_LOG_STREAM_DATA           62
+
+
+
+// ****************************************************************************
+// Define Event Log Stream Parameters
+//
+#define NODE_LOG_STREAM_MAX_WINDOW     32          // Packets in flight; one bit each in the ACK bitmap
+#define NODE_LOG_STREAM_DEFAULT_WINDOW 16
+#define NODE_LOG_STREAM_DEFAULT_BUDGET  2          // Packets sent per call to node_log_stream_poll()
+#define NODE_LOG_STREAM_TIMEOUT        50000       // usec without progress before outstanding packets are resent
+#define NODE_LOG_STREAM_MAX_TIMEOUTS   20          // Timeouts in a row before the stream is dropped
+
+#define NODE_LOG_STREAM_FLAG_OVERWRITTEN 0x80000000 // Packet flag: the first events of the stream have been overwritten
 
 
 
@@ -112,5 +131,7 @@ int  node_get_parameters(u32 * buffer, unsigned int max_words, unsigned char net
 void node_info_set_max_assn      ( u32 max_assn );
 void node_info_set_event_log_size( u32 log_size );
 
+void node_log_stream_poll();
+
 
 #endif /* WLAN_EXP_NODE_H_ */
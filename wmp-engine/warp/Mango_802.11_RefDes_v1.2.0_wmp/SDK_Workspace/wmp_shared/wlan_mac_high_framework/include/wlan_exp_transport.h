@@ -67,6 +67,8 @@
 
 #define TRANSPORT_ROBUST_MASK       0x1
 
+#define WN_ASYNC_BUFFER_NBYTES      1514         // Same as the Ethernet send buffer
+
 #define ETHPHYREG_17_0_LINKUP       0x0400
 
 #define WAITDURATION_SEC            2
@@ -165,6 +167,7 @@ int  transport_setReceiveCallback ( void(*handler) );
 void transport_poll               ( unsigned int eth_dev_num);
 void transport_send               ( wn_host_message*, pktSrcInfo*, unsigned int eth_dev_num);
 void transport_close              ( unsigned int eth_dev_num);
+wn_respHdr* transport_get_async_resp ( unsigned int eth_dev_num);
 
 int  transport_set_hw_info        ( unsigned int eth_dev_num, unsigned char* ip_addr, unsigned char* hw_addr);
 int  transport_get_hw_addr        ( unsigned int eth_dev_num, unsigned char* hw_addr);
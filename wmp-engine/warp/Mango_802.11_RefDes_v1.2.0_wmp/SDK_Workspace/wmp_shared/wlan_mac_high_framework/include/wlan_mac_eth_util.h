@@ -20,21 +20,68 @@
 #define ETH_A_PKT_BUF_SIZE	0x800 //2KB
 
 //Number of Tx and Rx DMA buffer descriptors
-#define ETH_A_NUM_TX_BD		1
+// Each Tx BD holds one frame in flight; frames are copied into a packet_bd, which is
+// checked back into the free queue when the DMA reports the BD as complete
+#define ETH_A_NUM_TX_BD		16
+
+//Completed Tx BDs are reaped by the Tx DMA interrupt when set to 1. When set to 0 they
+// are only reaped by polling, at the next wlan_eth_dma_send() or wlan_eth_tx_poll()
+#define ETH_A_TX_INTR		1
+
+//A call of wlan_poll_eth() handles at most ETH_A_RX_BUDGET frames; what is left is picked up by a poll
+// from the fine scheduler, so that a burst of wired frames does not hold off wireless Tx/Rx events
+#define ETH_A_RX_BUDGET			8
+
+//Handled Rx BDs are freed and re-armed every ETH_A_RX_REFILL_BATCH frames, and at the end of each poll
+#define ETH_A_RX_REFILL_BATCH	4
+
+//The Rx DMA interrupts after ETH_A_RX_COALESCE_COUNT frames, or when its delay timer (units of 125
+// DMA clock cycles) expires with fewer pending. Count 1, delay 0 interrupts for every frame
+#define ETH_A_RX_COALESCE_COUNT	4
+#define ETH_A_RX_COALESCE_DELAY	8
 
 #define ETH_A_BUF_MEM_BASE		(XPAR_MB_HIGH_AUX_BRAM_CTRL_S_AXI_BASEADDR + (48*1024)) //bottom 48kB are Tx queues
 
 #define ETH_A_TX_BD_SPACE_BASE	(ETH_A_BUF_MEM_BASE)
 #define ETH_A_RX_BD_SPACE_BASE	(ETH_A_TX_BD_SPACE_BASE + (ETH_A_NUM_TX_BD * XAXIDMA_BD_MINIMUM_ALIGNMENT)) //safer than sizeof(XAxiDma_Bd)?
 
+//Eth Tx ring counters, see wlan_eth_tx_get_stats()
+typedef struct{
+	u32 num_sent;			//Frames pushed to the Tx ring
+	u32 num_completed;		//Frames whose DMA transfer has completed
+	u32 num_in_flight;		//Tx BDs currently owned by the DMA
+	u32 max_in_flight;		//High-water mark of num_in_flight
+	u32 num_ring_stalls;	//Sends that had to wait for a free Tx BD
+	u32 num_sync;			//Sends that waited for their own completion (no packet_bd to copy into)
+	u32 num_errors;
+} eth_tx_stats;
+
+//Eth Rx processing counters, see wlan_eth_rx_get_stats()
+typedef struct{
+	u32 num_polls;				//Polls that found frames
+	u32 num_frames;				//Frames handled; num_frames/num_polls is the mean per poll
+	u32 max_frames_per_poll;
+	u32 num_budget_exhausted;	//Polls that stopped at ETH_A_RX_BUDGET
+	u32 num_ring_full;			//Polls that found the Rx channel idle, with every armed BD filled
+	u32 num_refill_starved;		//Refills that found no free packet_bd for an empty Rx BD
+	u32 num_not_queued;			//Frames not queued for wireless Tx (wmp commands, unknown types, full queue)
+} eth_rx_stats;
+
 int wlan_eth_init();
 int eth_bd_total_size();
 int wlan_eth_dma_init();
 int wlan_mpdu_eth_send(void* mpdu, u16 length);
 int wlan_eth_dma_send(u8* pkt_ptr, u32 length);
-inline void wlan_poll_eth();
+int wlan_eth_tx_poll();
+void wlan_eth_tx_get_stats(eth_tx_stats* stats);
+void wlan_eth_tx_reset_stats();
+void wlan_poll_eth();
+void wlan_poll_eth_scheduled();
+void wlan_eth_rx_get_stats(eth_rx_stats* stats);
+void wlan_eth_rx_reset_stats();
 void wlan_eth_dma_update();
 int wlan_eth_setup_interrupt(XIntc* intc);
 void RxIntrHandler(void *Callback);
+void TxIntrHandler(void *Callback);
 
 #endif /* WLAN_MAC_ETH_UTIL_H_ */
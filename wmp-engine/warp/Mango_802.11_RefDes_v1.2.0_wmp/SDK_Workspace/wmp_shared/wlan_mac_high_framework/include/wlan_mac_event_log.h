@@ -42,6 +42,10 @@
 #define EVENT_LOG_MAGIC_NUMBER         0xACED000000000000
 
 
+// Returned by event_log_get_event_index() for events that are not in the log
+#define EVENT_LOG_INDEX_INVALID        0xFFFFFFFF
+
+
 
 /*********************** Global Structure Definitions ************************/
 
@@ -70,6 +74,11 @@ u32       event_log_get_data( u32 start_address, u32 size, char * buffer );
 u32       event_log_get_size( void );
 u32       event_log_get_current_index( void );
 u32       event_log_get_oldest_event_index( void );
+u32       event_log_get_capacity( void );
+u32       event_log_get_oldest_event_id( void );
+u32       event_log_get_next_event_id( void );
+u32       event_log_get_event_index( u32 event_id );
+u32       event_log_get_event_ranges( u32 first_id, u32 num_events, u32 * index, u32 * size );
 void *    event_log_get_next_empty_event( u16 event_type, u16 event_size );
 
 int       event_log_update_type( void * event_ptr, u16 event_type );
@@ -29,6 +29,10 @@ struct tg_schedule{
 	u32 id;
 	u32 type;
 	u64 timestamp;
+	u32 sched_id;			//Scheduler event for the next deadline
+	u32 num_events;
+	u32 late_max_usec;
+	u64 late_total_usec;
 	void* params;
 	void* callback_arg;
 	function_ptr_t cleanup_callback;
@@ -105,9 +109,10 @@ int ltg_sched_stop_l(tg_schedule* curr_tg);
 int ltg_sched_get_state(u32 id, u32* type, void** state);
 int ltg_sched_get_params(u32 id, u32* type, void** params);
 int ltg_sched_get_callback_arg(u32 id, void** callback_arg);
+int ltg_sched_get_timing(u32 id, u32* num_events, u32* late_max_usec, u64* late_total_usec);
 
 //Internal functions to LTG -- users should not need to call these directly
-void ltg_sched_check();
+void ltg_sched_check(tg_schedule* curr_tg);
 tg_schedule* ltg_sched_create();
 void ltg_sched_destroy(tg_schedule* tg);
 tg_schedule* ltg_sched_find_tg_schedule(u32 id);
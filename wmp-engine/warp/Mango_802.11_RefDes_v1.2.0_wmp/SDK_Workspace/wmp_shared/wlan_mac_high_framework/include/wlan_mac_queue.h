@@ -54,8 +54,9 @@ void dequeue_from_beginning(packet_bd_list* new_list, u16 queue_sel, u16 num_pac
 //Functions for checking in and out packet_bds from the free ring
 void queue_checkout(packet_bd_list* new_list, u16 num_packet_bd);
 void queue_checkin(packet_bd_list* ring);
-inline u32 queue_num_free();
-inline u32 queue_num_queued(u16 queue_sel);
+u32 queue_num_free();
+u32 queue_num_queued(u16 queue_sel);
+packet_bd* queue_first(u16 queue_sel);
 
 //Doubly linked list helper functions
 void packet_bd_insertAfter(packet_bd_list* ring, packet_bd* bd, packet_bd* bd_new);
@@ -28,11 +28,17 @@
 #define ENCAP_MODE_STA	1
 
 //Scheduler
-#define SCHEDULER_NUM_EVENTS 10
+#define SCHEDULER_NUM_EVENTS 32
 #define NUM_SCHEDULERS 2
 #define SCHEDULE_FINE	0
 #define SCHEDULE_COARSE 1
 
+#define SCHEDULE_FAILED		0xFFFFFFFF
+#define SCHEDULE_NO_DEADLINE	0xFFFFFFFFFFFFFFFFULL
+
+//Longest single timer run; later deadlines are reached in several runs
+#define SCHEDULER_MAX_ARM_US	1000000
+
 
 // 802.11 Transmit interface defines
 /* WMP_START */
@@ -213,10 +219,13 @@ void wlan_mac_util_set_check_queue_callback(void(*callback)());
 void wlan_mac_util_set_mpdu_accept_callback(void(*callback)());
 
 void wlan_mac_util_set_eth_encap_mode(u8 mode);
-void wlan_mac_schedule_event(u8 scheduler_sel, u32 delay, void(*callback)());
+u32  wlan_mac_schedule_event(u8 scheduler_sel, u32 delay, void(*callback)());
+u32  wlan_mac_schedule_event_arg(u8 scheduler_sel, u32 delay, void(*callback)(void*), void* arg);
+int  wlan_mac_remove_schedule(u8 scheduler_sel, u32 id);
+u64  wlan_mac_schedule_next_deadline(u8 scheduler_sel);
 
-inline void poll_schedule();
-inline int wlan_mac_poll_tx_queue(u16 queue_sel);
+void poll_schedule();
+int wlan_mac_poll_tx_queue(u16 queue_sel);
 void write_hex_display(u8 val);
 void write_hex_display_dots(u8 dots_on);
 int memory_test();
@@ -226,8 +235,8 @@ void GpioIsr(void *InstancePtr);
 void SendHandler(void *CallBackRef, unsigned int EventData);
 void RecvHandler(void *CallBackRef, unsigned int EventData);
 void wlan_mac_util_set_ipc_rx_callback(void(*callback)());
-inline int interrupt_start();
-inline void interrupt_stop();
+int interrupt_start();
+void interrupt_stop();
 void timer_handler(void *CallBackRef, u8 TmrCtrNumber);
 u8* get_eeprom_mac_addr();
 
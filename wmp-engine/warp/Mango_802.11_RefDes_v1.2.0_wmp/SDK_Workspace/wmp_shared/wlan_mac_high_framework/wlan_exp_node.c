@@ -49,6 +49,53 @@ wn_tag_parameter   node_parameters[NODE_MAX_PARAMETER];
 wn_function_ptr_t  node_process_callback;
 extern function_ptr_t check_queue_callback;
 
+
+// Event log stream
+//   - Packets are numbered from 0 to num_pkts - 1.  Packets [base, next) have been sent and not
+//     yet acknowledged in order; their state is kept in pkt_state / pkt_tx at (seq % MAX_WINDOW).
+//
+#define NODE_LOG_STREAM_IDLE           0
+#define NODE_LOG_STREAM_ACTIVE         1
+
+#define NODE_LOG_STREAM_PKT_FREE       0           // Not sent yet (or acknowledged and retired)
+#define NODE_LOG_STREAM_PKT_SENT       1
+#define NODE_LOG_STREAM_PKT_LOST       2           // Sent, but the host has seen a later packet; resend
+#define NODE_LOG_STREAM_PKT_ACKED      3           // Acknowledged out of order
+
+typedef struct {
+	u32           state;
+	u32           id;
+	u32           flags;
+	u32           first_event_id;
+
+	u32           range_index[2];                  // Log ranges from event_log_get_event_ranges()
+	u32           range_size[2];
+	u32           range_pkts[2];                   // Packets never span two ranges
+
+	u32           num_pkts;
+	u32           bytes_per_pkt;
+	u32           window;
+	u32           budget;
+
+	u32           base;                            // Oldest packet not acknowledged
+	u32           next;                            // Next packet never sent
+	u32           tx_count;                        // Stamps each transmission
+	u32           acked_tx;                        // Latest stamp the host acknowledged
+	u32           num_tx;
+	u32           num_resent;
+
+	u64           last_progress;
+	u32           num_timeouts;
+
+	pktSrcInfo    pktSrc;
+	unsigned int  eth_dev_num;
+
+	u8            pkt_state[NODE_LOG_STREAM_MAX_WINDOW];
+	u32           pkt_tx[NODE_LOG_STREAM_MAX_WINDOW];
+} node_log_stream_info;
+
+node_log_stream_info  log_stream;
+
 /*************************** Functions Prototypes ****************************/
 
 int  node_init_parameters( u32 *info );
@@ -56,6 +103,15 @@ int  node_processCmd(const wn_cmdHdr* cmdHdr,const void* cmdArgs, wn_respHdr* re
 
 void node_ltg_cleanup(u32 id, void* callback_arg);
 
+void node_send_log_data(const wn_cmdHdr* cmdHdr, wn_respHdr* respHdr, u32 * respArgs32, void* pktSrc, unsigned int eth_dev_num,
+                        u32 bytes_per_pkt, u32 id, u32 flags, u32 start_address, u32 size);
+
+u32  node_log_stream_start(u32 id, u32 flags, u32 first_event_id, u32 num_events, u32 bytes_per_pkt, u32 window, u32 budget,
+                           void* pktSrc, unsigned int eth_dev_num);
+u32  node_log_stream_ack(u32 id, u32 ack, u32 bitmap);
+void node_log_stream_stop();
+int  node_log_stream_send(u32 seq);
+
 #ifdef _DEBUG_
 void print_wn_node_info( wn_node_info * info );
 void print_wn_parameters( wn_tag_parameter *param, int num_params );
@@ -151,6 +207,7 @@ void node_rxFromTransport(wn_host_message* toNode, wn_host_message* fromNode, vo
 		break;
 		default:
 			xil_printf("Unknown command group\n");
+			respSent = RESP_SENT; //Nothing to append to the response
 		break;
 	}
 
@@ -269,14 +326,11 @@ int node_processCmd(const wn_cmdHdr* cmdHdr,const void* cmdArgs, wn_respHdr* res
     u32           id;
     u32           flags;
 	u32           start_address;
-	u32           curr_address;
-	u32           next_address;
 	u32           size;
 	u32           evt_log_size;
-	u32           transfer_size;
 	u32           bytes_per_pkt;
-	u32           num_bytes;
-	u32           num_pkts;
+	u32           range_index[2];
+	u32           range_size[2];
 
 	u32           interval;
 
@@ -668,6 +722,9 @@ int node_processCmd(const wn_cmdHdr* cmdHdr,const void* cmdArgs, wn_respHdr* res
 			xil_printf("EVENT LOG:  Reset log\n");
 
 			event_log_reset();
+
+			// The stream refers to the old log contents
+			node_log_stream_stop();
 	    break;
 
 
@@ -777,64 +834,165 @@ int node_processCmd(const wn_cmdHdr* cmdHdr,const void* cmdArgs, wn_respHdr* res
             }
 
             bytes_per_pkt     = max_words * 4;
-            num_pkts          = size / bytes_per_pkt + 1;
-            curr_address      = start_address;
 
 #ifdef _DEBUG_
 			xil_printf("WLAN EXP NODE_GET_EVENTS \n");
-			xil_printf("    start_address    = 0x%8x\n    size             = %10d\n    num_pkts         = %10d\n", start_address, size, num_pkts);
 #endif
 
-            // Initialize constant parameters
-            respArgs32[0] = Xil_Htonl( id );
-            respArgs32[1] = Xil_Htonl( flags );
+            node_send_log_data( cmdHdr, respHdr, respArgs32, pktSrc, eth_dev_num, bytes_per_pkt, id, flags, start_address, size );
 
-            // Iterate through all the packets
-			for( i = 0; i < num_pkts; i++ ) {
+			respSent = RESP_SENT;
+		break;
 
-				// Get the next address
-				next_address  = curr_address + bytes_per_pkt;
 
-				// Compute the transfer size (use the full buffer unless you run out of space)
-				if( next_address > ( start_address + size ) ) {
-                    transfer_size = (start_address + size) - curr_address;
+	    //---------------------------------------------------------------------
+		case NODE_LOG_GET_EVENT_IDS:
+            // NODE_LOG_GET_EVENT_IDS Packet Format:
+            //   - respArgs32[0] - event_id of the oldest event in the log
+            //   - respArgs32[1] - event_id the next event will get
+			//
+			//   The log holds the events respArgs32[0] to respArgs32[1] - 1.
 
-				} else {
-					transfer_size = bytes_per_pkt;
-				}
+            respArgs32[respIndex++] = Xil_Htonl( event_log_get_oldest_event_id() );
+            respArgs32[respIndex++] = Xil_Htonl( event_log_get_next_event_id() );
 
-				// Set response args that change per packet
-	            respArgs32[2]   = Xil_Htonl( curr_address );
-                respArgs32[3]   = Xil_Htonl( transfer_size );
+			respHdr->length += (respIndex * sizeof(respArgs32));
+			respHdr->numArgs = respIndex;
+	    break;
 
-                // Unfortunately, due to the byte swapping that occurs in node_sendEarlyResp, we need to set all 
-                //   three command parameters for each packet that is sent.
-	            respHdr->cmd     = cmdHdr->cmd;
-	            respHdr->length  = 16 + transfer_size;
-				respHdr->numArgs = 4;
 
-				// Transfer data
-				num_bytes = event_log_get_data( curr_address, transfer_size, (char *) &respArgs32[4] );
+	    //---------------------------------------------------------------------
+		case NODE_LOG_GET_EVENTS_BY_ID:
+            // NODE_LOG_GET_EVENTS_BY_ID Packet Format:
+            //   - Note:  All u32 parameters in cmdArgs32 are byte swapped so use Xil_Ntohl()
+            //
+			//   - cmdArgs32[0] - buffer id
+			//   - cmdArgs32[1] - flags
+            //   - cmdArgs32[2] - event_id of the first event
+			//   - cmdArgs32[3] - number of events
+			//                      0xFFFF_FFFF  -> Every event from the first one on
+			//
+			//   Return Value:
+			//     - wn_buffer (same format as NODE_LOG_GET_EVENTS)
+			//
+			// NOTE:  If the first event has already been overwritten, the transfer starts at the
+			//   oldest event in the log; the event_id in each event header tells the host which
+			//   events it received.  When the events wrap around the end of the log, they are
+			//   sent as two runs of packets, each with its own start_byte.
+            //
 
-#ifdef _DEBUG_
-				xil_printf("Packet %8d: \n", i);
-				xil_printf("    transfer_address = 0x%8x\n    transfer_size    = %10d\n    num_bytes        = %10d\n", curr_address, transfer_size, num_bytes);
-#endif
+			id                = Xil_Ntohl(cmdArgs32[0]);
+			flags             = Xil_Ntohl(cmdArgs32[1]);
+			start_address     = Xil_Ntohl(cmdArgs32[2]);
+            size              = Xil_Ntohl(cmdArgs32[3]);
 
-				// Check that we copied everything
-				if ( num_bytes == transfer_size ) {
-					// Send the packet
-					node_sendEarlyResp(respHdr, pktSrc, eth_dev_num);
-				} else {
-					xil_printf("ERROR:  NODE_GET_EVENTS tried to get %d bytes, but only received %d @ 0x%x \n", transfer_size, num_bytes, curr_address );
-				}
+            bytes_per_pkt     = max_words * 4;
 
-				// Update our current address
-				curr_address = next_address;
+			temp = event_log_get_event_ranges( start_address, size, range_index, range_size );
+
+			if ( temp == 0 ) {
+				// Send a single empty buffer so the host is not left waiting
+				node_send_log_data( cmdHdr, respHdr, respArgs32, pktSrc, eth_dev_num, bytes_per_pkt, id, flags, 0, 0 );
+			}
+
+			for( i = 0; i < temp; i++ ) {
+				node_send_log_data( cmdHdr, respHdr, respArgs32, pktSrc, eth_dev_num, bytes_per_pkt, id, flags, range_index[i], range_size[i] );
 			}
 
 			respSent = RESP_SENT;
-		break;
+	    break;
+
+
+	    //---------------------------------------------------------------------
+		case NODE_LOG_STREAM_START:
+            // NODE_LOG_STREAM_START Packet Format:
+            //   - Note:  All u32 parameters in cmdArgs32 are byte swapped so use Xil_Ntohl()
+            //
+			//   - cmdArgs32[0] - buffer id
+			//   - cmdArgs32[1] - flags
+            //   - cmdArgs32[2] - event_id of the first event
+			//   - cmdArgs32[3] - number of events
+			//                      0xFFFF_FFFF  -> Every event from the first one on
+			//   - cmdArgs32[4] - window:  packets in flight (optional; 0 -> default)
+			//   - cmdArgs32[5] - packets sent per poll of the main loop (optional; 0 -> default)
+			//
+            //   - respArgs32[0] - 0           - Success
+			//                     0xFFFF_FFFF - Failure
+            //   - respArgs32[1] - number of packets in the stream
+            //   - respArgs32[2] - number of bytes in the stream
+            //   - respArgs32[3] - event_id of the first event in the stream
+			//
+			//   The packets are sent from the main loop with the NODE_LOG_STREAM_DATA command:
+			//     - buffer_id  - uint32  - ID of the buffer
+			//     - flags      - uint32  - Flags (NODE_LOG_STREAM_FLAG_OVERWRITTEN if the first
+			//                                events have been overwritten since the start)
+			//     - seq        - uint32  - Packet number
+			//     - num_pkts   - uint32  - Number of packets in the stream
+			//     - start_byte - uint32  - Byte index of the first byte in this packet
+			//     - size       - uint32  - Number of payload bytes in this packet
+			//     - byte[]     - uint8[] - Array of payload bytes
+			//
+			//   Starting a stream drops the one in progress, if any.
+            //
+
+			id                = Xil_Ntohl(cmdArgs32[0]);
+			flags             = Xil_Ntohl(cmdArgs32[1]);
+			start_address     = Xil_Ntohl(cmdArgs32[2]);
+            size              = Xil_Ntohl(cmdArgs32[3]);
+            interval          = ( cmdHdr->numArgs > 4 ) ? Xil_Ntohl(cmdArgs32[4]) : 0;
+            temp              = ( cmdHdr->numArgs > 5 ) ? Xil_Ntohl(cmdArgs32[5]) : 0;
+
+            // Leave room for the two extra words of the stream header
+            bytes_per_pkt     = ( max_words - 2 ) * 4;
+
+            status = node_log_stream_start( id, flags, start_address, size, bytes_per_pkt, interval, temp, pktSrc, eth_dev_num );
+
+            respArgs32[respIndex++] = Xil_Htonl( status );
+            respArgs32[respIndex++] = Xil_Htonl( log_stream.num_pkts );
+            respArgs32[respIndex++] = Xil_Htonl( log_stream.range_size[0] + log_stream.range_size[1] );
+            respArgs32[respIndex++] = Xil_Htonl( log_stream.first_event_id );
+
+			respHdr->length += (respIndex * sizeof(respArgs32));
+			respHdr->numArgs = respIndex;
+	    break;
+
+
+	    //---------------------------------------------------------------------
+		case NODE_LOG_STREAM_ACK:
+            // NODE_LOG_STREAM_ACK Packet Format:
+            //   - Note:  All u32 parameters in cmdArgs32 are byte swapped so use Xil_Ntohl()
+            //
+			//   - cmdArgs32[0] - buffer id
+			//   - cmdArgs32[1] - number of packets received in order (packets 0 to N - 1)
+			//   - cmdArgs32[2] - bitmap of the packets received after the first missing one
+			//                      bit i -> packet cmdArgs32[1] + 1 + i
+			//
+            //   - respArgs32[0] - number of packets not yet acknowledged
+			//                     0xFFFF_FFFF - No stream with this buffer id
+			//
+			//   A sent packet that is missing while a packet sent after it was acknowledged is
+			//   resent right away; only those packets are resent.
+            //
+
+			id                = Xil_Ntohl(cmdArgs32[0]);
+			start_address     = Xil_Ntohl(cmdArgs32[1]);
+            temp              = Xil_Ntohl(cmdArgs32[2]);
+
+            status = node_log_stream_ack( id, start_address, temp );
+
+            respArgs32[respIndex++] = Xil_Htonl( status );
+
+			respHdr->length += (respIndex * sizeof(respArgs32));
+			respHdr->numArgs = respIndex;
+	    break;
+
+
+	    //---------------------------------------------------------------------
+		case NODE_LOG_STREAM_STOP:
+			xil_printf("EVENT LOG:  Stop stream\n");
+
+			node_log_stream_stop();
+	    break;
 
 
 		//---------------------------------------------------------------------
@@ -863,6 +1021,468 @@ int node_processCmd(const wn_cmdHdr* cmdHdr,const void* cmdArgs, wn_respHdr* res
 
 
 
+/*****************************************************************************/
+/**
+* Send event log data
+*
+* Sends 'size' bytes of the event log starting at 'start_address' as a series
+* of early responses, each a wn_buffer of at most bytes_per_pkt bytes.
+*
+* @param    Command Header         - WARPNet Command Header
+*           Response Header        - WARPNet Response Header
+*           Response Arguments     - WARPNet Response Arguments (u32 words)
+*           Packet Source          - Ethernet Packet Source
+*           Ethernet Device Number - Indicates which Ethernet device packet came from
+*           bytes_per_pkt          - Maximum number of payload bytes per packet
+*           id, flags              - wn_buffer buffer id and flags
+*           start_address          - Index in the event log of the first byte
+*           size                   - Number of bytes to send
+*
+* @return	None.
+*
+* @note		None.
+*
+******************************************************************************/
+void node_send_log_data(const wn_cmdHdr* cmdHdr, wn_respHdr* respHdr, u32 * respArgs32, void* pktSrc, unsigned int eth_dev_num,
+                        u32 bytes_per_pkt, u32 id, u32 flags, u32 start_address, u32 size){
+
+	u32           i;
+	u32           curr_address;
+	u32           next_address;
+	u32           transfer_size;
+	u32           num_bytes;
+	u32           num_pkts;
+
+    num_pkts          = size / bytes_per_pkt + 1;
+    curr_address      = start_address;
+
+#ifdef _DEBUG_
+	xil_printf("    start_address    = 0x%8x\n    size             = %10d\n    num_pkts         = %10d\n", start_address, size, num_pkts);
+#endif
+
+    // Initialize constant parameters
+    respArgs32[0] = Xil_Htonl( id );
+    respArgs32[1] = Xil_Htonl( flags );
+
+    // Iterate through all the packets
+	for( i = 0; i < num_pkts; i++ ) {
+
+		// Get the next address
+		next_address  = curr_address + bytes_per_pkt;
+
+		// Compute the transfer size (use the full buffer unless you run out of space)
+		if( next_address > ( start_address + size ) ) {
+            transfer_size = (start_address + size) - curr_address;
+
+		} else {
+			transfer_size = bytes_per_pkt;
+		}
+
+		// Set response args that change per packet
+        respArgs32[2]   = Xil_Htonl( curr_address );
+        respArgs32[3]   = Xil_Htonl( transfer_size );
+
+        // Unfortunately, due to the byte swapping that occurs in node_sendEarlyResp, we need to set all 
+        //   three command parameters for each packet that is sent.
+        respHdr->cmd     = cmdHdr->cmd;
+        respHdr->length  = 16 + transfer_size;
+		respHdr->numArgs = 4;
+
+		// Transfer data
+		num_bytes = event_log_get_data( curr_address, transfer_size, (char *) &respArgs32[4] );
+
+#ifdef _DEBUG_
+		xil_printf("Packet %8d: \n", i);
+		xil_printf("    transfer_address = 0x%8x\n    transfer_size    = %10d\n    num_bytes        = %10d\n", curr_address, transfer_size, num_bytes);
+#endif
+
+		// Check that we copied everything
+		if ( num_bytes == transfer_size ) {
+			// Send the packet
+			node_sendEarlyResp(respHdr, pktSrc, eth_dev_num);
+		} else {
+			xil_printf("ERROR:  NODE_GET_EVENTS tried to get %d bytes, but only received %d @ 0x%x \n", transfer_size, num_bytes, curr_address );
+		}
+
+		// Update our current address
+		curr_address = next_address;
+	}
+}
+
+
+
+/*****************************************************************************/
+/**
+* Start an event log stream
+*
+* Takes a snapshot of the log ranges holding the requested events and resets
+* the window.  The packets themselves are sent by node_log_stream_poll().
+*
+* @param    id, flags              - Buffer id and flags copied into each packet
+*           first_event_id         - event_id of the first event
+*           num_events             - Number of events (0xFFFF_FFFF -> every event from the first one on)
+*           bytes_per_pkt          - Maximum number of payload bytes per packet
+*           window                 - Packets in flight (0 -> NODE_LOG_STREAM_DEFAULT_WINDOW)
+*           budget                 - Packets sent per poll (0 -> NODE_LOG_STREAM_DEFAULT_BUDGET)
+*           Packet Source          - Ethernet Packet Source
+*           Ethernet Device Number - Indicates which Ethernet device packet came from
+*
+* @return	 0          - Success
+*           0xFFFFFFFF - Failure
+*
+* @note		As with NODE_LOG_GET_EVENTS, events that are overwritten while the
+*           stream is in progress are sent as they are in the log at the time
+*           the packet is sent.
+*
+******************************************************************************/
+u32 node_log_stream_start(u32 id, u32 flags, u32 first_event_id, u32 num_events, u32 bytes_per_pkt, u32 window, u32 budget,
+                          void* pktSrc, unsigned int eth_dev_num){
+	u32 i;
+	u32 num_ranges;
+	u32 oldest_event_id;
+
+	node_log_stream_stop();
+
+	if ( window == 0 ) {
+		window = NODE_LOG_STREAM_DEFAULT_WINDOW;
+	} else if ( window > NODE_LOG_STREAM_MAX_WINDOW ) {
+		window = NODE_LOG_STREAM_MAX_WINDOW;
+	}
+
+	if ( budget == 0 ) {
+		budget = NODE_LOG_STREAM_DEFAULT_BUDGET;
+	}
+
+	// The ranges start at the oldest event if the first one is already gone
+	oldest_event_id = event_log_get_oldest_event_id();
+
+	num_ranges = event_log_get_event_ranges( first_event_id, num_events, log_stream.range_index, log_stream.range_size );
+
+	log_stream.id             = id;
+	log_stream.flags          = flags;
+	log_stream.first_event_id = ( first_event_id < oldest_event_id ) ? oldest_event_id : first_event_id;
+	log_stream.bytes_per_pkt  = bytes_per_pkt;
+	log_stream.window         = window;
+	log_stream.budget         = budget;
+	log_stream.num_pkts       = 0;
+
+	for( i = 0; i < 2; i++ ) {
+		if ( i >= num_ranges ) {
+			log_stream.range_index[i] = 0;
+			log_stream.range_size[i]  = 0;
+		}
+
+		log_stream.range_pkts[i]  = ( log_stream.range_size[i] + bytes_per_pkt - 1 ) / bytes_per_pkt;
+		log_stream.num_pkts      += log_stream.range_pkts[i];
+	}
+
+	memcpy( &log_stream.pktSrc, pktSrc, sizeof(pktSrcInfo) );
+	log_stream.eth_dev_num    = eth_dev_num;
+
+	if ( log_stream.num_pkts == 0 ) {
+		return 0;
+	}
+
+	xil_printf("EVENT LOG:  Stream %d - %d bytes in %d packets from event %d\n", id,
+	           log_stream.range_size[0] + log_stream.range_size[1], log_stream.num_pkts, log_stream.first_event_id);
+
+	log_stream.state          = NODE_LOG_STREAM_ACTIVE;
+	log_stream.last_progress  = get_usec_timestamp();
+
+	return 0;
+}
+
+
+
+/*****************************************************************************/
+/**
+* Acknowledge event log stream packets
+*
+* Retires the packets the host has received in order, records the ones it
+* received after a gap and marks for resend every outstanding packet that
+* was sent before a packet the host has now seen.
+*
+* @param    id                     - Buffer id of the stream
+*           ack                    - Number of packets received in order
+*           bitmap                 - Bit i set if packet (ack + 1 + i) was received
+*
+* @return	Number of packets not yet acknowledged; 0xFFFFFFFF if there is
+*           no stream with this buffer id
+*
+* @note		None.
+*
+******************************************************************************/
+u32 node_log_stream_ack(u32 id, u32 ack, u32 bitmap){
+	u32 i;
+	u32 seq;
+	u32 slot;
+	u32 progress = 0;
+
+	if ( ( log_stream.state == NODE_LOG_STREAM_IDLE ) || ( log_stream.id != id ) ) {
+		return 0xFFFFFFFF;
+	}
+
+	// Ignore acknowledgements for packets that were never sent
+	if ( ack > log_stream.next ) {
+		ack = log_stream.next;
+	}
+
+	// Retire the packets received in order
+	while ( log_stream.base < ack ) {
+		slot = log_stream.base % NODE_LOG_STREAM_MAX_WINDOW;
+
+		if ( log_stream.pkt_state[slot] != NODE_LOG_STREAM_PKT_ACKED ) {
+			if ( log_stream.pkt_tx[slot] > log_stream.acked_tx ) {
+				log_stream.acked_tx = log_stream.pkt_tx[slot];
+			}
+		}
+
+		log_stream.pkt_state[slot] = NODE_LOG_STREAM_PKT_FREE;
+		log_stream.base++;
+		progress = 1;
+	}
+
+	// Record the packets received after the first missing one
+	for( i = 0; i < 32; i++ ) {
+		seq = ack + 1 + i;
+
+		if ( seq >= log_stream.next ) {
+			break;
+		}
+
+		slot = seq % NODE_LOG_STREAM_MAX_WINDOW;
+
+		if ( ( seq >= log_stream.base ) && ( bitmap & ( 1 << i ) ) && ( log_stream.pkt_state[slot] != NODE_LOG_STREAM_PKT_ACKED ) ) {
+			if ( log_stream.pkt_tx[slot] > log_stream.acked_tx ) {
+				log_stream.acked_tx = log_stream.pkt_tx[slot];
+			}
+
+			log_stream.pkt_state[slot] = NODE_LOG_STREAM_PKT_ACKED;
+			progress = 1;
+		}
+	}
+
+	if ( log_stream.base == log_stream.num_pkts ) {
+		xil_printf("EVENT LOG:  Stream %d done - %d packets, %d resent\n", id, log_stream.num_pkts, log_stream.num_resent);
+
+		log_stream.state = NODE_LOG_STREAM_IDLE;
+		return 0;
+	}
+
+	if ( progress ) {
+		log_stream.last_progress = get_usec_timestamp();
+		log_stream.num_timeouts  = 0;
+	}
+
+	// A packet sent before one the host has seen is lost
+	for( seq = log_stream.base; seq < log_stream.next; seq++ ) {
+		slot = seq % NODE_LOG_STREAM_MAX_WINDOW;
+
+		if ( ( log_stream.pkt_state[slot] == NODE_LOG_STREAM_PKT_SENT ) && ( log_stream.pkt_tx[slot] < log_stream.acked_tx ) ) {
+			log_stream.pkt_state[slot] = NODE_LOG_STREAM_PKT_LOST;
+		}
+	}
+
+	return log_stream.num_pkts - log_stream.base;
+}
+
+
+
+/*****************************************************************************/
+/**
+* Stop the event log stream
+*
+* @param    None.
+*
+* @return	None.
+*
+* @note		None.
+*
+******************************************************************************/
+void node_log_stream_stop(){
+	u32 i;
+
+	log_stream.state      = NODE_LOG_STREAM_IDLE;
+	log_stream.base       = 0;
+	log_stream.next       = 0;
+	log_stream.tx_count   = 0;
+	log_stream.acked_tx   = 0;
+	log_stream.num_tx     = 0;
+	log_stream.num_resent = 0;
+	log_stream.num_timeouts = 0;
+
+	for( i = 0; i < NODE_LOG_STREAM_MAX_WINDOW; i++ ) {
+		log_stream.pkt_state[i] = NODE_LOG_STREAM_PKT_FREE;
+		log_stream.pkt_tx[i]    = 0;
+	}
+}
+
+
+
+/*****************************************************************************/
+/**
+* Send one event log stream packet
+*
+* @param    seq                    - Packet number
+*
+* @return	 0 - Success
+*           -1 - Failure (the log data could not be read)
+*
+* @note		None.
+*
+******************************************************************************/
+int node_log_stream_send(u32 seq){
+	u32           range;
+	u32           offset;
+	u32           address;
+	u32           transfer_size;
+	u32           num_bytes;
+	u32           flags;
+	u32           slot;
+	wn_respHdr  * respHdr;
+	u32         * respArgs32;
+
+	if ( seq < log_stream.range_pkts[0] ) {
+		range  = 0;
+		offset = seq * log_stream.bytes_per_pkt;
+	} else {
+		range  = 1;
+		offset = ( seq - log_stream.range_pkts[0] ) * log_stream.bytes_per_pkt;
+	}
+
+	address       = log_stream.range_index[range] + offset;
+	transfer_size = log_stream.range_size[range] - offset;
+
+	if ( transfer_size > log_stream.bytes_per_pkt ) {
+		transfer_size = log_stream.bytes_per_pkt;
+	}
+
+	flags = log_stream.flags;
+
+	if ( event_log_get_oldest_event_id() > log_stream.first_event_id ) {
+		flags |= NODE_LOG_STREAM_FLAG_OVERWRITTEN;
+	}
+
+	respHdr    = transport_get_async_resp( log_stream.eth_dev_num );
+	respArgs32 = (u32 *)((void *)respHdr + sizeof(wn_respHdr));
+
+	num_bytes  = event_log_get_data( address, transfer_size, (char *) &respArgs32[6] );
+
+	if ( num_bytes != transfer_size ) {
+		xil_printf("ERROR:  NODE_LOG_STREAM tried to get %d bytes, but only received %d @ 0x%x \n", transfer_size, num_bytes, address );
+		return -1;
+	}
+
+	respArgs32[0]    = Xil_Htonl( log_stream.id );
+	respArgs32[1]    = Xil_Htonl( flags );
+	respArgs32[2]    = Xil_Htonl( seq );
+	respArgs32[3]    = Xil_Htonl( log_stream.num_pkts );
+	respArgs32[4]    = Xil_Htonl( address );
+	respArgs32[5]    = Xil_Htonl( transfer_size );
+
+	respHdr->cmd     = ( NODE_GRP << 24 ) | NODE_LOG_STREAM_DATA;
+	respHdr->length  = 24 + transfer_size;
+	respHdr->numArgs = 6;
+
+	node_sendEarlyResp( respHdr, &log_stream.pktSrc, log_stream.eth_dev_num );
+
+	slot = seq % NODE_LOG_STREAM_MAX_WINDOW;
+
+	log_stream.pkt_state[slot] = NODE_LOG_STREAM_PKT_SENT;
+	log_stream.pkt_tx[slot]    = ++log_stream.tx_count;
+	log_stream.num_tx++;
+
+	return 0;
+}
+
+
+
+/*****************************************************************************/
+/**
+* Event log stream poll
+*
+* Called from the main loop.  Sends at most 'budget' packets of the event
+* log stream: first the packets the host is missing, oldest first, then new
+* packets while the window has room.  If nothing is acknowledged for
+* NODE_LOG_STREAM_TIMEOUT usec, every outstanding packet is resent.
+*
+* @param    None.
+*
+* @return	None.
+*
+* @note		Like the rest of the transport, this must not run while an interrupt
+*           context can send on the same Ethernet device.
+*
+******************************************************************************/
+void node_log_stream_poll(){
+	u32 seq;
+	u32 slot;
+	u32 sent;
+	u64 timestamp;
+
+	if ( log_stream.state == NODE_LOG_STREAM_IDLE ) {
+		return;
+	}
+
+	timestamp = get_usec_timestamp();
+
+	if ( ( log_stream.next != log_stream.base ) && ( ( timestamp - log_stream.last_progress ) > NODE_LOG_STREAM_TIMEOUT ) ) {
+
+		if ( ++log_stream.num_timeouts > NODE_LOG_STREAM_MAX_TIMEOUTS ) {
+			xil_printf("EVENT LOG:  Stream %d dropped at packet %d of %d\n", log_stream.id, log_stream.base, log_stream.num_pkts);
+			node_log_stream_stop();
+			return;
+		}
+
+		for( seq = log_stream.base; seq < log_stream.next; seq++ ) {
+			slot = seq % NODE_LOG_STREAM_MAX_WINDOW;
+
+			if ( log_stream.pkt_state[slot] == NODE_LOG_STREAM_PKT_SENT ) {
+				log_stream.pkt_state[slot] = NODE_LOG_STREAM_PKT_LOST;
+			}
+		}
+
+		log_stream.last_progress = timestamp;
+	}
+
+	sent = 0;
+
+	// Fill the gaps first
+	for( seq = log_stream.base; ( seq < log_stream.next ) && ( sent < log_stream.budget ); seq++ ) {
+		slot = seq % NODE_LOG_STREAM_MAX_WINDOW;
+
+		if ( log_stream.pkt_state[slot] == NODE_LOG_STREAM_PKT_LOST ) {
+			if ( node_log_stream_send( seq ) != 0 ) {
+				node_log_stream_stop();
+				return;
+			}
+
+			log_stream.num_resent++;
+			sent++;
+		}
+	}
+
+	// Then new packets while the window has room
+	while( ( sent < log_stream.budget ) && ( log_stream.next < log_stream.num_pkts ) &&
+	       ( ( log_stream.next - log_stream.base ) < log_stream.window ) ) {
+
+		// Nothing was outstanding, so the timeout starts now
+		if ( log_stream.next == log_stream.base ) {
+			log_stream.last_progress = timestamp;
+		}
+
+		if ( node_log_stream_send( log_stream.next ) != 0 ) {
+			node_log_stream_stop();
+			return;
+		}
+
+		log_stream.next++;
+		sent++;
+	}
+}
+
+
+
 /*****************************************************************************/
 /**
 * This will initialize the WARPNet WLAN_EXP node with the appropriate information
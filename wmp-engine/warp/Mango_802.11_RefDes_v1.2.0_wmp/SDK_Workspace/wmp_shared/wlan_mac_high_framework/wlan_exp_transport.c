@@ -94,6 +94,7 @@ u8                  node_group_ID_membership;
 //   - Asynchronous transmit buffer - Used to transmit messages asynchronously back to a node and
 //                                      not interfere with normal transport function.
 //
+unsigned int        async_sendbuf[(WN_ASYNC_BUFFER_NBYTES + 3) / 4];
 
 
 
@@ -742,6 +743,34 @@ void transport_send(wn_host_message* currMsg, pktSrcInfo* pktSrc, unsigned int e
 
 
 
+/*****************************************************************************/
+/**
+*
+* This function returns the response header of the asynchronous transmit buffer
+*
+*
+* @param    eth_dev_num is an int that specifies the Ethernet interface to use
+*
+* @return	Pointer to the response header; the response arguments follow it
+*
+* @note		The transport header is copied from the one the last host command was
+*       answered with, so packets built in the buffer go to that host.  The buffer
+*       has the same layout as the Ethernet send buffer, so a response built in it
+*       can be sent with node_sendEarlyResp() while no command is being processed.
+*
+******************************************************************************/
+
+wn_respHdr* transport_get_async_resp(unsigned int eth_dev_num){
+
+	unsigned char * buffer = (unsigned char *)async_sendbuf;
+
+	memcpy(buffer + PAYLOAD_OFFSET, wn_eth_devices[eth_dev_num].wn_header_tx, sizeof(wn_transport_header));
+
+	return (wn_respHdr *)(buffer + PAYLOAD_OFFSET + sizeof(wn_transport_header));
+}
+
+
+
 /*****************************************************************************/
 /**
 *
@@ -12,6 +12,7 @@
 #include "xaxidma.h"
 #include "xparameters.h"
 #include "xintc.h"
+#include "mb_interface.h"
 #include "wlan_mac_ipc_util.h"
 #include "wlan_mac_misc_util.h"
 #include "wlan_mac_802_11_defs.h"
@@ -41,6 +42,14 @@ u32 ETH_A_NUM_RX_BD;
 #define RX_INTR_ID		XPAR_INTC_0_AXIDMA_0_S2MM_INTROUT_VEC_ID
 #define TX_INTR_ID		XPAR_INTC_0_AXIDMA_0_MM2S_INTROUT_VEC_ID
 
+static eth_tx_stats tx_stats;
+static eth_rx_stats rx_stats;
+
+//Set while a poll for the frames left over by an exhausted budget is on the fine scheduler
+static u8 rx_poll_scheduled;
+
+//The Tx ring is touched both by senders and by TxIntrHandler; senders hold off interrupts with
+// wlan_mac_irq_lock() while they own it
 
 //The station code's implementation of encapsulation and de-encapsulation has an important
 //limitation: only one device may be plugged into the station's Ethernet port. The station
@@ -101,7 +110,16 @@ int wlan_eth_setup_interrupt(XIntc* intc){
 
 	XIntc_Enable(Intc_ptr, RX_INTR_ID);
 
+#if ETH_A_TX_INTR
+	Status = XIntc_Connect(Intc_ptr, TX_INTR_ID,(XInterruptHandler) TxIntrHandler, XAxiDma_GetTxRing(&ETH_A_DMA_Instance));
+	if (Status != XST_SUCCESS) {
+
+		xil_printf("Failed tx connect intc\r\n");
+		return XST_FAILURE;
+	}
 
+	XIntc_Enable(Intc_ptr, TX_INTR_ID);
+#endif
 
 	return 0;
 }
@@ -123,6 +141,30 @@ void RxIntrHandler(void *Callback){
 
 	return;
 }
+
+void TxIntrHandler(void *Callback){
+	XAxiDma_BdRing *TxRingPtr = (XAxiDma_BdRing *) Callback;
+	u32 IrqStatus;
+
+	XIntc_Stop(Intc_ptr);
+
+	IrqStatus = XAxiDma_BdRingGetIrq(TxRingPtr);
+	XAxiDma_BdRingAckIrq(TxRingPtr, IrqStatus);
+
+	if ((IrqStatus & XAXIDMA_IRQ_ERROR_MASK)) {
+		xil_printf("Error: Eth Tx DMA reported an error (irq status 0x%08x)\n", IrqStatus);
+		tx_stats.num_errors++;
+	}
+
+	if ((IrqStatus & (XAXIDMA_IRQ_DELAY_MASK | XAXIDMA_IRQ_IOC_MASK))) {
+		wlan_eth_tx_poll();
+	}
+
+	XIntc_Start(Intc_ptr, XIN_REAL_MODE);
+
+	return;
+}
+
 int wlan_eth_dma_init() {
 	int status;
 	int bd_count;
@@ -156,9 +198,9 @@ int wlan_eth_dma_init() {
 	XAxiDma_BdRingIntDisable(ETH_A_TxRing_ptr, XAXIDMA_IRQ_ALL_MASK);
 	XAxiDma_BdRingIntDisable(ETH_A_RxRing_ptr, XAXIDMA_IRQ_ALL_MASK);
 
-	//Disable delays and coalescing (for now - these will be useful when we transition to interrupts)
+	//Tx completions are reaped one interrupt per frame; Rx interrupts are coalesced by count and delay timer
 	XAxiDma_BdRingSetCoalesce(ETH_A_TxRing_ptr, 1, 0);
-	XAxiDma_BdRingSetCoalesce(ETH_A_RxRing_ptr, 1, 0);
+	XAxiDma_BdRingSetCoalesce(ETH_A_RxRing_ptr, ETH_A_RX_COALESCE_COUNT, ETH_A_RX_COALESCE_DELAY);
 
 	//Setup Tx/Rx buffer descriptor rings in memory
 	status =  XAxiDma_BdRingCreate(ETH_A_TxRing_ptr, ETH_A_TX_BD_SPACE_BASE, ETH_A_TX_BD_SPACE_BASE, XAXIDMA_BD_MINIMUM_ALIGNMENT, ETH_A_NUM_TX_BD);
@@ -170,6 +212,14 @@ int wlan_eth_dma_init() {
 	status |= XAxiDma_BdRingClone(ETH_A_RxRing_ptr, &ETH_DMA_BD_Template);
 	if(status != XST_SUCCESS) {xil_printf("Error in XAxiDma_BdRingClone()! Err = %d\n", status); return -1;}
 
+	bzero(&tx_stats, sizeof(eth_tx_stats));
+	bzero(&rx_stats, sizeof(eth_rx_stats));
+	rx_poll_scheduled = 0;
+
+#if ETH_A_TX_INTR
+	XAxiDma_BdRingIntEnable(ETH_A_TxRing_ptr, XAXIDMA_IRQ_ALL_MASK);
+#endif
+
 	//Start the DMA Tx channel
 	// No Eth packets are transmitted until actual Tx BD's are pushed to the DMA hardware
 	status = XAxiDma_BdRingStart(ETH_A_TxRing_ptr);
@@ -400,38 +450,172 @@ int wlan_mpdu_eth_send(void* mpdu, u16 length){
 
 int wlan_eth_dma_send(u8* pkt_ptr, u32 length) {
 	int status;
+	u32 msr;
 	XAxiDma_BdRing *txRing_ptr;
 	XAxiDma_Bd *cur_bd_ptr;
+	packet_bd_list checkout;
+	packet_bd* tx_queue;
+	u8* buf_ptr;
+
+	txRing_ptr = XAxiDma_GetTxRing(&ETH_A_DMA_Instance);
+
+	msr = wlan_mac_irq_lock();
+
+	//Reap whatever has completed since the last send, then wait for a free Tx BD if the ring is full
+	wlan_eth_tx_poll();
+	if(XAxiDma_BdRingGetFreeCnt(txRing_ptr) == 0){
+		tx_stats.num_ring_stalls++;
+		while(wlan_eth_tx_poll() == 0) {/*Do Nothing*/}
+	}
+
+	//The caller's buffer (an Rx packet buffer or a wmp response) is reused as soon as we
+	// return, so the frame is copied into a packet_bd that stays with the Tx BD until completion.
+	// Without one, the frame is sent from the caller's buffer and we wait for it as before
+	tx_queue = NULL;
+	buf_ptr = pkt_ptr;
+	if(length <= PQUEUE_MAX_FRAME_SIZE){
+		queue_checkout(&checkout, 1);
+		if(checkout.length == 1){
+			tx_queue = checkout.first;
+			buf_ptr = (u8*)(tx_queue->buf_ptr);
+			memcpy(buf_ptr, pkt_ptr, length);
+		}
+	}
 
 	//Flush the data cache of the pkt buffer
 	// Comment this back in if the dcache is enabled
-	//Xil_DCacheFlushRange((u32)TxPacket, MAX_PKT_LEN);
-
-	txRing_ptr = XAxiDma_GetTxRing(&ETH_A_DMA_Instance);
+	//Xil_DCacheFlushRange((u32)buf_ptr, length);
 
 	status = XAxiDma_BdRingAlloc(txRing_ptr, 1, &cur_bd_ptr);
-	status |= XAxiDma_BdSetBufAddr(cur_bd_ptr, (u32)pkt_ptr);
+	status |= XAxiDma_BdSetBufAddr(cur_bd_ptr, (u32)buf_ptr);
 	status |= XAxiDma_BdSetLength(cur_bd_ptr, length, txRing_ptr->MaxTransferLen);
-	if(status != XST_SUCCESS) {xil_printf("Error in setting ETH Tx BD! Err = %d\n", status); return -1;}
+	if(status != XST_SUCCESS) {
+		xil_printf("Error in setting ETH Tx BD! Err = %d\n", status);
+		tx_stats.num_errors++;
+		if(tx_queue != NULL) queue_checkin(&checkout);
+		wlan_mac_irq_unlock(msr);
+		return -1;
+	}
 
 	//When using 1 BD for 1 pkt set both SOF and EOF
 	XAxiDma_BdSetCtrl(cur_bd_ptr, (XAXIDMA_BD_CTRL_TXSOF_MASK | XAXIDMA_BD_CTRL_TXEOF_MASK) );
 
-	//Set arbitrary ID
-	XAxiDma_BdSetId(cur_bd_ptr, (u32)pkt_ptr);
+	//BD ID is the packet_bd to check back in on completion, NULL for a synchronous send
+	XAxiDma_BdSetId(cur_bd_ptr, (u32)tx_queue);
 
 	//Push the BD ring to hardware; this initiates the actual DMA transfer and Ethernet Tx
 	status = XAxiDma_BdRingToHw(txRing_ptr, 1, cur_bd_ptr);
-	if(status != XST_SUCCESS) {xil_printf("Error in XAxiDma_BdRingToHw(txRing_ptr)! Err = %d\n", status); return -1;}
+	if(status != XST_SUCCESS) {
+		xil_printf("Error in XAxiDma_BdRingToHw(txRing_ptr)! Err = %d\n", status);
+		tx_stats.num_errors++;
+		if(tx_queue != NULL) queue_checkin(&checkout);
+		wlan_mac_irq_unlock(msr);
+		return -1;
+	}
+
+	tx_stats.num_sent++;
+	tx_stats.num_in_flight++;
+	if(tx_stats.num_in_flight > tx_stats.max_in_flight){
+		tx_stats.max_in_flight = tx_stats.num_in_flight;
+	}
+
+	if(tx_queue == NULL){
+		//BDs complete in order, so ours is done once the ring is empty
+		tx_stats.num_sync++;
+		while(tx_stats.num_in_flight > 0){
+			wlan_eth_tx_poll();
+		}
+	}
 
-	//Wait for this DMA transfer to finish (will be replaced by post-Tx ISR)
-	while (XAxiDma_BdRingFromHw(txRing_ptr, 1, &cur_bd_ptr) == 0) {/*Do Nothing*/}
-	status = XAxiDma_BdRingFree(txRing_ptr, 1, cur_bd_ptr);
-	if(status != XST_SUCCESS) {xil_printf("Error in XAxiDma_BdRingFree(txRing_ptr, 1)! Err = %d\n", status); return -1;}
+	wlan_mac_irq_unlock(msr);
 
 	return 0;
 }
 
+int wlan_eth_tx_poll() {
+	//Reaps every completed Tx BD and checks the packet_bds they held back into the free queue.
+	// Returns the number of BDs reaped
+	int status;
+	int bd_count;
+	int i;
+	u32 msr;
+	XAxiDma_BdRing *txRing_ptr;
+	XAxiDma_Bd *first_bd_ptr;
+	XAxiDma_Bd *cur_bd_ptr;
+	packet_bd_list checkin;
+	packet_bd* tx_queue;
+
+	txRing_ptr = XAxiDma_GetTxRing(&ETH_A_DMA_Instance);
+
+	msr = wlan_mac_irq_lock();
+
+	bd_count = XAxiDma_BdRingFromHw(txRing_ptr, XAXIDMA_ALL_BDS, &first_bd_ptr);
+	if(bd_count == 0){
+		wlan_mac_irq_unlock(msr);
+		return 0;
+	}
+
+	packet_bd_list_init(&checkin);
+
+	cur_bd_ptr = first_bd_ptr;
+	for(i = 0; i < bd_count; i++){
+		tx_queue = (packet_bd*)XAxiDma_BdGetId(cur_bd_ptr);
+		if(tx_queue != NULL){
+			packet_bd_insertEnd(&checkin, tx_queue);
+		}
+		if(XAxiDma_BdGetSts(cur_bd_ptr) & XAXIDMA_BD_STS_ALL_ERR_MASK){
+			tx_stats.num_errors++;
+		}
+		cur_bd_ptr = XAxiDma_BdRingNext(txRing_ptr, cur_bd_ptr);
+	}
+
+	status = XAxiDma_BdRingFree(txRing_ptr, bd_count, first_bd_ptr);
+	if(status != XST_SUCCESS) {xil_printf("Error in XAxiDma_BdRingFree(txRing_ptr, %d)! Err = %d\n", bd_count, status);}
+
+	tx_stats.num_completed += bd_count;
+	tx_stats.num_in_flight -= bd_count;
+
+	if(checkin.length > 0){
+		queue_checkin(&checkin);
+		//Hand the returned packet_bds to the Rx ring if it is short of buffers
+		wlan_eth_dma_update();
+	}
+
+	wlan_mac_irq_unlock(msr);
+
+	return bd_count;
+}
+
+void wlan_eth_rx_get_stats(eth_rx_stats* stats){
+	memcpy(stats, &rx_stats, sizeof(eth_rx_stats));
+}
+
+void wlan_eth_rx_reset_stats(){
+	bzero(&rx_stats, sizeof(eth_rx_stats));
+}
+
+void wlan_eth_tx_get_stats(eth_tx_stats* stats){
+	u32 msr;
+
+	msr = wlan_mac_irq_lock();
+	memcpy(stats, &tx_stats, sizeof(eth_tx_stats));
+	wlan_mac_irq_unlock(msr);
+}
+
+void wlan_eth_tx_reset_stats(){
+	u32 msr;
+
+	msr = wlan_mac_irq_lock();
+	//Occupancy is the state of the ring, not a counter
+	tx_stats.num_sent = 0;
+	tx_stats.num_completed = 0;
+	tx_stats.max_in_flight = tx_stats.num_in_flight;
+	tx_stats.num_ring_stalls = 0;
+	tx_stats.num_sync = 0;
+	tx_stats.num_errors = 0;
+	wlan_mac_irq_unlock(msr);
+}
+
 void wlan_poll_eth() {
 	XAxiDma_BdRing *rxRing_ptr;
 	XAxiDma_Bd *cur_bd_ptr;
@@ -460,26 +644,34 @@ void wlan_poll_eth() {
 	u8 eth_dest[6];
 	u8 eth_src[6];
 
-	static u32 max_bd_count = 0;
+	XAxiDma_Bd *batch_bd_ptr;
+	int batch_count;
 
 	rxRing_ptr = XAxiDma_GetRxRing(&ETH_A_DMA_Instance);
 
-	//Check if any Rx BDs have been executed
-	//TODO: process XAXIDMA_ALL_BDS instead of 1 at a time
-	//bd_count = XAxiDma_BdRingFromHw(rxRing_ptr, 1, &cur_bd_ptr);
-	bd_count = XAxiDma_BdRingFromHw(rxRing_ptr, XAXIDMA_ALL_BDS, &first_bd_ptr);
-	cur_bd_ptr = first_bd_ptr;
-
-	if(bd_count > max_bd_count){
-		max_bd_count = bd_count;
-		//xil_printf("max_bd_count = %d\n",max_bd_count);
+	//An idle Rx channel has no armed BD left: the MAC drops what arrives until we re-arm some
+	if(!XAxiDma_BdRingBusy(rxRing_ptr)){
+		rx_stats.num_ring_full++;
 	}
 
+	//Check if any Rx BDs have been executed, taking no more than the budget of this poll
+	bd_count = XAxiDma_BdRingFromHw(rxRing_ptr, ETH_A_RX_BUDGET, &first_bd_ptr);
+	cur_bd_ptr = first_bd_ptr;
+
 	if(bd_count == 0) {
 		//No Rx BDs have been processed - no new Eth receptions waiting
 		return;
 	}
 
+	rx_stats.num_polls++;
+	rx_stats.num_frames += bd_count;
+	if(bd_count > rx_stats.max_frames_per_poll){
+		rx_stats.max_frames_per_poll = bd_count;
+	}
+
+	batch_bd_ptr = first_bd_ptr;
+	batch_count = 0;
+
 	for(i=0;i<bd_count;i++){
 
 		//A packet has been received and transferred by DMA
@@ -532,7 +724,7 @@ void wlan_poll_eth() {
 
 					/* WMP_START */
 					case WMP4WARP_ETHER_TYPE:
-						wmp_high_util_handle_wmp_cmd_from_ethernet(eth_hdr);
+						wmp_high_util_handle_wmp_cmd_from_ethernet(eth_hdr, eth_rx_len);
 					break;
 					/* WMP_END */
 					default:
@@ -619,7 +811,7 @@ void wlan_poll_eth() {
 
 					/* WMP_START */
 					case WMP4WARP_ETHER_TYPE:{
-						wmp_high_util_handle_wmp_cmd_from_ethernet(eth_hdr);
+						wmp_high_util_handle_wmp_cmd_from_ethernet(eth_hdr, eth_rx_len);
 					break;}
 					/* WMP_END */
 					default:
@@ -634,29 +826,44 @@ void wlan_poll_eth() {
 		if(packet_is_queued == 0){
 			//xil_printf("   ...checking in\n");
 			queue_checkin(&tx_queue_list);
+			rx_stats.num_not_queued++;
 		}
 
-		//TODO: Option A: We free this single BD and run the routine to checkout as many queues as we can and hook them up to BDs
-		//Results: pretty good TCP performance
-		//Free this bd
-		status = XAxiDma_BdRingFree(rxRing_ptr, 1, cur_bd_ptr);
-		if(status != XST_SUCCESS) {xil_printf("Error in XAxiDma_BdRingFree of Rx BD! Err = %d\n", status); return;}
-		wlan_eth_dma_update();
-
 		//Update cur_bd_ptr to the next BD in the chain for the next iteration
 		cur_bd_ptr = XAxiDma_BdRingNext(rxRing_ptr, cur_bd_ptr);
 
+		//Free the BDs handled so far and re-arm as many as we have packet_bds for. Refilling only once every
+		// received BD had been handled left the ring empty during bursts and hurt TCP
+		batch_count++;
+		if(batch_count == ETH_A_RX_REFILL_BATCH || i == (bd_count - 1)){
+			status = XAxiDma_BdRingFree(rxRing_ptr, batch_count, batch_bd_ptr);
+			if(status != XST_SUCCESS) {xil_printf("Error in XAxiDma_BdRingFree of Rx BD! Err = %d\n", status); return;}
+			wlan_eth_dma_update();
+
+			batch_bd_ptr = cur_bd_ptr;
+			batch_count = 0;
+		}
+	}
+
+	if(bd_count == ETH_A_RX_BUDGET){
+		//There may be more frames waiting. Their interrupt has already been acknowledged, so come back for
+		// them from the fine scheduler, after pending wireless events have had their turn
+		rx_stats.num_budget_exhausted++;
+		if(rx_poll_scheduled == 0){
+			if(wlan_mac_schedule_event(SCHEDULE_FINE, 0, (void*)wlan_poll_eth_scheduled) != SCHEDULE_FAILED){
+				rx_poll_scheduled = 1;
+			}
+		}
 	}
-	//TODO: Option B: We free all BDs at once and run the routine to checkout as many queues as we can and hook them up to BDs
-	//Results: pretty lackluster TCP performance. needs further investigation
-	//Free this bd
-	//status = XAxiDma_BdRingFree(rxRing_ptr, bd_count, first_bd_ptr);
-	//if(status != XST_SUCCESS) {xil_printf("Error in XAxiDma_BdRingFree of Rx BD! Err = %d\n", status); return;}
-	//wlan_eth_dma_update();
 
 	return;
 }
 
+void wlan_poll_eth_scheduled(){
+	rx_poll_scheduled = 0;
+	wlan_poll_eth();
+}
+
 void wlan_eth_dma_update(){
 	//Used to submit new BDs to the DMA hardware if space is available
 	int bd_count;
@@ -675,6 +882,10 @@ void wlan_eth_dma_update(){
 
 	num_available_packet_bd = queue_num_free();
 
+	if(bd_count > 0 && num_available_packet_bd == 0){
+		rx_stats.num_refill_starved++;
+	}
+
 	if(min(num_available_packet_bd,bd_count)>0){
 //		xil_printf("%d BDs are free\n",bd_count);
 //		xil_printf("%d packet_bds are free\n", num_available_packet_bd);
@@ -37,8 +37,11 @@
 // allocated.  Otherwise, the event log will wrap and begin to overwrite the
 // oldest events.
 //
-//   Finally, the log does not keep track of event entries and it is up to
-// calling functions to interpret the bytes within the log correctly.
+//   The log keeps a side index with the address of every event in the log,
+// in allocation order (ie by event_id).  The index lives at the front of the
+// memory given to event_log_init() and lets the log drop its oldest events
+// without walking event headers, and lets callers look up events by id.  It
+// is up to calling functions to interpret the bytes of an event correctly.
 //
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -58,6 +61,12 @@
 
 /*************************** Constant Definitions ****************************/
 
+// The event index has one entry per event and is sized so that it only
+//   fills up before the log does if the average event (with its header) is
+//   smaller than this.
+//
+#define EVENT_LOG_INDEX_MIN_EVENT_SIZE ( sizeof( event_header ) + 16 )
+
 
 
 /*********************** Global Variable Definitions *************************/
@@ -77,6 +86,14 @@ static u32   log_size;                 // Size of the log in bytes
 static u32   log_head_address;         // Pointer to the oldest event
 static u32   log_curr_address;
 
+// Event index variables
+//   log_index[] is a ring of event addresses; log_index[log_index_head] is the
+//   oldest event and the log_index_used entries after it are the newer ones.
+static u32 * log_index;
+static u32   log_index_len;
+static u32   log_index_head;
+static u32   log_index_used;
+
 // Log config variables
 static u8    log_wrap_enabled;         // Will the log wrap or stop; By default wrapping is DISABLED
 
@@ -97,7 +114,8 @@ static u8    allocation_mutex;
 
 // Internal functions;  Should not be called externally
 //
-void            event_log_increment_head_address( u32 size );
+void            event_log_retire_oldest_event( void );
+void            event_log_set_full( void );
 int             event_log_get_next_empty_address( u32 size, u32 * address );
 
 
@@ -116,19 +134,28 @@ int             event_log_get_next_empty_address( u32 size, u32 * address );
 * @return	None.
 *
 * @note		The event log will only use a integer number of event entries so
-*           any bytes over an integer number will be unused.
+*           any bytes over an integer number will be unused.  The event index
+*           is taken from the front of the memory, so the log itself is smaller
+*           than 'size' (see event_log_get_capacity()).
 *
 ******************************************************************************/
 void event_log_init( char * start_address, u32 size ) {
 
+	u32 index_size;
+
 	xil_printf("Initializing Event log (%d bytes) at 0x%x \n", size, start_address );
 
 	// If defined, enable event logging
 	if(ENABLE_EVENT_LOGGING) enable_event_logging = 1;
 
+	// Carve the event index out of the front of the memory, keeping events 8-byte aligned
+	log_index_len     = size / ( sizeof( u32 ) + EVENT_LOG_INDEX_MIN_EVENT_SIZE );
+	log_index         = (u32 *) start_address;
+	index_size        = ( log_index_len * sizeof( u32 ) + 0x7 ) & ~0x7;
+
 	// Set the global variables that describe the log
-    log_size          = size;
-	log_start_address = (u32) start_address;
+    log_size          = size - index_size;
+	log_start_address = (u32) start_address + index_size;
 	log_max_address   = log_start_address + log_size - 1;
 
 	// Set wrapping to be disabled
@@ -139,6 +166,7 @@ void event_log_init( char * start_address, u32 size ) {
 
 #ifdef _DEBUG_
 	xil_printf("    log_size             = 0x%x;\n", log_size );
+	xil_printf("    log_index_len        = 0x%x;\n", log_index_len );
 	xil_printf("    log_start_address    = 0x%x;\n", log_start_address );
 	xil_printf("    log_max_address      = 0x%x;\n", log_max_address );
 	xil_printf("    log_soft_end_address = 0x%x;\n", log_soft_end_address );
@@ -173,6 +201,9 @@ void event_log_reset(){
 	log_full             = 0;
 	log_count            = 0;
 
+	log_index_head       = 0;
+	log_index_used       = 0;
+
 	allocation_mutex     = 0;
 }
 
@@ -253,7 +284,7 @@ u32  event_log_get_data( u32 start_address, u32 size, char * buffer ) {
     start_address = start_address + log_start_address;
 
     // Compute the end address for validity checks
-    end_address = log_start_address + start_address + size;
+    end_address = (u64) start_address + size;
 
     // Check that the end address is less than the end of the buffer
     if ( end_address > log_soft_end_address ) {
@@ -337,6 +368,139 @@ u32  event_log_get_oldest_event_index( void ) {
 
 
 
+/*****************************************************************************/
+/**
+* Get the number of bytes available for events
+*
+* @param    None.
+*
+* @return	u32    - Size of the log in bytes (without the event index)
+*
+* @note		None.
+*
+******************************************************************************/
+u32  event_log_get_capacity( void ) {
+    return log_size;
+}
+
+
+
+/*****************************************************************************/
+/**
+* Get the event_id of the oldest event
+*
+* @param    None.
+*
+* @return	u32    - event_id of the oldest event in the log.  If the log is
+*                    empty, this is the event_id the next event will get.
+*
+* @note		Events are numbered consecutively, so the log holds the events
+*           from this id up to event_log_get_next_event_id() - 1.
+*
+******************************************************************************/
+u32  event_log_get_oldest_event_id( void ) {
+    return ( log_count - log_index_used );
+}
+
+
+
+/*****************************************************************************/
+/**
+* Get the event_id the next event will get
+*
+* @param    None.
+*
+* @return	u32    - event_id of the next event
+*
+* @note		None.
+*
+******************************************************************************/
+u32  event_log_get_next_event_id( void ) {
+    return log_count;
+}
+
+
+
+/*****************************************************************************/
+/**
+* Get the index of an event
+*
+* @param    event_id    - ID of the event
+*
+* @return	u32         - Index of the event in the event log, or
+*                         EVENT_LOG_INDEX_INVALID if the event is not in the log
+*
+* @note		None.
+*
+******************************************************************************/
+u32  event_log_get_event_index( u32 event_id ) {
+	u32 offset = event_id - event_log_get_oldest_event_id();
+
+	if ( offset >= log_index_used ) { return EVENT_LOG_INDEX_INVALID; }
+
+    return ( log_index[( log_index_head + offset ) % log_index_len] - log_start_address );
+}
+
+
+
+/*****************************************************************************/
+/**
+* Get the byte ranges that hold a run of events
+*
+* @param    first_id    - ID of the first event
+*           num_events  - Number of events
+*                           0xFFFF_FFFF  -> All events from first_id on
+*           index       - Array of (at least) 2 entries filled in with the
+*                         index of each range in the event log
+*           size        - Array of (at least) 2 entries filled in with the
+*                         size in bytes of each range
+*
+* @return	u32         - Number of ranges:  0 - No event in the log
+*                                            1 - The events are contiguous
+*                                            2 - The events wrap around the end
+*                                                of the log
+*
+* @note		If first_id has already been overwritten, the ranges start from
+*           the oldest event in the log.  Callers can find out which events
+*           they got from the event_id in each event header.
+*
+******************************************************************************/
+u32  event_log_get_event_ranges( u32 first_id, u32 num_events, u32 * index, u32 * size ) {
+	u32            oldest_id = event_log_get_oldest_event_id();
+	u32            first_address;
+	u32            last_address;
+	u32            end_address;
+	event_header * last_hdr;
+
+	if ( first_id < oldest_id ) { first_id = oldest_id; }
+
+	if ( ( first_id >= log_count ) || ( num_events == 0 ) ) { return 0; }
+
+	if ( num_events > ( log_count - first_id ) ) { num_events = log_count - first_id; }
+
+	first_address = log_index[( log_index_head + ( first_id - oldest_id ) ) % log_index_len];
+	last_address  = log_index[( log_index_head + ( first_id - oldest_id ) + num_events - 1 ) % log_index_len];
+	last_hdr      = (event_header *) last_address;
+	end_address   = last_address + sizeof( event_header ) + last_hdr->event_length;
+
+	if ( first_address < end_address ) {
+		index[0] = first_address - log_start_address;
+		size[0]  = end_address - first_address;
+
+		return 1;
+	}
+
+	// The run continues at the beginning of the array
+	index[0] = first_address - log_start_address;
+	size[0]  = log_soft_end_address - first_address;
+	index[1] = 0;
+	size[1]  = end_address - log_start_address;
+
+	return 2;
+}
+
+
+
 /*****************************************************************************/
 /**
 * Update the event type
@@ -419,61 +583,47 @@ int       event_log_update_timestamp( void * event_ptr ) {
 
 /*****************************************************************************/
 /**
-* Increment the head address
+* Drop the oldest event from the log
 *
-* @param    size        - Number of bytes to increment the head address
+* @param    None.
 *
-* @return	num_bytes   - Number of bytes that the head address moved
+* @return	None.
 *
-* @note		This function will blindly increment the head address by 'size'
-*           bytes (ie it does not check the log_head_address relative to the
-*           log_curr_address).  It is the responsibility of the calling
-*           function to make sure this is only called when appropriate.
+* @note		This only drops the event from the event index; the caller must
+*           update log_head_address once it is done dropping events.  It is
+*           the responsibility of the calling function to make sure the index
+*           is not empty.
 *
 ******************************************************************************/
-void event_log_increment_head_address( u32 size ) {
-
-    u64            end_address;
-    event_header * event;
-
-	// Calculate end address (need to make sure we don't overflow u32)
-    end_address = log_head_address + size;
-
-    // Check to see if we will wrap with the current increment
-    if ( end_address > log_soft_end_address ) {
-        // We will wrap the log
+void event_log_retire_oldest_event( void ) {
 
-    	// Reset the log_soft_end_address to the end of the array
-    	log_soft_end_address = log_max_address;
+	if ( ++log_index_head == log_index_len ) { log_index_head = 0; }
 
-    	// Move the log_soft_head_address to the beginning of the array and move it
-    	//   at least 'size' bytes from the front of the array.  This is done to mirror
-    	//   how allocation of the log_curr_address works.  Also, b/c of this allocation
-    	//   scheme, we are guaranteed that log_start_address is the beginning of an event.
-    	log_head_address = log_start_address;
-    	end_address      = log_start_address + size;
+	log_index_used--;
+}
 
-		// Move the head address an integer number of events until it points to the
-		//   first event after the allocation
-		event = (event_header *) log_head_address;
 
-		while ( log_head_address < end_address ) {
-			log_head_address += ( event->event_length + sizeof( event_header ) );
-			event             = (event_header *) log_head_address;
-		}
 
-    } else {
-    	// We will not wrap
+/*****************************************************************************/
+/**
+* Mark the log as full
+*
+* @param    None.
+*
+* @return	None.
+*
+* @note		None.
+*
+******************************************************************************/
+void event_log_set_full( void ) {
 
-		// Move the head address an integer number of events until it points to the
-		//   first event after the allocation
-		event = (event_header *) log_head_address;
+	// Set the full flag
+	log_full = 1;
 
-		while ( log_head_address < end_address ) {
-			log_head_address += ( event->event_length + sizeof( event_header ) );
-			event             = (event_header *) log_head_address;
-		}
-    }
+	// Log is now full, print warning
+	xil_printf("---------------------------------------- \n");
+	xil_printf("EVENT LOG:  WARNING - Event Log FULL !!! \n");
+	xil_printf("---------------------------------------- \n");
 }
 
 
@@ -494,6 +644,9 @@ void event_log_increment_head_address( u32 size ) {
 *           a warning message.  If this function is called while the event log
 *           is full, then it will always return max_event_index
 *
+*           The oldest events are dropped through the event index, so the cost
+*           of an allocation does not depend on how many bytes it overwrites.
+*
 ******************************************************************************/
 int  event_log_get_next_empty_address( u32 size, u32 * address ) {
 
@@ -512,110 +665,66 @@ int  event_log_get_next_empty_address( u32 size, u32 * address ) {
 		//   will not be ruined
 		allocation_mutex = 1;
 
-		// Compute the end address of the newly allocated event
-	    end_address = log_curr_address + size;
+		// Make sure the event index has room for the new event
+		if ( log_index_used == log_index_len ) {
+			if ( log_wrap_enabled && ( log_index_len > 0 ) ) {
+				event_log_retire_oldest_event();
+			} else {
+				event_log_set_full();
+			}
+		}
 
-	    // Check if the log has wrapped
-	    if ( log_curr_address >= log_head_address ) {
-	    	// The log has not wrapped
+		if ( !log_full ) {
+			return_address = log_curr_address;
+			end_address    = (u64) log_curr_address + size;
+			status         = 0;
 
 		    // Check to see if we will wrap with the current allocation
-		    if ( end_address > log_soft_end_address ) {
-		    	// Current allocation will wrap the log
-
-		    	// Check to see if wrapping is enabled
-		    	if ( log_wrap_enabled ) {
+			if ( end_address > log_max_address ) {
 
-					// Compute new end address
-					end_address = log_start_address + size;
+				// Check to see if wrapping is enabled
+				if ( log_wrap_enabled ) {
 
-					// Check that we are not going to pass the head address
-					if ( end_address > log_head_address ) {
-
-						event_log_increment_head_address( size );
+					// Events stored past the write pointer are older than any event at
+					//   the beginning of the array, so they are dropped first
+					while ( log_index_used && ( log_index[log_index_head] >= log_curr_address ) ) {
+						event_log_retire_oldest_event();
 					}
 
 					// Set the log_soft_end_address and allocate the new event from the beginning of the buffer
 					log_soft_end_address = log_curr_address;
-					log_curr_address     = end_address;
-
-					// Return address is the beginning of the buffer
-					return_address = log_start_address;
-					status         = 0;
-
-		    	} else {
-					// Set the full flag and fail
-					log_full = 1;
-
-					// Log is now full, print warning
-					xil_printf("---------------------------------------- \n");
-					xil_printf("EVENT LOG:  WARNING - Event Log FULL !!! \n");
-					xil_printf("---------------------------------------- \n");
-		    	}
-		    } else {
-		    	// Current allocation does not wrap
-
-		    	// NOTE: This should be the most common case; since we know the log has not wrapped
-		    	//   we do not need to increment the log_head_address.
-
-	    		// Set the return address and then move the log_curr_address
-	    		return_address   = log_curr_address;
-	    		log_curr_address = end_address;
-	    		status           = 0;
-		    }
-	    } else {
-	    	// The log has wrapped
-	    	//   NOTE:  Even though the log has wrapped, we cannot assume that the wrap flag
-	    	//     continues to allow the log to wrap.
-
-			// Check that we are not going to pass the head address
-	    	//   NOTE:  This will set the log_soft_end_address if the head_address passes the end of the array
-			if ( end_address > log_head_address ) {
-
-				event_log_increment_head_address( size );
+					return_address       = log_start_address;
+					end_address          = (u64) log_start_address + size;
+
+				} else {
+					event_log_set_full();
+					status = 1;
+				}
 			}
+		}
 
-		    // Check to see if we will wrap with the current allocation
-		    if ( end_address > log_soft_end_address ) {
-		    	// Current allocation will wrap the log
+		if ( status == 0 ) {
 
-		    	// Check to see if wrapping is enabled
-		    	if ( log_wrap_enabled ) {
+			// Drop the oldest events that the new event overwrites
+			//   NOTE:  Even though the log has wrapped, we cannot assume that the wrap flag
+			//     continues to allow the log to wrap.
+			while ( log_index_used && ( log_index[log_index_head] >= return_address ) &&
+					( log_index[log_index_head] < end_address ) ) {
+				event_log_retire_oldest_event();
+			}
 
-					// Compute new end address
-					end_address = log_start_address + size;
+			// Add the event to the index and move the log_curr_address
+			log_index[( log_index_head + log_index_used ) % log_index_len] = return_address;
+			log_index_used++;
 
-					// NOTE:  We have already incremented the log_head_address by size.  Since the
-					//   event_log_increment_head_address() function follows the same allocation scheme
-					//   we are guaranteed that at least 'size' bytes are available at the beginning of the
-					//   array if we wrapped.  Therefore, we do not need to check the log_head_address again.
+			log_curr_address = end_address;
+			log_head_address = log_index[log_index_head];
 
-					// Set the log_soft_end_address and allocate the new event from the beginning of the buffer
-					log_soft_end_address = log_curr_address;
-					log_curr_address     = end_address;
-
-					// Return address is the beginning of the buffer
-					return_address = log_start_address;
-					status         = 0;
-
-		    	} else {
-					// Set the full flag and fail
-					log_full = 1;
-
-					// Log is now full, print warning
-					xil_printf("---------------------------------------- \n");
-					xil_printf("EVENT LOG:  WARNING - Event Log FULL !!! \n");
-					xil_printf("---------------------------------------- \n");
-		    	}
-		    } else {
-		    	// Current allocation does not wrap
-
-	    		// Set the return address and then move the log_curr_address
-	    		return_address   = log_curr_address;
-	    		log_curr_address = end_address;
-	    		status           = 0;
-		    }
-	    }
+			// Once the oldest event is below the write pointer, the log no longer wraps
+			if ( log_head_address < log_curr_address ) {
+				log_soft_end_address = log_max_address;
+			}
+		}
 
 		// Set the mutex to '0' to allow for future allocations
 		allocation_mutex = 0;
@@ -698,98 +807,34 @@ void * event_log_get_next_empty_event( u16 event_type, u16 event_size ) {
 ******************************************************************************/
 void print_event_log( u32 num_events ) {
 	u32            i;
+	u32            slot;
 	u32            event_address;
-	u32            event_count;
 	event_header * event_hdr;
 	u32            event_hdr_size;
 	void         * event;
 
-	// Initialize count
 	event_hdr_size = sizeof( event_header );
-	event_count    = 0;
-	event_address  = log_head_address;
 
-    // Check if the log has wrapped
-    if ( log_curr_address >= log_head_address ) {
-    	// The log has not wrapped
+	// Walk the event index from the oldest event
+	if ( num_events > log_index_used ) { num_events = log_index_used; }
 
-    	// Print the log from log_head_address to log_curr_address
-    	for( i = event_count; i < num_events; i++ ){
+	slot = log_index_head;
 
-    		// Check that the current event address is less than log_curr_address
-    		if ( event_address < log_curr_address ) {
+	for( i = 0; i < num_events; i++ ){
 
-    			event_hdr = (event_header*) event_address;
-    			event     = (void *) ( event_address + event_hdr_size );
+		event_address = log_index[slot];
+		event_hdr     = (event_header*) event_address;
+		event         = (void *) ( event_address + event_hdr_size );
 
 #ifdef _DEBUG_
-                xil_printf(" Event [%d] - addr = 0x%8x;  size = 0x%4x \n", i, event_address, event_hdr->event_length );
+		xil_printf(" Event [%d] - addr = 0x%8x;  size = 0x%4x \n", i, event_address, event_hdr->event_length );
 #endif
 
-        		// Print event
-    		    print_event( event_hdr->event_id, event_hdr->event_type, event_hdr->timestamp, event );
-
-        	    // Get the next event
-        		event_address += ( event_hdr->event_length + event_hdr_size );
-
-    		} else {
-    			// Exit the loop
-    			break;
-    		}
-    	}
-
-    } else {
-    	// The log has wrapped
-
-    	// Print the log from log_head_address to the end of the buffer
-    	for( i = event_count; i < num_events; i++ ){
-
-    		// Check that the current event address is less than the end of the log
-    		if ( event_address < log_soft_end_address ) {
-
-    			event_hdr = (event_header*) event_address;
-    			event     = (void * ) ( event_hdr + event_hdr_size );
+		// Print event
+		print_event( event_hdr->event_id, event_hdr->event_type, event_hdr->timestamp, event );
 
-        		// Print event
-    		    print_event( event_hdr->event_id, event_hdr->event_type, event_hdr->timestamp, event );
-
-        	    // Get the next event
-        		event_address += ( event_hdr->event_length + event_hdr_size );
-
-    		} else {
-    			// Exit the loop and set the event to the beginning of the buffer
-    			event_address  = log_start_address;
-    			event_count    = i;
-    			break;
-    		}
-    	}
-
-
-    	// If we still have events to print, then start at the beginning
-    	if ( event_count < num_events ) {
-
-			// Print the log from the beginning to log_curr_address
-			for( i = event_count; i < num_events; i++ ){
-
-				// Check that the current event address is less than log_curr_address
-				if ( event_address < log_curr_address ) {
-
-	    			event_hdr = (event_header*) event_address;
-	    			event     = (void * ) ( event_hdr + event_hdr_size );
-
-	        		// Print event
-	    		    print_event( event_hdr->event_id, event_hdr->event_type, event_hdr->timestamp, event );
-
-					// Get the next event
-	        		event_address += ( event_hdr->event_length + event_hdr_size );
-
-				} else {
-					// Exit the loop
-					break;
-				}
-			}
-    	}
-    }
+		if ( ++slot == log_index_len ) { slot = 0; }
+	}
 }
 
 
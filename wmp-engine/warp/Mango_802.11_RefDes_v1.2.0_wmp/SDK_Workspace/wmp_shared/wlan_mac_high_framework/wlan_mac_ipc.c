@@ -79,6 +79,8 @@ u32                ipc_msg_from_low_payload[IPC_BUFFER_SIZE];
 
 /*************************** Functions Prototypes ****************************/
 
+static u32 ipc_ring_timestamp();
+
 #ifdef _DEBUG_
 void print_wlan_mac_hw_info( wlan_mac_hw_info * info );      // Function defined in wlan_mac_util.c
 #endif
@@ -98,7 +100,8 @@ void print_wlan_mac_hw_info( wlan_mac_hw_info * info );      // Function defined
 *
 * @return	None.
 *
-* @note		None.
+* @note		Messages to CPU low go through the mailbox until CPU low initializes
+*           its IPC ring.
 *
 ******************************************************************************/
 void wlan_mac_ipc_init( void ) {
@@ -106,6 +109,13 @@ void wlan_mac_ipc_init( void ) {
 	//create IPC message to receive into
 	ipc_msg_from_low.payload_ptr = &(ipc_msg_from_low_payload[0]);
 
+	ipc_ring_init(IPC_RING_LOW_TO_HIGH, IPC_RING_HIGH_TO_LOW, ipc_ring_timestamp);
+}
+
+
+
+static u32 ipc_ring_timestamp(){
+	return (u32)get_usec_timestamp();
 }
 
 
@@ -116,7 +126,8 @@ void wlan_mac_ipc_init( void ) {
 * WLAN MAC IPC receive
 *
 * IPC receive function that will poll the mailbox for as many messages as are
-*   available and then call the CPU high IPC processing function on each message
+*   available and then call the CPU high IPC processing function on each message.
+*   A doorbell hands over every message CPU low has put in its IPC ring
 *
 * @param    None.
 *
@@ -133,7 +144,11 @@ void ipc_rx(){
 #endif
 
 	while( ipc_mailbox_read_msg( &ipc_msg_from_low ) == IPC_MBOX_SUCCESS ) {
-		process_ipc_msg_from_low(&ipc_msg_from_low);
+		if(IPC_MBOX_MSG_ID_TO_MSG(ipc_msg_from_low.msg_id) == IPC_MBOX_RING_DOORBELL) {
+			ipc_ring_drain(process_ipc_msg_from_low);
+		} else {
+			process_ipc_msg_from_low(&ipc_msg_from_low);
+		}
 
 #ifdef _DEBUG_
 		numMsg++;
@@ -178,6 +193,7 @@ void process_ipc_msg_from_low( wlan_ipc_msg* msg ) {
 				if (msg->arg0 & 0x80) {
 					xil_printf("CPU_LOW is now running XFSM at slot %d\n",
 								msg->arg0 & 0x0F);
+					wmp_high_util_telemetry_fsm_switch(msg->arg0 & 0x0F);
 				} else {
 					xil_printf("CPU_LOW failed to switch to XFSM at slot %d\n",
 													msg->arg0 & 0x0F);
@@ -185,7 +201,7 @@ void process_ipc_msg_from_low( wlan_ipc_msg* msg ) {
 			break;
 
 		case IPC_MBOX_CONFIG_RF_IFC:
-				xil_printf("Switch to channel %d confirmed\n", ((ipc_config_rf_ifc*)ipc_msg_from_low_payload)->channel);
+				xil_printf("Switch to channel %d confirmed\n", ((ipc_config_rf_ifc*)(msg->payload_ptr))->channel);
 			break;
 
 		/* WMP_START */
@@ -212,25 +228,11 @@ void process_ipc_msg_from_low( wlan_ipc_msg* msg ) {
 		}
 
 		case IPC_MBOX_READVAR:
-				{
-					int status;
-					struct wmp4warp_header_read_var_rep *read_hdr =
-							(struct wmp4warp_header_read_var_rep *)
-								(((u8 *)(RX_PKT_BUF_TO_ADDR(WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD))) +
-										sizeof(ethernet_header) + sizeof(struct wmp4warp_header_common));
-
-					read_hdr->var_id = msg->arg0;
-					read_hdr->var_value = *((u16 *)(msg->payload_ptr));
-
-					wmp_high_printf(WMP_HIGH_PL_INFO, "Variable %d = %d\n", msg->arg0, *((u16 *)(msg->payload_ptr)));
-
-					status = wlan_eth_dma_send((void *)(RX_PKT_BUF_TO_ADDR(WMP_HIGH_UTIL_RX_BUF_RESERVED_WMP_CMD)),
-							WMP4WARP_READ_VAR_REP_L);
-					if(status != 0) {
-						wmp_high_printf(WMP_HIGH_PL_ERROR, "Error in wlan_mac_send_eth! Err = %d\n", status);
-					}
-					break;
-				}
+				wmp_high_printf(WMP_HIGH_PL_DEBUG, "Variable %d = %d\n", msg->arg0, *((u16 *)(msg->payload_ptr)));
+
+				//Replies are built by the read batch waiting for this value
+				wmp_high_util_read_var_done(msg->arg0, *((u16 *)(msg->payload_ptr)));
+			break;
 		/* WMP_END */
 
 		case IPC_MBOX_RX_MPDU_READY:
@@ -354,7 +356,7 @@ void process_ipc_msg_from_low( wlan_ipc_msg* msg ) {
 
 			// CPU Low updated the node's HW information
             //   NOTE:  this information is typically stored in the WARP v3 EEPROM, accessible only to CPU Low
-			memcpy((void*) &(hw_info), (void*) &(ipc_msg_from_low_payload[0]), sizeof( wlan_mac_hw_info ) );
+			memcpy((void*) &(hw_info), (void*) (msg->payload_ptr), sizeof( wlan_mac_hw_info ) );
 
 			hw_info.type              = temp_1;
 			hw_info.wn_exp_eth_device = temp_2;
@@ -379,11 +381,11 @@ void process_ipc_msg_from_low( wlan_ipc_msg* msg ) {
 		case IPC_MBOX_CPU_STATUS:
 			// This message indicates CPU low's status
 
-			cpu_low_status = ipc_msg_from_low_payload[0];
+			cpu_low_status = msg->payload_ptr[0];
 
 			if(cpu_low_status & CPU_STATUS_EXCEPTION){
 				warp_printf(PL_ERROR, "An unrecoverable exception has occurred in CPU_LOW, halting...\n");
-				warp_printf(PL_ERROR, "Reason code: %d\n", ipc_msg_from_low_payload[1]);
+				warp_printf(PL_ERROR, "Reason code: %d\n", msg->payload_ptr[1]);
 				while(1){}
 			}
 		break;
@@ -430,7 +432,7 @@ void set_mac_channel( unsigned int mac_channel ) {
 
 	config_rf_ifc->channel = mac_channel;
 
-	ipc_mailbox_write_msg(&ipc_msg_to_low);
+	ipc_ring_write_msg(&ipc_msg_to_low);
 }
 
 
@@ -464,7 +466,7 @@ void set_dsss_value( unsigned int dsss_value ) {
 
 	config_phy_rx->enable_dsss = dsss_value;
 
-	ipc_mailbox_write_msg(&ipc_msg_to_low);
+	ipc_ring_write_msg(&ipc_msg_to_low);
 }
 
 void set_backoff_slot_value( u32 num_slots ) {
@@ -482,7 +484,7 @@ void set_backoff_slot_value( u32 num_slots ) {
 	config_mac = (ipc_config_mac*) ipc_msg_to_low_payload;
 	config_mac->slot_config = num_slots;
 
-	ipc_mailbox_write_msg(&ipc_msg_to_low);
+	ipc_ring_write_msg(&ipc_msg_to_low);
 }
 
 
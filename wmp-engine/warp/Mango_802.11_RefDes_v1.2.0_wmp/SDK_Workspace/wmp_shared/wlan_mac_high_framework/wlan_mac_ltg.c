@@ -32,8 +32,6 @@ int wlan_mac_ltg_sched_init(){
 	tg_schedule_list_init(&tg_list);
 	ltg_callback = (function_ptr_t)nullCallback;
 
-	wlan_mac_schedule_event(SCHEDULE_FINE, 0, (void*)ltg_sched_check);
-
 	return return_value;
 }
 
@@ -69,15 +67,16 @@ int ltg_sched_configure(u32 id, u32 type, void* params, void* callback_arg, void
 	//Create a new tg for this id if we didn't find it in the list
 	if(create_new){
 		curr_tg = ltg_sched_create();
-		tg_schedule_insertEnd(&tg_list,curr_tg);
-		if(tg_list.length == 1){
-			//start the scheduler if the only thing in it is what we just added
-			wlan_mac_schedule_event(SCHEDULE_FINE, 0, (void*)ltg_sched_check);
+		if(curr_tg != NULL){
+			tg_schedule_insertEnd(&tg_list,curr_tg);
 		}
 	}
 
 	if(curr_tg != NULL){
 		curr_tg->id = id;
+		curr_tg->num_events = 0;
+		curr_tg->late_max_usec = 0;
+		curr_tg->late_total_usec = 0;
 		curr_tg->type = type;
 		curr_tg->cleanup_callback = (function_ptr_t)cleanup_callback;
 		switch(type){
@@ -113,7 +112,11 @@ int ltg_sched_configure(u32 id, u32 type, void* params, void* callback_arg, void
 				return -1;
 			break;
 		}
-		((ltg_sched_state_hdr*)(curr_tg->state))->enabled = is_enabled;
+		((ltg_sched_state_hdr*)(curr_tg->state))->enabled = 0;
+		if(is_enabled){
+			//Restart with the new parameters
+			return ltg_sched_start_l(curr_tg);
+		}
 
 
 	} else {
@@ -158,27 +161,37 @@ int ltg_sched_start_l(tg_schedule* curr_tg){
 			return -1;
 		break;
 	}
+
+	//Each LTG owns a scheduler event for its next deadline instead of being polled
+	wlan_mac_remove_schedule(SCHEDULE_FINE, curr_tg->sched_id);
+	curr_tg->sched_id = wlan_mac_schedule_event_arg(SCHEDULE_FINE, (u32)(curr_tg->timestamp - timestamp), (void*)ltg_sched_check, curr_tg);
+	if(curr_tg->sched_id == SCHEDULE_FAILED){
+		((ltg_sched_state_hdr*)(curr_tg->state))->enabled = 0;
+		return -1;
+	}
+
 	return 0;
 }
 
 
-void ltg_sched_check(){
+void ltg_sched_check(tg_schedule* curr_tg){
 	u64 timestamp;
-	tg_schedule* curr_tg;
-	u32 i;
+	u32 late;
+
+	curr_tg->sched_id = SCHEDULE_FAILED;
 
-	if(tg_list.length > 0){
+	if(((ltg_sched_state_hdr*)(curr_tg->state))->enabled){
 		timestamp = get_usec_timestamp();
-		curr_tg = tg_list.first;
-		for(i = 0; i < tg_list.length; i++ ){
-			if(((ltg_sched_state_hdr*)(curr_tg->state))->enabled && timestamp >= ( curr_tg->timestamp) ){
-				ltg_sched_stop_l(curr_tg);
-				ltg_sched_start_l(curr_tg);
-				ltg_callback(curr_tg->id, curr_tg->callback_arg);
-			}
-			curr_tg = curr_tg->next;
+		late = (timestamp > curr_tg->timestamp) ? (u32)(timestamp - curr_tg->timestamp) : 0;
+
+		curr_tg->num_events++;
+		curr_tg->late_total_usec += late;
+		if(late > curr_tg->late_max_usec){
+			curr_tg->late_max_usec = late;
 		}
-		wlan_mac_schedule_event(SCHEDULE_FINE, 0, (void*)ltg_sched_check);
+
+		ltg_sched_start_l(curr_tg);
+		ltg_callback(curr_tg->id, curr_tg->callback_arg);
 	}
 	return;
 }
@@ -195,6 +208,8 @@ int ltg_sched_stop(u32 id){
 
 int ltg_sched_stop_l(tg_schedule* curr_tg){
 	((ltg_sched_state_hdr*)(curr_tg->state))->enabled = 0;
+	wlan_mac_remove_schedule(SCHEDULE_FINE, curr_tg->sched_id);
+	curr_tg->sched_id = SCHEDULE_FAILED;
 	return 0;
 }
 
@@ -260,6 +275,22 @@ int ltg_sched_get_callback_arg(u32 id, void** callback_arg){
 	return 0;
 }
 
+int ltg_sched_get_timing(u32 id, u32* num_events, u32* late_max_usec, u64* late_total_usec){
+	//This function returns how late, past their deadlines, the events of the schedule were called
+	tg_schedule* curr_tg;
+
+	curr_tg = ltg_sched_find_tg_schedule(id);
+	if(curr_tg == NULL){
+		return -1;
+	}
+
+	*num_events = curr_tg->num_events;
+	*late_max_usec = curr_tg->late_max_usec;
+	*late_total_usec = curr_tg->late_total_usec;
+
+	return 0;
+}
+
 
 
 int ltg_sched_remove(u32 id){
@@ -286,11 +317,19 @@ int ltg_sched_remove(u32 id){
 }
 
 tg_schedule* ltg_sched_create(){
-	return (tg_schedule*)wlan_malloc(sizeof(tg_schedule));
+	tg_schedule* tg = (tg_schedule*)wlan_malloc(sizeof(tg_schedule));
+
+	if(tg != NULL){
+		tg->sched_id = SCHEDULE_FAILED;
+	}
+	return tg;
 }
 
 void ltg_sched_destroy(tg_schedule* tg){
 
+	wlan_mac_remove_schedule(SCHEDULE_FINE, tg->sched_id);
+	tg->sched_id = SCHEDULE_FAILED;
+
 	switch(tg->type){
 		case LTG_SCHED_TYPE_PERIODIC:
 		case LTG_SCHED_TYPE_UNIFORM_RAND:
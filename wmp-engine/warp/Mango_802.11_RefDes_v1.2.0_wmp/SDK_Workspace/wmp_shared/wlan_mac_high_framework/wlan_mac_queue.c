@@ -162,6 +162,11 @@ u32 queue_num_queued(u16 queue_sel){
 	return queue[queue_sel].length;
 }
 
+packet_bd* queue_first(u16 queue_sel){
+	//Returns the packet_bd at the head of the queue without removing it, or NULL if the queue is empty
+	return queue[queue_sel].first;
+}
+
 void queue_checkout(packet_bd_list* new_list, u16 num_packet_bd){
 	//Checks out up to num_packet_bd number of packet_bds from the free list. If num_packet_bd are not free,
 	//then this function will return the number that are free and only check out that many.
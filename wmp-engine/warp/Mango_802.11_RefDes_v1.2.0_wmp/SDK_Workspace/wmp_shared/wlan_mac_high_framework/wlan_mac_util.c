@@ -23,6 +23,7 @@
 
 #include "w3_userio.h"
 #include "xtmrctr.h"
+#include "mb_interface.h"
 
 #include "wlan_mac_ipc_util.h"
 #include "wlan_mac_802_11_defs.h"
@@ -40,6 +41,8 @@
 
 /*************************** Constant Definitions ****************************/
 
+#define SCHEDULER_EVENT_NONE	0xFF
+
 
 
 
@@ -87,9 +90,23 @@ function_ptr_t     check_queue_callback;
 function_ptr_t     mpdu_tx_accept_callback;
 
 // Scheduler variables
-static u8               scheduler_in_use    [NUM_SCHEDULERS][SCHEDULER_NUM_EVENTS];
-static function_ptr_t   scheduler_callbacks [NUM_SCHEDULERS][SCHEDULER_NUM_EVENTS];
-static u64              scheduler_timestamps[NUM_SCHEDULERS][SCHEDULER_NUM_EVENTS];
+//   Each scheduler keeps its pending events in a binary min-heap ordered by
+//   timestamp, so its hardware timer only has to fire at the earliest deadline.
+typedef struct {
+	u32             id;
+	u64             timestamp;
+	function_ptr_t  callback;
+	void*           arg;
+	u8              has_arg;
+	u8              heap_pos;
+} scheduler_event;
+
+static scheduler_event  scheduler_events    [NUM_SCHEDULERS][SCHEDULER_NUM_EVENTS];
+static u8               scheduler_heap      [NUM_SCHEDULERS][SCHEDULER_NUM_EVENTS];
+static u8               scheduler_heap_len  [NUM_SCHEDULERS];
+static u8               scheduler_free      [NUM_SCHEDULERS][SCHEDULER_NUM_EVENTS];
+static u8               scheduler_free_len  [NUM_SCHEDULERS];
+static u32              scheduler_generation;
 static u8               timer_running       [NUM_SCHEDULERS];
 
 // Node information
@@ -111,6 +128,9 @@ int mem_alloc_debug;
 
 /*************************** Functions Prototypes ****************************/
 
+static void scheduler_init();
+static void scheduler_dispatch(u8 scheduler_sel);
+
 #ifdef _DEBUG_
 void print_wlan_mac_hw_info( wlan_mac_hw_info * info );      // Function defined in wlan_mac_util.c
 #endif
@@ -269,6 +289,9 @@ void wlan_mac_util_init( u32 type, u32 eth_dev_num ){
 
 		event_log_init( (void*)(DDR3_BASEADDR + queue_len), log_size );
 
+		// Part of the memory holds the event index
+		log_size = event_log_get_capacity();
+
 	} else {
 		log_size = 0;
 	}
@@ -300,6 +323,7 @@ void wlan_mac_util_init( u32 type, u32 eth_dev_num ){
 
 	timer_running[TIMER_CNTR_FAST] = 0;
 	timer_running[TIMER_CNTR_SLOW] = 0;
+	scheduler_init();
     
     // Get the type of node from the input parameter
     hw_info.type              = type;
@@ -435,49 +459,12 @@ void XTmrCtr_CustomInterruptHandler(void *InstancePtr){
 
 
 void timer_handler(void *CallBackRef, u8 TmrCtrNumber){
-	u16 k;
-	u8 restart_timer;
-	u64 timestamp;
-
-	restart_timer = 0;
-	timestamp = get_usec_timestamp();
-
 	switch(TmrCtrNumber){
 		case TIMER_CNTR_FAST:
-			for(k = 0; k<SCHEDULER_NUM_EVENTS; k++){
-				if(scheduler_in_use[SCHEDULE_FINE][k] == 1){
-					restart_timer = 1;
-					if(timestamp > scheduler_timestamps[SCHEDULE_FINE][k]){
-						scheduler_in_use[SCHEDULE_FINE][k] = 0; //Free up schedule element before calling callback in case that function wants to reschedule
-						scheduler_callbacks[SCHEDULE_FINE][k]();
-					}
-				}
-			}
-			if(restart_timer){
-				timer_running[TIMER_CNTR_FAST] = 1;
-				XTmrCtr_SetResetValue(&TimerCounterInst, TIMER_CNTR_FAST, FAST_TIMER_DUR_US*(TIMER_FREQ/1000000));
-				XTmrCtr_Start(&TimerCounterInst, TIMER_CNTR_FAST);
-			} else {
-				timer_running[TIMER_CNTR_FAST] = 0;
-			}
+			scheduler_dispatch(SCHEDULE_FINE);
 		break;
 		case TIMER_CNTR_SLOW:
-			for(k = 0; k<SCHEDULER_NUM_EVENTS; k++){
-				if(scheduler_in_use[SCHEDULE_COARSE][k] == 1){
-					restart_timer = 1;
-					if(timestamp > scheduler_timestamps[SCHEDULE_COARSE][k]){
-						scheduler_in_use[SCHEDULE_COARSE][k] = 0; //Free up schedule element before calling callback in case that function wants to reschedule
-						scheduler_callbacks[SCHEDULE_COARSE][k]();
-					}
-				}
-			}
-			if(restart_timer){
-				timer_running[TIMER_CNTR_SLOW] = 1;
-				XTmrCtr_SetResetValue(&TimerCounterInst, TIMER_CNTR_SLOW, SLOW_TIMER_DUR_US*(TIMER_FREQ/1000000));
-				XTmrCtr_Start(&TimerCounterInst, TIMER_CNTR_SLOW);
-			} else {
-				timer_running[TIMER_CNTR_SLOW] = 0;
-			}
+			scheduler_dispatch(SCHEDULE_COARSE);
 		break;
 	}
 }
@@ -651,61 +638,235 @@ u64 get_usec_timestamp(){
 }
 
 
-void wlan_mac_schedule_event(u8 scheduler_sel, u32 delay, void(*callback)()){
+static void scheduler_init(){
+	u8 sel;
 	u32 k;
 
-	u64 timestamp = get_usec_timestamp();
+	for(sel = 0; sel < NUM_SCHEDULERS; sel++){
+		scheduler_heap_len[sel] = 0;
+		scheduler_free_len[sel] = SCHEDULER_NUM_EVENTS;
+		for(k = 0; k < SCHEDULER_NUM_EVENTS; k++){
+			scheduler_events[sel][k].id       = SCHEDULE_FAILED;
+			scheduler_events[sel][k].heap_pos = SCHEDULER_EVENT_NONE;
+			scheduler_free[sel][k]            = SCHEDULER_NUM_EVENTS - 1 - k;
+		}
+	}
+	scheduler_generation = 0;
+}
 
-	for (k = 0; k<SCHEDULER_NUM_EVENTS; k++){
-		if(scheduler_in_use[scheduler_sel][k] == 0){ //Found an empty schedule element
-			scheduler_in_use[scheduler_sel][k] = 1; //We are using this schedule element
-			scheduler_callbacks[scheduler_sel][k] = (function_ptr_t)callback;
-			scheduler_timestamps[scheduler_sel][k] = timestamp+(u64)delay;
-
-			if(scheduler_sel == SCHEDULE_FINE){
-				if(timer_running[TIMER_CNTR_FAST] == 0){
-					timer_running[TIMER_CNTR_FAST] = 1;
-					XTmrCtr_SetResetValue(&TimerCounterInst, TIMER_CNTR_FAST, FAST_TIMER_DUR_US*(TIMER_FREQ/1000000));
-					XTmrCtr_Start(&TimerCounterInst, TIMER_CNTR_FAST);
-				}
+static inline void scheduler_heap_set(u8 scheduler_sel, u8 pos, u8 idx){
+	scheduler_heap[scheduler_sel][pos] = idx;
+	scheduler_events[scheduler_sel][idx].heap_pos = pos;
+}
 
-			} else if(scheduler_sel == SCHEDULE_COARSE) {
-				if(timer_running[TIMER_CNTR_SLOW] == 0){
-					timer_running[TIMER_CNTR_SLOW] = 1;
-					XTmrCtr_SetResetValue(&TimerCounterInst, TIMER_CNTR_SLOW, SLOW_TIMER_DUR_US*(TIMER_FREQ/1000000));
-					XTmrCtr_Start(&TimerCounterInst, TIMER_CNTR_SLOW);
-				}
-			}
-			return;
+static void scheduler_sift_up(u8 scheduler_sel, u8 pos){
+	u8  idx = scheduler_heap[scheduler_sel][pos];
+	u64 timestamp = scheduler_events[scheduler_sel][idx].timestamp;
+	u8  parent;
+
+	while(pos > 0){
+		parent = (pos - 1) / 2;
+		if(scheduler_events[scheduler_sel][scheduler_heap[scheduler_sel][parent]].timestamp <= timestamp) break;
+		scheduler_heap_set(scheduler_sel, pos, scheduler_heap[scheduler_sel][parent]);
+		pos = parent;
+	}
+	scheduler_heap_set(scheduler_sel, pos, idx);
+}
+
+static void scheduler_sift_down(u8 scheduler_sel, u8 pos){
+	u8  len = scheduler_heap_len[scheduler_sel];
+	u8  idx = scheduler_heap[scheduler_sel][pos];
+	u64 timestamp = scheduler_events[scheduler_sel][idx].timestamp;
+	u8  child;
+
+	while((child = 2 * pos + 1) < len){
+		if(child + 1 < len &&
+		   scheduler_events[scheduler_sel][scheduler_heap[scheduler_sel][child + 1]].timestamp <
+		   scheduler_events[scheduler_sel][scheduler_heap[scheduler_sel][child]].timestamp){
+			child++;
 		}
+		if(timestamp <= scheduler_events[scheduler_sel][scheduler_heap[scheduler_sel][child]].timestamp) break;
+		scheduler_heap_set(scheduler_sel, pos, scheduler_heap[scheduler_sel][child]);
+		pos = child;
 	}
-	warp_printf(PL_ERROR,"ERROR: %d schedules already filled\n",SCHEDULER_NUM_EVENTS);
+	scheduler_heap_set(scheduler_sel, pos, idx);
 }
 
-void poll_schedule(){
-	u32 k;
+static void scheduler_heap_remove(u8 scheduler_sel, u8 pos){
+	u8 idx  = scheduler_heap[scheduler_sel][pos];
+	u8 last = --scheduler_heap_len[scheduler_sel];
+	u8 moved;
+
+	//Fill the hole with the last element and restore the heap around it
+	if(pos != last){
+		moved = scheduler_heap[scheduler_sel][last];
+		scheduler_heap_set(scheduler_sel, pos, moved);
+		scheduler_sift_down(scheduler_sel, pos);
+		scheduler_sift_up(scheduler_sel, scheduler_events[scheduler_sel][moved].heap_pos);
+	}
+
+	scheduler_events[scheduler_sel][idx].id       = SCHEDULE_FAILED;
+	scheduler_events[scheduler_sel][idx].heap_pos = SCHEDULER_EVENT_NONE;
+	scheduler_free[scheduler_sel][scheduler_free_len[scheduler_sel]++] = idx;
+}
+
+// Program the scheduler's one-shot timer for its earliest deadline
+static void scheduler_arm(u8 scheduler_sel){
+	u8  timer = (scheduler_sel == SCHEDULE_FINE) ? TIMER_CNTR_FAST : TIMER_CNTR_SLOW;
+	u64 timestamp;
+	u64 deadline;
+	u32 delay;
+
+	if(scheduler_heap_len[scheduler_sel] == 0){
+		timer_running[timer] = 0;
+		return;
+	}
+
+	timestamp = get_usec_timestamp();
+	deadline  = scheduler_events[scheduler_sel][scheduler_heap[scheduler_sel][0]].timestamp;
+
+	//Events fire once the timestamp has passed their deadline
+	if(deadline < timestamp){
+		delay = 1;
+	} else if(deadline - timestamp >= SCHEDULER_MAX_ARM_US){
+		delay = SCHEDULER_MAX_ARM_US;
+	} else {
+		delay = (u32)(deadline - timestamp) + 1;
+	}
+
+	timer_running[timer] = 1;
+	XTmrCtr_SetResetValue(&TimerCounterInst, timer, delay*(TIMER_FREQ/1000000));
+	XTmrCtr_Start(&TimerCounterInst, timer);
+}
+
+static void scheduler_dispatch(u8 scheduler_sel){
 	u64 timestamp = get_usec_timestamp();
+	scheduler_event* event;
+	function_ptr_t callback;
+	void* arg;
+	u8 has_arg;
+	u32 msr;
 
-	for(k = 0; k<SCHEDULER_NUM_EVENTS; k++){
-		if(scheduler_in_use[SCHEDULE_FINE][k] == 1){
-			if(timestamp > scheduler_timestamps[SCHEDULE_FINE][k]){
-				scheduler_in_use[SCHEDULE_FINE][k] = 0; //Free up schedule element before calling callback in case that function wants to reschedule
-				scheduler_callbacks[SCHEDULE_FINE][k]();
-			}
+	msr = wlan_mac_irq_lock();
+	while(scheduler_heap_len[scheduler_sel] > 0){
+		event = &(scheduler_events[scheduler_sel][scheduler_heap[scheduler_sel][0]]);
+
+		//Events scheduled by the callbacks below with a delay of 0 wait for the next dispatch
+		if(timestamp <= event->timestamp) break;
+
+		callback = event->callback;
+		arg      = event->arg;
+		has_arg  = event->has_arg;
+
+		//Free up schedule element before calling callback in case that function wants to reschedule
+		scheduler_heap_remove(scheduler_sel, 0);
+
+		wlan_mac_irq_unlock(msr);
+		if(has_arg){
+			callback(arg);
+		} else {
+			callback();
 		}
+		msr = wlan_mac_irq_lock();
 	}
+	scheduler_arm(scheduler_sel);
+	wlan_mac_irq_unlock(msr);
+}
 
-	for(k = 0; k<SCHEDULER_NUM_EVENTS; k++){
-		if(scheduler_in_use[SCHEDULE_COARSE][k] == 1){
-			if(timestamp > scheduler_timestamps[SCHEDULE_COARSE][k]){
-				scheduler_in_use[SCHEDULE_COARSE][k] = 0; //Free up schedule element before calling callback in case that function wants to reschedule
-				scheduler_callbacks[SCHEDULE_COARSE][k]();
-			}
-		}
+static u32 scheduler_insert(u8 scheduler_sel, u32 delay, function_ptr_t callback, void* arg, u8 has_arg){
+	scheduler_event* event;
+	u32 msr;
+	u32 id;
+	u8 idx;
+
+	if(scheduler_sel >= NUM_SCHEDULERS){
+		return SCHEDULE_FAILED;
+	}
+
+	msr = wlan_mac_irq_lock();
+
+	if(scheduler_free_len[scheduler_sel] == 0){
+		wlan_mac_irq_unlock(msr);
+		warp_printf(PL_ERROR,"ERROR: %d schedules already filled\n",SCHEDULER_NUM_EVENTS);
+		return SCHEDULE_FAILED;
+	}
+
+	idx   = scheduler_free[scheduler_sel][--scheduler_free_len[scheduler_sel]];
+	event = &(scheduler_events[scheduler_sel][idx]);
+
+	//IDs carry the element index and a generation so that a stale ID never cancels a newer event
+	scheduler_generation = (scheduler_generation + 1) & 0x00FFFFFF;
+	if(scheduler_generation == 0) scheduler_generation = 1;
+
+	id               = (scheduler_generation << 8) | idx;
+	event->id        = id;
+	event->timestamp = get_usec_timestamp() + (u64)delay;
+	event->callback  = callback;
+	event->arg       = arg;
+	event->has_arg   = has_arg;
+
+	scheduler_heap_set(scheduler_sel, scheduler_heap_len[scheduler_sel]++, idx);
+	scheduler_sift_up(scheduler_sel, event->heap_pos);
+
+	//Only a new earliest deadline moves the timer
+	if(event->heap_pos == 0){
+		scheduler_arm(scheduler_sel);
+	}
+
+	wlan_mac_irq_unlock(msr);
+
+	return id;
+}
+
+u32 wlan_mac_schedule_event(u8 scheduler_sel, u32 delay, void(*callback)()){
+	return scheduler_insert(scheduler_sel, delay, (function_ptr_t)callback, NULL, 0);
+}
+
+u32 wlan_mac_schedule_event_arg(u8 scheduler_sel, u32 delay, void(*callback)(void*), void* arg){
+	return scheduler_insert(scheduler_sel, delay, (function_ptr_t)callback, arg, 1);
+}
+
+int wlan_mac_remove_schedule(u8 scheduler_sel, u32 id){
+	u8 idx = id & 0xFF;
+	u32 msr;
+
+	if(scheduler_sel >= NUM_SCHEDULERS || id == SCHEDULE_FAILED || idx >= SCHEDULER_NUM_EVENTS){
+		return -1;
 	}
 
+	msr = wlan_mac_irq_lock();
+	if(scheduler_events[scheduler_sel][idx].id != id){
+		//Already fired or removed
+		wlan_mac_irq_unlock(msr);
+		return -1;
+	}
+	//The timer is left running; an early dispatch just re-arms it
+	scheduler_heap_remove(scheduler_sel, scheduler_events[scheduler_sel][idx].heap_pos);
+	wlan_mac_irq_unlock(msr);
 
+	return 0;
+}
+
+u64 wlan_mac_schedule_next_deadline(u8 scheduler_sel){
+	u64 deadline = SCHEDULE_NO_DEADLINE;
+	u32 msr;
+
+	if(scheduler_sel >= NUM_SCHEDULERS){
+		return deadline;
+	}
 
+	msr = wlan_mac_irq_lock();
+	if(scheduler_heap_len[scheduler_sel] > 0){
+		deadline = scheduler_events[scheduler_sel][scheduler_heap[scheduler_sel][0]].timestamp;
+	}
+	wlan_mac_irq_unlock(msr);
+
+	return deadline;
+}
+
+void poll_schedule(){
+	scheduler_dispatch(SCHEDULE_FINE);
+	scheduler_dispatch(SCHEDULE_COARSE);
 }
 
 int wlan_mac_poll_tx_queue(u16 queue_sel){
@@ -926,7 +1087,7 @@ void mpdu_transmit(packet_bd* tx_queue) {
 			/* WMP START */
 			tx_pkt_buf_prev_acc = 0;
 			/* WMP END */
-			ipc_mailbox_write_msg(&ipc_msg_to_low);
+			ipc_ring_write_msg(&ipc_msg_to_low);
 		}
 	} else {
 		warp_printf(PL_ERROR, "Bad state in mpdu_transmit. Attempting to transmit but tx_buffer %d is not empty\n",tx_pkt_buf);
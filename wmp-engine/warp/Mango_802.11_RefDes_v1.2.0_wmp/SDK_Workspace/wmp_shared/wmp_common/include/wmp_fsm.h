@@ -108,8 +108,10 @@ struct wmp_fsm {
  * mutex.
  */
 #define WMP_FSM_BUFFER_SIZE				65536 /* byte */
+#ifndef WMP_FSM_BUFFER_MUTEX_N
 #define WMP_FSM_BUFFER_MUTEX_N			32
-#define WMP_FSM_BUFFER_SINGLE_SIZE		(WMP_FSM_BUFFER_SIZE / 32)
+#endif
+#define WMP_FSM_BUFFER_SINGLE_SIZE		(WMP_FSM_BUFFER_SIZE / WMP_FSM_BUFFER_MUTEX_N)
 /* i goes from 0 to (FSM_BUFFER_MUTEX_N - 1)
  * wmp_fsm is a pointer to a struct wmp_fsm
  */
@@ -158,6 +160,23 @@ struct wmp_fsm {
 	(((*(bc)) == 0x00) && ((*(bc + 1)) == 0x00) && ((*(bc + 2)) == 0x99))
 #define WMP_FSM_BYTE_CODE_END_TAG_SIZE	3
 
+/* Elements that fit in the sections of one slot */
+#define WMP_FSM_PARAM_MAX	\
+	((WMP_FSM_PARAM_SECTION_SIZE_DEFAULT - WMP_FSM_COUNTER_FIELD_SIZE) / WMP_FSM_BYTE_CODE_PARAM_SIZE)
+#define WMP_FSM_STATE_MAX	\
+	((WMP_FSM_STATE_SECTION_SIZE_DEFAULT - WMP_FSM_COUNTER_FIELD_SIZE) / WMP_FSM_BYTE_CODE_STATE_SIZE)
+#define WMP_FSM_TRAN_MAX	\
+	((WMP_FSM_TRAN_SECTION_SIZE_DEFAULT - WMP_FSM_COUNTER_FIELD_SIZE) / WMP_FSM_BYTE_CODE_TRAN_SIZE)
+
+/* Longest byte code whose sections fit in one slot (2935 byte) */
+#define WMP_FSM_BYTE_CODE_MAX_SIZE															\
+	(WMP_FSM_BYTE_CODE_START_TAG_SIZE +														\
+	WMP_FSM_PARAM_MAX * (WMP_FSM_BYTE_CODE_PARAM_TAG_SIZE + WMP_FSM_BYTE_CODE_PARAM_SIZE) +	\
+	WMP_FSM_STATE_MAX * (WMP_FSM_BYTE_CODE_STATE_TAG_SIZE + WMP_FSM_BYTE_CODE_STATE_SIZE +	\
+						WMP_FSM_BYTE_CODE_TRAN_TAG_SIZE) +									\
+	WMP_FSM_TRAN_MAX * WMP_FSM_BYTE_CODE_TRAN_SIZE +											\
+	WMP_FSM_BYTE_CODE_END_TAG_SIZE)
+
 
 /**
  * get the number of parameters
@@ -113,6 +113,10 @@ int wmp_fsm_write(struct wmp_fsm *wmp_fsm, u8 *fsm)
 	fsm += WMP_FSM_BYTE_CODE_START_TAG_SIZE;
 
 	while (WMP_FSM_BYTE_CODE_PARAM_TAG_PARSE(fsm)) {
+		if (param_counter == WMP_FSM_PARAM_MAX) {
+			xil_printf("wmp_fsm_write: more than %d parameters\n", WMP_FSM_PARAM_MAX);
+			return -1;
+		}
 		fsm += WMP_FSM_BYTE_CODE_PARAM_TAG_SIZE;
 		Xil_Out16(wmp_fsm->fsm_desc.param_base_addr + WMP_FSM_COUNTER_FIELD_SIZE +
 				(param_counter * WMP_FSM_BYTE_CODE_PARAM_SIZE), (WMP_FSM_SWAP_BYTES(fsm)));
@@ -123,10 +127,23 @@ int wmp_fsm_write(struct wmp_fsm *wmp_fsm, u8 *fsm)
 	Xil_Out16(wmp_fsm->fsm_desc.param_base_addr, param_counter);
 
 	while (WMP_FSM_BYTE_CODE_STATE_TAG_PARSE(fsm)) {
+		if (state_counter == WMP_FSM_STATE_MAX) {
+			xil_printf("wmp_fsm_write: more than %d states\n", WMP_FSM_STATE_MAX);
+			return -1;
+		}
 		fsm += WMP_FSM_BYTE_CODE_STATE_TAG_SIZE;
 		tmp_state = WMP_FSM_SWAP_BYTES(fsm);
 		tmp_out_tran = WMP_STATE_GET_OUT_TRAN(tmp_state) + 1;
 		tmp_out_tran_offset = WMP_STATE_GET_OUT_TRAN_OFFSET(tmp_state);
+
+		// tmp_out_tran_offset counts 16 bit words, a transition takes 3 of them
+		if ((tran_counter + tmp_out_tran) > WMP_FSM_TRAN_MAX ||
+				(tmp_out_tran_offset + tmp_out_tran * 3) * 2 > WMP_FSM_TRAN_MAX * WMP_FSM_BYTE_CODE_TRAN_SIZE) {
+			xil_printf("wmp_fsm_write: transitions of state %d past the %d of the slot\n",
+									state_counter, WMP_FSM_TRAN_MAX);
+			return -1;
+		}
+
 		Xil_Out16(wmp_fsm->fsm_desc.state_base_addr + WMP_FSM_COUNTER_FIELD_SIZE +
 						(state_counter * WMP_FSM_BYTE_CODE_STATE_SIZE), tmp_state);
 		fsm += WMP_FSM_BYTE_CODE_STATE_SIZE;
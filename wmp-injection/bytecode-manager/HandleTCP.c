@@ -5,22 +5,386 @@
 #include <unistd.h>
 #include <errno.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <pwd.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
 
+#include "vars.h"
+#include "libb43.h"
+#include "bytecode-manager.h"
 #include "HandleTCP.h"
 #include "messageHandler.h"
 
 
-#define RCVBUFSIZE 1500
-#define MAX_MESSAGE_SIZE 4096
+#define MAXPENDING 64    /* Maximum outstanding connection requests */
 
-#define MAXPENDING 5    /* Maximum outstanding connection requests */
+#define RESPONSE_SIZE 4096
 
 
+struct tcp_client {
+	int fd;
+	/* Unframed client, see HandleTCP.h. */
+	int legacy;
+	/* Peer closed its side; close once the replies are written. */
+	int closing;
+	size_t received;
+	struct sockaddr_in addr;
+	char *in;
+	size_t in_len;
+	size_t in_cap;
+	char *out;
+	size_t out_len;
+	size_t out_off;
+	size_t out_cap;
+};
 
 
+static int set_nonblocking(int fd)
+{
+	int flags = fcntl(fd, F_GETFL, 0);
+	return (flags < 0) ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
 
+/* Grows buf to hold at least need bytes. */
+static int reserve(char **buf, size_t *cap, size_t need)
+{
+	if (need <= *cap) {
+		return 0;
+	}
+
+	size_t newcap = *cap ? *cap : 4096;
+	while (newcap < need) {
+		newcap *= 2;
+	}
+	char *newbuf = realloc(*buf, newcap);
+	if (newbuf == NULL) {
+		return -1;
+	}
+	*buf = newbuf;
+	*cap = newcap;
+	return 0;
+}
+
+static void close_client(int epfd, struct tcp_client *c)
+{
+	printf("Closing client %s\n", inet_ntoa(c->addr.sin_addr));
+	epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	free(c->in);
+	free(c->out);
+	free(c);
+}
+
+static int queue_reply(struct tcp_client *c, const char *reply)
+{
+	uint32_t len = strlen(reply);
+	uint32_t header = htonl(len);
+
+	if (reserve(&c->out, &c->out_cap, c->out_len + TCP_FRAME_HEADER + len) < 0) {
+		return -1;
+	}
+	memcpy(c->out + c->out_len, &header, TCP_FRAME_HEADER);
+	memcpy(c->out + c->out_len + TCP_FRAME_HEADER, reply, len);
+	c->out_len += TCP_FRAME_HEADER + len;
+	return 0;
+}
+
+/* Writes as much of the pending replies as the socket takes, and asks
+for EPOLLOUT if some are left. Returns -1 if the client is gone. */
+static int flush_client(int epfd, struct tcp_client *c)
+{
+	while (c->out_off < c->out_len) {
+		ssize_t n = write(c->fd, c->out + c->out_off, c->out_len - c->out_off);
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				break;
+			}
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		c->out_off += n;
+	}
+
+	if (c->out_off == c->out_len) {
+		c->out_off = 0;
+		c->out_len = 0;
+	}
+
+	struct epoll_event ev = { .data.ptr = c };
+	ev.events = EPOLLIN | (c->out_len > 0 ? EPOLLOUT : 0);
+	epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+
+	return 0;
+}
+
+/* Runs one XML message (NUL terminated) and writes the reply text. */
+static void handle_message(char *message, size_t len, char *reply, struct debugfs_file *df)
+{
+	const char *value;
+	size_t value_len;
+
+	sprintf(reply, "%s", "");
+
+	if (xmlFindValue(message, len, "Command", &value, &value_len) == 0) {
+		char command[1024];
+		printf("BYTECODE IS A COMMAND\n");
+		getCommandValue(value, value_len, command, sizeof(command));
+		executeCommand(command, reply, df);
+		if (!strcmp(reply, "")) {
+			sprintf(reply, "NO RESPONS COMMAND");
+		}
+		return;
+	}
+
+	if (xmlFindValue(message, len, "FileName", &value, &value_len) == 0) {
+		char filename[256];
+		char tmp_path[512];
+		const char *bytecode;
+		size_t bytecode_len;
+
+		getCommandValue(value, value_len, filename, sizeof(filename));
+		/* File names have no spaces either. */
+		filename[strcspn(filename, " ")] = '\0';
+		if (filename[0] == '\0' || strchr(filename, '/') != NULL) {
+			sprintf(reply, "ERROR invalid file name");
+			return;
+		}
+		if (xmlFindValue(message, len, "FileContent", &bytecode, &bytecode_len) < 0) {
+			bytecode = "";
+			bytecode_len = 0;
+		}
+
+		/* Replace the correct cache path file to save bytecodes */
+		struct passwd *pw = getpwuid(getuid());
+		snprintf(tmp_path, sizeof(tmp_path), "%s/%s%s", pw->pw_dir, CACHE_PATH_FILE, filename);
+
+		if (saveBytecodeData(tmp_path, bytecode, bytecode_len) < 0) {
+			sprintf(reply, "ERROR unable to save %s", filename);
+		} else {
+			printf("bytecode %s SAVED \n", filename);
+			sprintf(reply, "OK");
+		}
+		return;
+	}
+
+	sprintf(reply, "ERROR unknown message");
+}
+
+/* Runs every complete frame received so far, in order. */
+static int process_frames(struct tcp_client *c, struct debugfs_file *df)
+{
+	char reply[RESPONSE_SIZE];
+	size_t off = 0;
+
+	while (c->in_len - off >= TCP_FRAME_HEADER) {
+		uint32_t len;
+		memcpy(&len, c->in + off, TCP_FRAME_HEADER);
+		len = ntohl(len);
+		if (len > TCP_MAX_FRAME) {
+			fprintf(stderr, "Frame of %u bytes from %s is too large\n", len, inet_ntoa(c->addr.sin_addr));
+			return -1;
+		}
+		if (c->in_len - off < TCP_FRAME_HEADER + len) {
+			break;
+		}
+
+		/* The buffer always has a spare byte past the data, see read_client. */
+		char *message = c->in + off + TCP_FRAME_HEADER;
+		char saved = message[len];
+		message[len] = '\0';
+		handle_message(message, len, reply, df);
+		message[len] = saved;
+
+		if (queue_reply(c, reply) < 0) {
+			return -1;
+		}
+		off += TCP_FRAME_HEADER + len;
+	}
+
+	memmove(c->in, c->in + off, c->in_len - off);
+	c->in_len -= off;
+	return 0;
+}
+
+/* Reads everything available. Returns -1 if the client must be closed. */
+static int read_client(int epfd, struct tcp_client *c, struct debugfs_file *df)
+{
+	for (;;) {
+		if (reserve(&c->in, &c->in_cap, c->in_len + 1500 + 1) < 0) {
+			return -1;
+		}
+
+		ssize_t n = read(c->fd, c->in + c->in_len, c->in_cap - c->in_len - 1);
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				break;
+			}
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+
+		if (n == 0) {
+			c->closing = 1;
+			break;
+		}
+
+		if (c->received == 0 && c->in[0] == '<') {
+			c->legacy = 1;
+		}
+		c->received += n;
+		c->in_len += n;
+
+		if (c->in_len > TCP_MAX_FRAME + TCP_FRAME_HEADER) {
+			if (c->legacy) {
+				fprintf(stderr, "Message from %s is too large\n", inet_ntoa(c->addr.sin_addr));
+				return -1;
+			}
+			/* Let a framed client drain what it has before checking its frame. */
+			if (process_frames(c, df) < 0) {
+				return -1;
+			}
+		}
+	}
+
+	if (c->legacy) {
+		if (c->closing) {
+			char reply[RESPONSE_SIZE];
+			c->in[c->in_len] = '\0';
+			handle_message(c->in, c->in_len, reply, df);
+			return -1;
+		}
+		return 0;
+	}
+
+	if (process_frames(c, df) < 0 || flush_client(epfd, c) < 0) {
+		return -1;
+	}
+
+	return (c->closing && c->out_len == 0) ? -1 : 0;
+}
+
+static void accept_clients(int epfd, int servSock)
+{
+	for (;;) {
+		struct sockaddr_in clntAddr;
+		socklen_t clntLen = sizeof(clntAddr);
+		int clntSock = accept(servSock, (struct sockaddr *) &clntAddr, &clntLen);
+		if (clntSock < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+				perror("accept() failed");
+			}
+			return;
+		}
+
+		struct tcp_client *c = calloc(1, sizeof(struct tcp_client));
+		if (c == NULL || set_nonblocking(clntSock) < 0) {
+			perror("Unable to set up client");
+			free(c);
+			close(clntSock);
+			continue;
+		}
+		int nodelay = 1;
+		setsockopt(clntSock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+		c->fd = clntSock;
+		c->addr = clntAddr;
+
+		struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, clntSock, &ev) < 0) {
+			perror("epoll_ctl() failed");
+			free(c);
+			close(clntSock);
+			continue;
+		}
+
+		printf("Handling client %s\n", inet_ntoa(clntAddr.sin_addr));
+	}
+}
+
+int TCPServer(unsigned short servPort, struct options * current_options, struct debugfs_file *df)
+{
+	int servSock;                    /* Socket descriptor for server */
+	struct sockaddr_in servAddr;     /* Local address */
+
+	/* Create socket for incoming connections */
+	if ((servSock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) {
+		perror("socket() failed");
+		exit(1);
+	}
+	int so_reuseaddr = 1;
+	setsockopt(servSock, SOL_SOCKET, SO_REUSEADDR, &so_reuseaddr, sizeof so_reuseaddr);
+
+	/* Construct local address structure */
+	memset(&servAddr, 0, sizeof(servAddr));
+	servAddr.sin_family = AF_INET;
+	servAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+	servAddr.sin_port = htons(servPort);
+
+	if (bind(servSock, (struct sockaddr *) &servAddr, sizeof(servAddr)) < 0) {
+		perror("bind() failed");
+		exit(1);
+	}
+
+	if (listen(servSock, MAXPENDING) < 0 || set_nonblocking(servSock) < 0) {
+		perror("listen() failed");
+		exit(1);
+	}
+
+	int epfd = epoll_create1(0);
+	if (epfd < 0) {
+		perror("epoll_create1() failed");
+		exit(1);
+	}
+
+	/* The listening socket is the only one registered with a NULL pointer. */
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, servSock, &ev) < 0) {
+		perror("epoll_ctl() failed");
+		exit(1);
+	}
+
+	for (;;) /* Run forever */
+	{
+		struct epoll_event events[TCP_MAX_EVENTS];
+		int n = epoll_wait(epfd, events, TCP_MAX_EVENTS, -1);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("epoll_wait() failed");
+			exit(1);
+		}
+
+		for (int i = 0; i < n; i++) {
+			struct tcp_client *c = events[i].data.ptr;
+			if (c == NULL) {
+				accept_clients(epfd, servSock);
+				continue;
+			}
+
+			int gone = 0;
+			if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+				gone = read_client(epfd, c, df) < 0;
+			}
+			if (!gone && (events[i].events & EPOLLOUT)) {
+				gone = flush_client(epfd, c) < 0 || (c->closing && c->out_len == 0);
+			}
+			if (gone) {
+				close_client(epfd, c);
+			}
+		}
+	}
+
+	close(epfd);
+	close(servSock);
+	return 0;
+}
@@ -1,12 +1,23 @@
 /* Handel TCP.h */
 
+#ifndef HANDLE_TCP_H
+#define HANDLE_TCP_H
 
 //char * xml_tags[4]={"Maclet", "Filename", "FileContent", "Command"};
 
-
-
-
-
-
-
-
+/* Control server framing.
+ *
+ * Every message is a 4 byte length in network byte order followed by
+ * that many bytes of XML (<Maclet><Command>...</Command></Maclet> or
+ * <Maclet><FileName>...</FileName><FileContent>...</FileContent></Maclet>).
+ * Each message gets a reply framed the same way, in order, so a client
+ * can keep one connection open and send several messages without
+ * waiting for the replies. A connection whose first byte is '<' is an
+ * old style client: its whole stream up to the end of file is one
+ * unframed message, and it gets no reply. */
+
+#define TCP_FRAME_HEADER	4
+#define TCP_MAX_FRAME		(1 << 20)
+#define TCP_MAX_EVENTS		64
+
+#endif
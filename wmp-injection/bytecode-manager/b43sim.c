@@ -0,0 +1,535 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "b43sim.h"
+#include "dataParser.h"
+#include "metamac.h"
+
+enum sim_file_kind {
+	SIM_MMIO16READ,
+	SIM_MMIO16WRITE,
+	SIM_MMIO32READ,
+	SIM_MMIO32WRITE,
+	SIM_SHM16READ,
+	SIM_SHM16WRITE,
+	SIM_SHM32READ,
+	SIM_SHM32WRITE,
+};
+
+/* State of one simulated debugfs file. A read file remembers the address
+written to it and formats the value when it is read back. */
+struct sim_file {
+	struct b43_sim *sim;
+	enum sim_file_kind kind;
+	int routing;
+	int offset;
+	char result[16];
+	size_t length;
+	size_t position;
+};
+
+static uint64_t sim_clock(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sim_delay(unsigned int ns)
+{
+	struct timespec start, now;
+
+	if (ns == 0) {
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+	do {
+		clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	} while ((now.tv_sec - start.tv_sec) * 1000000000L + (now.tv_nsec - start.tv_nsec) < ns);
+}
+
+void b43_sim_init(struct b43_sim *sim)
+{
+	memset(sim, 0, sizeof(*sim));
+	sim->start = sim_clock();
+	sim->load = 0.5;
+	sim->persistence = 0.5;
+	sim->other = 0.2;
+	sim->random = 1;
+	pthread_mutex_init(&sim->lock, NULL);
+	/* The bytecode in slot 1 is running. */
+	sim->regs[GPR_BYTECODE_ADDRESS] = PARAMETER_ADDR_OFFSET_BYTECODE_1;
+}
+
+static uint64_t sim_tsf_at(const struct b43_sim *sim, uint64_t elapsed)
+{
+	if (sim->jump_period_us > 0) {
+		elapsed += (elapsed / sim->jump_period_us) * sim->jump_us;
+	}
+	return elapsed;
+}
+
+uint64_t b43_sim_tsf(const struct b43_sim *sim)
+{
+	return sim_tsf_at(sim, sim_clock() - sim->start);
+}
+
+/* xorshift32, so that a seed gives the same feedback on every host. */
+static int sim_chance(struct b43_sim *sim, double p)
+{
+	sim->random ^= sim->random << 13;
+	sim->random ^= sim->random >> 17;
+	sim->random ^= sim->random << 5;
+	return sim->random < p * 4294967296.0;
+}
+
+static void sim_feedback_bit(struct b43_sim *sim, int offset, int index, int set)
+{
+	uint16_t *word = &sim->shm[offset / 2];
+	*word = set ? (*word | (1 << index)) : (*word & ~(1 << index));
+}
+
+/* Feedback of slot n, written when it ends. The bit of the slot now
+starting is cleared, the firmware fills it in as the slot goes. */
+static void sim_slot_end(struct b43_sim *sim, uint64_t n)
+{
+	int queued = sim_chance(sim, sim->load);
+	int transmitted = queued && sim_chance(sim, sim->persistence);
+	int other = sim_chance(sim, sim->other);
+	int success = transmitted && !other;
+	int bad = other && !transmitted && sim_chance(sim, 0.1);
+	int index = n % 8, next = (n + 1) % 8;
+
+	sim_feedback_bit(sim, PACKET_TO_TRANSMIT, index, queued);
+	sim_feedback_bit(sim, MY_TRANSMISSION, index, transmitted);
+	sim_feedback_bit(sim, SUCCES_TRANSMISSION, index, success);
+	sim_feedback_bit(sim, OTHER_TRANSMISSION, index, other);
+	sim_feedback_bit(sim, BAD_RECEPTION, index, bad);
+	sim_feedback_bit(sim, BUSY_SLOT, index, other);
+
+	sim_feedback_bit(sim, PACKET_TO_TRANSMIT, next, 0);
+	sim_feedback_bit(sim, MY_TRANSMISSION, next, 0);
+	sim_feedback_bit(sim, SUCCES_TRANSMISSION, next, 0);
+	sim_feedback_bit(sim, OTHER_TRANSMISSION, next, 0);
+	sim_feedback_bit(sim, BAD_RECEPTION, next, 0);
+	sim_feedback_bit(sim, BUSY_SLOT, next, 0);
+
+	if (sim->ring_size > 0) {
+		uint16_t head = sim->shm[FEEDBACK_RING_HEAD_ADDR / 2];
+		uint16_t *record = &sim->shm[FEEDBACK_RING_RECORDS_ADDR / 2 +
+			(head % sim->ring_size) * FEEDBACK_RECORD_WORDS];
+
+		record[FEEDBACK_RECORD_SLOT] = n & 0xFFFF;
+		record[FEEDBACK_RECORD_TSF] = sim_tsf_at(sim, (n + 1) * sim->slot_us) & 0xFFFF;
+		record[FEEDBACK_RECORD_FLAGS] =
+			(queued ? FEEDBACK_PACKET_QUEUED : 0) |
+			(transmitted ? FEEDBACK_TRANSMITTED : 0) |
+			(success ? FEEDBACK_TRANSMIT_SUCCESS : 0) |
+			(other ? FEEDBACK_TRANSMIT_OTHER | FEEDBACK_BUSY_SLOT : 0) |
+			(bad ? FEEDBACK_BAD_RECEPTION : 0);
+		sim->shm[FEEDBACK_RING_HEAD_ADDR / 2] = head + 1;
+	}
+}
+
+/* Runs the slot clock up to now and serves the pending GPR_CONTROL
+request once its time has come. */
+static void sim_firmware(struct b43_sim *sim)
+{
+	uint64_t now = sim_clock();
+
+	if (sim->slot_us > 0) {
+		uint64_t current = (now - sim->start) / sim->slot_us;
+		/* After a long pause only the slots still visible in the
+		bitmaps and the ring are generated. */
+		uint64_t history = 8 + sim->ring_size;
+
+		if (current > sim->slots + history) {
+			sim->slots = current - history;
+		}
+		for (; sim->slots < current; sim->slots++) {
+			sim_slot_end(sim, sim->slots);
+		}
+		sim->regs[COUNT_SLOT] = current & 0xFFFF;
+	}
+
+	if (sim->commit_at == 0 || now < sim->commit_at) {
+		return;
+	}
+
+	uint16_t control = sim->regs[GPR_CONTROL];
+
+	if (control & 0x0F00) {
+		sim->regs[GPR_BYTECODE_ADDRESS] = (control & 0x0200) ?
+			PARAMETER_ADDR_OFFSET_BYTECODE_2 : PARAMETER_ADDR_OFFSET_BYTECODE_1;
+		control &= ~0x0F00;
+		sim->switches++;
+	}
+	if (control & 0x0001) {
+		control |= 0x0002;
+	}
+
+	sim->regs[GPR_CONTROL] = control;
+	sim->commit_at = 0;
+}
+
+static uint16_t *sim_word(struct b43_sim *sim, int routing, int offset)
+{
+	switch (routing) {
+	case B43_MMIO:
+		return &sim->mmio[(offset / 2) % B43_SIM_WORDS];
+	case B43_SHM_SHARED:
+		return &sim->shm[(offset / 2) % B43_SIM_WORDS];
+	case B43_SHM_REGS:
+		return &sim->regs[offset % 64];
+	case B43_SHM_IHR:
+		return &sim->ihr[offset % B43_SIM_WORDS];
+	case B43_SHM_RCMTA:
+		return &sim->rcmta[offset % B43_SIM_WORDS];
+	default:
+		return &sim->ucode[offset % B43_SIM_WORDS];
+	}
+}
+
+static uint16_t sim_read16(struct b43_sim *sim, int routing, int offset)
+{
+	if (routing == B43_MMIO && offset >= B43_MMIO_TSF_0 && offset <= B43_MMIO_TSF_3) {
+		return b43_sim_tsf(sim) >> (8 * (offset - B43_MMIO_TSF_0)) & 0xFFFF;
+	}
+
+	return *sim_word(sim, routing, offset);
+}
+
+static void sim_write16(struct b43_sim *sim, int routing, int offset, uint16_t mask, uint16_t value)
+{
+	uint16_t *word = sim_word(sim, routing, offset);
+	uint16_t old = *word;
+
+	*word = (old & mask) | value;
+
+	if (routing == B43_SHM_REGS && offset == GPR_CONTROL) {
+		/* A new switch request, or entering wait mode. */
+		if (((*word & 0x0F00) && !(old & 0x0F00)) || ((*word & 0x0001) && !(old & 0x0001))) {
+			if (sim->commit_at == 0) {
+				sim->commit_at = sim_clock() + sim->switch_us;
+			}
+		}
+		if (!(*word & 0x0001)) {
+			*word &= ~0x0002;
+		}
+		/* Both requests withdrawn before the firmware got to them. */
+		if (!(*word & 0x0F01)) {
+			sim->commit_at = 0;
+		}
+	}
+}
+
+/* Byte addressed spaces step by 2 to the upper halfword of a 32 bit
+access, word addressed ones by 1. */
+static int sim_step(int routing)
+{
+	return (routing == B43_SHM_SHARED || routing == B43_MMIO) ? 2 : 1;
+}
+
+static uint32_t sim_read(struct b43_sim *sim, int routing, int offset, int width)
+{
+	sim_delay(sim->access_ns);
+
+	pthread_mutex_lock(&sim->lock);
+	sim_firmware(sim);
+	sim->reads++;
+
+	uint32_t value = sim_read16(sim, routing, offset);
+	if (width == 32) {
+		value |= (uint32_t)sim_read16(sim, routing, offset + sim_step(routing)) << 16;
+	}
+	pthread_mutex_unlock(&sim->lock);
+
+	return value;
+}
+
+static void sim_write(struct b43_sim *sim, int routing, int offset, int width, uint32_t mask, uint32_t value)
+{
+	sim_delay(sim->access_ns);
+
+	pthread_mutex_lock(&sim->lock);
+	sim_firmware(sim);
+	sim->writes++;
+
+	sim_write16(sim, routing, offset, mask & 0xFFFF, value & 0xFFFF);
+	if (width == 32) {
+		sim_write16(sim, routing, offset + sim_step(routing), mask >> 16, value >> 16);
+	}
+	pthread_mutex_unlock(&sim->lock);
+}
+
+static int sim_file_width(const struct sim_file *file)
+{
+	return (file->kind == SIM_MMIO32READ || file->kind == SIM_MMIO32WRITE ||
+		file->kind == SIM_SHM32READ || file->kind == SIM_SHM32WRITE) ? 32 : 16;
+}
+
+static int sim_file_mmio(const struct sim_file *file)
+{
+	return file->kind <= SIM_MMIO32WRITE;
+}
+
+static ssize_t sim_file_write(void *cookie, const char *buf, size_t size)
+{
+	struct sim_file *file = cookie;
+	char cmd[64];
+	unsigned int a, b, c, d;
+	int n;
+
+	if (size >= sizeof(cmd)) {
+		return -1;
+	}
+	memcpy(cmd, buf, size);
+	cmd[size] = '\0';
+
+	n = sscanf(cmd, "%x %x %x %x", &a, &b, &c, &d);
+
+	switch (file->kind) {
+	case SIM_MMIO16READ:
+	case SIM_MMIO32READ:
+		if (n < 1) {
+			return -1;
+		}
+		file->routing = B43_MMIO;
+		file->offset = a;
+		break;
+
+	case SIM_SHM16READ:
+	case SIM_SHM32READ:
+		if (n < 2) {
+			return -1;
+		}
+		file->routing = a;
+		file->offset = b;
+		break;
+
+	case SIM_MMIO16WRITE:
+	case SIM_MMIO32WRITE:
+		if (n < 3) {
+			return -1;
+		}
+		sim_write(file->sim, B43_MMIO, a, sim_file_width(file), b, c);
+		break;
+
+	case SIM_SHM16WRITE:
+	case SIM_SHM32WRITE:
+		if (n < 4) {
+			return -1;
+		}
+		sim_write(file->sim, a, b, sim_file_width(file), c, d);
+		break;
+	}
+
+	return size;
+}
+
+static ssize_t sim_file_read(void *cookie, char *buf, size_t size)
+{
+	struct sim_file *file = cookie;
+
+	if (file->position == 0) {
+		uint32_t value = sim_read(file->sim, file->routing, file->offset, sim_file_width(file));
+		file->length = sprintf(file->result, sim_file_width(file) == 32 ? "0x%08X\n" : "0x%04X\n", value);
+	}
+
+	size_t n = file->length - file->position;
+	if (n > size) {
+		n = size;
+	}
+	memcpy(buf, file->result + file->position, n);
+	file->position += n;
+	return n;
+}
+
+static int sim_file_seek(void *cookie, off64_t *offset, int whence)
+{
+	struct sim_file *file = cookie;
+
+	if (whence != SEEK_SET || *offset != 0) {
+		return -1;
+	}
+	file->position = 0;
+	return 0;
+}
+
+static int sim_file_close(void *cookie)
+{
+	free(cookie);
+	return 0;
+}
+
+static FILE *sim_file_open(struct b43_sim *sim, enum sim_file_kind kind, const char *mode)
+{
+	static const cookie_io_functions_t io = {
+		.read = sim_file_read,
+		.write = sim_file_write,
+		.seek = sim_file_seek,
+		.close = sim_file_close,
+	};
+	struct sim_file *file = calloc(1, sizeof(struct sim_file));
+	FILE *f;
+
+	if (file == NULL) {
+		return NULL;
+	}
+	file->sim = sim;
+	file->kind = kind;
+	file->routing = sim_file_mmio(file) ? B43_MMIO : B43_SHM_SHARED;
+
+	f = fopencookie(file, mode, io);
+	if (f == NULL) {
+		free(file);
+	}
+	return f;
+}
+
+static int sim_batch_read(struct debugfs_file *df, struct b43_access *acc, size_t count)
+{
+	struct b43_sim *sim = df->backend_priv;
+
+	for (size_t i = 0; i < count; i++) {
+		acc[i].value = sim_read(sim, acc[i].routing, acc[i].offset, acc[i].width);
+	}
+	return 0;
+}
+
+static int sim_batch_write(struct debugfs_file *df, const struct b43_access *acc, size_t count)
+{
+	struct b43_sim *sim = df->backend_priv;
+
+	for (size_t i = 0; i < count; i++) {
+		sim_write(sim, acc[i].routing, acc[i].offset, acc[i].width, acc[i].mask, acc[i].value);
+	}
+	return 0;
+}
+
+static const struct b43_backend b43_sim_backend = {
+	.name = "sim",
+	.read = sim_batch_read,
+	.write = sim_batch_write,
+};
+
+/* Same files as init_file, on the simulated card. close_file releases them. */
+int b43_sim_open(struct debugfs_file *df, struct b43_sim *sim)
+{
+	df->f_mmio16read = sim_file_open(sim, SIM_MMIO16READ, "r+");
+	df->f_mmio16write = sim_file_open(sim, SIM_MMIO16WRITE, "w");
+	df->f_mmio32read = sim_file_open(sim, SIM_MMIO32READ, "r+");
+	df->f_mmio32write = sim_file_open(sim, SIM_MMIO32WRITE, "w");
+	df->f_shm16read = sim_file_open(sim, SIM_SHM16READ, "r+");
+	df->f_shm16write = sim_file_open(sim, SIM_SHM16WRITE, "w");
+	df->f_shm32read = sim_file_open(sim, SIM_SHM32READ, "r+");
+	df->f_shm32write = sim_file_open(sim, SIM_SHM32WRITE, "w");
+
+	if (df->f_mmio16read == NULL || df->f_mmio16write == NULL ||
+		df->f_mmio32read == NULL || df->f_mmio32write == NULL ||
+		df->f_shm16read == NULL || df->f_shm16write == NULL ||
+		df->f_shm32read == NULL || df->f_shm32write == NULL) {
+		return -1;
+	}
+
+	b43_set_backend(df, &b43_sim_backend, sim);
+	return 0;
+}
+
+/* Sets the parameters named in spec, "key=value[,key=value...]":
+access (ns), switch (us), slot (us), load, persistence, other, ring
+(records, a power of two), jump (period_us:delta_us) and seed.
+Returns -1 on an unknown key or invalid value. */
+int b43_sim_configure(struct b43_sim *sim, const char *spec)
+{
+	char *copy = strdup(spec), *saveptr = NULL;
+	int ret = 0;
+
+	if (copy == NULL) {
+		return -1;
+	}
+
+	for (char *item = strtok_r(copy, ",", &saveptr); item != NULL && ret == 0;
+		item = strtok_r(NULL, ",", &saveptr)) {
+		char *value = strchr(item, '=');
+		unsigned long long period;
+		long long delta;
+
+		if (value == NULL) {
+			ret = -1;
+			break;
+		}
+		*value++ = '\0';
+
+		if (strcmp(item, "access") == 0) {
+			ret = sscanf(value, "%u", &sim->access_ns) == 1 ? 0 : -1;
+		} else if (strcmp(item, "switch") == 0) {
+			ret = sscanf(value, "%u", &sim->switch_us) == 1 ? 0 : -1;
+		} else if (strcmp(item, "slot") == 0) {
+			ret = sscanf(value, "%u", &sim->slot_us) == 1 ? 0 : -1;
+		} else if (strcmp(item, "load") == 0) {
+			ret = sscanf(value, "%lf", &sim->load) == 1 ? 0 : -1;
+		} else if (strcmp(item, "persistence") == 0) {
+			ret = sscanf(value, "%lf", &sim->persistence) == 1 ? 0 : -1;
+		} else if (strcmp(item, "other") == 0) {
+			ret = sscanf(value, "%lf", &sim->other) == 1 ? 0 : -1;
+		} else if (strcmp(item, "ring") == 0) {
+			ret = sscanf(value, "%u", &sim->ring_size) == 1 &&
+				sim->ring_size <= FEEDBACK_RING_MAX_SIZE &&
+				(sim->ring_size & (sim->ring_size - 1)) == 0 ? 0 : -1;
+		} else if (strcmp(item, "jump") == 0) {
+			ret = sscanf(value, "%llu:%lld", &period, &delta) == 2 ? 0 : -1;
+			sim->jump_period_us = period;
+			sim->jump_us = delta;
+		} else if (strcmp(item, "seed") == 0) {
+			ret = sscanf(value, "%u", &sim->random) == 1 && sim->random != 0 ? 0 : -1;
+		} else {
+			ret = -1;
+		}
+	}
+
+	free(copy);
+
+	if (sim->ring_size > 0) {
+		sim->shm[FEEDBACK_RING_MAGIC_ADDR / 2] = FEEDBACK_RING_MAGIC;
+		sim->shm[FEEDBACK_RING_SIZE_ADDR / 2] = sim->ring_size;
+	}
+
+	return ret;
+}
+
+/* Opens a simulated card on df when B43_SIM is set, see b43sim.h.
+Returns 1 if it did, 0 if B43_SIM is not set. */
+int b43_sim_from_env(struct debugfs_file *df)
+{
+	const char *spec = getenv("B43_SIM");
+	struct b43_sim *sim;
+
+	if (spec == NULL) {
+		return 0;
+	}
+
+	sim = malloc(sizeof(struct b43_sim));
+	if (sim == NULL) {
+		perror("b43 sim");
+		exit(1);
+	}
+
+	b43_sim_init(sim);
+	sim->slot_us = 2200;
+	if (b43_sim_configure(sim, spec) < 0) {
+		fprintf(stderr, "Invalid B43_SIM: %s\n", spec);
+		exit(1);
+	}
+	if (b43_sim_open(df, sim) < 0) {
+		perror("b43 sim");
+		exit(1);
+	}
+
+	fprintf(stderr, "Using a simulated b43 card (B43_SIM=%s)\n", spec);
+	return 1;
+}
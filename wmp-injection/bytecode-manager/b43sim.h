@@ -0,0 +1,80 @@
+#ifndef B43SIM_H
+#define B43SIM_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "libb43.h"
+
+/* In-memory stand-in for the debugfs files of a b43 card.
+ *
+ * b43_sim_open fills a debugfs_file with streams that parse the same
+ * commands as /sys/kernel/debug/b43/phyX/{shm,mmio}{16,32}{read,write}
+ * and sets a backend for the batched API, both working on the memory
+ * image below. Every access costs access_ns, busy waited so that it
+ * stays accurate below the scheduler tick.
+ *
+ * The firmware model serves the GPR_CONTROL handshake: a slot switch
+ * request (bits 0x0F00) is committed, and wait mode (bit 0) acknowledged
+ * with bit 1, switch_us after it is written. With slot_us set it also
+ * runs the metaMAC slot clock: COUNT_SLOT counts slots, and at the end
+ * of every slot its feedback (packet queued with probability load, sent
+ * with probability persistence, another node transmitting with
+ * probability other) goes into the feedback bitmaps and, with ring_size
+ * set, into the slot feedback ring. The TSF counts microseconds since
+ * b43_sim_init and jumps by jump_us every jump_period_us, like the
+ * glitches metamac_read_loop has to survive; the slot clock does not.
+ *
+ * init_file opens the simulated card instead of debugfs when B43_SIM is
+ * set in the environment, to a comma separated list of key=value taken
+ * from b43_sim_configure (an empty string keeps the defaults), e.g.
+ *	B43_SIM=slot=2200,load=0.6,ring=64,jump=5000000:300000 ./metamac ... */
+
+#define B43_SIM_WORDS		4096
+
+struct b43_sim {
+	/* One array per routing. Shared memory and MMIO are byte
+	addressed, the other routings word addressed. */
+	uint16_t ucode[B43_SIM_WORDS];
+	uint16_t shm[B43_SIM_WORDS];
+	uint16_t regs[64];
+	uint16_t ihr[B43_SIM_WORDS];
+	uint16_t rcmta[B43_SIM_WORDS];
+	uint16_t mmio[B43_SIM_WORDS];
+
+	unsigned int access_ns;
+	unsigned int switch_us;
+
+	/* Firmware model, see above. */
+	unsigned int slot_us;
+	double load;
+	double persistence;
+	double other;
+	unsigned int ring_size;
+	uint64_t jump_period_us;
+	int64_t jump_us;
+	uint32_t random;
+
+	/* Slots whose feedback has been written. */
+	uint64_t slots;
+
+	/* Host time (CLOCK_MONOTONIC_RAW, microseconds) of TSF 0. */
+	uint64_t start;
+	/* Host time at which the pending GPR_CONTROL request is served, 0 if none. */
+	uint64_t commit_at;
+
+	unsigned long reads;
+	unsigned long writes;
+	unsigned long switches;
+
+	/* The reader and the processing threads of metamac share the card. */
+	pthread_mutex_t lock;
+};
+
+void b43_sim_init(struct b43_sim *sim);
+int b43_sim_configure(struct b43_sim *sim, const char *spec);
+int b43_sim_open(struct debugfs_file *df, struct b43_sim *sim);
+int b43_sim_from_env(struct debugfs_file *df);
+uint64_t b43_sim_tsf(const struct b43_sim *sim);
+
+#endif // B43SIM_H
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include <argp.h>
+
+#include "bytecode-image.h"
+
+/* ******************
+ * Bytecode compiler
+ *
+ * Turns a text bytecode (.txt) into a binary image that bytecode-manager
+ * (-m) and metamac load without any text parsing.
+ * usage: ./bytecode-compiler dcf_v3-2.txt dcf_v3-2.bin
+ * ***************** */
+
+const char *argp_program_version = "WMP Bytecode Compiler 0.0.1";
+static const char doc[] = "Compiles a text bytecode into a binary bytecode image.";
+static const char args_doc[] = "INPUT OUTPUT";
+
+static const struct argp_option options[] = {
+	{ "verbose", 'v', 0, 0, "Print the layout of the image." },
+	{ 0 }
+};
+
+struct arguments {
+	char *input;
+	char *output;
+	int verbose;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+	struct arguments *arguments = state->input;
+
+	switch (key) {
+	case 'v':
+		arguments->verbose = 1;
+		break;
+
+	case ARGP_KEY_ARG:
+		if (state->arg_num == 0) {
+			arguments->input = arg;
+		} else if (state->arg_num == 1) {
+			arguments->output = arg;
+		} else {
+			argp_usage(state);
+		}
+		break;
+
+	case ARGP_KEY_END:
+		if (state->arg_num < 2) {
+			argp_usage(state);
+		}
+		break;
+
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+static const struct argp argp = { options, parse_opt, args_doc, doc };
+
+int main(int argc, char *argv[])
+{
+	struct arguments arguments;
+	memset(&arguments, 0, sizeof(arguments));
+	argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+	struct bytecode_image img;
+	if (bytecode_image_compile(arguments.input, &img) < 0) {
+		errx(EXIT_FAILURE, "Unable to compile %s", arguments.input);
+	}
+	if (bytecode_image_save(arguments.output, &img) < 0) {
+		errx(EXIT_FAILURE, "Unable to write %s", arguments.output);
+	}
+
+	printf("%s: %u params, %u transition words, %u states\n", arguments.output,
+		img.param_count, img.transition_count, img.state_count);
+
+	if (arguments.verbose) {
+		printf("params      0x%04X - 0x%04X\n", 0, img.param_count * 2);
+		printf("transitions 0x%04X - 0x%04X\n", IMAGE_PARAM_LENGTH * 2,
+			(IMAGE_PARAM_LENGTH + img.transition_count) * 2);
+		printf("states      0x%04X - 0x%04X\n", (IMAGE_PARAM_LENGTH + IMAGE_TRANSITION_LENGTH) * 2,
+			(IMAGE_PARAM_LENGTH + IMAGE_TRANSITION_LENGTH + img.state_count) * 2);
+	}
+
+	return 0;
+}
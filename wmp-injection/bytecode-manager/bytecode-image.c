@@ -0,0 +1,469 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#include "bytecode-image.h"
+
+static uint32_t crc32_update(uint32_t crc, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	crc = ~crc;
+	while (len--) {
+		crc ^= *p++;
+		for (int k = 0; k < 8; k++) {
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+		}
+	}
+	return ~crc;
+}
+
+static int hex_pair(const char *s)
+{
+	char tmp[3] = { s[0], s[1], '\0' };
+	char *end;
+	long v = strtol(tmp, &end, 16);
+	return (end == tmp + 2) ? (int)v : -1;
+}
+
+/* Halfword stored as "LLHH" in the text bytecode. */
+static int hex_halfword(const char *s)
+{
+	int lo = hex_pair(s);
+	int hi = hex_pair(s + 2);
+	return (lo < 0 || hi < 0) ? -1 : (lo | (hi << 8));
+}
+
+static int parse_transitions(const char *line, struct bytecode_image *img, const char *path)
+{
+	size_t len = strlen(line);
+	size_t index = 0;
+
+	while (1) {
+		/* Condition reference, three halfwords per transition. */
+		if (index + 12 > len) {
+			warnx("%s: truncated transition line: %s", path, line);
+			return -1;
+		}
+		if (img->transition_count + 3 > IMAGE_TRANSITION_LENGTH) {
+			warnx("%s: transition region overflow", path);
+			return -1;
+		}
+
+		int condition = hex_pair(line + index + 2);
+		if (condition < 0 || condition >= NUM_CONDITION_PROCEDURE) {
+			warnx("%s: invalid condition reference in: %s", path, line);
+			return -1;
+		}
+		img->condition_ref[img->transition_count / 8] |= 1 << (img->transition_count % 8);
+		img->transitions[img->transition_count++] = condition;
+		index += 4;
+
+		for (int k = 0; k < 2; k++) {
+			int value = hex_halfword(line + index);
+			if (value < 0) {
+				warnx("%s: invalid transition word in: %s", path, line);
+				return -1;
+			}
+			img->transitions[img->transition_count++] = value;
+			index += 4;
+		}
+
+		if (index + 4 <= len && strncmp(line + index, "FFFF", 4) == 0) {
+			if (img->transition_count + 1 > IMAGE_TRANSITION_LENGTH) {
+				warnx("%s: transition region overflow", path);
+				return -1;
+			}
+			img->transitions[img->transition_count++] = 0xFFFF;
+			return 0;
+		}
+		if (index >= len || line[index] == '$') {
+			return 0;
+		}
+	}
+}
+
+/* Same grammar as bytecodeSharedWrite: everything before 000001 is
+ignored, '#' lines are comments, 000003 moves the parameter index,
+000004/000006/000010 carry the parameter, transition and state lines
+and 000099 ends the bytecode. */
+int bytecode_image_compile(const char *path, struct bytecode_image *img)
+{
+	char line[256];
+	int started = 0, finished = 0;
+	int param_index = 0;
+
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		warn("%s", path);
+		return -1;
+	}
+
+	memset(img, 0, sizeof(*img));
+
+	while (!finished && fgets(line, sizeof(line), file) != NULL) {
+		if (!started) {
+			started = strncmp(line, "000001", 6) == 0;
+			continue;
+		}
+		if (line[0] == '#') {
+			continue;
+		}
+
+		if (strncmp(line, "000099", 6) == 0) {
+			finished = 1;
+			continue;
+		}
+
+		int tag = strncmp(line, "000003", 6) == 0 ? 3 :
+			strncmp(line, "000004", 6) == 0 ? 4 :
+			strncmp(line, "000006", 6) == 0 ? 6 :
+			strncmp(line, "000010", 6) == 0 ? 10 : 0;
+		if (tag == 0) {
+			continue;
+		}
+
+		if (fgets(line, sizeof(line), file) == NULL) {
+			warnx("%s: missing operand after tag %06d", path, tag);
+			goto fail;
+		}
+		line[strcspn(line, " \t\r\n#")] = '\0';
+
+		int value = (tag == 6) ? 0 : (tag == 3) ? hex_pair(line) : hex_halfword(line);
+		if (value < 0) {
+			warnx("%s: invalid value: %s", path, line);
+			goto fail;
+		}
+
+		switch (tag) {
+		case 3:
+			param_index = value;
+			break;
+
+		case 4:
+			if (param_index >= IMAGE_PARAM_LENGTH) {
+				warnx("%s: parameter region overflow", path);
+				goto fail;
+			}
+			img->params[param_index] = value;
+			img->param_mask |= 1ULL << param_index;
+			param_index++;
+			if (param_index > img->param_count) {
+				img->param_count = param_index;
+			}
+			break;
+
+		case 6:
+			if (parse_transitions(line, img, path) < 0) {
+				goto fail;
+			}
+			break;
+
+		case 10:
+			if (img->state_count >= IMAGE_STATE_LENGTH) {
+				warnx("%s: state region overflow", path);
+				goto fail;
+			}
+			img->states[img->state_count++] = value;
+			break;
+		}
+	}
+
+	fclose(file);
+
+	if (!started) {
+		warnx("%s: could not find start file (000001)", path);
+		return -1;
+	}
+	return 0;
+
+fail:
+	fclose(file);
+	return -1;
+}
+
+int bytecode_image_save(const char *path, const struct bytecode_image *img)
+{
+	struct bytecode_image_header header = {
+		.magic = BYTECODE_IMAGE_MAGIC,
+		.version = BYTECODE_IMAGE_VERSION,
+		.header_size = sizeof(struct bytecode_image_header),
+		.param_mask = img->param_mask,
+		.param_count = img->param_count,
+		.transition_count = img->transition_count,
+		.state_count = img->state_count,
+	};
+	size_t ref_bytes = (img->transition_count + 7) / 8;
+	uint32_t crc = 0;
+
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) {
+		warn("%s", path);
+		return -1;
+	}
+
+	crc = crc32_update(crc, &header, sizeof(header));
+	crc = crc32_update(crc, img->params, img->param_count * sizeof(uint16_t));
+	crc = crc32_update(crc, img->transitions, img->transition_count * sizeof(uint16_t));
+	crc = crc32_update(crc, img->condition_ref, ref_bytes);
+	crc = crc32_update(crc, img->states, img->state_count * sizeof(uint16_t));
+
+	if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+		fwrite(img->params, sizeof(uint16_t), img->param_count, file) != img->param_count ||
+		fwrite(img->transitions, sizeof(uint16_t), img->transition_count, file) != img->transition_count ||
+		fwrite(img->condition_ref, 1, ref_bytes, file) != ref_bytes ||
+		fwrite(img->states, sizeof(uint16_t), img->state_count, file) != img->state_count ||
+		fwrite(&crc, sizeof(crc), 1, file) != 1) {
+		warn("%s", path);
+		fclose(file);
+		return -1;
+	}
+
+	return fclose(file);
+}
+
+int bytecode_image_read(const char *path, struct bytecode_image *img)
+{
+	struct bytecode_image_header header;
+	uint32_t crc = 0, stored_crc;
+	size_t ref_bytes;
+
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		warn("%s", path);
+		return -1;
+	}
+
+	memset(img, 0, sizeof(*img));
+
+	if (fread(&header, sizeof(header), 1, file) != 1 ||
+		header.magic != BYTECODE_IMAGE_MAGIC) {
+		warnx("%s: not a bytecode image", path);
+		goto fail;
+	}
+	if (header.version != BYTECODE_IMAGE_VERSION || header.header_size != sizeof(header)) {
+		warnx("%s: unsupported bytecode image version %u", path, header.version);
+		goto fail;
+	}
+	if (header.param_count > IMAGE_PARAM_LENGTH ||
+		header.transition_count > IMAGE_TRANSITION_LENGTH ||
+		header.state_count > IMAGE_STATE_LENGTH) {
+		warnx("%s: bytecode image does not fit a slot", path);
+		goto fail;
+	}
+
+	img->param_mask = header.param_mask;
+	img->param_count = header.param_count;
+	img->transition_count = header.transition_count;
+	img->state_count = header.state_count;
+	ref_bytes = (img->transition_count + 7) / 8;
+
+	if (fread(img->params, sizeof(uint16_t), img->param_count, file) != img->param_count ||
+		fread(img->transitions, sizeof(uint16_t), img->transition_count, file) != img->transition_count ||
+		fread(img->condition_ref, 1, ref_bytes, file) != ref_bytes ||
+		fread(img->states, sizeof(uint16_t), img->state_count, file) != img->state_count ||
+		fread(&stored_crc, sizeof(stored_crc), 1, file) != 1) {
+		warnx("%s: truncated bytecode image", path);
+		goto fail;
+	}
+
+	crc = crc32_update(crc, &header, sizeof(header));
+	crc = crc32_update(crc, img->params, img->param_count * sizeof(uint16_t));
+	crc = crc32_update(crc, img->transitions, img->transition_count * sizeof(uint16_t));
+	crc = crc32_update(crc, img->condition_ref, ref_bytes);
+	crc = crc32_update(crc, img->states, img->state_count * sizeof(uint16_t));
+	if (crc != stored_crc) {
+		warnx("%s: bytecode image checksum mismatch", path);
+		goto fail;
+	}
+
+	fclose(file);
+	return 0;
+
+fail:
+	fclose(file);
+	return -1;
+}
+
+int bytecode_image_is_binary(const char *path)
+{
+	uint32_t magic = 0;
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		return 0;
+	}
+	if (fread(&magic, sizeof(magic), 1, file) != 1) {
+		magic = 0;
+	}
+	fclose(file);
+	return magic == BYTECODE_IMAGE_MAGIC;
+}
+
+/* Loads either a precompiled image or a text bytecode. */
+int bytecode_image_open(const char *path, struct bytecode_image *img)
+{
+	if (bytecode_image_is_binary(path)) {
+		return bytecode_image_read(path, img);
+	}
+	return bytecode_image_compile(path, img);
+}
+
+uint16_t bytecode_slot_base(int slot)
+{
+	return (slot == 0) ? PARAMETER_ADDR_BYTECODE_1 : PARAMETER_ADDR_BYTECODE_2;
+}
+
+/* Condition procedure addresses of the running firmware, in one batch. */
+int bytecode_image_conditions(struct debugfs_file *df, uint16_t *conditions)
+{
+	return shmReadRange16(df, B43_SHM_SHARED, ADDRESS_CONDITION_PROCEDURE,
+		conditions, NUM_CONDITION_PROCEDURE);
+}
+
+/* Expands the image into the halfwords of a whole slot. defined[i] tells
+whether slot_image[i] is written by the bytecode; the others (parameters
+skipped by 000003, unused tail of the transition and state regions) are
+left untouched on the card, as the text loader does. */
+void bytecode_image_layout(const struct bytecode_image *img, const uint16_t *conditions,
+	uint16_t *slot_image, uint8_t *defined)
+{
+	memset(slot_image, 0, IMAGE_SLOT_LENGTH * sizeof(uint16_t));
+	memset(defined, 0, IMAGE_SLOT_LENGTH);
+
+	for (int i = 0; i < img->param_count; i++) {
+		if (img->param_mask & (1ULL << i)) {
+			slot_image[i] = img->params[i];
+			defined[i] = 1;
+		}
+	}
+
+	uint16_t *transitions = slot_image + IMAGE_PARAM_LENGTH;
+	for (int i = 0; i < img->transition_count; i++) {
+		if (img->condition_ref[i / 8] & (1 << (i % 8))) {
+			transitions[i] = conditions[img->transitions[i]];
+		} else {
+			transitions[i] = img->transitions[i];
+		}
+		defined[IMAGE_PARAM_LENGTH + i] = 1;
+	}
+
+	uint16_t *states = transitions + IMAGE_TRANSITION_LENGTH;
+	memcpy(states, img->states, img->state_count * sizeof(uint16_t));
+	memset(defined + IMAGE_PARAM_LENGTH + IMAGE_TRANSITION_LENGTH, 1, img->state_count);
+}
+
+/* Writes the image into bytecode slot 0 or 1 as one range write per run
+of defined halfwords, which the backend merges into 32 bit writes. */
+int bytecode_image_load(struct debugfs_file *df, int slot, const struct bytecode_image *img)
+{
+	uint16_t conditions[NUM_CONDITION_PROCEDURE];
+	uint16_t slot_image[IMAGE_SLOT_LENGTH];
+	uint8_t defined[IMAGE_SLOT_LENGTH];
+	uint16_t base = bytecode_slot_base(slot);
+
+	if (bytecode_image_conditions(df, conditions) < 0) {
+		return -1;
+	}
+
+	bytecode_image_layout(img, conditions, slot_image, defined);
+
+	int i = 0;
+	while (i < IMAGE_SLOT_LENGTH) {
+		if (!defined[i]) {
+			i++;
+			continue;
+		}
+
+		int start = i;
+		while (i < IMAGE_SLOT_LENGTH && defined[i]) {
+			i++;
+		}
+		if (shmWriteRange16(df, B43_SHM_SHARED, base + start * 2,
+			slot_image + start, i - start) < 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+void bytecode_shadow_invalidate(struct bytecode_shadow *shadow)
+{
+	memset(shadow->known, 0, IMAGE_SLOT_LENGTH);
+}
+
+/* Fills the shadow with the current content of the slot. */
+int bytecode_shadow_read(struct debugfs_file *df, int slot, struct bytecode_shadow *shadow)
+{
+	if (shmReadRange16(df, B43_SHM_SHARED, bytecode_slot_base(slot),
+		shadow->image, IMAGE_SLOT_LENGTH) < 0) {
+		bytecode_shadow_invalidate(shadow);
+		return -1;
+	}
+
+	memset(shadow->known, 1, IMAGE_SLOT_LENGTH);
+	return 0;
+}
+
+/* Writes the defined halfwords of slot_image that differ from the shadow,
+one range write per run of differing halfwords, and updates the shadow.
+Returns the number of halfwords written. */
+int bytecode_shadow_write(struct debugfs_file *df, int slot, struct bytecode_shadow *shadow,
+	const uint16_t *slot_image, const uint8_t *defined)
+{
+	uint16_t base = bytecode_slot_base(slot);
+	int written = 0;
+
+	int i = 0;
+	while (i < IMAGE_SLOT_LENGTH) {
+		if (!defined[i] || (shadow->known[i] && shadow->image[i] == slot_image[i])) {
+			i++;
+			continue;
+		}
+
+		int start = i;
+		while (i < IMAGE_SLOT_LENGTH && defined[i] &&
+			!(shadow->known[i] && shadow->image[i] == slot_image[i])) {
+			i++;
+		}
+
+		/* The halfwords of a failed write are in an unknown state. */
+		memset(shadow->known + start, 0, i - start);
+		if (shmWriteRange16(df, B43_SHM_SHARED, base + start * 2,
+			slot_image + start, i - start) < 0) {
+			return -1;
+		}
+
+		memcpy(shadow->image + start, slot_image + start, (i - start) * sizeof(uint16_t));
+		memset(shadow->known + start, 1, i - start);
+		written += i - start;
+	}
+
+	return written;
+}
+
+/* Reads the slot back and compares it with the known halfwords of the
+shadow. The shadow is resynchronised with what was read, so that the
+next write repairs any difference. Returns the number of mismatches. */
+int bytecode_shadow_verify(struct debugfs_file *df, int slot, struct bytecode_shadow *shadow)
+{
+	uint16_t actual[IMAGE_SLOT_LENGTH];
+	int mismatches = 0;
+
+	if (shmReadRange16(df, B43_SHM_SHARED, bytecode_slot_base(slot),
+		actual, IMAGE_SLOT_LENGTH) < 0) {
+		return -1;
+	}
+
+	for (int i = 0; i < IMAGE_SLOT_LENGTH; i++) {
+		if (shadow->known[i] && shadow->image[i] != actual[i]) {
+			mismatches++;
+		}
+	}
+
+	memcpy(shadow->image, actual, sizeof(actual));
+	memset(shadow->known, 1, IMAGE_SLOT_LENGTH);
+
+	return mismatches;
+}
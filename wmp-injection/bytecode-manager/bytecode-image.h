@@ -0,0 +1,85 @@
+#ifndef BYTECODE_IMAGE_H
+#define BYTECODE_IMAGE_H
+
+#include <stdint.h>
+
+#include "libb43.h"
+#include "dataParser.h"
+
+/* Precompiled bytecode image.
+ *
+ * The text bytecode (.txt, 000001/000004/000006/000010/000099 tags) is
+ * compiled once into the halfwords that end up in a bytecode slot, so
+ * that a load is only a handful of range writes. The on-disk image is
+ *
+ *	header | param block | transition block | state block | crc32
+ *
+ * in host byte order (little endian on every supported host). The
+ * transition block carries the condition indexes used by the bytecode,
+ * marked in a relocation bitmap: the matching procedure addresses are
+ * firmware dependent and are resolved against the table at
+ * ADDRESS_CONDITION_PROCEDURE when the image is loaded. */
+
+#define BYTECODE_IMAGE_MAGIC		0x42504D57	/* "WMPB" */
+#define BYTECODE_IMAGE_VERSION		1
+
+#define NUM_CONDITION_PROCEDURE		48
+
+/* Region sizes in halfwords, from the slot layout in dataParser.h. */
+#define IMAGE_PARAM_LENGTH		LENGTH_PARAMETER_REGION
+#define IMAGE_TRANSITION_LENGTH		(LENGTH_PARAMETER_AND_COMBINATION_REGION - LENGTH_PARAMETER_REGION)
+#define IMAGE_STATE_LENGTH		(((PARAMETER_ADDR_BYTECODE_2 - PARAMETER_ADDR_BYTECODE_1) / 2) - LENGTH_PARAMETER_AND_COMBINATION_REGION)
+#define IMAGE_SLOT_LENGTH		(IMAGE_PARAM_LENGTH + IMAGE_TRANSITION_LENGTH + IMAGE_STATE_LENGTH)
+
+struct bytecode_image_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t header_size;
+	/* Bit i set if parameter i is defined by the bytecode. */
+	uint64_t param_mask;
+	uint16_t param_count;
+	uint16_t transition_count;
+	uint16_t state_count;
+	uint16_t reserved;
+};
+
+struct bytecode_image {
+	uint64_t param_mask;
+	uint16_t param_count;
+	uint16_t transition_count;
+	uint16_t state_count;
+	uint16_t params[IMAGE_PARAM_LENGTH];
+	uint16_t transitions[IMAGE_TRANSITION_LENGTH];
+	/* Bit i set if transitions[i] is a condition index to relocate. */
+	uint8_t condition_ref[(IMAGE_TRANSITION_LENGTH + 7) / 8];
+	uint16_t states[IMAGE_STATE_LENGTH];
+};
+
+int bytecode_image_compile(const char *path, struct bytecode_image *img);
+int bytecode_image_save(const char *path, const struct bytecode_image *img);
+int bytecode_image_read(const char *path, struct bytecode_image *img);
+int bytecode_image_open(const char *path, struct bytecode_image *img);
+int bytecode_image_is_binary(const char *path);
+
+int bytecode_image_conditions(struct debugfs_file *df, uint16_t *conditions);
+void bytecode_image_layout(const struct bytecode_image *img, const uint16_t *conditions,
+	uint16_t *slot_image, uint8_t *defined);
+int bytecode_image_load(struct debugfs_file *df, int slot, const struct bytecode_image *img);
+
+uint16_t bytecode_slot_base(int slot);
+
+/* Host side copy of what a bytecode slot holds, so that a load only
+writes the halfwords that change. known[i] is cleared for halfwords
+whose content on the card is not known. */
+struct bytecode_shadow {
+	uint16_t image[IMAGE_SLOT_LENGTH];
+	uint8_t known[IMAGE_SLOT_LENGTH];
+};
+
+void bytecode_shadow_invalidate(struct bytecode_shadow *shadow);
+int bytecode_shadow_read(struct debugfs_file *df, int slot, struct bytecode_shadow *shadow);
+int bytecode_shadow_write(struct debugfs_file *df, int slot, struct bytecode_shadow *shadow,
+	const uint16_t *slot_image, const uint8_t *defined);
+int bytecode_shadow_verify(struct debugfs_file *df, int slot, struct bytecode_shadow *shadow);
+
+#endif // BYTECODE_IMAGE_H
@@ -209,14 +209,18 @@ int main(int argc, char * argv[])
 				if(strcmp(current_options.change_param_file,"")){
 				    load_params(&df, &current_options);
 				}
-				else{
-				    parser(&df, &current_options);
+				else if(parser(&df, &current_options) < 0){
+				    close_file(&df);
+				    exit(1);
 				}
 			  
 			}
 			
 			if(strcmp(current_options.active,"")){
-				activeBytecode(&df, &current_options);
+				if(activeBytecode(&df, &current_options) < 0){
+					close_file(&df);
+					exit(1);
+				}
 		
 			}
 
@@ -971,143 +975,6 @@ int TCPClient(char *servIP, unsigned short servPort, char * message){
 
 
 
-int TCPServer(unsigned short servPort, struct options * current_options, struct debugfs_file *df)
-{
-    int servSock;                    /* Socket descriptor for server */
-    int clntSock;                    /* Socket descriptor for client */
-    struct sockaddr_in servAddr;     /* Local address */
-    struct sockaddr_in clntAddr;     /* Client address */
-    unsigned int clntLen;            /* Length of client address data structure */
-    char buffer[RCVBUFSIZE];         /* Buffer for echo string */
-    int recvMsgSize;                 /* Size of received message */
-    char message[MAX_MESSAGE_SIZE]="";
-    char server_resp_message[MAX_MESSAGE_SIZE]="";
-
-
-
-    /* Create socket for incoming connections */
-    if ((servSock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0){
-        perror("socket() failed");
-	exit(1);
-    }
-    int so_reuseaddr = 1;
-    setsockopt(servSock, SOL_SOCKET, SO_REUSEADDR, &so_reuseaddr, sizeof so_reuseaddr);
-    
-    /* Construct local address structure */
-    memset(&servAddr, 0, sizeof(servAddr));   	 /* Zero out structure */
-    servAddr.sin_family = AF_INET;                /* Internet address family */
-    /** TODO: (forse) getIPByNIC() */
-    servAddr.sin_addr.s_addr = htonl(INADDR_ANY); /* Any incoming interface */
-
-    servAddr.sin_port = htons(servPort);          /* Local port */
-
-    /* Bind to the local address */
-    if (bind(servSock, (struct sockaddr *) &servAddr, sizeof(servAddr)) < 0){
-        perror("bind() failed");
-	exit(1);
-    }
-
-    /* Mark the socket so it will listen for incoming connections */
-    if (listen(servSock, MAXPENDING) < 0){
-        perror("listen() failed");
-	exit(1);
-    }
-
-    
-    /* Set the size of the in-out parameter */
-    clntLen = sizeof(clntAddr);
-    
-    for (;;) /* Run forever */
-    {
-      
-        /* Wait for a client to connect */
-        if ((clntSock = accept(servSock, (struct sockaddr *) &clntAddr, &clntLen)) < 0){
-	    perror("accept() failed");
-	    exit(1);
-	}
-	else{
-	    printf("accept() ok\n");
-	}
-
-        /* clntSock is connected to a client! */
-        printf("Handling client %s\n", inet_ntoa(clntAddr.sin_addr));
-	sprintf(message,"%s","");
-
-	
-	/* loop listening  for client command up on the message end*/
-	for (;;) {
-	    recvMsgSize = read(clntSock, buffer, RCVBUFSIZE);	
-	    buffer[recvMsgSize]='\0';
-	    if (recvMsgSize==0)
-		 break;
-	    else 
-		 sprintf(message,"%s%s",message,buffer);
-	
-	    sprintf(buffer,"%s","");
-	}
-	sprintf(message,"%s%s",message,"\0");
-
-	//insert for separate the send of command with execution of the command
-	sleep(1);
-	
-	
-	/* NOW HANDLE RECEIVED MESSAGE */
-	struct xml_node xml_elements[10];
-	int num_of_tags=xmlHandler(message,xml_elements);
-
-	if (isCommand(xml_elements,num_of_tags)){
-		char command[1024];
-		printf("BYTECODE IS A COMMAND\n");
-		int argcCommand = getCommand(xml_elements,num_of_tags,command);
-		//executeCommand(command);
-		//sprintf(server_resp_message,"");
-		executeCommand(command,server_resp_message,df);
-		if (!strcmp(server_resp_message,"")){
-			sprintf(server_resp_message,"NO RESPONS COMMAND");
-		}
-
-		/* if enable SEND OK MESSAGE TO CLIENT */
-		//write(clntSock, server_resp_message, strlen(server_resp_message));
-	}
-
-	if (isBytecode(xml_elements,num_of_tags)){
-		char filename[256];
-		char bytecode[4096];
-
-		sprintf(filename,"%s","");
-		sprintf(bytecode,"%s","");
-
-		getFilename(xml_elements,num_of_tags,filename);
-		getBytecode(xml_elements,num_of_tags,bytecode);
-
-		/* Replace the correct cache path file to save  bytecodes */
-		char tmp_path[256]="";
-		
-		struct passwd *pw = getpwuid(getuid());
-		const char *homedir = pw->pw_dir;
-		//printf("homedir : %s\n",homedir);
-		//printf("cachedir : %s\n",cachedir);
-		sprintf(tmp_path,"%s/%s%s",homedir,CACHE_PATH_FILE,filename);
-		
-		//printf("tmp_path=%s",tmp_path);
-		saveBytecode(tmp_path,bytecode);
-		printf("bytecode %s SAVED \n",filename);
-		
-		/* if enable SEND OK MESSAGE TO CLIENT */
-		//char * ok= "OK-FIN";
-		//write(clntSock, ok, strlen(ok));
-	}
-
-	//insert for separate the send of command with execution of the command
-	sleep(2);
-
-    }
-    close(clntSock);    // Close client socket
-
-}
-
-
-
 void viewActiveBytecode(struct debugfs_file * df,char *return_message){
 	char ret_msg[1024]="";
 	unsigned int read_wmp_value;
@@ -310,6 +310,10 @@ void readSlotTimeValue(struct debugfs_file * df,  char * file_name){
 	struct timeval start7slot, finish7slot;
 	
 	struct options opt;
+	struct control_wait switch_wait = control_wait_default;
+	struct control_wait_result switch_result;
+	
+	switch_wait.snapshot = 1;
 	
 	printf("name file %s\n",file_name);
 
@@ -332,14 +336,15 @@ void readSlotTimeValue(struct debugfs_file * df,  char * file_name){
 		
 	//	gettimeofday(&start7slot, NULL);	
 		//activation
-		writeAddressBytecode(df,&opt);	//change bytecode slot - generally we need from 20ms to 80ms to do it
-	
-	/*	gettimeofday(&finish7slot, NULL);	    
-		usec=(finish7slot.tv_sec-start7slot.tv_sec)*1000000;
-		usec+=(finish7slot.tv_usec-start7slot.tv_usec);
-		printf("%d - %ld\n", j, usec);
-		sleep(1);
-	*/	
+		//change bytecode slot - generally we need from 20ms to 80ms to do it
+		if(switchBytecodeSlot(df, opt.active[0] - '0', &switch_wait, &switch_result) < 0)
+			printf("%d - switch not committed after %llu us\n", l,
+				(unsigned long long)switch_result.latency_us);
+		else
+			printf("%d - switch %llu us (+/- %llu us, %u polls), tsf %llu us\n", l,
+				(unsigned long long)switch_result.latency_us,
+				(unsigned long long)switch_result.resolution_us, switch_result.polls,
+				(unsigned long long)(switch_result.tsf_completed - switch_result.tsf_requested));
 	
 		count_slot_old = 0x000F & shmRead16(df, B43_SHM_REGS, COUNT_SLOT);	//get current time slot number
 		for(j=0; j<84; j++){//we read metaMAC parameters every 12ms, so we complete 84 cycle in a second 
@@ -480,36 +485,37 @@ void change_parameter(struct debugfs_file * df,  struct options * opt){
 	printf("Insert value successful\n");
 }
 
-void set_parameter(struct debugfs_file *df, int slot, int num, int value)
+/* Byte offset inside a bytecode slot of the metamac parameter num,
+or -1 if num is not a settable parameter. */
+int parameter_offset(int num)
 {
-	int param_addr = 0;
 	switch (num){
 	  case 10:
-	    param_addr = 0x16*2;
-	    break;
+	    return 0x16*2;
 	  case 11:
-	    param_addr = 0x21*2;
-	    break;
+	    return 0x21*2;
 	  case 12:
-	    param_addr = 0x1F*2;
-	    break;
+	    return 0x1F*2;
 	  case 13:
-	    param_addr = 0x20*2;
-	    break;
+	    return 0x20*2;
 	  case 14:
-	    param_addr = 0x11*2;
-	    break;
+	    return 0x11*2;
 	  case 15:
-	    param_addr = 0x12*2;
-	    break;
+	    return 0x12*2;
 	  case 16:
-	    param_addr = 0x13*2;
-	    break;
+	    return 0x13*2;
 	  case 17:
-	    param_addr = 0x14*2;
-	    break;
+	    return 0x14*2;
 	  default:
-	    return;
+	    return -1;
+	}
+}
+
+void set_parameter(struct debugfs_file *df, int slot, int num, int value)
+{
+	int param_addr = parameter_offset(num);
+	if (param_addr < 0) {
+		return;
 	}
 
 	param_addr += (slot == 0) ? PARAMETER_ADDR_BYTECODE_1 : PARAMETER_ADDR_BYTECODE_2;
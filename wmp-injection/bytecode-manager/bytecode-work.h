@@ -3,4 +3,5 @@ void shmReadActivateTime(struct debugfs_file * df,  char * file_name);
 void shmReadZigbeeRx(struct debugfs_file * df,  char * file_name);
 void readSlotTimeValue(struct debugfs_file * df,  char * file_name);
 void change_parameter(struct debugfs_file * df,  struct options * opt);
+int parameter_offset(int num);
 void set_parameter(struct debugfs_file *df, int slot, int num, int value);
@@ -10,19 +10,18 @@
 #include "bytecode-manager.h"
 #include "bytecode-work.h"
 #include "dataParser.h"
+#include "bytecode-image.h"
 
 
-void activeBytecode(struct debugfs_file * df, struct options * opt){
+int activeBytecode(struct debugfs_file * df, struct options * opt){
   
   //if(strcmp(opt->do_up,"1"))
   //	 putInWaitMode(df);
   
-	writeAddressBytecode(df,opt);
+	return writeAddressBytecode(df,opt);
   
   //if(strcmp(opt->do_up,"1"))
   //	returnFromWaitMode(df);
-  
-	return;
 }
 
 void autoActiveBytecode(struct debugfs_file * df, struct options * opt){
@@ -51,8 +50,8 @@ void autoActiveBytecode(struct debugfs_file * df, struct options * opt){
 		  
 	    //loading
 	    
-	    if(strcmp(opt->do_up,"1"))
-		  putInWaitMode(df);
+	    if(strcmp(opt->do_up,"1") && putInWaitMode(df) < 0)
+		  break;
 	    
 	    gettimeofday(&starttime, NULL);	    
 	    bytecodeSharedWrite(df, opt);
@@ -113,10 +112,158 @@ void autoActiveBytecode(struct debugfs_file * df, struct options * opt){
 
 
 
-void writeAddressBytecode(struct debugfs_file * df, struct options * opt){
+/* ******************
+ * GPR_CONTROL HANDSHAKE
+ *
+ * The host sets request bits in GPR_CONTROL and the firmware clears
+ * (slot switch) or acknowledges (wait mode) them when it gets to it.
+ * Polls go through the batched API, so they cost one pread/pwrite pair
+ * on debugfs and nothing on backends that move several words at once.
+ * ***************** */
+
+const struct control_wait control_wait_default = {
+	.timeout_us = CONTROL_WAIT_TIMEOUT_US,
+	.spin_polls = CONTROL_WAIT_SPIN_POLLS,
+	.backoff_min_us = CONTROL_WAIT_BACKOFF_MIN_US,
+	.backoff_max_us = CONTROL_WAIT_BACKOFF_MAX_US,
+	.snapshot = 0,
+};
+
+/* Exponential average of the committed switch latencies. A switch first
+sleeps half of it, the backoff then covers the spread. */
+static uint64_t switch_latency_avg;
+
+static uint64_t control_clock(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* TSF words are read twice, as getTSFRegs does, and the poll repeated if
+the low word carried in between. */
+static int control_poll(struct debugfs_file * df, int snapshot, unsigned int * control,
+	unsigned int * state, uint64_t * tsf){
+	struct b43_access acc[] = {
+		{ .routing = B43_SHM_REGS, .offset = GPR_CONTROL, .width = 16 },
+		{ .routing = B43_SHM_REGS, .offset = GPR_CURRENT_STATE, .width = 16 },
+		{ .routing = B43_MMIO, .offset = B43_MMIO_TSF_3, .width = 16 },
+		{ .routing = B43_MMIO, .offset = B43_MMIO_TSF_2, .width = 16 },
+		{ .routing = B43_MMIO, .offset = B43_MMIO_TSF_1, .width = 16 },
+		{ .routing = B43_MMIO, .offset = B43_MMIO_TSF_0, .width = 16 },
+		{ .routing = B43_MMIO, .offset = B43_MMIO_TSF_3, .width = 16 },
+		{ .routing = B43_MMIO, .offset = B43_MMIO_TSF_2, .width = 16 },
+		{ .routing = B43_MMIO, .offset = B43_MMIO_TSF_1, .width = 16 },
+	};
+
+	if(!snapshot){
+		if(shmReadBatch(df, acc, 1) < 0)
+			return -1;
+		*control = acc[0].value;
+		return 0;
+	}
+
+	do {
+		if(shmReadBatch(df, acc, sizeof(acc) / sizeof(acc[0])) < 0)
+			return -1;
+	} while(acc[2].value != acc[6].value || acc[3].value != acc[7].value ||
+		acc[4].value != acc[8].value);
+
+	*control = acc[0].value;
+	*state = acc[1].value;
+	*tsf = ((uint64_t)acc[2].value << 48) | ((uint64_t)acc[3].value << 32) |
+		((uint64_t)acc[4].value << 16) | acc[5].value;
+	return 0;
+}
+
+/* Waits until (GPR_CONTROL & mask) == expect. result->requested must hold
+the host time of the request; expected_us, if not 0, is slept before the
+first poll. Returns 0 once the bits match, -1 on timeout or read error. */
+int waitControl(struct debugfs_file * df, unsigned int mask, unsigned int expect,
+	const struct control_wait * wait, uint64_t expected_us, struct control_wait_result * result){
+	uint64_t deadline = result->requested + wait->timeout_us;
+	uint64_t previous = control_clock();
+	uint64_t now;
+	unsigned int backoff = wait->backoff_min_us;
+	unsigned int nap;
+
+	result->completed = 0;
+	result->polls = 0;
+
+	if(expected_us > 0 && previous + expected_us < deadline){
+		usleep(expected_us);
+		previous = control_clock();
+	}
+
+	while(1){
+		if(control_poll(df, wait->snapshot, &result->control, &result->state,
+			&result->tsf_completed) < 0)
+			return -1;
+		now = control_clock();
+		result->polls++;
+
+		if((result->control & mask) == expect){
+			result->completed = 1;
+			result->latency_us = now - result->requested;
+			result->resolution_us = now - previous;
+			return 0;
+		}
+
+		if(now >= deadline){
+			result->latency_us = now - result->requested;
+			result->resolution_us = 0;
+			return -1;
+		}
+		previous = now;
+
+		if(result->polls <= wait->spin_polls)
+			continue;
+
+		nap = backoff;
+		if(now + nap > deadline)
+			nap = deadline - now;
+		usleep(nap);
+
+		if(backoff < wait->backoff_max_us){
+			backoff *= 2;
+			if(backoff > wait->backoff_max_us)
+				backoff = wait->backoff_max_us;
+		}
+	}
+}
+
+/* Asks the firmware to run byte-code slot 1 or 2 and waits until it has
+committed the switch, i.e. cleared the request bits 0x0F00. */
+int switchBytecodeSlot(struct debugfs_file * df, int slot, const struct control_wait * wait,
+	struct control_wait_result * result){
+	struct b43_access request = { .routing = B43_SHM_REGS, .offset = GPR_CONTROL, .width = 16,
+		.mask = 0xF0FF, .value = (slot == 2) ? 0x0200 : 0x0100 };
+	unsigned int state;
+	int ret;
+
+	memset(result, 0, sizeof(*result));
+
+	if(wait->snapshot && control_poll(df, 1, &result->control, &state, &result->tsf_requested) < 0)
+		return -1;
+
+	result->requested = control_clock();
+	if(shmWriteBatch(df, &request, 1) < 0)
+		return -1;
+
+	ret = waitControl(df, 0x0F00, 0, wait, switch_latency_avg / 2, result);
+
+	if(result->completed)
+		switch_latency_avg = switch_latency_avg ?
+			(switch_latency_avg * 7 + result->latency_us) / 8 : result->latency_us;
+
+	return ret;
+}
+
+/* Returns 0 once the firmware runs slot opt->active, -1 if it did not
+commit the switch in time; the request is then withdrawn. */
+int writeAddressBytecode(struct debugfs_file * df, struct options * opt){
 
 	int byte_code_address;
-	int control_return;
+	struct control_wait_result result;
 	
 	/*
 	if(!strcmp(opt->active, "1")){
@@ -138,30 +285,34 @@ void writeAddressBytecode(struct debugfs_file * df, struct options * opt){
 	
 	if(!strcmp(opt->active, "1")){
 		printf("Active byte-code '1' \n");
-		shmMaskSet16(df, B43_SHM_REGS, GPR_CONTROL, 0xF0FF, 0x0100);
+		byte_code_address = PARAMETER_ADDR_OFFSET_BYTECODE_1 ;
 	}
 	else{
 		if(!strcmp(opt->active, "2")){
 			printf("Active byte-code '2' \n");
-			shmMaskSet16(df, B43_SHM_REGS, GPR_CONTROL, 0xF0FF, 0x0200);
+			byte_code_address = PARAMETER_ADDR_OFFSET_BYTECODE_2 ;
 		}
 		else{
 			printf("active must be 1 or 2");
-			return;
+			return -1;
 		}
 	}
 	
-	while(1)
-	{
-		control_return = shmRead16(df, B43_SHM_REGS, GPR_CONTROL);
-		if( (control_return & 0x0F00) == 0)
-		  break;
+	if(switchBytecodeSlot(df, opt->active[0] - '0', &control_wait_default, &result) < 0){
+		shmMaskSet16(df, B43_SHM_REGS, GPR_CONTROL, 0xF0FF, 0x0000);
+
+		//the firmware may have committed between the last poll and the clear
+		if(shmRead16(df, B43_SHM_REGS, GPR_BYTECODE_ADDRESS) != byte_code_address){
+			fprintf(stderr, "byte-code slot switch not committed after %llu us (GPR_CONTROL 0x%04X)\n",
+				(unsigned long long)result.latency_us, result.control);
+			return -1;
+		}
 	}
 	//shmMaskSet16(df, B43_SHM_REGS, GPR_BYTECODE_ADDRESS, 0x0000, byte_code_address);
 	//setStartState(df);
 	//#resetto i bit del timer per ogni evenienza
 	//shmMaskSet16(df, B43_SHM_REGS, GPR_CONTROL, 0xFFF7, 0x000);
-	return;
+	return 0;
 }
 
 
@@ -337,7 +488,9 @@ void load_params(struct debugfs_file * df, struct options * opt){
 }
 
 
-void parser(struct debugfs_file * df, struct options * opt){
+/* Returns -1, without writing anything, if the MAC engine could not be
+stopped to load the byte-code. */
+int parser(struct debugfs_file * df, struct options * opt){
   
 	unsigned int byte_code_address;
 	byte_code_address = shmRead16(df, B43_SHM_REGS, GPR_BYTECODE_ADDRESS);
@@ -354,8 +507,8 @@ void parser(struct debugfs_file * df, struct options * opt){
   
 //	printf( "load byte-code 10 \n");
 	
-	if(strcmp(opt->do_up,"1"))
-		putInWaitMode(df);
+	if(strcmp(opt->do_up,"1") && putInWaitMode(df) < 0)
+		return -1;
 
 //	printf( "load byte-code 20 \n");
 	
@@ -368,36 +521,38 @@ void parser(struct debugfs_file * df, struct options * opt){
 
 //	printf( "load byte-code 40 \n");
 
-	return;
+	return 0;
 }	
 
 
 
 
-void putInWaitMode(struct debugfs_file * df){
+/* Returns 0 once the MAC engine is parked in its start state, -1 if it
+did not get there in time; the request is then withdrawn and the engine
+keeps running, so nothing must be written. */
+int putInWaitMode(struct debugfs_file * df){
 
 	//fermo il MACengine solo quando questo raggiunge lo stato di start
-	int value_reg=0;
+	struct control_wait_result result;
 	//printf("putFromWaitMode before set - 1 \n");
 	
 	//devo cambiare solo il bit che dice al MACengine che sono pronto a caricare una tabella
+	result.requested = control_clock();
 	shmMaskSet16(df, B43_SHM_REGS, GPR_CONTROL, 0xFFFE, 0x0001);
 	
 	//printf("putFromWaitMode before set - 2 \n");
 	
-	while (1){
-		//verifico soltanto i due bit che mi dicono che adesso posso caricare la maclet,
-		//perche il macengine si e' fermato nello stato di start
-		//unsigned int shmRead32_int(struct debugfs_file * df, int routing, int offset);
-		value_reg = shmRead16(df, B43_SHM_REGS, GPR_CONTROL);
-		//printf("value_reg : %X \n", value_reg);   
-		if ( (value_reg & 0x0003) == 0x03 ){
-		      break;
-		}
+	//verifico soltanto i due bit che mi dicono che adesso posso caricare la maclet,
+	//perche il macengine si e' fermato nello stato di start
+	if(waitControl(df, 0x0003, 0x0003, &control_wait_default, 0, &result) < 0){
+		fprintf(stderr, "MAC engine not in wait mode after %llu us (GPR_CONTROL 0x%04X)\n",
+			(unsigned long long)result.latency_us, result.control);
+		shmMaskSet16(df, B43_SHM_REGS, GPR_CONTROL, 0xFFFE, 0x0000);
+		return -1;
 	}
 	//printf("putFromWaitMode after set\n");
 	//ucodeStop(df);
-	return;
+	return 0;
 }
 
 void returnFromWaitMode(struct debugfs_file * df){
@@ -413,46 +568,17 @@ void returnFromWaitMode(struct debugfs_file * df){
 
 void bytecodeSharedWrite(struct debugfs_file * df, struct options * opt){
 	
-	char line[256];
-	char sub_line[256];
-	char sub_line_lo[3];
-	char sub_line_hi[3];
-	
-	int address_state_params, address_state_params_start, address_state_descriptor, address_state;
-	
-	int index = 0;
-	int detected_start_file = 0;
-	int num_state=0;
-	int num_writings=0;
-	
-	int num_addr_condition= 48;
-	int addr_condition[48];
-	int index_addr_condition = 0;
-	int address_condition_procedure_temporary = ADDRESS_CONDITION_PROCEDURE;
-	
-	int rif_condition=0;
-	int addr_proc_condition=0;
-	
-	FILE * file_bytecode;
-		
-//	printf("parser start\n");
-//	printf("opt load %s\n", opt->load);
-//	printf("opt byte-code name %s\n", opt->name_file);
+	struct bytecode_image img;
+	int slot;
 
 	if(!strcmp(opt->load, "1")){
 		printf( "Ready load byte-code '1' \n");
-		address_state_params_start = PARAMETER_ADDR_BYTECODE_1 ;
-		address_state_params = 	address_state_params_start;
-		address_state_descriptor = 	COMBINATION_ADDR_BYTECODE_1;
-		address_state = 		STATE_ADDR_BYTECODE_1;
+		slot = 0;
 	}
 	else{ 
 		if(!strcmp(opt->load, "2")){
 			printf("Ready load byte-code '2' \n");
-			address_state_params_start = PARAMETER_ADDR_BYTECODE_2 ;
-			address_state_params = address_state_params_start;
-			address_state_descriptor = 	COMBINATION_ADDR_BYTECODE_2;
-			address_state = 		STATE_ADDR_BYTECODE_2;
+			slot = 1;
 		}
 		else{
 			printf("load must be 1 or 2\n");
@@ -460,185 +586,20 @@ void bytecodeSharedWrite(struct debugfs_file * df, struct options * opt){
 			return;
 		}	
 	}	
-	
-	if (file_bytecode = fopen(opt->name_file, "r")){
-		printf("open file : %s\n", opt->name_file);
-	}
-	else{
-		
-		perror("");
+
+	//the text bytecode is compiled in memory, a precompiled image (see bytecode-compiler) is read as it is
+	if (bytecode_image_open(opt->name_file, &img) < 0){
 		exit(1);
-		//return;
 	}
+	printf("open file : %s\n", opt->name_file);
 
-	//printf( "address_state_params : %X \n address_state_descriptor : %X \n address_state : %X\n", address_state_params, address_state_descriptor, address_state);
-
-	//Fetch the hardware information
-	//load address condition
-	//addr_condition=zeros(num_addr_condition, Int)
-	//addr_condition=range(0,48)
-	while (index_addr_condition != num_addr_condition){
-		addr_condition[index_addr_condition] = shmRead16(df,B43_SHM_SHARED, address_condition_procedure_temporary);
-		address_condition_procedure_temporary += 2;
-		index_addr_condition += 1;
-	}
-	index_addr_condition=0;
-	//while (index_addr_condition != num_addr_condition){
-	//	printf(" %X ",addr_condition[index_addr_condition]);
-	//	//print addr_condition[ind_addr_condition]
-	//	index_addr_condition += 1;
-	//}
-	
-	while(!feof(file_bytecode)){
-		//end file
-		//if(feof(file_bytecode))
-		//	break;
-		//line = table_file.readline();
-		//fscanf(file_bytecode, "%[^\n]", line);
-		//fscanf (file_bytecode, "%s", line);
-		fgets (line , 256 , file_bytecode);
-		//printf("%s\n", line);
-		strncpy(sub_line,line,6);
-		sub_line[6]='\0';
-		//printf("%s\n",sub_line);
-		
-
-		if( !strcmp(sub_line,"000001") ){
-			detected_start_file = 1;
-			printf("-------------------\n");
-			printf("start file detected\n");
-			
-			while(!feof(file_bytecode)){
-				//if(feof(file_bytecode))
-				//	break;
-				fgets (line , 256, file_bytecode);
-				strncpy(sub_line,line,6);
-				sub_line[6]='\0';
-				//printf("%c\n", sub_line[0]);
-				
-				if(sub_line[0] == '#'){
-					//printf( "commento\n");
-					continue;
-				}	
-				//if len(line) == 0:
-				//	break
-
-				//read index state parameter
-				if( !strcmp(sub_line,"000003") ){ //if line[0:6] == "000004":
-					fgets (line , 256 , file_bytecode);
-					//printf("type 000004   : %s  ", line);
-					//printf("conversione %lu \n", strtoul(line,NULL,16));
-					sprintf(sub_line_lo,"%c%c",line[0],line[1]);
-					//sprintf(sub_line_hi,"%c%c",line[2],line[3]);
-					//printf("conversione - 1 - %s - %lu \n",sub_line_lo, strtoul(sub_line_lo,NULL,16));
-					address_state_params  = address_state_params_start  + (strtoul(sub_line_lo,NULL,16) * 2);
-				}
-				
-				//read state parameter
-				if( !strcmp(sub_line,"000004") ){ //if line[0:6] == "000004":
-					fgets (line , 256 , file_bytecode);
-					//printf("type 000004   : %s  ", line);
-					//printf("conversione %lu \n", strtoul(line,NULL,16));
-
-					sprintf(sub_line_lo,"%c%c",line[0],line[1]);
-					sprintf(sub_line_hi,"%c%c",line[2],line[3]);
-					
-					//printf("conversione - 1 - %s - %lu \n",sub_line_lo, strtoul(sub_line_lo,NULL,16));
-					//printf("conversione - 2 - %s - %lu \n",sub_line_hi, (strtoul(sub_line_hi,NULL,16) << 8));
-					
-					shmMaskSet16(df, B43_SHM_SHARED, address_state_params , 0xFF00, strtoul(sub_line_lo,NULL,16));
-					shmMaskSet16(df, B43_SHM_SHARED, address_state_params , 0x00FF, (strtoul(sub_line_hi,NULL,16) << 8));
-					address_state_params  = address_state_params  + 2;
-				}
-					
-				//read combination
-				if( !strcmp(sub_line,"000006") ){ //if line[0:6] == "000006":
-					fgets (line , 256 , file_bytecode);
-					//printf("type 000006   : %s  ", line);
-					//printf("conversione %lu \n", strtoul(line,NULL,16));
-					index = 0;
-					while(1){
-						sprintf(sub_line,"%c%c",line[index+2],line[index+3]);
-						rif_condition = strtoul(sub_line,NULL,16);
-
-						//printf("******** debug ***********\n");
-						//printf("%X\n", rif_condition);
-						addr_proc_condition = addr_condition[rif_condition];
-						//printf("%X\n", addr_proc_condition);
-																	
-						shmMaskSet16(df, B43_SHM_SHARED, address_state_descriptor, 0x0000, addr_proc_condition);
-						address_state_descriptor = address_state_descriptor + 2;
-						index = index + 4;
-
-						sprintf(sub_line,"%c%c",line[index],line[index+1]);
-						shmMaskSet16(df, B43_SHM_SHARED, address_state_descriptor, 0xFF00, strtoul(sub_line,NULL,16));
-						sprintf(sub_line,"%c%c",line[index+2],line[index+3]);
-						shmMaskSet16(df,B43_SHM_SHARED, address_state_descriptor, 0x00FF, (strtoul(sub_line,NULL,16)<<8));
-						address_state_descriptor = address_state_descriptor + 2;
-						index = index + 4;
-						
-						sprintf(sub_line,"%c%c",line[index],line[index+1]);
-						shmMaskSet16(df,B43_SHM_SHARED, address_state_descriptor, 0xFF00, strtoul(sub_line,NULL,16));
-						sprintf(sub_line,"%c%c",line[index+2],line[index+3]);
-						shmMaskSet16(df,B43_SHM_SHARED, address_state_descriptor, 0x00FF, (strtoul(sub_line,NULL,16)<<8) );
-						address_state_descriptor = address_state_descriptor + 2;
-						index = index + 4;
-						
-						sprintf(sub_line,"%c%c%c%c",line[index],line[index+1],line[index+2],line[index+3]);
-						if( !strcmp(sub_line, "FFFF")){
-							shmMaskSet16(df,B43_SHM_SHARED, address_state_descriptor, 0xFFFF, 0xFFFF);
-							address_state_descriptor = address_state_descriptor + 2;
-							break;
-						}
-						
-						if(line[index]== '$'){
-							//printf("dentro if ");
-							break;
-						}	
-					
-					}
-				}
-
-				//read state
-				if( !strcmp(sub_line,"000010") ){ //if line[0:6] == "000010":
-					fgets (line , 256 , file_bytecode);
-					//printf("type 000010    %s  ", line);
-					
-					sprintf(sub_line,"%c%c",line[0],line[1]);
-					shmMaskSet16(df,B43_SHM_SHARED, address_state, 0xFF00, (strtoul(sub_line,NULL,16)));
-					
-					sprintf(sub_line,"%c%c",line[2],line[3]);
-					shmMaskSet16(df,B43_SHM_SHARED, address_state, 0x00FF, (strtoul(sub_line,NULL,16)<<8));
-					
-					address_state = address_state + 2;
-				}	
-					
-				//end file
-				if( !strcmp(sub_line,"000099") ){ //if line[0:6] == "000099":
-					printf("end load file\n");
-					printf("-------------\n");
-					break;
-				}
-
-// 				num_writings++;
-// 				if (num_writings == 10){
-// 				  num_writings=0;
-// 				  returnFromWaitMode(df);
-// 				  sleep(2);
-// 				  putInWaitMode(df);
-// 				}	
-  			}  			
-		}
-
+	if (bytecode_image_load(df, slot, &img) < 0){
+		perror("bytecodeSharedWrite");
+		exit(1);
 	}
 
-	
-	
-	if(detected_start_file == 0)
-	    printf("Error : Could not find start file (000001)");
-
-	
-	fclose(file_bytecode);
+	printf("end load file\n");
+	printf("-------------\n");
 	return;
 }
 
@@ -69,6 +69,8 @@
 #define 	MY_TRANSMISSION			0x00F2
 #define 	SUCCES_TRANSMISSION		0x00F4
 #define 	OTHER_TRANSMISSION		0x00F6
+#define 	BAD_RECEPTION			0x00FA
+#define 	BUSY_SLOT			0x00FC
 
 #define		NEAR_SLOT		43
 #define		COUNT_SLOT		43
@@ -78,16 +80,58 @@
 
 
 
-void parser(struct debugfs_file * df, struct options * opt);
+//attesa sui bit di GPR_CONTROL (cambio slot, wait mode)
+#define CONTROL_WAIT_TIMEOUT_US		1000000
+#define CONTROL_WAIT_SPIN_POLLS		4
+#define CONTROL_WAIT_BACKOFF_MIN_US	50
+#define CONTROL_WAIT_BACKOFF_MAX_US	2000
+
+/* Bounds of a wait on GPR_CONTROL. After spin_polls back to back reads the
+wait sleeps between reads, doubling from backoff_min_us to backoff_max_us,
+and gives up after timeout_us. With snapshot set, every poll is a single
+batch of GPR_CONTROL, GPR_CURRENT_STATE and the TSF, which costs more per
+poll but timestamps the completion on the card. */
+struct control_wait {
+	unsigned int timeout_us;
+	unsigned int spin_polls;
+	unsigned int backoff_min_us;
+	unsigned int backoff_max_us;
+	int snapshot;
+};
+
+/* Outcome of a wait on GPR_CONTROL. Host times are CLOCK_MONOTONIC_RAW
+microseconds; the completion happened between the end of the previous
+poll and the end of the completing one, which is latency_us with an
+uncertainty of resolution_us. */
+struct control_wait_result {
+	int completed;
+	unsigned int polls;
+	unsigned int control;
+	unsigned int state;		/* snapshot only */
+	uint64_t requested;
+	uint64_t latency_us;
+	uint64_t resolution_us;
+	uint64_t tsf_requested;		/* snapshot only */
+	uint64_t tsf_completed;		/* snapshot only */
+};
+
+extern const struct control_wait control_wait_default;
+
+int waitControl(struct debugfs_file * df, unsigned int mask, unsigned int expect,
+	const struct control_wait * wait, uint64_t expected_us, struct control_wait_result * result);
+int switchBytecodeSlot(struct debugfs_file * df, int slot, const struct control_wait * wait,
+	struct control_wait_result * result);
+
+int parser(struct debugfs_file * df, struct options * opt);
 void load_params(struct debugfs_file * df, struct options * opt);
 
 void bytecodeSharedWrite(struct debugfs_file * df, struct options * opt);
-void putInWaitMode(struct debugfs_file * df);
+int putInWaitMode(struct debugfs_file * df);
 void returnFromWaitMode(struct debugfs_file * df);
 
 void setStartState(struct debugfs_file * df);
-void writeAddressBytecode(struct debugfs_file * df, struct options * opt);
-void activeBytecode(struct debugfs_file * df, struct options * opt);
+int writeAddressBytecode(struct debugfs_file * df, struct options * opt);
+int activeBytecode(struct debugfs_file * df, struct options * opt);
 void autoActiveBytecode(struct debugfs_file * df, struct options * opt);
 
 
@@ -25,6 +25,7 @@
 #include <sys/time.h>
 
 #include "libb43.h"
+#include "b43sim.h"
 #include "hex2int.h"
 #include "dataParser.h"
 #include "vars.h"
@@ -35,6 +36,11 @@ void init_file(struct debugfs_file * df){
 
       char debugfs_path[256]="";
       char path[256]="";
+
+      //B43_SIM=... : no card, see b43sim.h
+      if (b43_sim_from_env(df))
+	return;
+
       __debugfs_find(debugfs_path);
 
 	sprintf(path,"%s%s",debugfs_path,"/mmio32read");
@@ -60,6 +66,8 @@ void init_file(struct debugfs_file * df){
 	
 	sprintf(path,"%s%s",debugfs_path,"/shm32write");
 	df->f_shm32write=fopen(path, "w");
+
+	b43_set_backend(df, &b43_debugfs_backend, NULL);
 }
 
 void close_file( struct debugfs_file * df){
@@ -251,29 +259,25 @@ void __debugfs_find(char *path){
 
 void shmSharedRead(struct debugfs_file * df){
   
-  char * ret="";
-   
-  char buffer[256]="";
-  char tmp_buff[256]="";  
+  uint16_t shm[2048];
   int offset;
+
+  if (shmReadRange16(df, B43_SHM_SHARED, 0, shm, 2048) < 0){
+    perror("shmSharedRead");
+    return;
+  }
+
   printf("Shared memory:\n");
   for (offset=0; offset < 4096; offset+=4){
-  //for (offset=0; offset < 512; offset+=4){
-
-    //unsigned int buffer_int = shmRead32_int(df, B43_SHM_SHARED, offset);
 
     if (offset%16==0){
       printf("\n");
       printf("0x%04X:\t", offset);
     }  
 
-    shmRead32( df, B43_SHM_SHARED, offset, buffer);
-    
-    sprintf(tmp_buff,"%c%c%c%c", buffer[8], buffer[9],buffer[6],buffer[7]);
-    printf("%s ", tmp_buff);
-
-    sprintf(tmp_buff,"%c%c%c%c", buffer[4], buffer[5],buffer[2],buffer[3]);
-    printf("%s ", tmp_buff);
+    /* same byte order as the 32 bit debugfs dump */
+    printf("%02X%02X ", shm[offset/2] & 0xFF, shm[offset/2] >> 8);
+    printf("%02X%02X ", shm[offset/2 + 1] & 0xFF, shm[offset/2 + 1] >> 8);
 
   }
 
@@ -284,13 +288,18 @@ void shmSharedRead(struct debugfs_file * df){
 
 void getGprs(struct debugfs_file * df){
 	/* Returns an array of 64 ints. One for each General Purpose register. */
-	unsigned int reg=0;
+	uint16_t reg[64];
 	int i=0;
+
+	if (shmReadRange16(df, B43_SHM_REGS, 0, reg, 64) < 0){
+		perror("getGprs");
+		return;
+	}
+
 	printf("General purpose registers:\n");
 
 	for (i=0;i<64;i++){
-		reg = shmRead16(df,B43_SHM_REGS, i);
-		printf("r%02u: %04X  ",i,reg);
+		printf("r%02u: %04X  ",i,reg[i]);
 		if ((i-3)%4==0)
 			printf("\n");
 	}
@@ -369,3 +378,206 @@ void ucodeStart(struct debugfs_file * df){
 }
 
 
+
+
+
+/* ******************
+ * BATCHED ACCESS
+ *
+ * The single word functions above pay a rewind, a formatted write, a
+ * flush, a second rewind and a scanf for every halfword. The batched
+ * functions hand a whole list of accesses to the backend of the
+ * debugfs_file, so the cost of a round trip is paid once per batch on
+ * transports that support it.
+ * ***************** */
+
+void b43_set_backend(struct debugfs_file * df, const struct b43_backend * backend, void * priv){
+	df->backend = backend;
+	df->backend_priv = priv;
+}
+
+/* debugfs backend: the files are driven through their descriptors with
+pwrite/pread at offset 0, which skips the stdio buffering and halves
+the number of syscalls. Aligned pairs of 16 bit shared memory words
+are merged into one 32 bit access. */
+
+static FILE * debugfs_read_file(struct debugfs_file * df, const struct b43_access * acc){
+	if (acc->routing == B43_MMIO)
+		return (acc->width == 32) ? df->f_mmio32read : df->f_mmio16read;
+	return (acc->width == 32) ? df->f_shm32read : df->f_shm16read;
+}
+
+static FILE * debugfs_write_file(struct debugfs_file * df, const struct b43_access * acc){
+	if (acc->routing == B43_MMIO)
+		return (acc->width == 32) ? df->f_mmio32write : df->f_mmio16write;
+	return (acc->width == 32) ? df->f_shm32write : df->f_shm16write;
+}
+
+static int debugfs_pair(const struct b43_access * acc, size_t i, size_t count){
+	return i + 1 < count &&
+		acc[i].routing == B43_SHM_SHARED && acc[i + 1].routing == B43_SHM_SHARED &&
+		acc[i].width == 16 && acc[i + 1].width == 16 &&
+		(acc[i].offset & 3) == 0 && acc[i + 1].offset == acc[i].offset + 2;
+}
+
+static int debugfs_transfer(FILE * f, const char * cmd, int len, uint32_t * value){
+	char buffer[32];
+	int fd = fileno(f);
+	ssize_t n;
+
+	if (pwrite(fd, cmd, len, 0) != len)
+		return -1;
+	if (value == NULL)
+		return 0;
+
+	n = pread(fd, buffer, sizeof(buffer) - 1, 0);
+	if (n <= 0)
+		return -1;
+	buffer[n] = '\0';
+	*value = strtoul(buffer, NULL, 16);
+	return 0;
+}
+
+static int debugfs_batch_read(struct debugfs_file * df, struct b43_access * acc, size_t count){
+	char cmd[64];
+	int len;
+	size_t i;
+	uint32_t value;
+
+	for (i = 0; i < count; i++){
+		if (debugfs_pair(acc, i, count)){
+			len = sprintf(cmd, "0x%X 0x%X", B43_SHM_SHARED, acc[i].offset);
+			if (debugfs_transfer(df->f_shm32read, cmd, len, &value) < 0)
+				return -1;
+			acc[i].value = value & 0xFFFF;
+			acc[i + 1].value = value >> 16;
+			i++;
+			continue;
+		}
+
+		if (acc[i].routing == B43_MMIO)
+			len = sprintf(cmd, "0x%X", acc[i].offset);
+		else
+			len = sprintf(cmd, "0x%X 0x%X", acc[i].routing, acc[i].offset);
+		if (debugfs_transfer(debugfs_read_file(df, &acc[i]), cmd, len, &value) < 0)
+			return -1;
+		acc[i].value = (acc[i].width == 32) ? value : (value & 0xFFFF);
+	}
+	return 0;
+}
+
+static int debugfs_batch_write(struct debugfs_file * df, const struct b43_access * acc, size_t count){
+	char cmd[64];
+	int len;
+	size_t i;
+
+	for (i = 0; i < count; i++){
+		if (debugfs_pair(acc, i, count) && acc[i].mask == 0 && acc[i + 1].mask == 0){
+			len = sprintf(cmd, "0x%X 0x%X 0x%X 0x%X", B43_SHM_SHARED, acc[i].offset, 0,
+				(acc[i].value & 0xFFFF) | ((acc[i + 1].value & 0xFFFF) << 16));
+			if (debugfs_transfer(df->f_shm32write, cmd, len, NULL) < 0)
+				return -1;
+			i++;
+			continue;
+		}
+
+		uint32_t width_mask = (acc[i].width == 32) ? 0xFFFFFFFF : 0xFFFF;
+		if (acc[i].routing == B43_MMIO)
+			len = sprintf(cmd, "0x%X 0x%X 0x%X", acc[i].offset,
+				acc[i].mask & width_mask, acc[i].value & width_mask);
+		else
+			len = sprintf(cmd, "0x%X 0x%X 0x%X 0x%X", acc[i].routing, acc[i].offset,
+				acc[i].mask & width_mask, acc[i].value & width_mask);
+		if (debugfs_transfer(debugfs_write_file(df, &acc[i]), cmd, len, NULL) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+const struct b43_backend b43_debugfs_backend = {
+	.name = "debugfs",
+	.read = debugfs_batch_read,
+	.write = debugfs_batch_write,
+};
+
+int shmReadBatch(struct debugfs_file * df, struct b43_access * acc, size_t count){
+	return df->backend->read(df, acc, count);
+}
+
+int shmWriteBatch(struct debugfs_file * df, const struct b43_access * acc, size_t count){
+	return df->backend->write(df, acc, count);
+}
+
+/* Ranges are split in chunks on the stack; the first chunk is shortened
+by one when the range starts on an odd halfword so that the following
+chunks start on a 32 bit boundary and can be merged by the backend. */
+#define RANGE_CHUNK	128
+
+int shmReadRange16(struct debugfs_file * df, int routing, int offset, uint16_t * values, size_t count){
+	struct b43_access acc[RANGE_CHUNK];
+	size_t done = 0, n, i;
+	/* Shared memory is byte addressed, the other routings are word addressed. */
+	int step = (routing == B43_SHM_SHARED || routing == B43_MMIO) ? 2 : 1;
+
+	while (done < count){
+		n = count - done;
+		if (n > RANGE_CHUNK)
+			n = RANGE_CHUNK;
+		if (done == 0 && (offset & 2) && n == RANGE_CHUNK)
+			n--;
+
+		for (i = 0; i < n; i++){
+			acc[i].routing = routing;
+			acc[i].offset = offset + (done + i) * step;
+			acc[i].width = 16;
+			acc[i].mask = 0;
+			acc[i].value = 0;
+		}
+		if (shmReadBatch(df, acc, n) < 0)
+			return -1;
+		for (i = 0; i < n; i++)
+			values[done + i] = acc[i].value;
+		done += n;
+	}
+	return 0;
+}
+
+int shmWriteRange16(struct debugfs_file * df, int routing, int offset, const uint16_t * values, size_t count){
+	struct b43_access acc[RANGE_CHUNK];
+	size_t done = 0, n, i;
+	int step = (routing == B43_SHM_SHARED || routing == B43_MMIO) ? 2 : 1;
+
+	while (done < count){
+		n = count - done;
+		if (n > RANGE_CHUNK)
+			n = RANGE_CHUNK;
+		if (done == 0 && (offset & 2) && n == RANGE_CHUNK)
+			n--;
+
+		for (i = 0; i < n; i++){
+			acc[i].routing = routing;
+			acc[i].offset = offset + (done + i) * step;
+			acc[i].width = 16;
+			acc[i].mask = 0;
+			acc[i].value = values[done + i];
+		}
+		if (shmWriteBatch(df, acc, n) < 0)
+			return -1;
+		done += n;
+	}
+	return 0;
+}
+
+static uint64_t snapshot_clock(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int shmSnapshotRead(struct debugfs_file * df, struct b43_snapshot * snap){
+	int ret;
+	snap->host_start = snapshot_clock();
+	ret = shmReadBatch(df, snap->acc, snap->count);
+	snap->host_finish = snapshot_clock();
+	return ret;
+}
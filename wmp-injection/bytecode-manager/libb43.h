@@ -35,6 +35,36 @@
 
 
 
+/* Pseudo routing used by the batched API to address MMIO registers
+(read16/write16 space) instead of one of the SHM routings above. */
+#define B43_MMIO		0xFF
+
+
+struct debugfs_file;
+
+/* A single word access in a batch. On reads, value is filled in by
+the backend; on writes, the word becomes (old & mask) | value, so a
+mask of 0 is a plain write (same convention as shmMaskSet16). */
+struct b43_access {
+	int routing;
+	int offset;
+	int width;		/* 16 or 32 */
+	uint32_t mask;
+	uint32_t value;
+};
+
+/* Transport used by the batched API. A backend receives the whole
+batch at once, so a transport able to move several words per round
+trip can do so; the debugfs backend coalesces what it can. Both
+callbacks return 0 on success and -1 on error. */
+struct b43_backend {
+	const char *name;
+	int (*read)(struct debugfs_file *df, struct b43_access *acc, size_t count);
+	int (*write)(struct debugfs_file *df, const struct b43_access *acc, size_t count);
+};
+
+extern const struct b43_backend b43_debugfs_backend;
+
 struct debugfs_file{
 	FILE * f_mmio16read;
 	FILE * f_mmio16write;
@@ -44,6 +74,18 @@ struct debugfs_file{
 	FILE * f_shm16write;
 	FILE * f_shm32read;
 	FILE * f_shm32write;
+
+	const struct b43_backend * backend;
+	void * backend_priv;
+};
+
+/* Set of words captured together by shmSnapshotRead, bracketed by
+the host time (CLOCK_MONOTONIC_RAW, microseconds) of the batch. */
+struct b43_snapshot {
+	struct b43_access * acc;
+	size_t count;
+	uint64_t host_start;
+	uint64_t host_finish;
 };
 
 void init_file(struct debugfs_file * df);
@@ -72,4 +114,11 @@ void getTSFRegs(struct debugfs_file * df, uint64_t * tsf);
 
 void __debugfs_find(char *);
 
+void b43_set_backend(struct debugfs_file * df, const struct b43_backend * backend, void * priv);
+int shmReadBatch(struct debugfs_file * df, struct b43_access * acc, size_t count);
+int shmWriteBatch(struct debugfs_file * df, const struct b43_access * acc, size_t count);
+int shmReadRange16(struct debugfs_file * df, int routing, int offset, uint16_t * values, size_t count);
+int shmWriteRange16(struct debugfs_file * df, int routing, int offset, const uint16_t * values, size_t count);
+int shmSnapshotRead(struct debugfs_file * df, struct b43_snapshot * snap);
+
 #endif
\ No newline at end of file
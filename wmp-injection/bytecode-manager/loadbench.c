@@ -0,0 +1,331 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include <argp.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "b43sim.h"
+#include "dataParser.h"
+#include "bytecode-image.h"
+#include "metamac.h"
+
+/* ******************
+ * bytecode loading benchmark
+ *
+ * Drives the loading path against a simulated card (b43sim) and reports
+ * the latency distribution of each phase: parse, condition read, slot
+ * write and slot switch, then of bytecodeSharedWrite, load_params and
+ * metamac's load_protocol end to end. acc/op counts the debugfs accesses
+ * of one operation, which does not depend on the machine and catches
+ * most regressions by itself.
+ * Without FSM files, two synthetic bytecodes are generated.
+ * usage: ./loadbench -a 10000 -s 2000 -n 50 [FSM1 [FSM2]]
+ * ***************** */
+
+const char *argp_program_version = "Bytecode Loading Benchmark 0.0.1";
+static const char doc[] = "Measures the bytecode loading path on a simulated b43 card.";
+static const char args_doc[] = "[FSM1 [FSM2]]";
+
+static const struct argp_option options[] = {
+	{ "access",     'a', "NS",    0, "Cost of one debugfs access in nanoseconds (default 10000)." },
+	{ "switch",     's', "US",    0, "Time the firmware takes to commit a slot switch in microseconds (default 2000)." },
+	{ "iterations", 'n', "COUNT", 0, "Number of repetitions of each measure (default 50)." },
+	{ 0 }
+};
+
+struct arguments {
+	unsigned int access_ns;
+	unsigned int switch_us;
+	unsigned int iterations;
+	char *fsm[2];
+	int num_fsm;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+	struct arguments *arguments = state->input;
+
+	switch (key) {
+	case 'a':
+		if (sscanf(arg, "%u", &arguments->access_ns) < 1) {
+			argp_error(state, "Invalid value for argument 'access'.");
+		}
+		break;
+
+	case 's':
+		if (sscanf(arg, "%u", &arguments->switch_us) < 1) {
+			argp_error(state, "Invalid value for argument 'switch'.");
+		}
+		break;
+
+	case 'n':
+		if (sscanf(arg, "%u", &arguments->iterations) < 1 || arguments->iterations == 0) {
+			argp_error(state, "Invalid value for argument 'iterations'.");
+		}
+		break;
+
+	case ARGP_KEY_ARG:
+		if (state->arg_num >= 2) {
+			argp_usage(state);
+		}
+		arguments->fsm[arguments->num_fsm++] = arg;
+		break;
+
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+static const struct argp argp = { options, parse_opt, args_doc, doc };
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* Samples of one phase, in nanoseconds, and the debugfs accesses made. */
+struct phase {
+	const char *name;
+	uint64_t *samples;
+	unsigned int count;
+	unsigned long accesses;
+};
+
+static struct b43_sim sim;
+static struct debugfs_file df;
+static uint64_t phase_start;
+static unsigned long phase_accesses;
+
+static void phase_begin(void)
+{
+	phase_accesses = sim.reads + sim.writes;
+	phase_start = now_ns();
+}
+
+static void phase_end(struct phase *phase)
+{
+	phase->samples[phase->count++] = now_ns() - phase_start;
+	phase->accesses += sim.reads + sim.writes - phase_accesses;
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static void report(struct phase *phase)
+{
+	qsort(phase->samples, phase->count, sizeof(uint64_t), compare_samples);
+
+#define PERCENTILE(p) (phase->samples[(phase->count - 1) * (p) / 100] / 1000.0)
+	printf("%-14s %9.1f %9.1f %9.1f %9.1f %9.1f %8.1f\n", phase->name,
+		PERCENTILE(0), PERCENTILE(50), PERCENTILE(90), PERCENTILE(99), PERCENTILE(100),
+		(double)phase->accesses / phase->count);
+#undef PERCENTILE
+}
+
+/* The loading functions print their progress on stdout; it is sent to
+/dev/null while they are measured. */
+static int saved_stdout = -1;
+
+static void quiet(int on)
+{
+	fflush(stdout);
+	if (on) {
+		int null = open("/dev/null", O_WRONLY);
+		saved_stdout = dup(STDOUT_FILENO);
+		if (null < 0 || saved_stdout < 0 || dup2(null, STDOUT_FILENO) < 0) {
+			err(EXIT_FAILURE, "Unable to silence stdout");
+		}
+		close(null);
+	} else {
+		dup2(saved_stdout, STDOUT_FILENO);
+		close(saved_stdout);
+	}
+}
+
+/* Text bytecode with 16 parameters and states and 3 transitions per
+state, the size of the usual MAC protocols. */
+static void write_fsm(const char *path, int variant)
+{
+	FILE *f = fopen(path, "w");
+	if (f == NULL) {
+		err(EXIT_FAILURE, "Unable to create %s", path);
+	}
+
+	fprintf(f, "000001\n# synthetic bytecode %d\n", variant);
+	for (int i = 0; i < 16; i++) {
+		fprintf(f, "000004\n%02X%02X\n", (i * 7 + variant) & 0xFF, variant);
+	}
+	for (int s = 0; s < 16; s++) {
+		fprintf(f, "000006\n");
+		for (int t = 0; t < 3; t++) {
+			fprintf(f, "00%02X%02X00%02X00", (s + t + variant) % NUM_CONDITION_PROCEDURE,
+				(s + t + 1) % 16, t);
+		}
+		fprintf(f, "FFFF\n");
+	}
+	for (int s = 0; s < 16; s++) {
+		fprintf(f, "000010\n%02X%02X\n", s * 10, variant);
+	}
+	fprintf(f, "000099\n");
+	fclose(f);
+}
+
+int main(int argc, char *argv[])
+{
+	struct arguments arguments = { .access_ns = 10000, .switch_us = 2000, .iterations = 50 };
+	argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+	char dir[] = "/tmp/loadbench.XXXXXX";
+	char generated[2][64];
+	if (arguments.num_fsm < 2) {
+		if (mkdtemp(dir) == NULL) {
+			err(EXIT_FAILURE, "Unable to create a temporary directory");
+		}
+		for (int i = arguments.num_fsm; i < 2; i++) {
+			snprintf(generated[i], sizeof(generated[i]), "%s/fsm%d.txt", dir, i + 1);
+			write_fsm(generated[i], i);
+			arguments.fsm[i] = generated[i];
+		}
+	}
+
+	b43_sim_init(&sim);
+	sim.access_ns = arguments.access_ns;
+	sim.switch_us = arguments.switch_us;
+	if (b43_sim_open(&df, &sim) < 0) {
+		err(EXIT_FAILURE, "Unable to open the simulated card");
+	}
+	for (int i = 0; i < NUM_CONDITION_PROCEDURE; i++) {
+		sim.shm[ADDRESS_CONDITION_PROCEDURE / 2 + i] = 0x0100 + i * 8;
+	}
+
+	struct phase phases[] = {
+		{ "parse" }, { "conditions" }, { "write" }, { "switch" },
+		{ "shared-write" }, { "load-params" }, { "load-protocol" },
+	};
+	for (int p = 0; p < ARRAY_SIZE(phases); p++) {
+		phases[p].samples = calloc(arguments.iterations, sizeof(uint64_t));
+		if (phases[p].samples == NULL) {
+			err(EXIT_FAILURE, "Unable to allocate memory");
+		}
+	}
+
+	/* Protocols 0 and 1 share the first FSM with different parameters,
+	protocol 2 runs the second one, so that load_protocol goes through
+	slot switches, parameter only writes and full loads. */
+	struct protocol_suite *suite = malloc(sizeof(struct protocol_suite));
+	struct fsm_param param = { .num = 10, .value = 0x1234, .next = NULL };
+	if (suite == NULL) {
+		err(EXIT_FAILURE, "Unable to allocate memory");
+	}
+	init_protocol_suite(suite, 3, 0.1, 0);
+	for (int p = 0; p < 3; p++) {
+		suite->protocols[p].id = p;
+		suite->protocols[p].name = "bench";
+		suite->protocols[p].fsm_path = arguments.fsm[p / 2];
+		suite->protocols[p].fsm_image = malloc(sizeof(struct bytecode_image));
+		if (suite->protocols[p].fsm_image == NULL ||
+			bytecode_image_open(arguments.fsm[p / 2], suite->protocols[p].fsm_image) < 0) {
+			errx(EXIT_FAILURE, "Unable to read %s", arguments.fsm[p / 2]);
+		}
+	}
+	suite->protocols[1].fsm_params = &param;
+
+	printf("access %u ns, switch %u us, %u iterations\n",
+		arguments.access_ns, arguments.switch_us, arguments.iterations);
+	printf("fsm: %s %s\n", arguments.fsm[0], arguments.fsm[1]);
+
+	quiet(1);
+
+	struct bytecode_image img;
+	uint16_t conditions[NUM_CONDITION_PROCEDURE];
+	uint16_t slot_image[IMAGE_SLOT_LENGTH];
+	uint8_t defined[IMAGE_SLOT_LENGTH];
+	struct bytecode_shadow shadow;
+	struct options opt;
+	memset(&opt, 0, sizeof(opt));
+
+	for (unsigned int n = 0; n < arguments.iterations; n++) {
+		const char *fsm = arguments.fsm[n % 2];
+		int slot = n % 2;
+
+		phase_begin();
+		if (bytecode_image_compile(fsm, &img) < 0) {
+			errx(EXIT_FAILURE, "Unable to parse %s", fsm);
+		}
+		phase_end(&phases[0]);
+
+		phase_begin();
+		if (bytecode_image_conditions(&df, conditions) < 0) {
+			errx(EXIT_FAILURE, "Unable to read the condition procedure table");
+		}
+		phase_end(&phases[1]);
+
+		/* Whole slot, as the first load of a protocol. */
+		bytecode_image_layout(&img, conditions, slot_image, defined);
+		bytecode_shadow_invalidate(&shadow);
+		phase_begin();
+		if (bytecode_shadow_write(&df, slot, &shadow, slot_image, defined) < 0) {
+			errx(EXIT_FAILURE, "Unable to write slot %d", slot + 1);
+		}
+		phase_end(&phases[2]);
+
+		opt.active = slot ? "2" : "1";
+		phase_begin();
+		if (writeAddressBytecode(&df, &opt) < 0) {
+			errx(EXIT_FAILURE, "Unable to run slot %d", slot + 1);
+		}
+		phase_end(&phases[3]);
+
+		opt.load = slot ? "2" : "1";
+		opt.name_file = (char *)fsm;
+		phase_begin();
+		bytecodeSharedWrite(&df, &opt);
+		phase_end(&phases[4]);
+
+		opt.change_param_file = (char *)fsm;
+		phase_begin();
+		load_params(&df, &opt);
+		phase_end(&phases[5]);
+	}
+
+	metamac_init(&df, suite, 0);
+	for (unsigned int n = 0; n < arguments.iterations; n++) {
+		static const int order[] = { 1, 2, 0, 2, 1, 0 };
+
+		phase_begin();
+		if (load_protocol(&df, suite, order[n % ARRAY_SIZE(order)]) < 0) {
+			errx(EXIT_FAILURE, "Unable to switch to protocol %d", order[n % ARRAY_SIZE(order)]);
+		}
+		phase_end(&phases[6]);
+	}
+
+	quiet(0);
+
+	printf("%-14s %9s %9s %9s %9s %9s %8s\n", "phase (us)", "min", "p50", "p90", "p99", "max", "acc/op");
+	for (int p = 0; p < ARRAY_SIZE(phases); p++) {
+		report(&phases[p]);
+	}
+	printf("simulated switches: %lu\n", sim.switches);
+
+	if (arguments.num_fsm < 2) {
+		for (int i = arguments.num_fsm; i < 2; i++) {
+			unlink(generated[i]);
+		}
+		rmdir(dir);
+	}
+
+	close_file(&df);
+
+	return 0;
+}
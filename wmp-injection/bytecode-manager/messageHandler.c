@@ -313,7 +313,8 @@ void executeCommand(char *command, char *res_message, struct debugfs_file *df){
 		FILE *f;
 		if (f = fopen(server_options.name_file, "r")){
 			fclose(f);
-			parser(df, &server_options);
+			if(parser(df, &server_options) < 0)
+				sprintf(res_options,"wait_mode_timeout");
 		}else{
 			sprintf(res_options,"no_file_in_cache");
 		}
@@ -321,7 +322,8 @@ void executeCommand(char *command, char *res_message, struct debugfs_file *df){
 
 	if (strcmp(a_option,"")){
 		printf("server_options.active = %s \n",server_options.active);
-		activeBytecode(df, &server_options);
+		if(activeBytecode(df, &server_options) < 0)
+			sprintf(res_options,"switch_timeout");
 	}
 
 	if(server_options.view){
@@ -353,3 +355,50 @@ void executeCommand(char *command, char *res_message, struct debugfs_file *df){
 
 
 
+
+/* Finds the value of <tag> in message: everything from the end of the
+opening tag up to the next '<', as xmlHandler does, without copying it.
+Returns -1 if the tag is not there. */
+int xmlFindValue(const char *message, size_t len, const char *tag, const char **value, size_t *value_len){
+	size_t tag_len = strlen(tag);
+	const char *end = message + len;
+	const char *p = message;
+
+	while ((p = memchr(p, '<', end - p)) != NULL) {
+		p++;
+		if ((size_t)(end - p) > tag_len && !strncmp(p, tag, tag_len) && p[tag_len] == '>') {
+			*value = p + tag_len + 1;
+			const char *close = memchr(*value, '<', end - *value);
+			*value_len = (close ? close : end) - *value;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/* Copies a tag value keeping only printable characters and spaces, as getCommand does. */
+void getCommandValue(const char *value, size_t value_len, char *command, size_t size){
+	size_t i, pos = 0;
+	for (i = 0; i < value_len && pos + 1 < size; i++) {
+		if (value[i] >= 0x20 && value[i] <= 0x7E) {
+			command[pos++] = value[i];
+		}
+	}
+	command[pos] = '\0';
+}
+
+int saveBytecodeData(const char *filename, const char *bytecode, size_t len){
+	printf("-----------------\n");
+	printf("save file  bytecode : %s\n",filename);
+	printf("-----------------\n");
+	FILE *f = fopen(filename, "w");
+	if (f == NULL) {
+		perror(filename);
+		return -1;
+	}
+	size_t written = fwrite(bytecode, 1, len, f);
+	if (fclose(f) != 0 || written != len) {
+		return -1;
+	}
+	return 0;
+}
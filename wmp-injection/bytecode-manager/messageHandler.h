@@ -15,3 +15,6 @@ void getFilename(struct xml_node* xml_data,int num_of_tags,char *filename);
 void getBytecode(struct xml_node* xml_data,int num_of_tags,char *bytecode);
 int getCommand(struct xml_node* xml_data,int num_of_tags,char *command);
 void executeCommand(char *comand, char *, struct debugfs_file *);
+int xmlFindValue(const char *message, size_t len, const char *tag, const char **value, size_t *value_len);
+void getCommandValue(const char *value, size_t value_len, char *command, size_t size);
+int saveBytecodeData(const char *filename, const char *bytecode, size_t len);
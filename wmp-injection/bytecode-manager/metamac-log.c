@@ -0,0 +1,232 @@
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#include "metamac-log.h"
+
+#define LOG_BLOCK_BYTES		65536
+#define LOG_NUM_BLOCKS		8
+
+static void *log_writer(void *arg)
+{
+	struct metamac_log *log = arg;
+
+	pthread_mutex_lock(&log->lock);
+	for (;;) {
+		while (log->full == 0 && !log->closing) {
+			pthread_cond_wait(&log->cond, &log->lock);
+		}
+		if (log->full == 0) {
+			break;
+		}
+
+		int block = log->tail;
+		pthread_mutex_unlock(&log->lock);
+
+		if (fwrite(log->blocks + block * log->block_size, 1, log->fill[block], log->file) != log->fill[block]) {
+			log->error = 1;
+		}
+
+		pthread_mutex_lock(&log->lock);
+		log->fill[block] = 0;
+		log->tail = (log->tail + 1) % log->num_blocks;
+		log->full--;
+		pthread_cond_broadcast(&log->cond);
+	}
+	pthread_mutex_unlock(&log->lock);
+
+	return (void*)NULL;
+}
+
+int metamac_log_open(struct metamac_log *log, const char *path, const struct protocol_suite *suite)
+{
+	memset(log, 0, sizeof(struct metamac_log));
+
+	log->file = fopen(path, "w+");
+	if (log->file == NULL) {
+		goto fail;
+	}
+
+	log->num_protocols = suite->num_protocols;
+	log->record_size = METAMAC_LOG_RECORD_SIZE(suite->num_protocols);
+	log->block_size = (LOG_BLOCK_BYTES / log->record_size) * log->record_size;
+	if (log->block_size == 0) {
+		log->block_size = log->record_size;
+	}
+	log->num_blocks = LOG_NUM_BLOCKS;
+
+	log->blocks = malloc(log->block_size * log->num_blocks);
+	log->fill = calloc(log->num_blocks, sizeof(size_t));
+	if (log->blocks == NULL || log->fill == NULL) {
+		err(EXIT_FAILURE, "Unable to allocate memory");
+	}
+
+	uint32_t names_size = 0;
+	for (int i = 0; i < suite->num_protocols; i++) {
+		names_size += strlen(suite->protocols[i].name) + 1;
+	}
+
+	struct metamac_log_header header = {
+		.magic = METAMAC_LOG_MAGIC,
+		.version = METAMAC_LOG_VERSION,
+		.num_protocols = suite->num_protocols,
+		.record_size = log->record_size,
+		.names_size = names_size,
+	};
+	fwrite(&header, sizeof(header), 1, log->file);
+	for (int i = 0; i < suite->num_protocols; i++) {
+		fwrite(suite->protocols[i].name, strlen(suite->protocols[i].name) + 1, 1, log->file);
+	}
+	if (ferror(log->file)) {
+		goto fail;
+	}
+
+	pthread_mutex_init(&log->lock, NULL);
+	pthread_cond_init(&log->cond, NULL);
+	if (pthread_create(&log->writer, NULL, log_writer, log) != 0) {
+		err(EXIT_FAILURE, "Unable to start log writer");
+	}
+
+	return 0;
+
+fail:
+	if (log->file != NULL) {
+		fclose(log->file);
+		log->file = NULL;
+	}
+	free(log->blocks);
+	free(log->fill);
+	log->blocks = NULL;
+	log->fill = NULL;
+	return -1;
+}
+
+/* Hands the block being filled over to the writer thread. */
+static void log_submit(struct metamac_log *log)
+{
+	pthread_mutex_lock(&log->lock);
+	log->full++;
+	log->head = (log->head + 1) % log->num_blocks;
+	pthread_cond_broadcast(&log->cond);
+	if (log->full == log->num_blocks) {
+		log->stalls++;
+		while (log->full == log->num_blocks) {
+			pthread_cond_wait(&log->cond, &log->lock);
+		}
+	}
+	pthread_mutex_unlock(&log->lock);
+}
+
+void metamac_log_slot(struct metamac_log *log, const struct metamac_slot *slot, int offset,
+	int protocol, const double *weights)
+{
+	struct metamac_log_record *record = (struct metamac_log_record*)
+		(log->blocks + log->head * log->block_size + log->fill[log->head]);
+
+	record->slot_num = slot->slot_num;
+	record->read_num = slot->read_num;
+	record->host_time = slot->host_time;
+	record->tsf_time = slot->tsf_time;
+	record->offset = offset;
+	record->slot_index = slot->slot_index;
+	record->slots_passed = slot->slots_passed;
+	record->protocol = protocol;
+	record->flags =
+		(slot->filler ? METAMAC_LOG_FILLER : 0) |
+		(slot->packet_queued ? METAMAC_LOG_PACKET_QUEUED : 0) |
+		(slot->transmitted ? METAMAC_LOG_TRANSMITTED : 0) |
+		(slot->transmit_success ? METAMAC_LOG_TRANSMIT_SUCCESS : 0) |
+		(slot->transmit_other ? METAMAC_LOG_TRANSMIT_OTHER : 0) |
+		(slot->bad_reception ? METAMAC_LOG_BAD_RECEPTION : 0) |
+		(slot->busy_slot ? METAMAC_LOG_BUSY_SLOT : 0) |
+		(slot->channel_busy ? METAMAC_LOG_CHANNEL_BUSY : 0);
+	record->reserved = 0;
+	memcpy(record->weights, weights, log->num_protocols * sizeof(double));
+
+	log->records++;
+	log->fill[log->head] += log->record_size;
+	if (log->fill[log->head] == log->block_size) {
+		log_submit(log);
+	}
+}
+
+/* Writes out the partial block, stops the writer thread and closes the
+file. Returns -1 if any write failed. */
+int metamac_log_close(struct metamac_log *log)
+{
+	pthread_mutex_lock(&log->lock);
+	if (log->fill[log->head] > 0) {
+		log->full++;
+		log->head = (log->head + 1) % log->num_blocks;
+	}
+	log->closing = 1;
+	pthread_cond_broadcast(&log->cond);
+	pthread_mutex_unlock(&log->lock);
+
+	pthread_join(log->writer, NULL);
+	pthread_mutex_destroy(&log->lock);
+	pthread_cond_destroy(&log->cond);
+
+	if (fclose(log->file) != 0) {
+		log->error = 1;
+	}
+	free(log->blocks);
+	free(log->fill);
+
+	return log->error ? -1 : 0;
+}
+
+void metamac_log_unpack(const struct metamac_log_record *record, struct metamac_slot *slot)
+{
+	slot->slot_num = record->slot_num;
+	slot->read_num = record->read_num;
+	slot->host_time = record->host_time;
+	slot->tsf_time = record->tsf_time;
+	slot->slot_index = record->slot_index;
+	slot->slots_passed = record->slots_passed;
+	slot->filler = (record->flags & METAMAC_LOG_FILLER) != 0;
+	slot->packet_queued = (record->flags & METAMAC_LOG_PACKET_QUEUED) != 0;
+	slot->transmitted = (record->flags & METAMAC_LOG_TRANSMITTED) != 0;
+	slot->transmit_success = (record->flags & METAMAC_LOG_TRANSMIT_SUCCESS) != 0;
+	slot->transmit_other = (record->flags & METAMAC_LOG_TRANSMIT_OTHER) != 0;
+	slot->bad_reception = (record->flags & METAMAC_LOG_BAD_RECEPTION) != 0;
+	slot->busy_slot = (record->flags & METAMAC_LOG_BUSY_SLOT) != 0;
+	slot->channel_busy = (record->flags & METAMAC_LOG_CHANNEL_BUSY) != 0;
+}
+
+void metamac_log_csv_header(FILE *file, const struct protocol_suite *suite)
+{
+	fprintf(file, "slot_num,offset,read_num,host_time,tsf_time,slot_index,slots_passed,filler,packet_queued,transmitted,transmit_success,transmit_other,bad_reception,busy_slot,channel_busy,protocol");
+	for (int i = 0; i < suite->num_protocols; i++) {
+		fprintf(file, ",%s", suite->protocols[i].name);
+	}
+	fprintf(file, "\n");
+}
+
+void metamac_log_csv_slot(FILE *file, const struct metamac_slot *slot, int offset,
+	const char *protocol, const double *weights, int num_protocols)
+{
+	fprintf(file, "%llu,%d,%llu,%llu,%llu,%d,%d,%01x,%01x,%01x,%01x,%01x,%01x,%01x,%01x,%s",
+		(unsigned long long) slot->slot_num,
+		offset,
+		(unsigned long long) slot->read_num,
+		(unsigned long long) slot->host_time,
+		(unsigned long long) slot->tsf_time,
+		slot->slot_index,
+		slot->slots_passed,
+		slot->filler,
+		slot->packet_queued,
+		slot->transmitted,
+		slot->transmit_success,
+		slot->transmit_other,
+		slot->bad_reception,
+		slot->busy_slot,
+		slot->channel_busy,
+		protocol);
+
+	for (int i = 0; i < num_protocols; i++) {
+		fprintf(file, ",%e", weights[i]);
+	}
+
+	fprintf(file, "\n");
+}
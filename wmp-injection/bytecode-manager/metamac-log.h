@@ -0,0 +1,95 @@
+#ifndef METAMAC_LOG_H
+#define METAMAC_LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "metamac.h"
+
+/* Binary metamac log.
+ *
+ *	header | protocol names | record | record | ...
+ *
+ * The header gives the number of protocols and the record size, the names
+ * follow as num_protocols NUL terminated strings (names_size bytes in
+ * all) and every slot is one fixed size record ending with the weight
+ * vector. Everything is in host byte order. metamac-log2csv turns a
+ * binary log back into the CSV layout written by metamac -l. */
+
+#define METAMAC_LOG_MAGIC		0x4C504D57	/* "WMPL" */
+#define METAMAC_LOG_VERSION		1
+
+/* Bits of metamac_log_record.flags, in CSV column order. */
+#define METAMAC_LOG_FILLER		0x01
+#define METAMAC_LOG_PACKET_QUEUED	0x02
+#define METAMAC_LOG_TRANSMITTED		0x04
+#define METAMAC_LOG_TRANSMIT_SUCCESS	0x08
+#define METAMAC_LOG_TRANSMIT_OTHER	0x10
+#define METAMAC_LOG_BAD_RECEPTION	0x20
+#define METAMAC_LOG_BUSY_SLOT		0x40
+#define METAMAC_LOG_CHANNEL_BUSY	0x80
+
+struct metamac_log_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t num_protocols;
+	uint32_t record_size;
+	uint32_t names_size;
+};
+
+struct metamac_log_record {
+	uint64_t slot_num;
+	uint64_t read_num;
+	uint64_t host_time;
+	uint64_t tsf_time;
+	int32_t offset;
+	int32_t slot_index;
+	int32_t slots_passed;
+	uint16_t protocol;
+	uint8_t flags;
+	uint8_t reserved;
+	double weights[];
+};
+
+#define METAMAC_LOG_RECORD_SIZE(n) (sizeof(struct metamac_log_record) + (n) * sizeof(double))
+
+/* Records are appended to preallocated blocks by the process thread and
+written out by a background thread, so the process thread never formats
+or writes anything. It only waits if every block is waiting to be
+written, which is counted in stalls. */
+struct metamac_log {
+	FILE *file;
+	int num_protocols;
+	size_t record_size;
+	size_t block_size;
+	int num_blocks;
+	char *blocks;
+	size_t *fill;
+	/* Block being filled by the process thread. */
+	int head;
+	/* Next block to be written by the writer thread. */
+	int tail;
+	/* Number of blocks waiting to be written. */
+	int full;
+	int closing;
+	int error;
+	unsigned long records;
+	unsigned long stalls;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t writer;
+};
+
+int metamac_log_open(struct metamac_log *log, const char *path, const struct protocol_suite *suite);
+void metamac_log_slot(struct metamac_log *log, const struct metamac_slot *slot, int offset,
+	int protocol, const double *weights);
+int metamac_log_close(struct metamac_log *log);
+
+void metamac_log_unpack(const struct metamac_log_record *record, struct metamac_slot *slot);
+
+void metamac_log_csv_header(FILE *file, const struct protocol_suite *suite);
+void metamac_log_csv_slot(FILE *file, const struct metamac_slot *slot, int offset,
+	const char *protocol, const double *weights, int num_protocols);
+
+#endif // METAMAC_LOG_H
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include <argp.h>
+
+#include "metamac-log.h"
+
+/* ******************
+ * Binary metamac log converter
+ *
+ * Turns a log written with metamac -B -l into the CSV layout that
+ * metamac -l writes, for experiments/analysis.py.
+ * usage: ./metamac-log2csv metamac.bin metamac.csv
+ * ***************** */
+
+const char *argp_program_version = "MetaMAC Log Converter 0.0.1";
+static const char doc[] = "Converts a binary metamac log into CSV.";
+static const char args_doc[] = "INPUT [OUTPUT]";
+
+struct arguments {
+	char *input;
+	char *output;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+	struct arguments *arguments = state->input;
+
+	switch (key) {
+	case ARGP_KEY_ARG:
+		if (state->arg_num == 0) {
+			arguments->input = arg;
+		} else if (state->arg_num == 1) {
+			arguments->output = arg;
+		} else {
+			argp_usage(state);
+		}
+		break;
+
+	case ARGP_KEY_END:
+		if (state->arg_num < 1) {
+			argp_usage(state);
+		}
+		break;
+
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+static const struct argp argp = { NULL, parse_opt, args_doc, doc };
+
+int main(int argc, char *argv[])
+{
+	struct arguments arguments;
+	memset(&arguments, 0, sizeof(arguments));
+	argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+	FILE *in = fopen(arguments.input, "r");
+	if (in == NULL) {
+		err(EXIT_FAILURE, "Unable to open %s", arguments.input);
+	}
+
+	FILE *out = stdout;
+	if (arguments.output != NULL) {
+		out = fopen(arguments.output, "w");
+		if (out == NULL) {
+			err(EXIT_FAILURE, "Unable to open %s", arguments.output);
+		}
+	}
+
+	struct metamac_log_header header;
+	if (fread(&header, sizeof(header), 1, in) != 1 || header.magic != METAMAC_LOG_MAGIC) {
+		errx(EXIT_FAILURE, "%s is not a binary metamac log", arguments.input);
+	}
+	if (header.version != METAMAC_LOG_VERSION ||
+		header.record_size != METAMAC_LOG_RECORD_SIZE(header.num_protocols)) {
+		errx(EXIT_FAILURE, "Unsupported log version %u", header.version);
+	}
+
+	/* Only the names are needed to write the CSV header. */
+	struct protocol_suite suite;
+	memset(&suite, 0, sizeof(suite));
+	suite.num_protocols = header.num_protocols;
+	suite.protocols = calloc(header.num_protocols, sizeof(struct protocol));
+	char *names = malloc(header.names_size);
+	struct metamac_log_record *record = malloc(header.record_size);
+	if (suite.protocols == NULL || names == NULL || record == NULL) {
+		err(EXIT_FAILURE, "Unable to allocate memory");
+	}
+
+	if (fread(names, 1, header.names_size, in) != header.names_size) {
+		errx(EXIT_FAILURE, "Truncated log header");
+	}
+	char *name = names;
+	for (int i = 0; i < suite.num_protocols; i++) {
+		if (name >= names + header.names_size) {
+			errx(EXIT_FAILURE, "Invalid protocol names in log header");
+		}
+		suite.protocols[i].name = name;
+		name += strlen(name) + 1;
+	}
+
+	metamac_log_csv_header(out, &suite);
+
+	unsigned long records = 0;
+	while (fread(record, header.record_size, 1, in) == 1) {
+		if (record->protocol >= suite.num_protocols) {
+			errx(EXIT_FAILURE, "Invalid protocol index in record %lu", records);
+		}
+
+		struct metamac_slot slot;
+		metamac_log_unpack(record, &slot);
+		metamac_log_csv_slot(out, &slot, record->offset, suite.protocols[record->protocol].name,
+			record->weights, suite.num_protocols);
+		records++;
+	}
+
+	if (ferror(in)) {
+		err(EXIT_FAILURE, "Error reading %s", arguments.input);
+	}
+
+	if (out != stdout) {
+		fclose(out);
+	}
+	fclose(in);
+	free(record);
+	free(names);
+	free(suite.protocols);
+
+	return 0;
+}
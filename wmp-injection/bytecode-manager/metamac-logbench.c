@@ -0,0 +1,172 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include <argp.h>
+#include <time.h>
+
+#include "metamac-log.h"
+
+/* ******************
+ * metamac log benchmark
+ *
+ * Logs the same synthetic slots as CSV (metamac -l) and as binary records
+ * (metamac -B -l) and reports the slots per second of each on the
+ * logging thread.
+ * usage: ./metamac-logbench -p 16 -n 200000 /tmp/metamac-logbench
+ * ***************** */
+
+const char *argp_program_version = "MetaMAC Log Benchmark 0.0.1";
+static const char doc[] = "Compares CSV and binary metamac logging throughput.";
+static const char args_doc[] = "PREFIX";
+
+static const struct argp_option options[] = {
+	{ "protocols", 'p', "COUNT", 0, "Number of protocols in the suite (default 8)." },
+	{ "slots",     'n', "COUNT", 0, "Number of slots to log (default 200000)." },
+	{ 0 }
+};
+
+struct arguments {
+	int protocols;
+	unsigned long slots;
+	char *prefix;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+	struct arguments *arguments = state->input;
+
+	switch (key) {
+	case 'p':
+		if (sscanf(arg, "%d", &arguments->protocols) < 1 || arguments->protocols < 1 ||
+			arguments->protocols > 65535) {
+			argp_error(state, "Invalid value for argument 'protocols'.");
+		}
+		break;
+
+	case 'n':
+		if (sscanf(arg, "%lu", &arguments->slots) < 1 || arguments->slots == 0) {
+			argp_error(state, "Invalid value for argument 'slots'.");
+		}
+		break;
+
+	case ARGP_KEY_ARG:
+		if (state->arg_num >= 1) {
+			argp_usage(state);
+		}
+		arguments->prefix = arg;
+		break;
+
+	case ARGP_KEY_END:
+		if (state->arg_num < 1) {
+			argp_usage(state);
+		}
+		break;
+
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+static const struct argp argp = { options, parse_opt, args_doc, doc };
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void make_slot(struct metamac_slot *slot, unsigned long n)
+{
+	memset(slot, 0, sizeof(struct metamac_slot));
+	slot->slot_num = n;
+	slot->read_num = n / 4;
+	slot->host_time = n * 2200;
+	slot->tsf_time = 1000000 + n * 2200;
+	slot->slot_index = n % 8;
+	slot->slots_passed = 4;
+	slot->packet_queued = (n % 3) != 0;
+	slot->transmitted = (n % 5) == 0;
+	slot->transmit_success = (n % 10) == 0;
+	slot->channel_busy = (n % 7) == 0;
+}
+
+static void report(const char *name, unsigned long slots, uint64_t elapsed)
+{
+	printf("%-8s %12.0f slots/s %8.3f us/slot\n", name,
+		(double)slots * 1e9 / elapsed, (double)elapsed / slots / 1000.0);
+}
+
+int main(int argc, char *argv[])
+{
+	struct arguments arguments = { .protocols = 8, .slots = 200000 };
+	argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+	struct protocol_suite suite;
+	memset(&suite, 0, sizeof(suite));
+	suite.num_protocols = arguments.protocols;
+	suite.protocols = calloc(arguments.protocols, sizeof(struct protocol));
+	suite.weights = malloc(sizeof(double) * arguments.protocols);
+	if (suite.protocols == NULL || suite.weights == NULL) {
+		err(EXIT_FAILURE, "Unable to allocate memory");
+	}
+	for (int i = 0; i < arguments.protocols; i++) {
+		if (asprintf(&suite.protocols[i].name, "protocol-%d", i) < 0) {
+			err(EXIT_FAILURE, "Unable to allocate memory");
+		}
+		suite.weights[i] = 1.0 / arguments.protocols;
+	}
+
+	char *csvpath, *binpath;
+	if (asprintf(&csvpath, "%s.csv", arguments.prefix) < 0 ||
+		asprintf(&binpath, "%s.bin", arguments.prefix) < 0) {
+		err(EXIT_FAILURE, "Unable to allocate memory");
+	}
+
+	printf("%d protocols, %lu slots\n", arguments.protocols, arguments.slots);
+
+	struct metamac_slot slot;
+	FILE *csv = fopen(csvpath, "w+");
+	if (csv == NULL) {
+		err(EXIT_FAILURE, "Unable to open %s", csvpath);
+	}
+	uint64_t start = now_ns();
+	metamac_log_csv_header(csv, &suite);
+	for (unsigned long n = 0; n < arguments.slots; n++) {
+		make_slot(&slot, n);
+		suite.weights[n % arguments.protocols] *= 1.0000001;
+		metamac_log_csv_slot(csv, &slot, 0, suite.protocols[n % arguments.protocols].name,
+			suite.weights, suite.num_protocols);
+	}
+	fclose(csv);
+	report("csv", arguments.slots, now_ns() - start);
+
+	/* Same weights as the CSV run, so that the two logs can be compared. */
+	for (int i = 0; i < arguments.protocols; i++) {
+		suite.weights[i] = 1.0 / arguments.protocols;
+	}
+
+	struct metamac_log log;
+	start = now_ns();
+	if (metamac_log_open(&log, binpath, &suite) < 0) {
+		err(EXIT_FAILURE, "Unable to open %s", binpath);
+	}
+	for (unsigned long n = 0; n < arguments.slots; n++) {
+		make_slot(&slot, n);
+		suite.weights[n % arguments.protocols] *= 1.0000001;
+		metamac_log_slot(&log, &slot, 0, n % arguments.protocols, suite.weights);
+	}
+	uint64_t logged = now_ns() - start;
+	if (metamac_log_close(&log) < 0) {
+		errx(EXIT_FAILURE, "Error writing %s", binpath);
+	}
+	report("binary", arguments.slots, logged);
+	report("+flush", arguments.slots, now_ns() - start);
+	printf("writer stalls: %lu\n", log.stalls);
+
+	return 0;
+}
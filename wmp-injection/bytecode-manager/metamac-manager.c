@@ -2,6 +2,7 @@
 #include "parseconfig.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <argp.h>
 #include <signal.h>
 #include <sched.h>
@@ -24,6 +25,12 @@ static struct argp_option options[] = {
 	{ "cycle",    'c', 0,      0, "Force cycling of protocols."},
 	{ "eta",      'e', "ETA",  0, "Learning constant eta (>= 0)."},
 	{ "usebusy",  'b', 0,      0, "Use the busy slot feedback."},
+	{ "verify",   'k', 0,      0, "Read back bytecode slots after every load."},
+	{ "queue",    'q', "SLOTS", 0, "Capacity of the slot queue, a power of two (default 256)."},
+	{ "dropoldest", 'o', 0,    0, "Drop the oldest slots instead of the newest when the queue is full."},
+	{ "binary",   'B', 0,      0, "Write the log file in binary format (see metamac-log2csv)."},
+	{ "ring",     'R', 0,      0, "Drain the firmware slot feedback ring instead of the feedback bitmaps."},
+	{ "logweights", 'w', 0,    0, "Keep the weights in the log domain and update them a batch of slots at a time."},
 	{ 0 }
 };
 
@@ -60,6 +67,33 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
 		arguments->metamac_flags |= FLAG_USE_BUSY;
 		break;
 
+	case 'k':
+		arguments->metamac_flags |= FLAG_VERIFY;
+		break;
+
+	case 'q':
+		if (sscanf(arg, "%zu", &arguments->queue_capacity) < 1 || arguments->queue_capacity == 0 ||
+			(arguments->queue_capacity & (arguments->queue_capacity - 1)) != 0) {
+			argp_usage(state);
+		}
+		break;
+
+	case 'o':
+		arguments->queue_overflow = QUEUE_DROP_OLDEST;
+		break;
+
+	case 'B':
+		arguments->metamac_flags |= FLAG_LOG_BINARY;
+		break;
+
+	case 'R':
+		arguments->metamac_flags |= FLAG_FEEDBACK_RING;
+		break;
+
+	case 'w':
+		arguments->metamac_flags |= FLAG_LOG_WEIGHTS;
+		break;
+
 	case ARGP_KEY_ARG:
 		if (state->arg_num >= 1) {
 			argp_usage(state);
@@ -128,15 +162,18 @@ int main(int argc, char *argv[])
 	/* Parse command line arguments. */
 	struct arguments arguments;
 	memset(&arguments, 0, sizeof(arguments));
+	arguments.queue_capacity = 256;
+	arguments.queue_overflow = QUEUE_DROP_NEWEST;
 	argp_parse(&argp, argc, argv, 0, 0, &arguments);
 
 	struct protocol_suite *suite = read_config(argv[0], &arguments);
-	struct thread_params *params = malloc(sizeof(struct thread_params));
-	if (!params) {
+	/* The queue indexes are cache line aligned. */
+	struct thread_params *params;
+	if (posix_memalign((void**)&params, QUEUE_CACHE_LINE, sizeof(struct thread_params)) != 0) {
 		err(EXIT_FAILURE, "Unable to allocate memory");
 	}
 
-	queue_init(&params->queue, 256);
+	queue_init(&params->queue, arguments.queue_capacity, arguments.queue_overflow);
 	init_file(&params->df);
 	params->flags = arguments.metamac_flags;
 
@@ -150,6 +187,10 @@ int main(int argc, char *argv[])
 
 	pthread_join(reader, NULL);
 
+	if (queue_dropped(&params->queue) > 0) {
+		fprintf(stderr, "Dropped %lu slots on queue overflow.\n", queue_dropped(&params->queue));
+	}
+
 	queue_destroy(&params->queue);
 	close_file(&params->df);
 	free(params);
@@ -0,0 +1,201 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <err.h>
+#include <argp.h>
+#include <time.h>
+
+#include "metamac.h"
+#include "protocols.h"
+
+/* ******************
+ * metamac weight update benchmark
+ *
+ * Runs the same synthetic slots through the linear weight update
+ * (update_weights) and the log domain batch update (metamac -w) for
+ * suites of 2 to MAX protocols, a mix of TDMA and ALOHA, and reports the
+ * slots per second of each and the largest difference between the final
+ * weights.
+ * usage: ./metamac-weightbench -m 1024 -n 100000 -b 64
+ * ***************** */
+
+const char *argp_program_version = "MetaMAC Weight Benchmark 0.0.1";
+static const char doc[] = "Compares linear and log domain metamac weight updates.";
+
+static const struct argp_option options[] = {
+	{ "max",   'm', "COUNT", 0, "Largest number of protocols in the sweep (default 1024)." },
+	{ "slots", 'n', "COUNT", 0, "Number of slots per run (default 100000)." },
+	{ "batch", 'b', "COUNT", 0, "Slots per log domain batch (default 64)." },
+	{ "eta",   'e', "ETA",   0, "Learning rate (default 0.1)." },
+	{ 0 }
+};
+
+struct arguments {
+	int max;
+	unsigned long slots;
+	int batch;
+	double eta;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+	struct arguments *arguments = state->input;
+
+	switch (key) {
+	case 'm':
+		if (sscanf(arg, "%d", &arguments->max) < 1 || arguments->max < 2 ||
+			arguments->max > 65535) {
+			argp_error(state, "Invalid value for argument 'max'.");
+		}
+		break;
+
+	case 'n':
+		if (sscanf(arg, "%lu", &arguments->slots) < 1 || arguments->slots == 0) {
+			argp_error(state, "Invalid value for argument 'slots'.");
+		}
+		break;
+
+	case 'b':
+		if (sscanf(arg, "%d", &arguments->batch) < 1 || arguments->batch < 1) {
+			argp_error(state, "Invalid value for argument 'batch'.");
+		}
+		break;
+
+	case 'e':
+		if (sscanf(arg, "%lf", &arguments->eta) < 1 || arguments->eta <= 0.0) {
+			argp_error(state, "Invalid value for argument 'eta'.");
+		}
+		break;
+
+	case ARGP_KEY_ARG:
+		argp_usage(state);
+		break;
+
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+static const struct argp argp = { options, parse_opt, 0, doc };
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void make_slot(struct metamac_slot *slot, unsigned long n)
+{
+	memset(slot, 0, sizeof(struct metamac_slot));
+	slot->slot_num = n;
+	slot->read_num = n / 4;
+	slot->slot_index = n % 8;
+	slot->slots_passed = 4;
+	slot->packet_queued = (n % 3) != 0;
+	slot->transmitted = (n % 5) == 0;
+	slot->transmit_success = (n % 10) == 0;
+	slot->channel_busy = (n % 7) == 0;
+}
+
+/* Even protocols are TDMA with growing frames, odd ones ALOHA with
+growing persistence, like a large generated configuration would be. */
+static struct protocol_suite *make_suite(int num_protocols, double eta, metamac_flag_t flags)
+{
+	struct protocol_suite *suite = malloc(sizeof(struct protocol_suite));
+	if (suite == NULL) {
+		err(EXIT_FAILURE, "Unable to allocate memory");
+	}
+	init_protocol_suite(suite, num_protocols, eta, flags);
+
+	for (int p = 0; p < num_protocols; p++) {
+		struct protocol *proto = &suite->protocols[p];
+
+		if (p % 2 == 0) {
+			struct tdma_param *param = malloc(sizeof(struct tdma_param));
+			if (param == NULL) {
+				err(EXIT_FAILURE, "Unable to allocate memory");
+			}
+			param->frame_offset = 0;
+			param->frame_length = 2 + (p / 2) % 16;
+			param->slot_assignment = (p / 2) % param->frame_length;
+			proto->emulator = tdma_emulate;
+			proto->parameter = param;
+		} else {
+			struct aloha_param *param = malloc(sizeof(struct aloha_param));
+			if (param == NULL) {
+				err(EXIT_FAILURE, "Unable to allocate memory");
+			}
+			param->persistence = (double)(p % 100 + 1) / 101.0;
+			proto->emulator = aloha_emulate;
+			proto->parameter = param;
+		}
+
+		if (asprintf(&proto->name, "protocol-%d", p) < 0) {
+			err(EXIT_FAILURE, "Unable to allocate memory");
+		}
+	}
+
+	suite->active_protocol = 0;
+
+	return suite;
+}
+
+int main(int argc, char *argv[])
+{
+	struct arguments arguments = { .max = 1024, .slots = 100000, .batch = 64, .eta = 0.1 };
+	argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+	struct metamac_slot *slots = malloc(sizeof(struct metamac_slot) * arguments.slots);
+	if (slots == NULL) {
+		err(EXIT_FAILURE, "Unable to allocate memory");
+	}
+	for (unsigned long n = 0; n < arguments.slots; n++) {
+		make_slot(&slots[n], n);
+	}
+
+	printf("%lu slots, batches of %d, eta %g\n", arguments.slots, arguments.batch, arguments.eta);
+	printf("%9s %14s %14s %8s %10s\n", "protocols", "linear us/slot", "log us/slot",
+		"speedup", "max diff");
+
+	for (int n = 2; n <= arguments.max; n *= 2) {
+		struct protocol_suite *linear = make_suite(n, arguments.eta, 0);
+		struct protocol_suite *logd = make_suite(n, arguments.eta, FLAG_LOG_WEIGHTS);
+
+		uint64_t start = now_ns();
+		for (unsigned long i = 0; i < arguments.slots; i++) {
+			update_weights(linear, slots[i]);
+		}
+		uint64_t linear_ns = now_ns() - start;
+
+		start = now_ns();
+		for (unsigned long i = 0; i < arguments.slots; i += arguments.batch) {
+			unsigned long count = arguments.slots - i;
+			count = count < arguments.batch ? count : arguments.batch;
+			update_weights_batch(logd, &slots[i], count);
+		}
+		sync_weights(logd);
+		uint64_t log_ns = now_ns() - start;
+
+		double diff = 0.0;
+		for (int p = 0; p < n; p++) {
+			diff = fmax(diff, fabs(linear->weights[p] - logd->weights[p]));
+		}
+
+		printf("%9d %14.3f %14.3f %7.1fx %10.2e\n", n,
+			(double)linear_ns / arguments.slots / 1000.0,
+			(double)log_ns / arguments.slots / 1000.0,
+			(double)linear_ns / log_ns, diff);
+
+		free_protocol_suite(linear);
+		free_protocol_suite(logd);
+	}
+
+	free(slots);
+
+	return 0;
+}
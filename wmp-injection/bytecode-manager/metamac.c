@@ -8,6 +8,7 @@
 #include <string.h>
 
 #include "metamac.h"
+#include "metamac-log.h"
 #include "protocols.h"
 #include "vars.h"
 #include "dataParser.h"
@@ -18,13 +19,16 @@ void free_protocol(struct protocol *proto)
 {
 	free(proto->name);
 	free(proto->fsm_path);
+	free(proto->fsm_image);
 	free(proto->parameter);
 	free(proto);
 }
 
-/* Performs the computation for emulating the suite of protocols
-for a single slot, and adjusting the weights. */
-void update_weights(struct protocol_suite* suite, struct metamac_slot current_slot)
+/* Log weights are shifted back to 0 once the largest one falls below
+this, so that they never lose precision however long the run. */
+#define LOG_WEIGHT_RENORM	512.0
+
+static void track_slot_offset(struct protocol_suite *suite, const struct metamac_slot *current_slot)
 {
 	/* Accounting for the fact that the slots that TDMA variants transmit on are
 	not necessarily aligned to the slot indices provided by the board. For instance,
@@ -32,14 +36,26 @@ void update_weights(struct protocol_suite* suite, struct metamac_slot current_sl
 	this is not necessarily true. Offset between transmissions will be 4, but not
 	necessarily aligned to the slot indexes. */
 	if (suite->protocols[suite->active_protocol].emulator == tdma_emulate &&
-		current_slot.transmitted) {
+		current_slot->transmitted) {
 		/* Update slot_offset. */
 
 		struct tdma_param *params = suite->protocols[suite->active_protocol].parameter;
-		int neg_offset = (current_slot.slot_num - params->frame_offset - params->slot_assignment) %
+		int neg_offset = (current_slot->slot_num - params->frame_offset - params->slot_assignment) %
 			params->frame_length;
 		suite->slot_offset = (params->frame_length - neg_offset) % params->frame_length;
 	}
+}
+
+/* Performs the computation for emulating the suite of protocols
+for a single slot, and adjusting the weights. */
+void update_weights(struct protocol_suite* suite, struct metamac_slot current_slot)
+{
+	if (suite->log_domain) {
+		update_weights_batch(suite, &current_slot, 1);
+		return;
+	}
+
+	track_slot_offset(suite, &current_slot);
 
 	/* If there is no packet queued for this slot, consider all protocols to be correct
 	and thus the weights will not change. */
@@ -69,6 +85,150 @@ void update_weights(struct protocol_suite* suite, struct metamac_slot current_sl
 	suite->last_slot = current_slot;
 }
 
+/* Emulates the queued slots of a run for every protocol family and
+adds the losses of each protocol to suite->losses. */
+static void emulate_batch(struct protocol_suite *suite, const struct emulated_slot *emulated,
+	const double *z, size_t num_slots)
+{
+	for (int f = 0; f < suite->num_families; f++) {
+		const struct protocol_family *family = &suite->families[f];
+		int count = family->count;
+		double *restrict decisions = suite->decisions;
+		double *restrict family_losses = suite->family_losses;
+
+		family->emulate(family, emulated, num_slots, decisions);
+
+		for (int j = 0; j < count; j++) {
+			family_losses[j] = 0.0;
+		}
+
+		for (size_t i = 0; i < num_slots; i++) {
+			for (int j = 0; j < count; j++) {
+				family_losses[j] += fabs(decisions[i * count + j] - z[i]);
+			}
+		}
+
+		for (int j = 0; j < count; j++) {
+			suite->losses[family->members[j]] += family_losses[j];
+		}
+	}
+}
+
+/* Log domain version of update_weights for a run of slots. The protocols
+are emulated a family and up to METAMAC_BATCH_SLOTS slots at a time, and
+the losses summed over the run are subtracted from the log weights in one
+pass over flat arrays, without any exp() or division; sync_weights()
+turns them back into normalized weights when needed. */
+void update_weights_batch(struct protocol_suite *suite, const struct metamac_slot *slots, size_t count)
+{
+	int n = suite->num_protocols;
+	double *restrict losses = suite->losses;
+	double *restrict log_weights = suite->log_weights;
+	struct emulated_slot emulated[METAMAC_BATCH_SLOTS];
+	double z[METAMAC_BATCH_SLOTS];
+	size_t queued = 0, total = 0;
+
+	if (!suite->log_domain) {
+		for (size_t i = 0; i < count; i++) {
+			update_weights(suite, slots[i]);
+		}
+		return;
+	}
+
+	if (suite->families == NULL) {
+		init_protocol_families(suite);
+	}
+
+	for (int p = 0; p < n; ++p) {
+		losses[p] = 0.0;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		track_slot_offset(suite, &slots[i]);
+
+		if (slots[i].packet_queued) {
+			/* The inputs update_weights would pass to the emulators. */
+			emulated[queued].slot_num = slots[i].slot_num;
+			emulated[queued].offset = suite->slot_offset;
+			emulated[queued].previous_slot = suite->last_slot;
+			z[queued] = (!slots[i].channel_busy) ? 1.0 : 0.0;
+
+			if (++queued == METAMAC_BATCH_SLOTS) {
+				emulate_batch(suite, emulated, z, queued);
+				total += queued;
+				queued = 0;
+			}
+		}
+
+		suite->last_slot = slots[i];
+	}
+
+	if (queued > 0) {
+		emulate_batch(suite, emulated, z, queued);
+		total += queued;
+	}
+
+	if (total == 0) {
+		return;
+	}
+
+	double eta = suite->eta;
+	double max = -INFINITY;
+
+	for (int p = 0; p < n; ++p) {
+		log_weights[p] -= eta * losses[p];
+		max = log_weights[p] > max ? log_weights[p] : max;
+	}
+
+	if (max < -LOG_WEIGHT_RENORM) {
+		for (int p = 0; p < n; ++p) {
+			log_weights[p] -= max;
+		}
+	}
+
+	suite->weights_stale = 1;
+}
+
+/* Brings the normalized weights up to date with the log weights. */
+void sync_weights(struct protocol_suite *suite)
+{
+	if (!suite->log_domain || !suite->weights_stale) {
+		return;
+	}
+
+	double max = -INFINITY;
+	for (int p = 0; p < suite->num_protocols; ++p) {
+		max = suite->log_weights[p] > max ? suite->log_weights[p] : max;
+	}
+
+	double s = 0;
+	for (int p = 0; p < suite->num_protocols; ++p) {
+		suite->weights[p] = exp(suite->log_weights[p] - max);
+		s += suite->weights[p];
+	}
+
+	for (int p = 0; p < suite->num_protocols; ++p) {
+		suite->weights[p] /= s;
+	}
+
+	suite->weights_stale = 0;
+}
+
+/* Index of the protocol with the largest weight, the first one on ties. */
+int best_protocol(const struct protocol_suite *suite)
+{
+	const double *w = suite->log_domain ? suite->log_weights : suite->weights;
+	int best = 0;
+
+	for (int p = 1; p < suite->num_protocols; p++) {
+		if (w[p] > w[best]) {
+			best = p;
+		}
+	}
+
+	return best;
+}
+
 void init_protocol_suite(struct protocol_suite *suite, int num_protocols, double eta, metamac_flag_t metamac_flags)
 {
 	suite->num_protocols = num_protocols;
@@ -92,26 +252,88 @@ void init_protocol_suite(struct protocol_suite *suite, int num_protocols, double
 		suite->weights[p] = 1.0 / num_protocols;
 	}
 
+	suite->log_domain = (metamac_flags & FLAG_LOG_WEIGHTS) != 0;
+	suite->weights_stale = 0;
+	suite->log_weights = NULL;
+	suite->families = NULL;
+	suite->num_families = 0;
+	suite->decisions = NULL;
+	suite->losses = NULL;
+	suite->family_losses = NULL;
+
+	if (suite->log_domain) {
+		suite->log_weights = (double*)calloc(num_protocols, sizeof(double));
+		suite->decisions = (double*)calloc(METAMAC_BATCH_SLOTS * num_protocols, sizeof(double));
+		suite->losses = (double*)calloc(num_protocols, sizeof(double));
+		suite->family_losses = (double*)calloc(num_protocols, sizeof(double));
+		if (suite->log_weights == NULL || suite->decisions == NULL || suite->losses == NULL ||
+			suite->family_losses == NULL) {
+			err(EXIT_FAILURE, "Unable to allocate memory");
+		}
+	}
+
 	suite->eta = eta;
 	suite->last_slot.slot_num = -1;
 	suite->last_slot.packet_queued = 0;
 	suite->last_slot.transmitted = 0;
 	suite->last_slot.channel_busy = 0;
+	suite->slot_loads = 0;
+	suite->slot_writes = 0;
 	suite->cycle = (metamac_flags & FLAG_CYCLE) != 0;
+	suite->verify = (metamac_flags & FLAG_VERIFY) != 0;
+	bytecode_shadow_invalidate(&suite->shadows[0]);
+	bytecode_shadow_invalidate(&suite->shadows[1]);
 }
 
 void free_protocol_suite(struct protocol_suite *suite)
 {
+	free_protocol_families(suite);
 	free(suite->protocols);
 	free(suite->weights);
+	free(suite->log_weights);
+	free(suite->decisions);
+	free(suite->losses);
+	free(suite->family_losses);
 	free(suite);
 }
 
-void configure_params(struct debugfs_file *df, int slot, struct fsm_param *param)
+/* Brings a slot to the FSM image and parameters of a protocol, writing
+only the halfwords that differ from the shadow copy of the slot. */
+static void write_slot(struct debugfs_file *df, struct protocol_suite *suite, int slot, int protocol)
 {
-	while (param != NULL) {
-		set_parameter(df, slot, param->num, param->value);
-		param = param->next;
+	struct protocol *proto = &suite->protocols[protocol];
+	uint16_t slot_image[IMAGE_SLOT_LENGTH];
+	uint8_t defined[IMAGE_SLOT_LENGTH];
+
+	bytecode_image_layout(proto->fsm_image, suite->conditions, slot_image, defined);
+
+	for (struct fsm_param *param = proto->fsm_params; param != NULL; param = param->next) {
+		int offset = parameter_offset(param->num);
+		if (offset >= 0) {
+			slot_image[offset / 2] = param->value & 0xffff;
+			defined[offset / 2] = 1;
+		}
+	}
+
+	int written = bytecode_shadow_write(df, slot, &suite->shadows[slot], slot_image, defined);
+	if (written < 0) {
+		err(EXIT_FAILURE, "Unable to load %s", proto->fsm_path);
+	}
+	suite->slot_loads++;
+	suite->slot_writes += written;
+
+	if (suite->verify) {
+		int mismatches = bytecode_shadow_verify(df, slot, &suite->shadows[slot]);
+		if (mismatches < 0) {
+			err(EXIT_FAILURE, "Unable to read back slot %d", slot + 1);
+		} else if (mismatches > 0) {
+			warnx("Slot %d differs from its shadow in %d halfwords, rewriting", slot + 1, mismatches);
+			written = bytecode_shadow_write(df, slot, &suite->shadows[slot], slot_image, defined);
+			if (written < 0) {
+				err(EXIT_FAILURE, "Unable to load %s", proto->fsm_path);
+			}
+			suite->slot_writes += written;
+		}
 	}
 }
 
@@ -125,16 +347,7 @@ void metamac_init(struct debugfs_file * df, struct protocol_suite *suite, metama
 	if (suite->active_protocol < 0) {
 		/* Select the best protocol based on weights. At this point, they
 		should be the same, so the first protocol will be selected. */
-		int p = 0;
-		double w = suite->weights[0];
-		for (int i = 1; i < suite->num_protocols; ++i) {
-			if (suite->weights[i] > w) {
-				p = i;
-				w = suite->weights[i];
-			}
-		}
-
-		suite->active_protocol = p;
+		suite->active_protocol = best_protocol(suite);
 	}
 
 	if (flags & FLAG_READONLY) {
@@ -142,13 +355,24 @@ void metamac_init(struct debugfs_file * df, struct protocol_suite *suite, metama
 		suite->slots[1] = -1;
 	} else {
 		struct options opt;
-		opt.load = "1";
-		opt.name_file = suite->protocols[suite->active_protocol].fsm_path;
-		bytecodeSharedWrite(df, &opt);
-		configure_params(df, 0, suite->protocols[suite->active_protocol].fsm_params);
+		if (bytecode_image_conditions(df, suite->conditions) < 0) {
+			err(EXIT_FAILURE, "Unable to read the condition procedure table");
+		}
+
+		/* Start from what the slots actually hold, so that even the
+		first load only writes the halfwords that differ. */
+		for (int slot = 0; slot < 2; slot++) {
+			if (bytecode_shadow_read(df, slot, &suite->shadows[slot]) < 0) {
+				err(EXIT_FAILURE, "Unable to read slot %d", slot + 1);
+			}
+		}
+
+		write_slot(df, suite, 0, suite->active_protocol);
 
-		opt.active = opt.load;
-		writeAddressBytecode(df, &opt);
+		opt.active = "1";
+		if (writeAddressBytecode(df, &opt) < 0) {
+			errx(EXIT_FAILURE, "Unable to run slot 1");
+		}
 
 		suite->slots[0] = suite->active_protocol;
 		suite->slots[1] = -1;
@@ -165,6 +389,8 @@ static void metamac_display(unsigned long loop, struct protocol_suite *suite)
 		printf("\x1b[%dF", suite->num_protocols);
 	}
 
+	sync_weights(suite);
+
 	int i;
 	for (i = 0; i < suite->num_protocols; i++) {
 		printf("%c %5.3f %s\n",
@@ -174,7 +400,9 @@ static void metamac_display(unsigned long loop, struct protocol_suite *suite)
 	}
 }
 
-static void load_protocol(struct debugfs_file *df, struct protocol_suite *suite, int protocol)
+/* Returns -1 if the firmware did not switch slot in time. The protocol
+then stays where it was written and the previous one keeps running. */
+int load_protocol(struct debugfs_file *df, struct protocol_suite *suite, int protocol)
 {
 	struct options opt;
 	int active = suite->active_slot; // Always 0 or 1 since metamac_init will already have run.
@@ -186,7 +414,9 @@ static void load_protocol(struct debugfs_file *df, struct protocol_suite *suite,
 	} else if (protocol == suite->slots[inactive]) {
 		/* Switch to other slot. */
 		opt.active = (inactive == 0) ? "1" : "2";
-		writeAddressBytecode(df, &opt);
+		if (writeAddressBytecode(df, &opt) < 0) {
+			return -1;
+		}
 		suite->active_slot = inactive;
 
 	} else if (suite->slots[active] >= 0 &&
@@ -194,7 +424,7 @@ static void load_protocol(struct debugfs_file *df, struct protocol_suite *suite,
 			suite->protocols[suite->slots[active]].fsm_path) == 0) {
 		/* Protocol in active slot shares same FSM, but is not the same protocol
 		(already checked). Write the parameters for this protocol. */
-		configure_params(df, active, suite->protocols[protocol].fsm_params);
+		write_slot(df, suite, active, protocol);
 		suite->slots[active] = protocol;
 
 	} else if (suite->slots[inactive] >= 0 &&
@@ -202,39 +432,37 @@ static void load_protocol(struct debugfs_file *df, struct protocol_suite *suite,
 			suite->protocols[suite->slots[inactive]].fsm_path) == 0) {
 		/* Protocol in inactive slot shares same FSM, but is not the same protocol,
 		so write the parameters for this protocol and activate it. */
-		configure_params(df, inactive, suite->protocols[protocol].fsm_params);
-		opt.active = (inactive == 0) ? "1" : "2";
-		writeAddressBytecode(df, &opt);
+		write_slot(df, suite, inactive, protocol);
 		suite->slots[inactive] = protocol;
+		opt.active = (inactive == 0) ? "1" : "2";
+		if (writeAddressBytecode(df, &opt) < 0) {
+			return -1;
+		}
 		suite->active_slot = inactive;
 
 	} else {
-		/* Load into inactive slot. */
-		opt.load = (inactive == 0) ? "1" : "2";
-		opt.name_file = suite->protocols[protocol].fsm_path;
-		bytecodeSharedWrite(df, &opt);
-		configure_params(df, inactive, suite->protocols[protocol].fsm_params);
-		opt.active = opt.load;
-		writeAddressBytecode(df, &opt);
-
+		/* Load into inactive slot. Suites mostly share states and
+		transitions, so only the differences are written. */
+		write_slot(df, suite, inactive, protocol);
 		suite->slots[inactive] = protocol;
+		opt.active = (inactive == 0) ? "1" : "2";
+		if (writeAddressBytecode(df, &opt) < 0) {
+			return -1;
+		}
+
 		suite->active_slot = inactive;
 
 	}
 
 	suite->active_protocol = protocol;
 	clock_gettime(CLOCK_MONOTONIC_RAW, &suite->last_update);
+	return 0;
 }
 
 static void metamac_evaluate(struct debugfs_file *df, struct protocol_suite *suite)
 {
 	/* Identify the best protocol. */
-	int best = 0;
-	for (int i = 0; i < suite->num_protocols; i++) {
-		if (suite->weights[i] > suite->weights[best]) {
-			best = i;
-		}
-	}
+	int best = best_protocol(suite);
 
 	if (suite->cycle) {
 		struct timespec current_time;
@@ -250,11 +478,221 @@ static void metamac_evaluate(struct debugfs_file *df, struct protocol_suite *sui
 	}
 }
 
-#define BAD_RECEPTION       0x00FA
-#define BUSY_SLOT           0x00FC
-
 volatile int metamac_loop_break = 0;
 
+static uint64_t elapsed_usec(const struct timespec *start_time)
+{
+	struct timespec current_time;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &current_time);
+	return (current_time.tv_sec - start_time->tv_sec) * 1000000L +
+		(current_time.tv_nsec - start_time->tv_nsec) / 1000L;
+}
+
+/* Works on single flags as well as on the feedback bitmaps. */
+static uint channel_busy(metamac_flag_t flags, uint transmitted, uint transmit_success,
+	uint transmit_other, uint bad_reception, uint busy_slot)
+{
+	uint other = transmit_other | bad_reception;
+
+	if (flags & FLAG_USE_BUSY) {
+		other |= busy_slot;
+	}
+
+	return (transmitted & ~transmit_success) | (other & ~(transmitted & transmit_success));
+}
+
+/* Number of records in the firmware feedback ring, 0 if the running
+firmware does not have one. */
+static unsigned int feedback_ring_size(struct debugfs_file *df)
+{
+	uint16_t header[2];
+
+	if (shmReadRange16(df, B43_SHM_SHARED, FEEDBACK_RING_MAGIC_ADDR, header, 2) < 0) {
+		err(EXIT_FAILURE, "Unable to read the slot feedback ring");
+	}
+
+	if (header[0] != FEEDBACK_RING_MAGIC || header[1] == 0 ||
+		header[1] > FEEDBACK_RING_MAX_SIZE || (header[1] & (header[1] - 1)) != 0) {
+		return 0;
+	}
+
+	return header[1];
+}
+
+/* Ring head and TSF, read together after the records. The TSF words are
+read twice, as getTSFRegs does, in case the low word carried meanwhile. */
+static void feedback_ring_tail(struct debugfs_file *df, uint16_t *head, uint64_t *tsf)
+{
+	struct b43_access acc[] = {
+		{ .routing = B43_SHM_SHARED, .offset = FEEDBACK_RING_HEAD_ADDR, .width = 16 },
+		{ .routing = B43_MMIO, .offset = B43_MMIO_TSF_3, .width = 16 },
+		{ .routing = B43_MMIO, .offset = B43_MMIO_TSF_2, .width = 16 },
+		{ .routing = B43_MMIO, .offset = B43_MMIO_TSF_1, .width = 16 },
+		{ .routing = B43_MMIO, .offset = B43_MMIO_TSF_0, .width = 16 },
+		{ .routing = B43_MMIO, .offset = B43_MMIO_TSF_3, .width = 16 },
+		{ .routing = B43_MMIO, .offset = B43_MMIO_TSF_2, .width = 16 },
+		{ .routing = B43_MMIO, .offset = B43_MMIO_TSF_1, .width = 16 },
+	};
+
+	do {
+		if (shmReadBatch(df, acc, ARRAY_SIZE(acc)) < 0) {
+			err(EXIT_FAILURE, "Unable to read the slot feedback ring");
+		}
+	} while (acc[1].value != acc[5].value || acc[2].value != acc[6].value ||
+		acc[3].value != acc[7].value);
+
+	*head = acc[0].value;
+	*tsf = ((uint64_t)acc[1].value << 48) | ((uint64_t)acc[2].value << 32) |
+		((uint64_t)acc[3].value << 16) | acc[4].value;
+}
+
+static uint16_t feedback_ring_head(struct debugfs_file *df)
+{
+	struct b43_access acc = { .routing = B43_SHM_SHARED, .offset = FEEDBACK_RING_HEAD_ADDR, .width = 16 };
+
+	if (shmReadBatch(df, &acc, 1) < 0) {
+		err(EXIT_FAILURE, "Unable to read the slot feedback ring");
+	}
+
+	return acc.value;
+}
+
+/* Read count records starting at ring position first, in at most two
+runs since the records may wrap around the end of the ring. */
+static void feedback_ring_read(struct debugfs_file *df, unsigned int size,
+	unsigned int first, unsigned int count, uint16_t *records)
+{
+	unsigned int index = first % size;
+	unsigned int run = count < size - index ? count : size - index;
+
+	if (run > 0 && shmReadRange16(df, B43_SHM_SHARED,
+			FEEDBACK_RING_RECORDS_ADDR + index * FEEDBACK_RECORD_WORDS * 2,
+			records, run * FEEDBACK_RECORD_WORDS) < 0) {
+		err(EXIT_FAILURE, "Unable to read the slot feedback ring");
+	}
+
+	if (count > run && shmReadRange16(df, B43_SHM_SHARED, FEEDBACK_RING_RECORDS_ADDR,
+			records + run * FEEDBACK_RECORD_WORDS, (count - run) * FEEDBACK_RECORD_WORDS) < 0) {
+		err(EXIT_FAILURE, "Unable to read the slot feedback ring");
+	}
+}
+
+/* Drains the records written by the firmware since the last read. Each
+record names its slot and carries the low TSF bits, so nothing has to be
+inferred from the TSF between reads and the reads can be as far apart as
+the ring allows. Only slots overwritten before they were read are lost;
+the slot counter of the next record accounts for them. */
+static int metamac_ring_read_loop(struct metamac_queue *queue, struct debugfs_file *df,
+	metamac_flag_t flags, int slot_time, unsigned int size)
+{
+	unsigned long slot_num = 0L, read_num = 0L, lost = 0L;
+	uint16_t records[FEEDBACK_RING_MAX_SIZE * FEEDBACK_RECORD_WORDS];
+	uint64_t record_tsf[FEEDBACK_RING_MAX_SIZE];
+	struct metamac_slot slots[FEEDBACK_RING_MAX_SIZE];
+	uint16_t cursor, head, last_counter = 0;
+	int first = 1;
+	uint64_t tsf;
+
+	/* Leave three quarters of the ring as slack for late wakeups. */
+	int read_interval = size * slot_time / 4;
+
+	struct timespec start_time;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &start_time);
+
+	cursor = feedback_ring_head(df);
+
+	while (metamac_loop_break == 0) {
+		uint64_t loop_start = elapsed_usec(&start_time);
+
+		head = feedback_ring_head(df);
+		unsigned int count = (uint16_t)(head - cursor);
+
+		if (count > size) {
+			cursor = head - size;
+			count = size;
+		}
+
+		feedback_ring_read(df, size, cursor, count, records);
+
+		/* The firmware may have gone around the ring while we were
+		reading; the records it reached since then are not reliable. */
+		uint16_t end;
+		feedback_ring_tail(df, &end, &tsf);
+		unsigned int skip = (uint16_t)(end - cursor);
+		skip = skip > size ? skip - size : 0;
+		skip = skip > count ? count : skip;
+
+		/* Extend the TSF bits backwards from the current TSF. Slots
+		are much shorter than the 65 ms the 16 bits cover. */
+		uint64_t t = tsf;
+		for (int i = count - 1; i >= (int)skip; i--) {
+			uint16_t *rec = &records[i * FEEDBACK_RECORD_WORDS];
+			uint64_t rec_tsf = (t & ~0xFFFFULL) | rec[FEEDBACK_RECORD_TSF];
+
+			if (rec_tsf > t) {
+				rec_tsf -= 0x10000;
+			}
+
+			record_tsf[i] = t = rec_tsf;
+		}
+
+		int ai = 0;
+
+		for (unsigned int i = skip; i < count; i++) {
+			uint16_t *rec = &records[i * FEEDBACK_RECORD_WORDS];
+			uint16_t counter = rec[FEEDBACK_RECORD_SLOT];
+			uint16_t fb = rec[FEEDBACK_RECORD_FLAGS];
+
+			if (first) {
+				slot_num = counter;
+				first = 0;
+			} else {
+				uint16_t passed = counter - last_counter;
+				lost += passed - 1;
+				slot_num += passed;
+			}
+			last_counter = counter;
+
+			slots[ai].slot_num = slot_num;
+			slots[ai].read_num = read_num;
+			slots[ai].host_time = loop_start;
+			slots[ai].tsf_time = record_tsf[i];
+			slots[ai].slot_index = counter & 0x7;
+			slots[ai].slots_passed = count - skip;
+			slots[ai].filler = 0;
+			slots[ai].packet_queued = (fb & FEEDBACK_PACKET_QUEUED) != 0;
+			slots[ai].transmitted = (fb & FEEDBACK_TRANSMITTED) != 0;
+			slots[ai].transmit_success = (fb & FEEDBACK_TRANSMIT_SUCCESS) != 0;
+			slots[ai].transmit_other = (fb & FEEDBACK_TRANSMIT_OTHER) != 0;
+			slots[ai].bad_reception = (fb & FEEDBACK_BAD_RECEPTION) != 0;
+			slots[ai].busy_slot = (fb & FEEDBACK_BUSY_SLOT) != 0;
+			slots[ai].channel_busy = channel_busy(flags, slots[ai].transmitted,
+				slots[ai].transmit_success, slots[ai].transmit_other,
+				slots[ai].bad_reception, slots[ai].busy_slot) & 1;
+			ai++;
+		}
+
+		queue_multipush(queue, slots, ai);
+		cursor = head;
+
+		int64_t delay = ((int64_t)loop_start) + read_interval - ((int64_t)elapsed_usec(&start_time));
+		if (delay > 0) {
+			usleep(delay);
+		}
+
+		read_num++;
+	}
+
+	if ((flags & FLAG_VERBOSE) && lost > 0) {
+		fprintf(stderr, "Lost %lu slots to feedback ring overruns.\n", lost);
+	}
+
+	usleep(10000);
+	queue_signal(queue);
+
+	return metamac_loop_break;
+}
+
 int metamac_read_loop(struct metamac_queue *queue, struct debugfs_file *df,
 	metamac_flag_t flags, int slot_time, int read_interval)
 {
@@ -262,6 +700,16 @@ int metamac_read_loop(struct metamac_queue *queue, struct debugfs_file *df,
 	int slot_index, last_slot_index;
 	uint64_t tsf, last_tsf, initial_tsf;
 
+	if (flags & FLAG_FEEDBACK_RING) {
+		unsigned int size = feedback_ring_size(df);
+
+		if (size > 0) {
+			return metamac_ring_read_loop(queue, df, flags, slot_time, size);
+		}
+
+		warnx("The firmware has no slot feedback ring, reading the feedback bitmaps");
+	}
+
 	struct timespec start_time;
 	clock_gettime(CLOCK_MONOTONIC_RAW, &start_time);
 	uint64_t loop_end = 0L;
@@ -281,25 +729,36 @@ int metamac_read_loop(struct metamac_queue *queue, struct debugfs_file *df,
 		last_tsf = tsf;
 		getTSFRegs(df, &tsf);
 		last_slot_index = slot_index;
-		slot_index = shmRead16(df, B43_SHM_REGS, COUNT_SLOT) & 0x7;
 
-		uint packet_queued = shmRead16(df, B43_SHM_SHARED, PACKET_TO_TRANSMIT);
-		uint transmitted = shmRead16(df, B43_SHM_SHARED, MY_TRANSMISSION);
-		uint transmit_success = shmRead16(df, B43_SHM_SHARED, SUCCES_TRANSMISSION);
-		uint transmit_other = shmRead16(df, B43_SHM_SHARED, OTHER_TRANSMISSION);
-		uint bad_reception = shmRead16(df, B43_SHM_SHARED, BAD_RECEPTION);
-		uint busy_slot = shmRead16(df, B43_SHM_SHARED, BUSY_SLOT);
-		int end_slot_index = shmRead16(df, B43_SHM_REGS, COUNT_SLOT) & 0x7;
-
-		uint channel_busy;
-		if (flags & FLAG_USE_BUSY) {
-			channel_busy = (transmitted & ~transmit_success) |
-				((transmit_other | bad_reception | busy_slot) & ~(transmitted & transmit_success));
-		} else {
-			channel_busy = (transmitted & ~transmit_success) |
-				((transmit_other | bad_reception) & ~(transmitted & transmit_success));
+		/* Slot counter, feedback bitmaps and slot counter again, read as one
+		batch so that the backend can merge the adjacent feedback words. */
+		struct b43_access feedback[] = {
+			{ .routing = B43_SHM_REGS,   .offset = COUNT_SLOT,          .width = 16 },
+			{ .routing = B43_SHM_SHARED, .offset = PACKET_TO_TRANSMIT,  .width = 16 },
+			{ .routing = B43_SHM_SHARED, .offset = MY_TRANSMISSION,     .width = 16 },
+			{ .routing = B43_SHM_SHARED, .offset = SUCCES_TRANSMISSION, .width = 16 },
+			{ .routing = B43_SHM_SHARED, .offset = OTHER_TRANSMISSION,  .width = 16 },
+			{ .routing = B43_SHM_SHARED, .offset = BAD_RECEPTION,       .width = 16 },
+			{ .routing = B43_SHM_SHARED, .offset = BUSY_SLOT,           .width = 16 },
+			{ .routing = B43_SHM_REGS,   .offset = COUNT_SLOT,          .width = 16 },
+		};
+		struct b43_snapshot snap = { .acc = feedback, .count = ARRAY_SIZE(feedback) };
+		if (shmSnapshotRead(df, &snap) < 0) {
+			err(EXIT_FAILURE, "Unable to read slot feedback");
 		}
 
+		slot_index = feedback[0].value & 0x7;
+		uint packet_queued = feedback[1].value;
+		uint transmitted = feedback[2].value;
+		uint transmit_success = feedback[3].value;
+		uint transmit_other = feedback[4].value;
+		uint bad_reception = feedback[5].value;
+		uint busy_slot = feedback[6].value;
+		int end_slot_index = feedback[7].value & 0x7;
+
+		uint busy = channel_busy(flags, transmitted, transmit_success,
+			transmit_other, bad_reception, busy_slot);
+
 		int slots_passed = slot_index - last_slot_index;
 		slots_passed = slots_passed < 0 ? slots_passed + 8 : slots_passed;
 		int64_t actual = ((int64_t)tsf) - ((int64_t)last_tsf);
@@ -356,7 +815,7 @@ int metamac_read_loop(struct metamac_queue *queue, struct debugfs_file *df,
 			slots[ai].transmit_other = (transmit_other >> si) & 1;
 			slots[ai].bad_reception = (bad_reception >> si) & 1;
 			slots[ai].busy_slot = (busy_slot >> si) & 1;
-			slots[ai].channel_busy = (channel_busy >> si) & 1;
+			slots[ai].channel_busy = (busy >> si) & 1;
 			ai++;
 		}
 
@@ -383,21 +842,23 @@ int metamac_read_loop(struct metamac_queue *queue, struct debugfs_file *df,
 int metamac_process_loop(struct metamac_queue *queue, struct debugfs_file *df,
 	struct protocol_suite *suite, metamac_flag_t flags, const char *logpath)
 {
-	FILE * logfile;
-	if (flags & FLAG_LOGGING) {
+	FILE * logfile = NULL;
+	struct metamac_log binlog;
+	int binary = (flags & FLAG_LOGGING) && (flags & FLAG_LOG_BINARY);
+
+	if (binary) {
+		if (metamac_log_open(&binlog, logpath, suite) < 0) {
+			err(EXIT_FAILURE, "Unable to open log file");
+		}
+		printf("Logging to %s (binary)\n", logpath);
+	} else if (flags & FLAG_LOGGING) {
 		logfile = fopen(logpath, "w+");
 		if (logfile == NULL) {
 			err(EXIT_FAILURE, "Unable to open log file");
 		}
 
-		fprintf(logfile, "slot_num,offset,read_num,host_time,tsf_time,slot_index,slots_passed,filler,packet_queued,transmitted,transmit_success,transmit_other,bad_reception,busy_slot,channel_busy,protocol");
-		for (int i = 0; i < suite->num_protocols; i++) {
-			fprintf(logfile, ",%s", suite->protocols[i].name);
-		}
-		fprintf(logfile, "\n");
+		metamac_log_csv_header(logfile, suite);
 		printf("Logging to %s\n", logpath);
-	} else {
-		logfile = NULL;
 	}
 
 	unsigned long loop = 0;
@@ -405,40 +866,41 @@ int metamac_process_loop(struct metamac_queue *queue, struct debugfs_file *df,
 	clock_gettime(CLOCK_MONOTONIC_RAW, &last_update_time);
 
 	metamac_loop_break = 0;
-	while (metamac_loop_break == 0) {
+	for (;;) {
 
-		struct metamac_slot slots[16];
+		/* The reader closes the queue after its last push, so once it is
+		seen closed, an empty pop means every slot has been processed. */
+		int closed = queue_closed(queue);
+		struct metamac_slot slots[64];
 		size_t count = queue_multipop(queue, slots, ARRAY_SIZE(slots));
+		if (count == 0) {
+			if (closed) {
+				break;
+			}
+			/* The pop does not block. The reader pushes every few
+			milliseconds, so a short sleep loses nothing. */
+			usleep(1000);
+		}
+
+		/* The log records the weights after every slot, so the batch
+		update only pays off without logging. */
+		if (suite->log_domain && !(flags & FLAG_LOGGING)) {
+			update_weights_batch(suite, slots, count);
+			count = 0;
+		}
 
 		for (int i = 0; i < count; i++) {
 			update_weights(suite, slots[i]);
-
-			if (logfile != NULL) {
-				fprintf(logfile, "%llu,%d,%llu,%llu,%llu,%d,%d,%01x,%01x,%01x,%01x,%01x,%01x,%01x,%01x,%s",
-					(unsigned long long) slots[i].slot_num,
-					suite->slot_offset,
-					(unsigned long long) slots[i].read_num,
-					(unsigned long long) slots[i].host_time,
-					(unsigned long long) slots[i].tsf_time,
-					slots[i].slot_index,
-					slots[i].slots_passed,
-					slots[i].filler,
-					slots[i].packet_queued,
-					slots[i].transmitted,
-					slots[i].transmit_success,
-					slots[i].transmit_other,
-					slots[i].bad_reception,
-					slots[i].busy_slot,
-					slots[i].channel_busy,
-					suite->protocols[suite->active_protocol].name);
-
-				for (int i = 0; i < suite->num_protocols; i++) {
-					fprintf(logfile, ",%e", suite->weights[i]);
-				}
-
-				fprintf(logfile, "\n");
+			sync_weights(suite);
+
+			if (binary) {
+				metamac_log_slot(&binlog, &slots[i], suite->slot_offset,
+					suite->active_protocol, suite->weights);
+			} else if (logfile != NULL) {
+				metamac_log_csv_slot(logfile, &slots[i], suite->slot_offset,
+					suite->protocols[suite->active_protocol].name,
+					suite->weights, suite->num_protocols);
 			}
-
 		}
 
 		struct timespec current_time;
@@ -462,9 +924,21 @@ int metamac_process_loop(struct metamac_queue *queue, struct debugfs_file *df,
 		}
 	}
 
-	if (logfile != NULL) {
+	if (binary) {
+		if (metamac_log_close(&binlog) < 0) {
+			warnx("Error writing log file %s", logpath);
+		}
+		if (binlog.stalls > 0) {
+			fprintf(stderr, "Log writer fell behind %lu times.\n", binlog.stalls);
+		}
+	} else if (logfile != NULL) {
 		fclose(logfile);
 	}
 
+	if ((flags & FLAG_VERBOSE) && suite->slot_loads > 0) {
+		printf("%lu slot loads, %.1f halfwords written per load\n", suite->slot_loads,
+			(double)suite->slot_writes / suite->slot_loads);
+	}
+
 	return metamac_loop_break;
 }
@@ -4,6 +4,7 @@
 #include "libb43.h"
 
 #include "queue.h"
+#include "bytecode-image.h"
 
 typedef unsigned char uchar;
 typedef unsigned int uint;
@@ -14,9 +15,38 @@ typedef enum {
 	FLAG_READONLY = 4,
 	FLAG_CYCLE = 8,
 	FLAG_ETA_OVERRIDE = 16,
-	FLAG_USE_BUSY = 32
+	FLAG_USE_BUSY = 32,
+	FLAG_VERIFY = 64,
+	FLAG_LOG_BINARY = 128,
+	FLAG_FEEDBACK_RING = 256,
+	FLAG_LOG_WEIGHTS = 512
 } metamac_flag_t;
 
+/* Slot feedback ring in shared memory, used with FLAG_FEEDBACK_RING.
+A firmware with ring support writes FEEDBACK_RING_MAGIC and the number
+of records (a power of two) once, then for every slot fills the record
+at (HEAD % size) and increments HEAD, a free running 16 bit count of the
+records written. Records before HEAD - size have been overwritten. */
+#define FEEDBACK_RING_MAGIC_ADDR	0x1400
+#define FEEDBACK_RING_SIZE_ADDR		0x1402
+#define FEEDBACK_RING_HEAD_ADDR		0x1404
+#define FEEDBACK_RING_RECORDS_ADDR	0x1408
+#define FEEDBACK_RING_MAGIC		0x4642	/* "FB" */
+#define FEEDBACK_RING_MAX_SIZE		128
+
+/* Record: firmware slot counter, TSF bits 0-15, flags, reserved. */
+#define FEEDBACK_RECORD_WORDS		4
+#define FEEDBACK_RECORD_SLOT		0
+#define FEEDBACK_RECORD_TSF		1
+#define FEEDBACK_RECORD_FLAGS		2
+
+#define FEEDBACK_PACKET_QUEUED		0x01
+#define FEEDBACK_TRANSMITTED		0x02
+#define FEEDBACK_TRANSMIT_SUCCESS	0x04
+#define FEEDBACK_TRANSMIT_OTHER		0x08
+#define FEEDBACK_BAD_RECEPTION		0x10
+#define FEEDBACK_BUSY_SLOT		0x20
+
 struct metamac_slot {
 	unsigned long slot_num;
 	unsigned long read_num;
@@ -43,6 +73,8 @@ struct metamac_slot {
 	uchar channel_busy : 1;
 };
 
+struct protocol_family;
+
 typedef double (*protocol_emulator)(void *param, int slot_num, int offset, struct metamac_slot previous_slot);
 
 struct fsm_param {
@@ -61,6 +93,8 @@ struct protocol {
 	char *name;
 	/* Path to the compiled (.txt) FSM implementation. */
 	char *fsm_path;
+	/* FSM image, compiled once when the configuration is read. */
+	struct bytecode_image *fsm_image;
 	/* Parameters for the FSM. */
 	struct fsm_param *fsm_params;
 	/* Protocol emulator for determining decisions of protocol locally. */
@@ -84,21 +118,51 @@ struct protocol_suite {
 	struct protocol *protocols;
 	/* Array of weights corresponding to protocols. */
 	double *weights;
+	/* With FLAG_LOG_WEIGHTS, the logarithms of the weights up to a common
+	offset. These are the reference and weights is only brought up to date
+	by sync_weights(). */
+	double *log_weights;
+	/* Protocols grouped for batch emulation, built on the first
+	update_weights_batch. */
+	struct protocol_family *families;
+	int num_families;
+	/* Scratch arrays for update_weights_batch: a decision matrix of up
+	to METAMAC_BATCH_SLOTS slots by num_protocols, and per protocol losses. */
+	double *decisions;
+	double *losses;
+	double *family_losses;
 	/* Factor used in computing weights. */
 	double eta;
 	/* Slot information for last to be emulated. */
 	struct metamac_slot last_slot;
 	/* Time of last protocol update. */
 	struct timespec last_update;
+	/* Host copies of the two bytecode slots. */
+	struct bytecode_shadow shadows[2];
+	/* Condition procedure table of the running firmware. */
+	uint16_t conditions[NUM_CONDITION_PROCEDURE];
+	/* Number of slot loads and halfwords written by them. */
+	unsigned long slot_loads;
+	unsigned long slot_writes;
 	/* Indicates whether protocols should be cycled. */
 	uchar cycle : 1;
+	/* Indicates whether slots are read back after every load. */
+	uchar verify : 1;
+	/* Indicates whether the weights are kept in the log domain. */
+	uchar log_domain : 1;
+	/* Indicates that weights is behind log_weights. */
+	uchar weights_stale : 1;
 };
 
 void free_protocol(struct protocol *proto);
 void init_protocol_suite(struct protocol_suite *suite, int num_protocols, double eta,  metamac_flag_t metamac_flags);
 void free_protocol_suite(struct protocol_suite *suite);
 void update_weights(struct protocol_suite *suite, struct metamac_slot slot);
+void update_weights_batch(struct protocol_suite *suite, const struct metamac_slot *slots, size_t count);
+void sync_weights(struct protocol_suite *suite);
+int best_protocol(const struct protocol_suite *suite);
 void metamac_init(struct debugfs_file * df, struct protocol_suite *suite, metamac_flag_t flags);
+int load_protocol(struct debugfs_file *df, struct protocol_suite *suite, int protocol);
 
 int metamac_read_loop(struct metamac_queue *queue, struct debugfs_file *df,
 	metamac_flag_t flags, int slot_time, int read_interval);
@@ -107,6 +171,9 @@ int metamac_process_loop(struct metamac_queue *queue, struct debugfs_file *df,
 
 extern volatile int metamac_loop_break;
 
+/* Slots emulated together by update_weights_batch. */
+#define METAMAC_BATCH_SLOTS 64
+
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
 
 #endif // METAMAC_H
\ No newline at end of file
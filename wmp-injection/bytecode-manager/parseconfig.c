@@ -289,6 +289,14 @@ void read_protocol(struct protocol *proto, xmlNode *protocol_node, const char *f
 		errx(EXIT_FAILURE, "Invalid configuration file: %s.\n", "Missing \"path\" attribute on <fsm> node");
 	}
 
+	proto->fsm_image = (struct bytecode_image*)malloc(sizeof(struct bytecode_image));
+	if (proto->fsm_image == NULL) {
+		err(EXIT_FAILURE, "Unable to allocate memory");
+	}
+	if (bytecode_image_open(proto->fsm_path, proto->fsm_image) < 0) {
+		errx(EXIT_FAILURE, "Invalid configuration file: Unable to load FSM %s.\n", proto->fsm_path);
+	}
+
 	proto->fsm_params = NULL;
 	read_fsm_params(fsm_node, &proto->fsm_params);
 
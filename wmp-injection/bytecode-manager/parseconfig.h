@@ -9,6 +9,8 @@ struct arguments {
   char *logpath;
   double eta;
   metamac_flag_t metamac_flags;
+  size_t queue_capacity;
+  queue_overflow_t queue_overflow;
 };
 
 struct protocol_suite *read_config(const char *program_name, struct arguments *arguments);
@@ -1,3 +1,7 @@
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
 #include "protocols.h"
 
 /*void tdma_init(struct tdma_param *param, int frame_offset, int frame_length, int slot_assignment)
@@ -28,4 +32,193 @@ double aloha_emulate(void *param, int slot_num, int offset, struct metamac_slot
 		/* Transmit with a probability of the persistance parameter. */
 		return ((struct aloha_param*)param)->persistence;
 	}
-}
\ No newline at end of file
+}
+
+/* Frames longer than this are not worth a mask table, their protocols
+are emulated one by one. */
+#define TDMA_MASK_MAX_FRAME 1024
+
+static void generic_emulate_family(const struct protocol_family *family,
+	const struct emulated_slot *slots, size_t num_slots, double *decisions)
+{
+	for (size_t i = 0; i < num_slots; i++) {
+		for (int j = 0; j < family->count; j++) {
+			const struct protocol *proto = &family->protocols[family->members[j]];
+			decisions[i * family->count + j] = proto->emulator(proto->parameter,
+				slots[i].slot_num, slots[i].offset, slots[i].previous_slot);
+		}
+	}
+}
+
+/* A slot position in the frame selects a row of precomputed decisions,
+so the members cost a copy instead of a division each. */
+static void tdma_emulate_family(const struct protocol_family *family,
+	const struct emulated_slot *slots, size_t num_slots, double *decisions)
+{
+	for (size_t i = 0; i < num_slots; i++) {
+		int slot_num = slots[i].slot_num + slots[i].offset;
+		double *row = &decisions[i * family->count];
+
+		if (slot_num < family->max_frame_offset) {
+			/* tdma_emulate truncates negative positions towards zero,
+			which the table does not. Rare enough to do it the long way. */
+			generic_emulate_family(family, &slots[i], 1, row);
+			continue;
+		}
+
+		int position = slot_num % family->frame_length;
+		memcpy(row, &family->masks[position * family->count], sizeof(double) * family->count);
+	}
+}
+
+/* Whether a packet is new does not depend on the member, so every member
+either transmits or transmits with its own persistence. */
+static void aloha_emulate_family(const struct protocol_family *family,
+	const struct emulated_slot *slots, size_t num_slots, double *decisions)
+{
+	for (size_t i = 0; i < num_slots; i++) {
+		const struct metamac_slot *previous_slot = &slots[i].previous_slot;
+		double *row = &decisions[i * family->count];
+
+		if (previous_slot->slot_num != slots[i].slot_num ||
+			!previous_slot->packet_queued ||
+			(previous_slot->transmitted && previous_slot->transmit_success)) {
+			for (int j = 0; j < family->count; j++) {
+				row[j] = 1.0;
+			}
+		} else {
+			memcpy(row, family->persistence, sizeof(double) * family->count);
+		}
+	}
+}
+
+static int family_frame_length(const struct protocol *proto)
+{
+	if (proto->emulator != tdma_emulate) {
+		return 0;
+	}
+
+	int frame_length = ((struct tdma_param*)proto->parameter)->frame_length;
+	return frame_length > 0 && frame_length <= TDMA_MASK_MAX_FRAME ? frame_length : 0;
+}
+
+static family_emulator family_emulator_of(const struct protocol *proto)
+{
+	if (proto->emulator == aloha_emulate) {
+		return aloha_emulate_family;
+	} else if (family_frame_length(proto) > 0) {
+		return tdma_emulate_family;
+	} else {
+		return generic_emulate_family;
+	}
+}
+
+/* Groups the protocols of a suite into families and precomputes the
+TDMA masks and ALOHA persistence vectors of each. */
+void init_protocol_families(struct protocol_suite *suite)
+{
+	suite->families = calloc(suite->num_protocols, sizeof(struct protocol_family));
+	if (suite->families == NULL) {
+		err(EXIT_FAILURE, "Unable to allocate memory");
+	}
+	suite->num_families = 0;
+
+	int *family_of = malloc(sizeof(int) * suite->num_protocols);
+	if (family_of == NULL) {
+		err(EXIT_FAILURE, "Unable to allocate memory");
+	}
+
+	for (int p = 0; p < suite->num_protocols; p++) {
+		const struct protocol *proto = &suite->protocols[p];
+		family_emulator emulate = family_emulator_of(proto);
+		int frame_length = family_frame_length(proto);
+		struct protocol_family *family = NULL;
+
+		/* Protocols without a family emulator are on their own. */
+		for (int f = 0; f < suite->num_families && emulate != generic_emulate_family; f++) {
+			if (suite->families[f].emulate == emulate &&
+				suite->families[f].frame_length == frame_length) {
+				family = &suite->families[f];
+				break;
+			}
+		}
+
+		if (family == NULL) {
+			family = &suite->families[suite->num_families++];
+			family->emulate = emulate;
+			family->protocols = suite->protocols;
+			family->frame_length = frame_length;
+		}
+
+		family_of[p] = family - suite->families;
+		family->count++;
+	}
+
+	for (int f = 0; f < suite->num_families; f++) {
+		struct protocol_family *family = &suite->families[f];
+
+		family->members = malloc(sizeof(int) * family->count);
+		if (family->members == NULL) {
+			err(EXIT_FAILURE, "Unable to allocate memory");
+		}
+		family->count = 0;
+	}
+
+	for (int p = 0; p < suite->num_protocols; p++) {
+		struct protocol_family *family = &suite->families[family_of[p]];
+		family->members[family->count++] = p;
+	}
+
+	free(family_of);
+
+	for (int f = 0; f < suite->num_families; f++) {
+		struct protocol_family *family = &suite->families[f];
+
+		if (family->emulate == tdma_emulate_family) {
+			family->masks = calloc(family->frame_length * family->count, sizeof(double));
+			if (family->masks == NULL) {
+				err(EXIT_FAILURE, "Unable to allocate memory");
+			}
+
+			for (int j = 0; j < family->count; j++) {
+				struct tdma_param *params = suite->protocols[family->members[j]].parameter;
+
+				if (params->frame_offset > family->max_frame_offset) {
+					family->max_frame_offset = params->frame_offset;
+				}
+
+				for (int position = 0; position < family->frame_length; position++) {
+					/* Same as tdma_emulate for any slot at this position
+					of the frame and not before frame_offset. */
+					int frame_slot = ((position - params->frame_offset) % family->frame_length +
+						family->frame_length) % family->frame_length;
+					family->masks[position * family->count + j] =
+						frame_slot == params->slot_assignment ? 1.0 : 0.0;
+				}
+			}
+		} else if (family->emulate == aloha_emulate_family) {
+			family->persistence = malloc(sizeof(double) * family->count);
+			if (family->persistence == NULL) {
+				err(EXIT_FAILURE, "Unable to allocate memory");
+			}
+
+			for (int j = 0; j < family->count; j++) {
+				struct aloha_param *params = suite->protocols[family->members[j]].parameter;
+				family->persistence[j] = params->persistence;
+			}
+		}
+	}
+}
+
+void free_protocol_families(struct protocol_suite *suite)
+{
+	for (int f = 0; f < suite->num_families; f++) {
+		free(suite->families[f].members);
+		free(suite->families[f].masks);
+		free(suite->families[f].persistence);
+	}
+
+	free(suite->families);
+	suite->families = NULL;
+	suite->num_families = 0;
+}
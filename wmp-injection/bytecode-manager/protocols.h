@@ -19,4 +19,42 @@ struct aloha_param {
 //void aloha_init(struct aloha_param *param, double persistance);
 double aloha_emulate(void *param, int slot_num, int offset, struct metamac_slot previous_slot);
 
+/* Emulator inputs for one slot, as update_weights passes them. */
+struct emulated_slot {
+	int slot_num;
+	int offset;
+	struct metamac_slot previous_slot;
+};
+
+struct protocol_family;
+
+/* Fills decisions, a num_slots x family->count matrix in row major order,
+with the decision of every member of the family in every slot. */
+typedef void (*family_emulator)(const struct protocol_family *family,
+	const struct emulated_slot *slots, size_t num_slots, double *decisions);
+
+/* Protocols of a suite that are emulated together: ALOHA protocols, TDMA
+protocols with the same frame length, or a single protocol of any other
+kind. */
+struct protocol_family {
+	family_emulator emulate;
+	/* Number of members. */
+	int count;
+	/* Indexes of the members in the protocols of the suite. */
+	int *members;
+	/* Protocols of the suite. */
+	const struct protocol *protocols;
+	/* TDMA frame length, and the largest frame offset of the members. */
+	int frame_length;
+	int max_frame_offset;
+	/* TDMA decisions of the members for each slot of the frame, frame_length
+	rows of count decisions. */
+	double *masks;
+	/* ALOHA persistence of the members. */
+	double *persistence;
+};
+
+void init_protocol_families(struct protocol_suite *suite);
+void free_protocol_families(struct protocol_suite *suite);
+
 #endif // PROTOCOLS_H
\ No newline at end of file
@@ -6,67 +6,27 @@
 #include "queue.h"
 #include "metamac.h"
 
-void queue_init(struct metamac_queue *queue, size_t capacity)
+void queue_init(struct metamac_queue *queue, size_t capacity, queue_overflow_t overflow)
 {
-	if (capacity <= 0) {
-		errx(EXIT_FAILURE, "Invalid capacity value: %ld.\n", capacity);
+	/* Capacity must be a power of two, so that indexes can be masked. */
+	if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+		errx(EXIT_FAILURE, "Invalid capacity value: %zu.\n", capacity);
 	}
 
+	memset(queue, 0, sizeof(struct metamac_queue));
+
 	queue->data = malloc(sizeof(struct metamac_slot) * capacity);
 	if (!queue->data) {
 		err(EXIT_FAILURE, "Unable to allocate memory");
 	}
 
-	pthread_mutex_init(&queue->pop_mutex, NULL);
-	pthread_cond_init(&queue->nonempty_cond, NULL);
-
 	queue->capacity = capacity;
-	queue->in = 0;
-	queue->out = 0;
+	queue->overflow = overflow;
 }
 
 void queue_destroy(struct metamac_queue *queue)
 {
 	free(queue->data);
-	pthread_mutex_destroy(&queue->pop_mutex);
-	pthread_cond_destroy(&queue->nonempty_cond);
-}
-
-static void queue_resize(struct metamac_queue *queue, size_t newcap)
-{
-	if (pthread_mutex_lock(&queue->pop_mutex) != 0) {
-		err(EXIT_FAILURE, "Error locking mutex");
-	}
-
-	struct metamac_slot *newdata = malloc(sizeof(struct metamac_slot) * newcap);
-	if (!newdata) {
-		err(EXIT_FAILURE, "Unable to allocate memory");
-	}
-
-	if (queue->in >= queue->out) {
-		/* Queue is not wrapped. */
-		memcpy(newdata, queue->data + queue->out,
-			(queue->in - queue->out) * sizeof(struct metamac_slot));
-		queue->in -= queue->out;
-		queue->out = 0;
-	} else {
-		/* Queue is wrapped. */
-		memcpy(newdata, queue->data + queue->out,
-			(queue->capacity - queue->out) * sizeof(struct metamac_slot));
-		memcpy(newdata + (queue->capacity - queue->out), queue->data,
-			queue->in * sizeof(struct metamac_slot));
-		queue->in += queue->capacity - queue->out;
-		queue->out = 0;
-	}
-
-	struct metamac_slot *olddata = queue->data;
-	queue->data = newdata;
-	queue->capacity = newcap;
-	free(olddata);
-
-	if (pthread_mutex_unlock(&queue->pop_mutex) != 0) {
-		err(EXIT_FAILURE, "Error unlocking mutex");
-	}
 }
 
 void queue_push(struct metamac_queue *queue, struct metamac_slot *slot)
@@ -74,48 +34,80 @@ void queue_push(struct metamac_queue *queue, struct metamac_slot *slot)
 	queue_multipush(queue, slot, 1);
 }
 
+/* Called by the producer only. Never blocks: when the queue is full the
+slots are dropped according to the overflow policy and counted. */
 void queue_multipush(struct metamac_queue *queue, struct metamac_slot *slots, size_t count)
 {
+	size_t in = queue->in;
+	size_t mask = queue->capacity - 1;
+
 	for (size_t i = 0; i < count; i++) {
-		if (queue->in == (queue->out + queue->capacity - 1) % queue->capacity) {
-			queue_resize(queue, queue->capacity * 2);
+		size_t out = __atomic_load_n(&queue->out, __ATOMIC_ACQUIRE);
+
+		if (in - out == queue->capacity) {
+			if (queue->overflow == QUEUE_DROP_NEWEST) {
+				__atomic_add_fetch(&queue->dropped, count - i, __ATOMIC_RELAXED);
+				break;
+			}
+
+			/* Drop the oldest slot. If this fails the consumer has just
+			freed a place, which is as good. */
+			if (__atomic_compare_exchange_n(&queue->out, &out, out + 1, false,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				__atomic_add_fetch(&queue->dropped, 1, __ATOMIC_RELAXED);
+			}
 		}
 
-		queue->data[queue->in] = slots[i];
-		queue->in = (queue->in + 1) % queue->capacity;
-	}
-
-	if (pthread_cond_broadcast(&queue->nonempty_cond) != 0) {
-		err(EXIT_FAILURE, "Error signaling condition variable");
+		queue->data[in & mask] = slots[i];
+		in++;
+		__atomic_store_n(&queue->in, in, __ATOMIC_RELEASE);
+		queue->pushed++;
 	}
 }
 
+/* Called by the consumer only. Copies up to count queued slots and returns
+immediately, with 0 if the queue is empty. */
 size_t queue_multipop(struct metamac_queue *queue, struct metamac_slot *slots, size_t count)
 {
-	if (pthread_mutex_lock(&queue->pop_mutex) != 0) {
-		err(EXIT_FAILURE, "Error locking mutex");
-	}
+	size_t mask = queue->capacity - 1;
+
+	for (;;) {
+		size_t out = __atomic_load_n(&queue->out, __ATOMIC_ACQUIRE);
+		size_t in = __atomic_load_n(&queue->in, __ATOMIC_ACQUIRE);
+		size_t n = in - out;
+		if (n > count) {
+			n = count;
+		}
+		if (n == 0) {
+			return 0;
+		}
 
-	if (queue->out == queue->in) {
-		pthread_cond_wait(&queue->nonempty_cond, &queue->pop_mutex);
-	}
+		for (size_t i = 0; i < n; i++) {
+			slots[i] = queue->data[(out + i) & mask];
+		}
 
-	size_t i = 0;
-	while (i < count && queue->out != queue->in) {
-		slots[i++] = queue->data[queue->out];
-		queue->out = (queue->out + 1) % queue->capacity;
+		/* A drop-oldest producer may have advanced out, and then
+		overwritten what was just copied. Only commit if it did not. */
+		if (__atomic_compare_exchange_n(&queue->out, &out, out + n, false,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			queue->popped += n;
+			return n;
+		}
 	}
+}
 
-	if (pthread_mutex_unlock(&queue->pop_mutex) != 0) {
-		err(EXIT_FAILURE, "Error unlocking mutex");
-	}
+/* Tells the consumer that the producer has stopped. */
+void queue_signal(struct metamac_queue *queue)
+{
+	__atomic_store_n(&queue->closed, 1, __ATOMIC_RELEASE);
+}
 
-	return i;
+int queue_closed(struct metamac_queue *queue)
+{
+	return __atomic_load_n(&queue->closed, __ATOMIC_ACQUIRE);
 }
 
-void queue_signal(struct metamac_queue *queue)
+unsigned long queue_dropped(struct metamac_queue *queue)
 {
-	if (pthread_cond_broadcast(&queue->nonempty_cond) != 0) {
-		err(EXIT_FAILURE, "Error signaling condition variable");
-	}
-}
\ No newline at end of file
+	return __atomic_load_n(&queue->dropped, __ATOMIC_RELAXED);
+}
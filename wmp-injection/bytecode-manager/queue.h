@@ -1,25 +1,51 @@
 #ifndef QUEUE_H
 #define QUEUE_H
 
-#include <pthread.h>
+#include <stddef.h>
 
+#define QUEUE_CACHE_LINE 64
+
+typedef enum {
+	/* A push into a full queue discards the slots being pushed. */
+	QUEUE_DROP_NEWEST = 0,
+	/* A push into a full queue discards the oldest queued slots. */
+	QUEUE_DROP_OLDEST = 1
+} queue_overflow_t;
+
+/* Bounded single producer, single consumer ring of slots.
+ *
+ * in and out are free running counters, each written by one side only
+ * (except that a drop-oldest producer advances out with a compare and
+ * swap), and kept on separate cache lines together with the fields only
+ * their owner touches, so that the reader and process threads never
+ * share a line they write to. Neither side ever blocks or allocates. */
 struct metamac_queue {
-	pthread_mutex_t pop_mutex;
-	pthread_cond_t nonempty_cond;
-	struct metamac_slot *data;
+	/* Producer side. */
+	size_t in __attribute__((aligned(QUEUE_CACHE_LINE)));
+	unsigned long pushed;
+	unsigned long dropped;
+
+	/* Consumer side. */
+	size_t out __attribute__((aligned(QUEUE_CACHE_LINE)));
+	unsigned long popped;
+
+	/* Set once at initialization. */
+	struct metamac_slot *data __attribute__((aligned(QUEUE_CACHE_LINE)));
 	size_t capacity;
-	size_t in;
-	size_t out;
+	queue_overflow_t overflow;
+	int closed;
 };
 
 #include "metamac.h"
 
-void queue_init(struct metamac_queue *queue, size_t capacity);
+void queue_init(struct metamac_queue *queue, size_t capacity, queue_overflow_t overflow);
 void queue_destroy(struct metamac_queue *queue);
 
 void queue_push(struct metamac_queue *queue, struct metamac_slot *slot);
 void queue_multipush(struct metamac_queue *queue, struct metamac_slot *slots, size_t count);
 size_t queue_multipop(struct metamac_queue *queue, struct metamac_slot *slots, size_t count);
 void queue_signal(struct metamac_queue *queue);
+int queue_closed(struct metamac_queue *queue);
+unsigned long queue_dropped(struct metamac_queue *queue);
 
-#endif
\ No newline at end of file
+#endif
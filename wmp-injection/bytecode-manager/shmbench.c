@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include <argp.h>
+#include <time.h>
+
+#include "libb43.h"
+
+/* ******************
+ * SHM access micro-benchmark
+ *
+ * Reads the same shared memory range and the general purpose registers
+ * through the single word path (shmRead16) and through the batched
+ * path (shmReadRange16) and reports the cost per word of each.
+ * usage: ./shmbench -w 2048 -n 20
+ * ***************** */
+
+const char *argp_program_version = "SHM Access Benchmark 0.0.1";
+static const char doc[] = "Measures per-word cost of single and batched SHM reads.";
+static const char args_doc[] = "";
+
+static const struct argp_option options[] = {
+	{ "words",      'w', "WORDS",  0, "Number of 16 bit shared memory words to read (default 2048)." },
+	{ "offset",     'o', "OFFSET", 0, "Shared memory byte offset to start from (default 0)." },
+	{ "iterations", 'n', "COUNT",  0, "Number of repetitions of each measure (default 20)." },
+	{ 0 }
+};
+
+struct arguments {
+	unsigned int words;
+	unsigned int offset;
+	unsigned int iterations;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+	struct arguments *arguments = state->input;
+
+	switch (key) {
+	case 'w':
+		if (sscanf(arg, "%u", &arguments->words) < 1 || arguments->words == 0) {
+			argp_error(state, "Invalid value for argument 'words'.");
+		}
+		break;
+
+	case 'o':
+		if (sscanf(arg, "%i", &arguments->offset) < 1 || (arguments->offset & 1)) {
+			argp_error(state, "Invalid value for argument 'offset'.");
+		}
+		break;
+
+	case 'n':
+		if (sscanf(arg, "%u", &arguments->iterations) < 1 || arguments->iterations == 0) {
+			argp_error(state, "Invalid value for argument 'iterations'.");
+		}
+		break;
+
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+static const struct argp argp = { options, parse_opt, args_doc, doc };
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void report(const char *name, unsigned int words, unsigned int iterations, uint64_t elapsed)
+{
+	double per_word = (double)elapsed / ((double)words * iterations) / 1000.0;
+	printf("%-16s %8u %10.1f %10.3f\n", name, words,
+		(double)elapsed / iterations / 1000.0, per_word);
+}
+
+int main(int argc, char *argv[])
+{
+	struct arguments arguments = { .words = 2048, .offset = 0, .iterations = 20 };
+	argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+	struct debugfs_file df;
+	init_file(&df);
+
+	uint16_t *single = malloc(sizeof(uint16_t) * arguments.words);
+	uint16_t *batched = malloc(sizeof(uint16_t) * arguments.words);
+	if (!single || !batched) {
+		err(EXIT_FAILURE, "Unable to allocate memory");
+	}
+
+	printf("backend: %s\n", df.backend->name);
+	printf("%-16s %8s %10s %10s\n", "path", "words", "us/call", "us/word");
+
+	uint64_t start = now_ns();
+	for (unsigned int n = 0; n < arguments.iterations; n++) {
+		for (unsigned int i = 0; i < arguments.words; i++) {
+			single[i] = shmRead16(&df, B43_SHM_SHARED, arguments.offset + i * 2);
+		}
+	}
+	report("shm single", arguments.words, arguments.iterations, now_ns() - start);
+
+	start = now_ns();
+	for (unsigned int n = 0; n < arguments.iterations; n++) {
+		if (shmReadRange16(&df, B43_SHM_SHARED, arguments.offset, batched, arguments.words) < 0) {
+			err(EXIT_FAILURE, "Batched read failed");
+		}
+	}
+	report("shm batched", arguments.words, arguments.iterations, now_ns() - start);
+
+	uint16_t gprs[64];
+	start = now_ns();
+	for (unsigned int n = 0; n < arguments.iterations; n++) {
+		for (int i = 0; i < 64; i++) {
+			gprs[i] = shmRead16(&df, B43_SHM_REGS, i);
+		}
+	}
+	report("gpr single", 64, arguments.iterations, now_ns() - start);
+
+	start = now_ns();
+	for (unsigned int n = 0; n < arguments.iterations; n++) {
+		if (shmReadRange16(&df, B43_SHM_REGS, 0, gprs, 64) < 0) {
+			err(EXIT_FAILURE, "Batched read failed");
+		}
+	}
+	report("gpr batched", 64, arguments.iterations, now_ns() - start);
+
+	/* The firmware keeps running, so only a static region is expected to match. */
+	unsigned int mismatches = 0;
+	for (unsigned int i = 0; i < arguments.words; i++) {
+		if (single[i] != batched[i]) {
+			mismatches++;
+		}
+	}
+	printf("words differing between paths: %u\n", mismatches);
+
+	free(single);
+	free(batched);
+	close_file(&df);
+
+	return 0;
+}
@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include <argp.h>
+#include <math.h>
+#include <time.h>
+
+#include "xfsm.h"
+
+/* ******************
+ * Offline XFSM simulator
+ *
+ * Runs a bytecode from mac-programs/ on the host against a scripted
+ * event trace or a random one, and reports the interpreter speed, the
+ * dwell time histogram of every state and the number of actions.
+ * usage: ./xfsm-sim -n 1000000 ../../mac-programs/dcf/dcf_v3-2.txt
+ *        ./xfsm-sim -e trace.txt -c equal_in_RX_QUEUE(FRAME)=0.9 dcf_v3-2.txt
+ * A trace has one "TIME EVENT" line per event, TIME in us and EVENT
+ * a name from events.csv or a code.
+ * ***************** */
+
+const char *argp_program_version = "WMP XFSM Simulator 0.0.1";
+static const char doc[] = "Runs a bytecode on the host against an event trace.";
+static const char args_doc[] = "BYTECODE";
+
+static const struct argp_option options[] = {
+	{ "tables",    't', "DIR",        0, "Directory of events.csv, conditions.csv and actions.csv (default ../../wmp-editor)." },
+	{ "trace",     'e', "FILE",       0, "Scripted event trace instead of a random one." },
+	{ "events",    'n', "COUNT",      0, "Number of random events (default 100000)." },
+	{ "interval",  'm', "US",         0, "Mean time between random events in us (default 100)." },
+	{ "seed",      's', "SEED",       0, "Seed of the random generator (default 1)." },
+	{ "condition", 'c', "NAME=PROB",  0, "Probability that a condition holds (default 0.5). Repeatable." },
+	{ "verbose",   'v', 0,            0, "Print every event and the resulting state." },
+	{ 0 }
+};
+
+#define MAX_CONDITION_ARGS 32
+
+struct arguments {
+	char *bytecode;
+	char *tables;
+	char *trace;
+	unsigned long events;
+	double interval;
+	unsigned long long seed;
+	char *conditions[MAX_CONDITION_ARGS];
+	int num_conditions;
+	int verbose;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+	struct arguments *arguments = state->input;
+
+	switch (key) {
+	case 't':
+		arguments->tables = arg;
+		break;
+
+	case 'e':
+		arguments->trace = arg;
+		break;
+
+	case 'n':
+		if (sscanf(arg, "%lu", &arguments->events) < 1 || arguments->events == 0) {
+			argp_error(state, "Invalid value for argument 'events'.");
+		}
+		break;
+
+	case 'm':
+		if (sscanf(arg, "%lf", &arguments->interval) < 1 || arguments->interval <= 0.0) {
+			argp_error(state, "Invalid value for argument 'interval'.");
+		}
+		break;
+
+	case 's':
+		if (sscanf(arg, "%llu", &arguments->seed) < 1) {
+			argp_error(state, "Invalid value for argument 'seed'.");
+		}
+		break;
+
+	case 'c':
+		if (arguments->num_conditions >= MAX_CONDITION_ARGS || strchr(arg, '=') == NULL) {
+			argp_error(state, "Invalid value for argument 'condition'.");
+		}
+		arguments->conditions[arguments->num_conditions++] = arg;
+		break;
+
+	case 'v':
+		arguments->verbose = 1;
+		break;
+
+	case ARGP_KEY_ARG:
+		if (state->arg_num >= 1) {
+			argp_usage(state);
+		}
+		arguments->bytecode = arg;
+		break;
+
+	case ARGP_KEY_END:
+		if (state->arg_num < 1) {
+			argp_usage(state);
+		}
+		break;
+
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+static const struct argp argp = { options, parse_opt, args_doc, doc };
+
+struct trace_event {
+	uint64_t time;
+	int event;
+};
+
+static int parse_code(char *const *names, const char *s)
+{
+	char *end;
+	long code = strtol(s, &end, 0);
+	if (end != s && *end == '\0') {
+		return (code >= 0 && code < XFSM_CODES) ? (int)code : -1;
+	}
+	return xfsm_lookup(names, s);
+}
+
+static struct trace_event *read_trace(const char *path, const struct xfsm_tables *tables, size_t *count)
+{
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		err(EXIT_FAILURE, "%s", path);
+	}
+
+	size_t capacity = 1024;
+	struct trace_event *trace = malloc(capacity * sizeof(struct trace_event));
+	if (trace == NULL) {
+		err(EXIT_FAILURE, "Unable to allocate memory");
+	}
+
+	char line[256];
+	int lineno = 0;
+	*count = 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		lineno++;
+		line[strcspn(line, "#\r\n")] = '\0';
+
+		unsigned long long time;
+		char name[128];
+		int fields = sscanf(line, "%llu %127s", &time, name);
+		if (fields <= 0) {
+			continue;
+		}
+		int event = (fields == 2) ? parse_code(tables->events, name) : -1;
+		if (event < 0) {
+			errx(EXIT_FAILURE, "%s:%d: invalid event", path, lineno);
+		}
+
+		if (*count == capacity) {
+			capacity *= 2;
+			trace = realloc(trace, capacity * sizeof(struct trace_event));
+			if (trace == NULL) {
+				err(EXIT_FAILURE, "Unable to allocate memory");
+			}
+		}
+		trace[*count].time = time;
+		trace[*count].event = event;
+		(*count)++;
+	}
+
+	fclose(f);
+	return trace;
+}
+
+/* Random events among those the bytecode waits for, with exponentially
+distributed gaps, drawn before the run so that only the interpreter
+is timed. */
+static struct trace_event *random_trace(const struct xfsm *fsm, struct xfsm_run *rng,
+	unsigned long count, double interval)
+{
+	int events[XFSM_CODES];
+	int num_events = 0;
+	uint8_t seen[XFSM_CODES] = { 0 };
+
+	for (int s = 0; s < fsm->num_states; s++) {
+		const struct xfsm_state *st = &fsm->states[s];
+		for (int k = 0; k < st->ntrans && !st->virtual_condition; k++) {
+			int code = st->trans[k].code;
+			if (code != XFSM_NO_EVENT && !seen[code]) {
+				seen[code] = 1;
+				events[num_events++] = code;
+			}
+		}
+	}
+	if (num_events == 0) {
+		errx(EXIT_FAILURE, "The bytecode does not wait for any event");
+	}
+
+	struct trace_event *trace = malloc(count * sizeof(struct trace_event));
+	if (trace == NULL) {
+		err(EXIT_FAILURE, "Unable to allocate memory");
+	}
+
+	double time = 0.0;
+	for (unsigned long i = 0; i < count; i++) {
+		time += -interval * log(1.0 - xfsm_random(rng));
+		trace[i].time = (uint64_t)time;
+		trace[i].event = events[(int)(xfsm_random(rng) * num_events)];
+	}
+
+	return trace;
+}
+
+static const char *name_or_code(char *const *names, int code, char *buf, size_t len)
+{
+	if (names[code] != NULL) {
+		return names[code];
+	}
+	snprintf(buf, len, "0x%02X", code);
+	return buf;
+}
+
+static void report(const struct xfsm *fsm, const struct xfsm_run *run,
+	const struct xfsm_tables *tables, uint64_t elapsed_ns, uint64_t sim_time)
+{
+	char buf[16];
+
+	printf("events %lu (ignored %lu), transitions %lu, simulated %.3f s\n",
+		run->events, run->ignored, run->transitions, sim_time / 1e6);
+	printf("interpreter: %.0f transitions/s, %.1f ns/event\n",
+		run->transitions * 1e9 / (elapsed_ns ? elapsed_ns : 1),
+		(double)elapsed_ns / (run->events ? run->events : 1));
+
+	printf("\nstate  visits     dwell histogram (us: count)\n");
+	for (int s = 0; s < fsm->num_states; s++) {
+		printf("0x%02X %8lu   ", s, run->visits[s]);
+		for (int b = 0; b < XFSM_DWELL_BUCKETS; b++) {
+			if (run->dwell[s][b] == 0) {
+				continue;
+			}
+			if (b == 0) {
+				printf(" 0:%lu", run->dwell[s][b]);
+			} else {
+				printf(" %llu-:%lu", 1ULL << (b - 1), run->dwell[s][b]);
+			}
+		}
+		printf("\n");
+	}
+
+	printf("\naction                  count\n");
+	for (int a = 0; a < XFSM_CODES; a++) {
+		if (run->actions[a] > 0) {
+			printf("%-20s %8lu\n", name_or_code(tables->actions, a, buf, sizeof(buf)), run->actions[a]);
+		}
+	}
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+	struct arguments arguments = {
+		.tables = "../../wmp-editor",
+		.events = 100000,
+		.interval = 100.0,
+		.seed = 1,
+	};
+	argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+	struct xfsm_tables tables;
+	if (xfsm_tables_load(&tables, arguments.tables) < 0) {
+		errx(EXIT_FAILURE, "Unable to read the opcode tables");
+	}
+
+	struct bytecode_image img;
+	if (bytecode_image_open(arguments.bytecode, &img) < 0) {
+		errx(EXIT_FAILURE, "Unable to load %s", arguments.bytecode);
+	}
+
+	static struct xfsm fsm;
+	if (xfsm_decode(&fsm, &img) < 0) {
+		errx(EXIT_FAILURE, "Invalid state machine in %s", arguments.bytecode);
+	}
+
+	static struct xfsm_run run;
+	xfsm_run_init(&run, &fsm, arguments.seed);
+
+	for (int i = 0; i < arguments.num_conditions; i++) {
+		char *eq = strrchr(arguments.conditions[i], '=');
+		*eq = '\0';
+		int code = parse_code(tables.conditions, arguments.conditions[i]);
+		double prob;
+		if (code < 0 || sscanf(eq + 1, "%lf", &prob) < 1 || prob < 0.0 || prob > 1.0) {
+			errx(EXIT_FAILURE, "Invalid condition probability: %s=%s", arguments.conditions[i], eq + 1);
+		}
+		run.condition_prob[code] = prob;
+	}
+
+	size_t count;
+	struct trace_event *trace;
+	if (arguments.trace != NULL) {
+		trace = read_trace(arguments.trace, &tables, &count);
+	} else {
+		/* A generator of its own, so the trace does not depend on the conditions drawn. */
+		struct xfsm_run rng = { .rng = arguments.seed ^ 0x9E3779B97F4A7C15ULL };
+		count = arguments.events;
+		trace = random_trace(&fsm, &rng, count, arguments.interval);
+	}
+
+	printf("%s: %d states, start 0x%02X\n", arguments.bytecode, fsm.num_states, fsm.start_state);
+
+	char buf[16];
+	uint64_t start = now_ns();
+	for (size_t i = 0; i < count; i++) {
+		if (xfsm_run_event(&run, trace[i].time, trace[i].event) < 0) {
+			errx(EXIT_FAILURE, "State 0x%02X loops without waiting for an event", run.state);
+		}
+		if (arguments.verbose) {
+			printf("%llu %s -> 0x%02X\n", (unsigned long long)trace[i].time,
+				name_or_code(tables.events, trace[i].event, buf, sizeof(buf)), run.state);
+		}
+	}
+	uint64_t elapsed = now_ns() - start;
+
+	report(&fsm, &run, &tables, elapsed, count > 0 ? trace[count - 1].time : 0);
+
+	free(trace);
+	xfsm_tables_free(&tables);
+
+	return 0;
+}
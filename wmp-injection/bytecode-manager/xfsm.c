@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#include "xfsm.h"
+
+static int load_table(char **names, const char *dir, const char *file)
+{
+	char path[512];
+	char line[1024];
+
+	snprintf(path, sizeof(path), "%s/%s", dir, file);
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		warn("%s", path);
+		return -1;
+	}
+
+	/* "code,NAME[,operand tables]" per line, only the first two fields are used. */
+	while (fgets(line, sizeof(line), f) != NULL) {
+		char *end;
+		long code = strtol(line, &end, 0);
+		if (end == line || *end != ',' || code < 0 || code >= XFSM_CODES) {
+			continue;
+		}
+
+		char *name = end + 1;
+		name[strcspn(name, ",\r\n")] = '\0';
+		if (*name == '\0') {
+			continue;
+		}
+
+		free(names[code]);
+		names[code] = strdup(name);
+		if (names[code] == NULL) {
+			err(EXIT_FAILURE, "Unable to allocate memory");
+		}
+	}
+
+	fclose(f);
+	return 0;
+}
+
+/* Reads events.csv, conditions.csv and actions.csv from dir. */
+int xfsm_tables_load(struct xfsm_tables *tables, const char *dir)
+{
+	memset(tables, 0, sizeof(*tables));
+
+	if (load_table(tables->events, dir, "events.csv") < 0 ||
+		load_table(tables->conditions, dir, "conditions.csv") < 0 ||
+		load_table(tables->actions, dir, "actions.csv") < 0) {
+		xfsm_tables_free(tables);
+		return -1;
+	}
+
+	return 0;
+}
+
+void xfsm_tables_free(struct xfsm_tables *tables)
+{
+	for (int i = 0; i < XFSM_CODES; i++) {
+		free(tables->events[i]);
+		free(tables->conditions[i]);
+		free(tables->actions[i]);
+	}
+	memset(tables, 0, sizeof(*tables));
+}
+
+/* Code of a name, or -1 if it is not in the table. */
+int xfsm_lookup(char *const *names, const char *name)
+{
+	for (int i = 0; i < XFSM_CODES; i++) {
+		if (names[i] != NULL && strcmp(names[i], name) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* Builds the state machine from a compiled image, before the condition
+references are relocated, so transition codes are the opcodes of the
+tables rather than firmware procedure addresses. */
+int xfsm_decode(struct xfsm *fsm, const struct bytecode_image *img)
+{
+	memset(fsm, 0, sizeof(*fsm));
+
+	if (img->state_count == 0) {
+		warnx("bytecode has no states");
+		return -1;
+	}
+
+	for (int i = 0; i + 2 < img->transition_count; i += 3) {
+		struct xfsm_transition *t = &fsm->transitions[i / 3];
+		t->code = img->transitions[i];
+		t->operand[0] = img->transitions[i + 1] & 0xFF;
+		t->operand[1] = img->transitions[i + 1] >> 8;
+		t->next = img->transitions[i + 2] & 0xFF;
+		t->action = img->transitions[i + 2] >> 8;
+	}
+
+	fsm->num_states = img->state_count;
+	fsm->start_state = (img->param_mask & 1) ? img->params[0] : 0;
+	if (fsm->start_state >= fsm->num_states) {
+		warnx("start state 0x%02X out of range", fsm->start_state);
+		return -1;
+	}
+
+	for (int s = 0; s < fsm->num_states; s++) {
+		int pos = img->states[s] & 0xFF;
+		int flags = img->states[s] >> 8;
+		struct xfsm_state *st = &fsm->states[s];
+
+		st->ntrans = (flags & 0x0F) / 2 + 1;
+		st->virtual_condition = (flags & 0xF0) == 0xF0;
+		if (pos % 3 != 0 || pos + st->ntrans * 3 > img->transition_count) {
+			warnx("state 0x%02X: transitions out of range", s);
+			return -1;
+		}
+		st->trans = &fsm->transitions[pos / 3];
+
+		for (int k = 0; k < st->ntrans; k++) {
+			if (st->trans[k].next >= fsm->num_states) {
+				warnx("state 0x%02X: next state 0x%02X out of range", s, st->trans[k].next);
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* xorshift64*, so that a seed gives the same run on every host. */
+double xfsm_random(struct xfsm_run *run)
+{
+	run->rng ^= run->rng >> 12;
+	run->rng ^= run->rng << 25;
+	run->rng ^= run->rng >> 27;
+	return (double)((run->rng * 0x2545F4914F6CDD1DULL) >> 11) / (double)(1ULL << 53);
+}
+
+static void take(struct xfsm_run *run, const struct xfsm_transition *t, uint64_t time)
+{
+	uint64_t dwell = time - run->entered;
+	int bucket = 0;
+	while (dwell > 0 && bucket < XFSM_DWELL_BUCKETS - 1) {
+		dwell >>= 1;
+		bucket++;
+	}
+
+	run->dwell[run->state][bucket]++;
+	run->transitions++;
+	run->actions[t->action]++;
+	run->state = t->next;
+	run->visits[t->next]++;
+	run->entered = time;
+}
+
+/* Follows the transitions that need no event: virtual condition states
+and NO_EVENT transitions. Returns the number taken, -1 on a loop. */
+static int settle(struct xfsm_run *run, uint64_t time)
+{
+	int taken = 0;
+
+	for (;;) {
+		const struct xfsm_state *st = &run->fsm->states[run->state];
+		const struct xfsm_transition *t = NULL;
+
+		if (st->virtual_condition) {
+			t = &st->trans[0];
+			if (st->ntrans > 1 && xfsm_random(run) >= run->condition_prob[t->code]) {
+				t = &st->trans[1];
+			}
+		} else {
+			for (int k = 0; k < st->ntrans; k++) {
+				if (st->trans[k].code == XFSM_NO_EVENT) {
+					t = &st->trans[k];
+					break;
+				}
+			}
+		}
+
+		if (t == NULL) {
+			return taken;
+		}
+		if (++taken > XFSM_MAX_CHAIN) {
+			return -1;
+		}
+		take(run, t, time);
+	}
+}
+
+void xfsm_run_init(struct xfsm_run *run, const struct xfsm *fsm, uint64_t seed)
+{
+	memset(run, 0, sizeof(*run));
+	run->fsm = fsm;
+	run->state = fsm->start_state;
+	run->visits[run->state]++;
+	run->rng = seed ? seed : 1;
+
+	for (int i = 0; i < XFSM_CODES; i++) {
+		run->condition_prob[i] = 0.5;
+	}
+}
+
+/* Delivers an event at time (us). Returns the number of transitions taken,
+0 if the current state does not wait for this event, -1 if the machine
+loops without waiting for any event. */
+int xfsm_run_event(struct xfsm_run *run, uint64_t time, int event)
+{
+	/* The start state may itself need no event. */
+	if (run->events == 0 && settle(run, run->entered) < 0) {
+		return -1;
+	}
+
+	run->events++;
+
+	const struct xfsm_state *st = &run->fsm->states[run->state];
+	for (int k = 0; k < st->ntrans; k++) {
+		if (st->trans[k].code == event && !st->virtual_condition) {
+			take(run, &st->trans[k], time);
+
+			int taken = settle(run, time);
+			return taken < 0 ? -1 : taken + 1;
+		}
+	}
+
+	run->ignored++;
+	return 0;
+}
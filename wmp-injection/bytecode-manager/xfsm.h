@@ -0,0 +1,89 @@
+#ifndef XFSM_H
+#define XFSM_H
+
+#include <stdint.h>
+
+#include "bytecode-image.h"
+
+/* Host side XFSM interpreter.
+ *
+ * Runs a bytecode the way the firmware walks a slot, from the same
+ * compiled image that is loaded on the card:
+ *
+ * - a state word holds the position of its first transition in the low
+ *   byte, (ntrans - 1) * 2 in the low nibble of the high byte and 0xF in
+ *   the high nibble for a virtual condition state;
+ * - a transition is three halfwords: the event (or condition) code, two
+ *   operand bytes and the next state in the low byte with the action code
+ *   in the high byte.
+ *
+ * A transition with code NO_EVENT fires as soon as its state is entered.
+ * A virtual condition state takes its first transition if the condition
+ * holds and its second one otherwise; as the card registers are not
+ * modelled, conditions hold with a configurable probability. */
+
+#define XFSM_CODES		256
+#define XFSM_MAX_STATES		IMAGE_STATE_LENGTH
+#define XFSM_MAX_TRANSITIONS	(IMAGE_TRANSITION_LENGTH / 3)
+#define XFSM_DWELL_BUCKETS	24
+/* Transitions allowed without an event before a loop is reported. */
+#define XFSM_MAX_CHAIN		256
+
+#define XFSM_NO_EVENT		0x00
+
+/* Names of the event, condition and action codes, read from the
+wmp-editor opcode tables. Unknown codes have a NULL name. */
+struct xfsm_tables {
+	char *events[XFSM_CODES];
+	char *conditions[XFSM_CODES];
+	char *actions[XFSM_CODES];
+};
+
+struct xfsm_transition {
+	uint8_t code;
+	uint8_t operand[2];
+	uint8_t action;
+	uint8_t next;
+};
+
+struct xfsm_state {
+	int ntrans;
+	int virtual_condition;
+	struct xfsm_transition *trans;
+};
+
+struct xfsm {
+	int num_states;
+	int start_state;
+	struct xfsm_state states[XFSM_MAX_STATES];
+	struct xfsm_transition transitions[XFSM_MAX_TRANSITIONS];
+};
+
+struct xfsm_run {
+	const struct xfsm *fsm;
+	int state;
+	uint64_t entered;
+	uint64_t rng;
+	/* Probability for each condition code to hold, 0.5 by default. */
+	double condition_prob[XFSM_CODES];
+
+	unsigned long events;
+	unsigned long ignored;
+	unsigned long transitions;
+	unsigned long actions[XFSM_CODES];
+	unsigned long visits[XFSM_MAX_STATES];
+	/* Dwell time per state, bucket 0 for 0 us and bucket k for [2^(k-1), 2^k) us. */
+	unsigned long dwell[XFSM_MAX_STATES][XFSM_DWELL_BUCKETS];
+};
+
+int xfsm_tables_load(struct xfsm_tables *tables, const char *dir);
+void xfsm_tables_free(struct xfsm_tables *tables);
+int xfsm_lookup(char *const *names, const char *name);
+
+int xfsm_decode(struct xfsm *fsm, const struct bytecode_image *img);
+
+void xfsm_run_init(struct xfsm_run *run, const struct xfsm *fsm, uint64_t seed);
+int xfsm_run_event(struct xfsm_run *run, uint64_t time, int event);
+double xfsm_random(struct xfsm_run *run);
+
+#endif // XFSM_H
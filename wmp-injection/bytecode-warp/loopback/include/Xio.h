@@ -0,0 +1,5 @@
+/*
+ * wlan_exp_node.c includes <Xio.h>, the case the SDK finds it under on
+ * Windows; the BSP file is xio.h.
+ */
+#include "xio.h"
@@ -0,0 +1,29 @@
+/*
+ * Included ahead of the node sources (gcc -include). The BSP xil_types.h
+ * makes u32 an unsigned long, 64 bits on the host, which would widen every
+ * word of the WARPNet packets. u8/u16/u32 are defined here instead; with
+ * xil_types.h marked as read, xbasic_types.h skips its own, and xil_types.h
+ * then skips its own because xbasic_types.h has been read.
+ *
+ * xil_io.h byte swaps Xil_Htonl and friends on __LITTLE_ENDIAN__, which
+ * the MicroBlaze compiler defines for the board and the host one does not.
+ */
+#ifndef HOST_TYPES_H_
+#define HOST_TYPES_H_
+
+#include <stdint.h>
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ && !defined(__LITTLE_ENDIAN__)
+#define __LITTLE_ENDIAN__
+#endif
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+
+#define XIL_TYPES_H
+#include "xbasic_types.h"
+#undef XIL_TYPES_H
+#include "xil_types.h"
+
+#endif /* HOST_TYPES_H_ */
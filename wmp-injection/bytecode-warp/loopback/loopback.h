@@ -0,0 +1,38 @@
+/*
+ * Interface between the two halves of wmp4warplog-loopback: node.c, built
+ * with the firmware headers, and wmp4warplog_loopback.c, built with the
+ * host ones. Packets cross it as UDP payloads, in network byte order.
+ */
+#ifndef LOOPBACK_H_
+#define LOOPBACK_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* simulated time, in usec, seen by both the node and the receiver */
+extern uint64_t loopback_usec;
+extern int loopback_verbose;
+
+struct loopback_node_stats {
+        int active;
+        uint32_t num_pkts;
+        uint32_t num_acked;
+        uint32_t num_tx;
+        uint32_t num_resent;
+};
+
+/*
+ * node.c: sets up the event log for a run and returns its size; *expect
+ * is pointed to the bytes a stream of the whole log must deliver
+ */
+size_t loopback_node_reset(int wrapped, size_t log_size, const uint8_t **expect);
+/* a packet from the host, as the transport receives it */
+void loopback_node_receive(const uint8_t *pkt, size_t len);
+/* one pass of the main loop */
+void loopback_node_poll(void);
+void loopback_node_get_stats(struct loopback_node_stats *stats);
+
+/* wmp4warplog_loopback.c: a packet from the node */
+void loopback_to_host(const uint8_t *pkt, size_t len);
+
+#endif /* LOOPBACK_H_ */
@@ -0,0 +1,283 @@
+/* ******************
+ * Node side of wmp4warplog-loopback
+ *
+ * wlan_exp_node.c is built whole, as for the board, so that commands reach
+ * the event log stream through node_rxFromTransport and node_processCmd
+ * and its packets leave through node_sendEarlyResp. Below it, the
+ * transport hands packets to and from wmp4warplog_loopback.c and the event
+ * log is a buffer of known bytes. The byte swaps are those of the BSP
+ * (xil_io.c); the rest of CPU_HIGH is stubbed.
+ * ***************** */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../../../wmp-engine/warp/Mango_802.11_RefDes_v1.2.0_wmp/SDK_Workspace/wmp_shared/wlan_mac_high_framework/wlan_exp_node.c"
+
+#include "wlan_mac_queue.h"
+#include "wlan_mac_util.h"
+
+#include "loopback.h"
+
+#define LOOPBACK_LOG_MAX                (1024 * 1024)
+#define LOOPBACK_BUF_L                  2048
+
+uint64_t loopback_usec;
+int loopback_verbose;
+
+function_ptr_t check_queue_callback;
+
+/* The event log: one range, or two when the log has wrapped */
+static u8 log_mem[LOOPBACK_LOG_MAX];
+static u8 log_expect[LOOPBACK_LOG_MAX];
+static u32 log_num_ranges;
+static u32 log_index[2];
+static u32 log_size[2];
+
+/* Transport buffers, laid out as the Ethernet frames: the UDP payload starts PAYLOAD_OFFSET - PAYLOAD_PAD_NBYTES in */
+static u32 rx_buf[LOOPBACK_BUF_L / 4];
+static u32 tx_buf[LOOPBACK_BUF_L / 4];
+static u32 async_buf[LOOPBACK_BUF_L / 4];
+
+size_t loopback_node_reset(int wrapped, size_t log_size_total, const uint8_t **expect)
+{
+        u32 i;
+
+        if (log_size_total > LOOPBACK_LOG_MAX)
+                log_size_total = LOOPBACK_LOG_MAX;
+
+        for (i = 0; i < LOOPBACK_LOG_MAX; i++)
+                log_mem[i] = (i * 2654435761u) >> 13;
+
+        if (log_size_total == 0) {
+                log_num_ranges = 0;
+        } else if (wrapped) {
+                /* the oldest events are at the end of the buffer, the newest at its start */
+                log_num_ranges = 2;
+                log_index[0] = LOOPBACK_LOG_MAX - log_size_total / 3 - 1;
+                log_size[0] = LOOPBACK_LOG_MAX - log_index[0];
+                log_index[1] = 0;
+                log_size[1] = log_size_total - log_size[0];
+        } else {
+                log_num_ranges = 1;
+                log_index[0] = 0;
+                log_size[0] = log_size_total;
+        }
+
+        for (i = 0; i < log_num_ranges; i++)
+                memcpy(log_expect + (i ? log_size[0] : 0), log_mem + log_index[i], log_size[i]);
+
+        node_log_stream_stop();
+
+        *expect = log_expect;
+        return log_size_total;
+}
+
+void loopback_node_receive(const uint8_t *pkt, size_t len)
+{
+        u8 *rx = (u8 *)rx_buf + PAYLOAD_OFFSET - PAYLOAD_PAD_NBYTES;
+        wn_transport_header *hdr = (wn_transport_header *)(rx + PAYLOAD_PAD_NBYTES);
+        wn_host_message toNode, fromNode;
+        pktSrcInfo src;
+
+        if (len > LOOPBACK_BUF_L - PAYLOAD_OFFSET || len < PAYLOAD_PAD_NBYTES + sizeof(wn_transport_header) + sizeof(wn_cmdHdr))
+                return;
+
+        memcpy(rx, pkt, len);
+        memset(&src, 0, sizeof(src));
+
+        /* as transport_receiveCallback */
+        toNode.buffer = hdr;
+        toNode.payload = (u8 *)hdr + sizeof(wn_transport_header);
+        toNode.length = len;
+
+        fromNode.buffer = tx_buf;
+        fromNode.payload = (u8 *)tx_buf + PAYLOAD_OFFSET + sizeof(wn_transport_header);
+        fromNode.length = PAYLOAD_PAD_NBYTES;
+
+        node_rxFromTransport(&toNode, &fromNode, &src, 0);
+
+        if ((Xil_Ntohs(hdr->flags) & TRANSPORT_ROBUST_MASK) && fromNode.length > PAYLOAD_PAD_NBYTES)
+                transport_send(&fromNode, &src, 0);
+}
+
+void loopback_node_poll(void)
+{
+        node_log_stream_poll();
+}
+
+void loopback_node_get_stats(struct loopback_node_stats *stats)
+{
+        stats->active = log_stream.state != NODE_LOG_STREAM_IDLE;
+        stats->num_pkts = log_stream.num_pkts;
+        stats->num_acked = log_stream.base;
+        stats->num_tx = log_stream.num_tx;
+        stats->num_resent = log_stream.num_resent;
+}
+
+/* Transport */
+void transport_send(wn_host_message *currMsg, pktSrcInfo *pktSrc, unsigned int eth_dev_num)
+{
+        loopback_to_host((u8 *)currMsg->buffer + PAYLOAD_OFFSET - PAYLOAD_PAD_NBYTES,
+                         currMsg->length + sizeof(wn_transport_header));
+}
+
+wn_respHdr *transport_get_async_resp(unsigned int eth_dev_num)
+{
+        return (wn_respHdr *)((u8 *)async_buf + PAYLOAD_OFFSET + sizeof(wn_transport_header));
+}
+
+int transport_processCmd(const wn_cmdHdr *cmdHdr, const void *cmdArgs, wn_respHdr *respHdr, void *respArgs,
+                         void *pktSrc, unsigned int eth_dev_num)
+{
+        return NO_RESP_SENT;
+}
+
+int transport_init(unsigned int node, unsigned int eth_dev_num, unsigned char *hw_addr, unsigned char *ip_addr,
+                   unsigned int unicast_port, unsigned int bcast_port)
+{
+        return SUCCESS;
+}
+
+int transport_config_sockets(unsigned int eth_dev_num, unsigned int unicast_port, unsigned int bcast_port)
+{
+        return SUCCESS;
+}
+
+int transport_get_parameters(unsigned int eth_dev_num, u32 *buffer, unsigned int max_words, unsigned char network)
+{
+        return 0;
+}
+
+int transport_linkStatus(unsigned int eth_dev_num)
+{
+        return LINK_READY;
+}
+
+int transport_setReceiveCallback(void (*handler))
+{
+        return SUCCESS;
+}
+
+int transport_set_hw_info(unsigned int eth_dev_num, unsigned char *ip_addr, unsigned char *hw_addr)
+{
+        return SUCCESS;
+}
+
+/* Event log */
+u32 event_log_get_event_ranges(u32 first_id, u32 num_events, u32 *index, u32 *size)
+{
+        u32 i;
+
+        for (i = 0; i < log_num_ranges; i++) {
+                index[i] = log_index[i];
+                size[i] = log_size[i];
+        }
+
+        return log_num_ranges;
+}
+
+u32 event_log_get_data(u32 start_address, u32 size, char *buffer)
+{
+        if (start_address >= LOOPBACK_LOG_MAX)
+                return 0;
+
+        if (size > LOOPBACK_LOG_MAX - start_address)
+                size = LOOPBACK_LOG_MAX - start_address;
+
+        memcpy(buffer, log_mem + start_address, size);
+
+        return size;
+}
+
+u32 event_log_get_oldest_event_id(void)
+{
+        return 0;
+}
+
+u32 event_log_get_next_event_id(void)
+{
+        return 0;
+}
+
+u32 event_log_get_oldest_event_index(void)
+{
+        return log_num_ranges ? log_index[0] : 0;
+}
+
+u32 event_log_get_current_index(void)
+{
+        return log_num_ranges ? log_index[log_num_ranges - 1] + log_size[log_num_ranges - 1] : 0;
+}
+
+u32 event_log_get_size(void)
+{
+        return log_size[0] + log_size[1];
+}
+
+int event_log_config_wrap(u32 enable)
+{
+        return 0;
+}
+
+void event_log_reset()
+{
+}
+
+/* The rest of CPU_HIGH */
+u64 get_usec_timestamp()
+{
+        return loopback_usec;
+}
+
+void xil_printf(const char *ctrl1, ...)
+{
+        va_list ap;
+
+        if (!loopback_verbose)
+                return;
+
+        va_start(ap, ctrl1);
+        vfprintf(stderr, ctrl1, ap);
+        va_end(ap);
+}
+
+void *wlan_malloc(u32 size)
+{
+        return malloc(size);
+}
+
+void wlan_free(void *addr)
+{
+        free(addr);
+}
+
+void purge_queue(u16 queue_sel)
+{
+}
+
+int ltg_sched_configure(u32 id, u32 type, void *params, void *callback_arg, void (*callback)())
+{
+        return -1;
+}
+
+int ltg_sched_get_callback_arg(u32 id, void **callback_arg)
+{
+        return -1;
+}
+
+int ltg_sched_remove(u32 id)
+{
+        return -1;
+}
+
+int ltg_sched_start(u32 id)
+{
+        return -1;
+}
+
+int ltg_sched_stop(u32 id)
+{
+        return -1;
+}
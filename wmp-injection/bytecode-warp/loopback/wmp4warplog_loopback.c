@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
+
+#include "loopback.h"
+
+/* ******************
+ * Event log stream loopback test
+ *
+ * Runs wmp4warplog against the stream of wlan_exp_node.c (node.c) over a
+ * lossy in-memory transport, in simulated time. wmp4warplog.c is built
+ * unchanged: its socket, poll, recv, sendto and clock calls are routed
+ * below. While the receiver waits in poll(), the node's main loop runs,
+ * one pass every LOOPBACK_LOOP_USEC; packets take LOOPBACK_DELAY_USEC to
+ * cross, and each is dropped with the loss rate of the run, in both
+ * directions.
+ *
+ * For every loss rate and log (empty, one range, wrapped into two ranges)
+ * the file written must hold the log bytes in order. Without loss, no
+ * packet may be resent. Once the receiver is done, the node must end the
+ * stream: as done, or, if the last acknowledgements were lost, as dropped
+ * after its timeouts.
+ * usage: ./wmp4warplog-loopback [-s seed] [-v]
+ * ***************** */
+
+#define LOOPBACK_FD                     1000
+#define LOOPBACK_LOOP_USEC              10
+#define LOOPBACK_DELAY_USEC             200
+#define LOOPBACK_QUEUE_N                256
+#define LOOPBACK_PKT_L                  2048
+#define LOOPBACK_DRAIN_USEC             (2 * 1000 * 1000)
+
+struct loopback_pkt {
+        uint64_t due;
+        size_t len;
+        uint8_t data[LOOPBACK_PKT_L];
+};
+
+struct loopback_queue {
+        unsigned int head, count;
+        unsigned long sent, dropped;
+        struct loopback_pkt pkt[LOOPBACK_QUEUE_N];
+};
+
+static struct loopback_queue to_node, to_host;
+static unsigned int loss_permille;
+static uint32_t rand_state;
+
+static uint32_t loopback_rand()
+{
+        /* xorshift32, so that a seed replays the same losses everywhere */
+        rand_state ^= rand_state << 13;
+        rand_state ^= rand_state >> 17;
+        rand_state ^= rand_state << 5;
+        return rand_state;
+}
+
+static void queue_reset(struct loopback_queue *q)
+{
+        q->head = q->count = 0;
+        q->sent = q->dropped = 0;
+}
+
+static void queue_put(struct loopback_queue *q, const void *data, size_t len)
+{
+        struct loopback_pkt *p;
+
+        q->sent++;
+
+        if (loopback_rand() % 1000 < loss_permille) {
+                q->dropped++;
+                return;
+        }
+
+        if (q->count == LOOPBACK_QUEUE_N || len > LOOPBACK_PKT_L) {
+                fprintf(stderr, "loopback queue overflow\n");
+                exit(EXIT_FAILURE);
+        }
+
+        p = &q->pkt[(q->head + q->count) % LOOPBACK_QUEUE_N];
+        p->due = loopback_usec + LOOPBACK_DELAY_USEC;
+        p->len = len;
+        memcpy(p->data, data, len);
+        q->count++;
+}
+
+static struct loopback_pkt *queue_due(struct loopback_queue *q)
+{
+        if (q->count == 0 || q->pkt[q->head].due > loopback_usec)
+                return NULL;
+
+        return &q->pkt[q->head];
+}
+
+static void queue_pop(struct loopback_queue *q)
+{
+        q->head = (q->head + 1) % LOOPBACK_QUEUE_N;
+        q->count--;
+}
+
+/* one pass of the node's main loop */
+static void node_step()
+{
+        struct loopback_pkt *p;
+
+        while ((p = queue_due(&to_node)) != NULL) {
+                loopback_node_receive(p->data, p->len);
+                queue_pop(&to_node);
+        }
+
+        loopback_node_poll();
+        loopback_usec += LOOPBACK_LOOP_USEC;
+}
+
+void loopback_to_host(const uint8_t *pkt, size_t len)
+{
+        queue_put(&to_host, pkt, len);
+}
+
+/* The receiver's system calls */
+static int loopback_socket(int domain, int type, int protocol)
+{
+        return LOOPBACK_FD;
+}
+
+static int loopback_close(int fd)
+{
+        return 0;
+}
+
+static ssize_t loopback_sendto(int fd, const void *buf, size_t len, int flags,
+                               const struct sockaddr *dest_addr, socklen_t addrlen)
+{
+        queue_put(&to_node, buf, len);
+        return len;
+}
+
+static ssize_t loopback_recv(int fd, void *buf, size_t len, int flags)
+{
+        struct loopback_pkt *p = queue_due(&to_host);
+
+        if (!p) {
+                errno = EAGAIN;
+                return -1;
+        }
+
+        if (len > p->len)
+                len = p->len;
+        memcpy(buf, p->data, len);
+        queue_pop(&to_host);
+
+        return len;
+}
+
+/* the node runs while the receiver waits */
+static int loopback_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+        uint64_t deadline = loopback_usec + (uint64_t)timeout * 1000;
+
+        fds->revents = 0;
+
+        while (!queue_due(&to_host)) {
+                if (loopback_usec >= deadline)
+                        return 0;
+                node_step();
+        }
+
+        fds->revents = POLLIN;
+        return 1;
+}
+
+static int loopback_clock_gettime(clockid_t clk_id, struct timespec *tp)
+{
+        tp->tv_sec = loopback_usec / 1000000;
+        tp->tv_nsec = (loopback_usec % 1000000) * 1000;
+        return 0;
+}
+
+#define main            wmp4warplog_main
+#define socket          loopback_socket
+#define close           loopback_close
+#define sendto          loopback_sendto
+#define recv            loopback_recv
+#define poll            loopback_poll
+#define clock_gettime   loopback_clock_gettime
+
+#include "../wmp4warplog.c"
+
+#undef main
+#undef socket
+#undef close
+#undef sendto
+#undef recv
+#undef poll
+#undef clock_gettime
+
+static int run(const char *out_name, int wrapped, size_t log_size, unsigned int loss, char *extra_opt)
+{
+        char *argv[] = { "wmp4warplog", "-a", "10.0.0.1", "-o", (char *)out_name, extra_opt, NULL };
+        struct loopback_node_stats stats;
+        const uint8_t *expect;
+        uint8_t *got;
+        uint64_t start;
+        size_t got_l;
+        FILE *f;
+        int failed = 0;
+
+        log_size = loopback_node_reset(wrapped, log_size, &expect);
+        queue_reset(&to_node);
+        queue_reset(&to_host);
+        loss_permille = loss;
+        start = loopback_usec;
+
+        optind = 1;
+        if (wmp4warplog_main(extra_opt ? 6 : 5, argv) != 0)
+                return 1;
+
+        /* let the node finish, or give up, on its own */
+        while (loopback_usec - start < LOOPBACK_DRAIN_USEC) {
+                loopback_node_get_stats(&stats);
+                if (!stats.active)
+                        break;
+                node_step();
+        }
+
+        loopback_node_get_stats(&stats);
+
+        got = malloc(log_size + 1);
+        f = fopen(out_name, "rb");
+        if (!got || !f) {
+                perror(out_name);
+                exit(EXIT_FAILURE);
+        }
+        got_l = fread(got, 1, log_size + 1, f);
+        fclose(f);
+
+        if (got_l != log_size || memcmp(got, expect, log_size) != 0) {
+                printf("FAIL: %zu bytes written, %zu expected%s\n", got_l, log_size,
+                       got_l == log_size ? ", contents differ" : "");
+                failed = 1;
+        }
+        if (loss == 0 && stats.num_resent) {
+                printf("FAIL: %u packets resent without loss\n", stats.num_resent);
+                failed = 1;
+        }
+        if (stats.active) {
+                printf("FAIL: the node is still streaming\n");
+                failed = 1;
+        }
+
+        printf("%8s %6zu %4u.%u%% %6u %6u %6u %6lu %6lu %8.1f %-7s %s\n", wrapped ? "wrapped" : "linear", log_size,
+               loss / 10, loss % 10, stats.num_pkts, stats.num_tx, stats.num_resent, to_host.dropped, to_node.dropped,
+               (loopback_usec - start) / 1000.0, stats.num_acked == stats.num_pkts ? "done" : "dropped",
+               extra_opt ? extra_opt : "");
+
+        free(got);
+
+        return failed;
+}
+
+int main(int argc, char *argv[])
+{
+        static const unsigned int loss[] = { 0, 10, 50, 100, 200, 300 };
+        static const size_t sizes[] = { 0, 1, 1240, 200000 };
+        char out_name[] = "/tmp/wmp4warplog-loopback-XXXXXX";
+        unsigned int seed = 1;
+        int failures = 0;
+        unsigned int i, j, wrapped;
+        int fd, opt;
+
+        while ((opt = getopt(argc, argv, "s:vh")) != -1) {
+                switch (opt) {
+                case 's':
+                        seed = strtoul(optarg, NULL, 0);
+                break;
+                case 'v':
+                        loopback_verbose = 1;
+                break;
+                default:
+                        fprintf(stderr, "usage: %s [-s seed] [-v]\n", argv[0]);
+                        exit(EXIT_FAILURE);
+                }
+        }
+
+        rand_state = seed ? seed : 1;
+
+        fd = mkstemp(out_name);
+        if (fd < 0) {
+                perror("mkstemp");
+                exit(EXIT_FAILURE);
+        }
+        close(fd);
+
+        printf("%8s %6s %7s %6s %6s %6s %6s %6s %8s %-7s\n", "log", "bytes", "loss", "pkts", "tx", "resent",
+               "lost>h", "lost>n", "ms", "node");
+
+        for (wrapped = 0; wrapped < 2; wrapped++)
+                for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+                        for (j = 0; j < sizeof(loss) / sizeof(loss[0]); j++)
+                                failures += run(out_name, wrapped, sizes[i], loss[j], NULL);
+
+        /* the largest window, then an acknowledgement for every packet */
+        for (j = 0; j < sizeof(loss) / sizeof(loss[0]); j++)
+                failures += run(out_name, 1, sizes[3], loss[j], "-w32");
+        for (j = 0; j < sizeof(loss) / sizeof(loss[0]); j++)
+                failures += run(out_name, 1, sizes[3], loss[j], "-k1");
+
+        unlink(out_name);
+
+        if (failures) {
+                printf("%d runs failed\n", failures);
+                return 1;
+        }
+        printf("every run delivered the log in order\n");
+
+        return 0;
+}
@@ -13,17 +13,27 @@
 #endif
 #include <string.h>
 #include <sys/stat.h>
+#include <signal.h>
+#include <time.h>
 
 #include "wmp4warp.h"
 
-#define MAX_BC_LENGTH 1500
+#define MAX_BC_LENGTH WMP4WARP_FSM_IMAGE_MAX_SIZE
+
+/* fragmented FSM_LOAD: fragments in flight, and time without progress before
+ * sending again from the first fragment not acknowledged */
+#define FSM_LOAD_WINDOW         WMP4WARP_FSM_LOAD_WINDOW
+#define FSM_LOAD_TIMEOUT_S      0.1
+#define FSM_LOAD_RETRIES        10
 
 char* print_fsm_bin(const char *filename);
 
+static volatile sig_atomic_t stop = 0;
+
 void static usage()
 {
         fprintf(stdout, "----------------------\n");
-        fprintf(stdout, "wmp4warp -i <int_name> -1 <MAC addr int> [-ewlxdtra]\n");
+        fprintf(stdout, "wmp4warp -i <int_name> -1 <MAC addr int> [-ewlxdtrapfon]\n");
         fprintf(stdout, "       -h    		: Print this help text\n");
         fprintf(stdout, "       -i <int_name>   : int_name is the name of the output interface\n");
         fprintf(stdout, "       -1 <MAC addr>   : source MAC address\n");
@@ -31,12 +41,21 @@ void static usage()
         fprintf(stdout, "       -w <warpid>     : WARP identifier. required fon any command different from -e\n");
         fprintf(stdout, "       -m <fsmfile>    : load on warpid the FSM in fsmfile\n");
         fprintf(stdout, "       -l <fsmid>      : ID for fsm in fsmfile (identifier 0 is for the default fsm)\n");
+        fprintf(stdout, "       -F <bytes>      : with -m, send the FSM in fragments of bytes bytes (default: only if\n");
+        fprintf(stdout, "                         it does not fit one frame, in fragments as large as possible)\n");
+        fprintf(stdout, "       -W <n>          : with -m, fragments in flight (default %d)\n", FSM_LOAD_WINDOW);
         fprintf(stdout, "       -d <fsmid>      : delete FSM whose id is fsmid from warpid\n");
         fprintf(stdout, "       -t              : require timestamp to warpid\n");
 	fprintf(stdout, "       -a <us>         : active fsmid after 0 us\n");
-        fprintf(stdout, "       -r <us>         : require to active fsmid after us us\n");
+        fprintf(stdout, "       -u <us>         : require to active fsmid after us us\n");
         fprintf(stdout, "       -s <ts>         : require to run fsmid at ts\n");
-        fprintf(stdout, "       -v <var_id>     : read variable identified by var_id\n");
+        fprintf(stdout, "       -r <var_id>     : read variable identified by var_id\n");
+        fprintf(stdout, "       -v              : read registers 1 to 5 in one request\n");
+        fprintf(stdout, "       -x <id,id,...>  : read the listed variables in one request (at most %d)\n", WMP4WARP_MAX_VARS);
+        fprintf(stdout, "       -p <us>         : subscribe to the variables of -x (default 1 to 5), pushed every us us\n");
+        fprintf(stdout, "       -f              : subscribe, pushed whenever warpid switches FSM\n");
+        fprintf(stdout, "       -o              : with -p, skip the samples where no variable changed\n");
+        fprintf(stdout, "       -n <count>      : stop the subscription after count samples (default: on ctrl-c)\n");
         fprintf(stdout, "----------------------\n");
 }
 
@@ -59,6 +78,10 @@ static uint32_t get_wmp_packet_l(uint16_t cmd)
                 ret = WMP4WARP_FSM_LOAD_L;
         break;
 
+        case WMP4WARP_FSM_LOAD_FRAG:
+                ret = WMP4WARP_FSM_LOAD_FRAG_L;
+        break;
+
         case WMP4WARP_FSM_DEL:
                 ret = WMP4WARP_FSM_DEL_L;
         break;
@@ -78,6 +101,14 @@ static uint32_t get_wmp_packet_l(uint16_t cmd)
         case WMP4WARP_READ_VAR:
                 ret = WMP4WARP_READ_VAR_L;
         break;
+
+        case WMP4WARP_READ_VARS:
+                ret = WMP4WARP_READ_VARS_L;
+        break;
+
+        case WMP4WARP_SUBSCRIBE:
+                ret = WMP4WARP_SUBSCRIBE_L;
+        break;
         }
 
         return ret;
@@ -127,6 +158,30 @@ static void handle_fsm_load_conf(u_char *user, const u_char *bytes)
 
 }
 
+static void handle_fsm_load_ack(u_char *user, const u_char *bytes)
+{
+    struct packet_header *mac_header = (struct packet_header *) (bytes);
+    struct wmp4warp_header_fsm_load_ack *ack_hdr =
+                (struct wmp4warp_header_fsm_load_ack *) (bytes + sizeof(struct packet_header) + sizeof(struct wmp4warp_header_common));
+
+    struct wmp4warp *w4w = (struct wmp4warp *) user;
+
+    if (memcmp(mac_header->mac_src, w4w->warp_mac_addr, sizeof(w4w->warp_mac_addr)) ||
+        ack_hdr->xfer_id != w4w->xfer_id) {
+        return;
+    }
+
+    /* acks may be reordered, the cumulative one only moves forward */
+    if (ack_hdr->next_seq > w4w->ack_next_seq) {
+        w4w->ack_next_seq = ack_hdr->next_seq;
+    }
+    if (ack_hdr->status != WMP4WARP_FSM_LOAD_PENDING) {
+        w4w->ack_status = ack_hdr->status;
+        w4w->ack_crc = ack_hdr->crc;
+    }
+
+}
+
 static void handle_fsm_del_conf(u_char *user, const u_char *bytes)
 {
     struct packet_header *mac_header = (struct packet_header *) (bytes);
@@ -207,6 +262,199 @@ static void handle_read_var(u_char *user, const u_char *bytes)
 
 }
 
+static void handle_read_vars(u_char *user, const u_char *bytes)
+{
+    struct packet_header *mac_header = (struct packet_header *) (bytes);
+    struct wmp4warp_header_var_set *var_set_hdr =
+                (struct wmp4warp_header_var_set *) (bytes + sizeof(struct packet_header) + sizeof(struct wmp4warp_header_common));
+    int i;
+
+    struct wmp4warp *w4w = (struct wmp4warp *) user;
+
+    if (!memcmp(mac_header->mac_src, w4w->warp_mac_addr, sizeof(w4w->warp_mac_addr))) {
+        for (i = 0; i < var_set_hdr->num_vars && i < WMP4WARP_MAX_VARS; i++) {
+            fprintf(stdout, "Register %d: %05hu\n", var_set_hdr->var_id[i] + 1, var_set_hdr->var_value[i]);
+        }
+    }
+
+}
+
+static void handle_subscribe_conf(u_char *user, const u_char *bytes)
+{
+    struct packet_header *mac_header = (struct packet_header *) (bytes);
+    struct wmp4warp_header_subscribe_conf *sub_hdr =
+                (struct wmp4warp_header_subscribe_conf *) (bytes + sizeof(struct packet_header) + sizeof(struct wmp4warp_header_common));
+
+    struct wmp4warp *w4w = (struct wmp4warp *) user;
+
+    if (!memcmp(mac_header->mac_src, w4w->warp_mac_addr, sizeof(w4w->warp_mac_addr))) {
+        if (sub_hdr->num_vars) {
+            fprintf(stdout, "%s pushes %d variables every %u us (flags 0x%04x)\n", w4w->warp_name,
+                sub_hdr->num_vars, sub_hdr->period_us, sub_hdr->flags);
+            w4w->cmd_wait = WMP4WARP_TELEMETRY;
+        } else {
+            fprintf(stdout, "%s stopped pushing variables\n", w4w->warp_name);
+        }
+    }
+
+}
+
+static void handle_telemetry(u_char *user, const u_char *bytes)
+{
+    struct packet_header *mac_header = (struct packet_header *) (bytes);
+    struct wmp4warp_header_var_set *var_set_hdr =
+                (struct wmp4warp_header_var_set *) (bytes + sizeof(struct packet_header) + sizeof(struct wmp4warp_header_common));
+    int i;
+
+    struct wmp4warp *w4w = (struct wmp4warp *) user;
+
+    if (memcmp(mac_header->mac_src, w4w->warp_mac_addr, sizeof(w4w->warp_mac_addr))) {
+        return;
+    }
+
+    /* with -o the samples where nothing changed are not pushed, gaps are expected */
+    if (w4w->telemetry_count && !(w4w->sub_flags & WMP4WARP_SUBSCRIBE_ON_CHANGE) &&
+        var_set_hdr->sample > w4w->last_sample + 1) {
+        w4w->telemetry_skipped += var_set_hdr->sample - w4w->last_sample - 1;
+    }
+    w4w->last_sample = var_set_hdr->sample;
+    w4w->telemetry_count++;
+
+    fprintf(stdout, "%s %8u %16llu", w4w->warp_name, var_set_hdr->sample, (unsigned long long)var_set_hdr->ts);
+    if (var_set_hdr->trigger == WMP4WARP_TRIGGER_SWITCH) {
+        fprintf(stdout, " switch %d", var_set_hdr->slot);
+    } else {
+        fprintf(stdout, " period  ");
+    }
+    for (i = 0; i < var_set_hdr->num_vars && i < WMP4WARP_MAX_VARS; i++) {
+        fprintf(stdout, " %d:%05hu", var_set_hdr->var_id[i] + 1, var_set_hdr->var_value[i]);
+    }
+    fprintf(stdout, "\n");
+
+}
+
+static void handle_signal(int sig)
+{
+        stop = 1;
+}
+
+static double now_s()
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* ids are 1-based on the command line, as for -r */
+static void parse_var_list(char *list, struct wmp4warp *w4w)
+{
+        char *tok;
+        int id;
+
+        w4w->num_vars = 0;
+        for (tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+                id = atoi(tok);
+                if (id < 1 || id > 256 || w4w->num_vars == WMP4WARP_MAX_VARS) {
+                        fprintf(stderr, "Invalid variable list (ids 1 to 256, at most %d)\n", WMP4WARP_MAX_VARS);
+                        usage();
+                        exit(1);
+                }
+                w4w->var_ids[w4w->num_vars++] = id - 1;
+        }
+}
+
+void resp_handler(u_char *user, const struct pcap_pkthdr *h, const u_char *bytes);
+
+/* Sends w4w->fsm as FSM_LOAD_FRAG fragments, keeping up to window of them in
+ * flight. The board acknowledges every fragment with the first one it is still
+ * missing; when that does not move for FSM_LOAD_TIMEOUT_S, the fragments from
+ * there on are sent again. buffer already holds the MAC and common headers. */
+static int fsm_load_fragmented(pcap_t *pcap, uint8_t *buffer, struct wmp4warp *w4w,
+                uint16_t frag_size, uint16_t window)
+{
+        struct wmp4warp_header_common *w4w_hdr_cmn =
+                (struct wmp4warp_header_common *) (buffer + sizeof(struct packet_header));
+        struct wmp4warp_header_fsm_load_frag *frag_hdr =
+                (struct wmp4warp_header_fsm_load_frag *) (buffer + sizeof(struct packet_header) + sizeof(struct wmp4warp_header_common));
+        uint8_t *frag = (uint8_t *) frag_hdr + sizeof(struct wmp4warp_header_fsm_load_frag);
+        uint16_t num_frags, base = 0, next = 0, seq;
+        uint32_t sent = 0, resent = 0, retries = 0;
+        double start, progress;
+
+        if (!frag_size) {
+                frag_size = MAX_FRAME_LENGTH - WMP4WARP_FSM_LOAD_FRAG_L;
+        }
+        num_frags = (w4w->fsm_size + frag_size - 1) / frag_size;
+        if (num_frags > WMP4WARP_FSM_MAX_FRAGS) {
+                fprintf(stderr, "%u bytes need more than %d fragments of %u bytes\n",
+                        w4w->fsm_size, WMP4WARP_FSM_MAX_FRAGS, frag_size);
+                return -1;
+        }
+
+        w4w_hdr_cmn->cmd_id = WMP4WARP_FSM_LOAD_FRAG;
+        w4w->cmd_wait = WMP4WARP_FSM_LOAD_ACK;
+        w4w->xfer_id = (uint16_t) (getpid() ^ time(NULL));
+        w4w->ack_next_seq = 0;
+        w4w->ack_status = WMP4WARP_FSM_LOAD_PENDING;
+
+        frag_hdr->fsm_id = w4w->fsm_id;
+        frag_hdr->xfer_id = w4w->xfer_id;
+        frag_hdr->image_l = w4w->fsm_size;
+        frag_hdr->frag_size = frag_size;
+        frag_hdr->image_crc = wmp4warp_crc32(w4w->fsm, w4w->fsm_size);
+
+        start = progress = now_s();
+        while (w4w->ack_status == WMP4WARP_FSM_LOAD_PENDING) {
+                while (next < num_frags && next < base + window) {
+                        seq = next++;
+                        frag_hdr->frag_seq = seq;
+                        frag_hdr->frag_l = (seq == num_frags - 1) ? w4w->fsm_size - seq * frag_size : frag_size;
+                        w4w_hdr_cmn->seq = seq;
+                        memcpy(frag, w4w->fsm + seq * frag_size, frag_hdr->frag_l);
+
+                        if (pcap_inject(pcap, buffer, WMP4WARP_FSM_LOAD_FRAG_L + frag_hdr->frag_l) == -1) {
+                                pcap_perror(pcap,0);
+                                return -1;
+                        }
+                        sent++;
+                }
+
+                if (pcap_dispatch(pcap, -1, resp_handler, (u_char *)w4w) < 0) {
+                        pcap_perror(pcap,0);
+                        return -1;
+                }
+
+                if (w4w->ack_next_seq > base) {
+                        base = w4w->ack_next_seq;
+                        progress = now_s();
+                        retries = 0;
+                } else if (now_s() - progress > FSM_LOAD_TIMEOUT_S) {
+                        if (++retries > FSM_LOAD_RETRIES) {
+                                fprintf(stderr, "%s does not acknowledge fragment %u of FSM %d\n",
+                                        w4w->warp_name, base, w4w->fsm_id);
+                                return -1;
+                        }
+                        resent += next - base;
+                        next = base;
+                        progress = now_s();
+                }
+        }
+
+        if (w4w->ack_status != WMP4WARP_FSM_LOAD_DONE) {
+                fprintf(stderr, "%s failed to load FSM %d: %s (CRC 0x%08x, sent 0x%08x)\n",
+                        w4w->warp_name, w4w->fsm_id,
+                        w4w->ack_status == WMP4WARP_FSM_LOAD_BAD_CRC ? "CRC mismatch" : "rejected",
+                        w4w->ack_crc, frag_hdr->image_crc);
+                return -1;
+        }
+
+        fprintf(stdout, "%s has loaded FSM whose ID is %d: %u bytes in %u fragments, %u sent again, %.3f ms\n",
+                w4w->warp_name, w4w->fsm_id, w4w->fsm_size, num_frags, resent, (now_s() - start) * 1000);
+
+        return 0;
+}
+
 void resp_handler(u_char *user, const struct pcap_pkthdr *h, const u_char *bytes)
 {
         struct packet_header *mac_header = (struct packet_header *) (bytes);
@@ -227,6 +475,9 @@ void resp_handler(u_char *user, const struct pcap_pkthdr *h, const u_char *bytes
         case WMP4WARP_FSM_LOAD_CONF:
             handle_fsm_load_conf(user, bytes);
         break;
+        case WMP4WARP_FSM_LOAD_ACK:
+            handle_fsm_load_ack(user, bytes);
+        break;
         case WMP4WARP_FSM_DEL_CONF:
             handle_fsm_del_conf(user, bytes);
         break;
@@ -238,9 +489,19 @@ void resp_handler(u_char *user, const struct pcap_pkthdr *h, const u_char *bytes
         break;
         case WMP4WARP_RUN_ABS_CONF:
             handle_run_abs(user, bytes);
+        break;
         case WMP4WARP_READ_VAR_REP:
             handle_read_var(user, bytes);
         break;
+        case WMP4WARP_READ_VARS_REP:
+            handle_read_vars(user, bytes);
+        break;
+        case WMP4WARP_SUBSCRIBE_CONF:
+            handle_subscribe_conf(user, bytes);
+        break;
+        case WMP4WARP_TELEMETRY:
+            handle_telemetry(user, bytes);
+        break;
         }
 
         fflush(stdout);
@@ -265,6 +526,11 @@ int main (int argc, char **argv)
         int fsm_id_set = 0;
 	int var_tot = 0;
 	int count = 1;
+        int subscribe = 0;
+        uint32_t telemetry_n = 0;
+        uint16_t frag_size = 0;
+        uint16_t window = FSM_LOAD_WINDOW;
+        double start;
         char *warp_dest_id_str = NULL;
 	char *in_file_name = NULL;
 	char *out_name = NULL;
@@ -289,7 +555,7 @@ int main (int argc, char **argv)
         errbuf[0]='\0';
 
 	w4w.out_interface_name = "eth1";
-        while ((c = (char)getopt(argc, argv, "i:1:w:l:m:d:a:u:s:r:tevh")) != EOF) {
+        while ((c = (char)getopt(argc, argv, "i:1:w:l:m:d:a:u:s:r:x:p:n:F:W:fotevh")) != EOF) {
                 switch (c) {
                 case 'i':
                         w4w.out_interface_name = optarg;
@@ -326,6 +592,23 @@ int main (int argc, char **argv)
                         fsm_id_set = 1;
                 break;
 
+                case 'F':
+                        frag_size = atoi(optarg);
+                        if (!frag_size || frag_size > MAX_FRAME_LENGTH - WMP4WARP_FSM_LOAD_FRAG_L) {
+                                fprintf(stderr, "Fragment size must be between 1 and %d\n",
+                                        (int)(MAX_FRAME_LENGTH - WMP4WARP_FSM_LOAD_FRAG_L));
+                                exit(1);
+                        }
+                break;
+
+                case 'W':
+                        window = atoi(optarg);
+                        if (!window) {
+                                fprintf(stderr, "Window must be at least 1 fragment\n");
+                                exit(1);
+                        }
+                break;
+
                 case 'd':
                         w4w.fsm_id = atoi(optarg);
                         w4w.cmd = WMP4WARP_FSM_DEL;
@@ -365,9 +648,36 @@ int main (int argc, char **argv)
 
 		case 'v':
 			var_tot = 1;
-	   		w4w.var_id = 0;
-                        w4w.cmd = WMP4WARP_READ_VAR;
-                        w4w.cmd_wait = WMP4WARP_READ_VAR_REP;
+                        for (i = 0; i < 5; i++) {
+                                w4w.var_ids[i] = i;
+                        }
+                        w4w.num_vars = 5;
+                        w4w.cmd = WMP4WARP_READ_VARS;
+                        w4w.cmd_wait = WMP4WARP_READ_VARS_REP;
+                break;
+
+                case 'x':
+                        parse_var_list(optarg, &w4w);
+                        w4w.cmd = WMP4WARP_READ_VARS;
+                        w4w.cmd_wait = WMP4WARP_READ_VARS_REP;
+                break;
+
+                case 'p':
+                        w4w.period_us = strtoul(optarg, NULL, 10);
+                        subscribe = 1;
+                break;
+
+                case 'f':
+                        w4w.sub_flags |= WMP4WARP_SUBSCRIBE_ON_SWITCH;
+                        subscribe = 1;
+                break;
+
+                case 'o':
+                        w4w.sub_flags |= WMP4WARP_SUBSCRIBE_ON_CHANGE;
+                break;
+
+                case 'n':
+                        telemetry_n = strtoul(optarg, NULL, 10);
                 break;
                 
                 case 'h':
@@ -383,6 +693,17 @@ int main (int argc, char **argv)
                 }
         }
 
+        if (subscribe) {
+                if (!w4w.num_vars) {
+                        for (i = 0; i < 5; i++) {
+                                w4w.var_ids[i] = i;
+                        }
+                        w4w.num_vars = 5;
+                }
+                w4w.cmd = WMP4WARP_SUBSCRIBE;
+                w4w.cmd_wait = WMP4WARP_SUBSCRIBE_CONF;
+        }
+
         if (!w4w.out_interface_name) {
                 fprintf(stderr, "Output interface name is mandatory\n");
                 usage();
@@ -416,6 +737,10 @@ int main (int argc, char **argv)
             }
 
             stat(w4w.fsm_file_name, &st);
+            if (st.st_size > sizeof(w4w.fsm)) {
+                fprintf(stderr, "%s is larger than %d bytes\n", w4w.fsm_file_name, (int)sizeof(w4w.fsm));
+                exit(1);
+            }
             w4w.fsm_size = st.st_size;
 
             fread(w4w.fsm, sizeof(w4w.fsm[0]), w4w.fsm_size, fsm_file);
@@ -521,6 +846,15 @@ int main (int argc, char **argv)
 
         length = get_wmp_packet_l(w4w.cmd);
 
+        /* byte codes that do not fit one frame go in fragments */
+        if (w4w.cmd == WMP4WARP_FSM_LOAD &&
+            (frag_size || length + w4w.fsm_size > MAX_FRAME_LENGTH)) {
+            int ret = fsm_load_fragmented(pcap, buffer, &w4w, frag_size, window);
+
+            pcap_close(pcap);
+            return ret ? 1 : 0;
+        }
+
         if (w4w.cmd == WMP4WARP_FSM_LOAD) {
             struct wmp4warp_header_fsm_load *fsm_load_hdr =
                 (struct wmp4warp_header_fsm_load *) (buffer + sizeof(struct packet_header) + sizeof(struct wmp4warp_header_common));
@@ -550,52 +884,71 @@ int main (int argc, char **argv)
         if (w4w.cmd == WMP4WARP_READ_VAR) {
             struct wmp4warp_header_read_var *read_hdr =
                 (struct wmp4warp_header_read_var *) (buffer + sizeof(struct packet_header) + sizeof(struct wmp4warp_header_common));
-	  if(var_tot == 0) 
+
             read_hdr->var_id = w4w.var_id;
-	  else{
-	    read_hdr->var_id = w4w.var_id;
-	fprintf(stdout, "--------------------------------------\nREGISTER INFORMATION\n\n");
-	    if (pcap_inject(pcap, buffer, length) == -1) {
-                pcap_perror(pcap,0);
-                pcap_close(pcap);
-                exit(1);
         }
-	read_hdr->var_id = w4w.var_id + 1;
 
-	if (pcap_inject(pcap, buffer, length) == -1) {
-                pcap_perror(pcap,0);
-                pcap_close(pcap);
-                exit(1);
-        }
+        if (w4w.cmd == WMP4WARP_READ_VARS) {
+            struct wmp4warp_header_read_vars *read_hdr =
+                (struct wmp4warp_header_read_vars *) (buffer + sizeof(struct packet_header) + sizeof(struct wmp4warp_header_common));
 
-	read_hdr->var_id = w4w.var_id + 2;
+            read_hdr->num_vars = w4w.num_vars;
+            memcpy(read_hdr->var_id, w4w.var_ids, w4w.num_vars);
 
-	if (pcap_inject(pcap, buffer, length) == -1) {
-                pcap_perror(pcap,0);
-                pcap_close(pcap);
+            if (var_tot) {
+                fprintf(stdout, "--------------------------------------\nREGISTER INFORMATION\n\n");
+                if (pcap_inject(pcap, buffer, length) == -1) {
+                        pcap_perror(pcap,0);
+                        pcap_close(pcap);
+                        exit(1);
+                }
+                pcap_loop(pcap, 1, resp_handler, (u_char *)&w4w);
+                fprintf(stdout, "--------------------------------------\n");
                 exit(1);
+            }
         }
 
-	read_hdr->var_id = w4w.var_id + 3;
+        if (w4w.cmd == WMP4WARP_SUBSCRIBE) {
+            struct wmp4warp_header_subscribe *sub_hdr =
+                (struct wmp4warp_header_subscribe *) (buffer + sizeof(struct packet_header) + sizeof(struct wmp4warp_header_common));
 
-	if (pcap_inject(pcap, buffer, length) == -1) {
-                pcap_perror(pcap,0);
-                pcap_close(pcap);
-                exit(1);
-        }
+            sub_hdr->period_us = w4w.period_us;
+            sub_hdr->flags = w4w.sub_flags;
+            sub_hdr->num_vars = w4w.num_vars;
+            memcpy(sub_hdr->var_id, w4w.var_ids, w4w.num_vars);
+
+            if (pcap_inject(pcap, buffer, length) == -1) {
+                    pcap_perror(pcap,0);
+                    pcap_close(pcap);
+                    exit(1);
+            }
 
-	read_hdr->var_id = w4w.var_id + 4;
+            signal(SIGINT, handle_signal);
+            signal(SIGTERM, handle_signal);
 
-	if (pcap_inject(pcap, buffer, length) == -1) {
-                pcap_perror(pcap,0);
-                pcap_close(pcap);
-                exit(1);
+            /* the 10 ms read timeout of the capture bounds the reaction to a signal */
+            start = now_s();
+            while (!stop && (!telemetry_n || w4w.telemetry_count < telemetry_n)) {
+                    if (pcap_dispatch(pcap, -1, resp_handler, (u_char *)&w4w) < 0) {
+                            pcap_perror(pcap,0);
+                            break;
+                    }
+            }
+
+            fprintf(stdout, "%u samples in %.3f s (%.1f samples/s), %u skipped by %s\n",
+                w4w.telemetry_count, now_s() - start, w4w.telemetry_count / (now_s() - start),
+                w4w.telemetry_skipped, w4w.warp_name);
+
+            /* cancel the subscription, the confirmation is not waited for */
+            sub_hdr->num_vars = 0;
+            if (pcap_inject(pcap, buffer, length) == -1) {
+                    pcap_perror(pcap,0);
+            }
+            pcap_close(pcap);
+
+            return 0;
         }
-	pcap_loop(pcap, 5, resp_handler, (u_char *)&w4w); 
-	fprintf(stdout, "--------------------------------------\n");
-	exit(1);
-	   }
-	}
+
         if (w4w.cmd == WMP4WARP_RUN_ABS) {
             struct wmp4warp_header_run_abs *run_hdr =
                 (struct wmp4warp_header_run_abs *) (buffer + sizeof(struct packet_header) + sizeof(struct wmp4warp_header_common));
@@ -633,6 +986,7 @@ char* print_fsm_bin(const char *filename)
 	FILE *in_f = NULL;
         uint8_t bc[MAX_BC_LENGTH] = {0,};
         char next_byte_str[5];
+        unsigned int byte;
 	char buff[50];
 	char *out_file_name = NULL;
 
@@ -661,7 +1015,12 @@ char* print_fsm_bin(const char *filename)
                 for (k = 0; k < (strlen(buffer) - 1); k += 2) {
 //                        printf(" 0x%c%c,", buffer[k], buffer[k + 1]);
                         sprintf(next_byte_str, "0x%c%c", buffer[k], buffer[k + 1]);
-                        sscanf(next_byte_str, "%x", (unsigned int *)&bc[counter]);
+                        if (counter == MAX_BC_LENGTH) {
+                                fprintf(stderr, "%s is larger than %d bytes\n", filename, MAX_BC_LENGTH);
+                                exit(1);
+                        }
+                        sscanf(next_byte_str, "%x", &byte);
+                        bc[counter] = byte;
                         counter++;
                         if (!(counter % 10)) {
 //                                printf("\n");
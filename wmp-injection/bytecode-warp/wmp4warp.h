@@ -1,6 +1,7 @@
 #ifndef _WMP4WARP_H_
 #define _WMP4WARP_H_
 
+#include <stddef.h>
 #include <inttypes.h>
 
 #define WARP_LIST_FILE_NAME     "warplist"
@@ -25,6 +26,51 @@
 #define WMP4WARP_RUN_ABS_CONF        0x000c
 #define WMP4WARP_READ_VAR                0x000d
 #define WMP4WARP_READ_VAR_REP            0x000e
+#define WMP4WARP_READ_VARS               0x000f
+#define WMP4WARP_READ_VARS_REP           0x0010
+#define WMP4WARP_SUBSCRIBE               0x0011
+#define WMP4WARP_SUBSCRIBE_CONF          0x0012
+#define WMP4WARP_TELEMETRY               0x0013
+#define WMP4WARP_FSM_LOAD_FRAG           0x0014
+#define WMP4WARP_FSM_LOAD_ACK            0x0015
+
+#define WMP4WARP_MAX_VARS               32
+
+/* wmp4warp_header_subscribe flags */
+#define WMP4WARP_SUBSCRIBE_ON_SWITCH    0x0001  /* also push when the board switches FSM */
+#define WMP4WARP_SUBSCRIBE_ON_CHANGE    0x0002  /* skip periodic samples where nothing changed */
+
+/* wmp4warp_header_var_set trigger */
+#define WMP4WARP_TRIGGER_REQUEST        0x00
+#define WMP4WARP_TRIGGER_PERIOD         0x01
+#define WMP4WARP_TRIGGER_SWITCH         0x02
+
+/* sections of one FSM slot on the board (wmp_fsm.h), each starting with a 2 byte counter */
+#define WMP4WARP_FSM_PARAM_SECTION_SIZE 136
+#define WMP4WARP_FSM_STATE_SECTION_SIZE 232
+#define WMP4WARP_FSM_TRAN_SECTION_SIZE  1680
+#define WMP4WARP_FSM_COUNTER_SIZE       2
+
+#define WMP4WARP_FSM_PARAM_MAX          ((WMP4WARP_FSM_PARAM_SECTION_SIZE - WMP4WARP_FSM_COUNTER_SIZE) / 2)
+#define WMP4WARP_FSM_STATE_MAX          ((WMP4WARP_FSM_STATE_SECTION_SIZE - WMP4WARP_FSM_COUNTER_SIZE) / 2)
+#define WMP4WARP_FSM_TRAN_MAX           ((WMP4WARP_FSM_TRAN_SECTION_SIZE - WMP4WARP_FSM_COUNTER_SIZE) / 6)
+
+/* byte code accepted by FSM_LOAD_FRAG, no more than one FSM slot can hold: same formula
+as WMP_FSM_BYTE_CODE_MAX_SIZE on the board, 3 byte tags, 2 byte params and states, 6 byte
+transitions; and the number of fragments it may be cut into */
+#define WMP4WARP_FSM_IMAGE_MAX_SIZE     (3 + WMP4WARP_FSM_PARAM_MAX * (3 + 2) + \
+                                        WMP4WARP_FSM_STATE_MAX * (3 + 2 + 3) + \
+                                        WMP4WARP_FSM_TRAN_MAX * 6 + 3)
+#define WMP4WARP_FSM_MAX_FRAGS          32
+
+/* fragments of one FSM_LOAD_FRAG transfer in flight at once */
+#define WMP4WARP_FSM_LOAD_WINDOW        8
+
+/* wmp4warp_header_fsm_load_ack status */
+#define WMP4WARP_FSM_LOAD_PENDING       0x0000
+#define WMP4WARP_FSM_LOAD_DONE          0x0001
+#define WMP4WARP_FSM_LOAD_BAD_CRC       0x0002
+#define WMP4WARP_FSM_LOAD_FAILED        0x0003
 
 struct __attribute__((__packed__)) packet_header {
      uint8_t mac_dst[6];
@@ -35,6 +81,7 @@ struct __attribute__((__packed__)) packet_header {
 struct __attribute__((__packed__)) wmp4warp_header_common {
      uint16_t   cmd_id;
      uint8_t mac_addr[6];
+     uint16_t   seq;       /* echoed unchanged in the reply */
 };
 
 struct __attribute__((__packed__)) wmp4warp_header_fsm_load {
@@ -46,6 +93,27 @@ struct __attribute__((__packed__)) wmp4warp_header_fsm_load_conf {
      uint16_t   fsm_id;
 };
 
+/* fragment frag_seq of a byte code of image_l bytes cut in fragments of frag_size
+ * bytes (the last one may be shorter); image_crc is the CRC-32 of the whole image */
+struct __attribute__((__packed__)) wmp4warp_header_fsm_load_frag {
+     uint16_t   fsm_id;
+     uint16_t   xfer_id;
+     uint16_t   image_l;
+     uint16_t   frag_size;
+     uint16_t   frag_seq;
+     uint16_t   frag_l;
+     uint32_t   image_crc;
+};
+
+/* every fragment before next_seq has been received */
+struct __attribute__((__packed__)) wmp4warp_header_fsm_load_ack {
+     uint16_t   fsm_id;
+     uint16_t   xfer_id;
+     uint16_t   next_seq;
+     uint16_t   status;
+     uint32_t   crc;
+};
+
 struct __attribute__((__packed__)) wmp4warp_header_fsm_del {
      uint16_t   fsm_id;
 };
@@ -67,6 +135,38 @@ struct __attribute__((__packed__)) wmp4warp_header_read_var_rep {
      uint16_t   var_value;
 };
 
+struct __attribute__((__packed__)) wmp4warp_header_read_vars {
+     uint16_t   num_vars;
+     uint8_t    var_id[WMP4WARP_MAX_VARS];
+};
+
+/* body of READ_VARS_REP and TELEMETRY: ts is the board time (us) of the sample,
+ * sample counts the samples of a subscription, so that gaps show the skipped ones */
+struct __attribute__((__packed__)) wmp4warp_header_var_set {
+     uint64_t   ts;
+     uint32_t   sample;
+     uint8_t    trigger;
+     uint8_t    slot;
+     uint8_t    num_vars;
+     uint8_t    reserved;
+     uint8_t    var_id[WMP4WARP_MAX_VARS];
+     uint16_t   var_value[WMP4WARP_MAX_VARS];
+};
+
+/* num_vars 0 cancels the subscription */
+struct __attribute__((__packed__)) wmp4warp_header_subscribe {
+     uint32_t   period_us;
+     uint16_t   flags;
+     uint16_t   num_vars;
+     uint8_t    var_id[WMP4WARP_MAX_VARS];
+};
+
+struct __attribute__((__packed__)) wmp4warp_header_subscribe_conf {
+     uint32_t   period_us;
+     uint16_t   flags;
+     uint16_t   num_vars;
+};
+
 struct __attribute__((__packed__)) wmp4warp_header_run {
         uint16_t   fsm_id;
         uint64_t   ts;
@@ -102,7 +202,7 @@ struct wmp4warp {
         uint16_t cmd_wait;
 
         char *fsm_file_name;
-        uint8_t fsm[MAX_FRAME_LENGTH];
+        uint8_t fsm[WMP4WARP_FSM_IMAGE_MAX_SIZE];
         uint16_t fsm_size;
         uint16_t fsm_id;
 
@@ -112,6 +212,19 @@ struct wmp4warp {
 
         uint32_t var_id;
 
+        uint8_t var_ids[WMP4WARP_MAX_VARS];
+        uint16_t num_vars;
+        uint32_t period_us;
+        uint16_t sub_flags;
+        uint32_t telemetry_count;
+        uint32_t telemetry_skipped;
+        uint32_t last_sample;
+
+        uint16_t xfer_id;
+        uint16_t ack_next_seq;
+        uint16_t ack_status;
+        uint32_t ack_crc;
+
         struct warpinfo *warplist;
 };
 
@@ -121,6 +234,8 @@ struct wmp4warp {
 #define WMP4WARP_ECHO_REP_L             (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)))
 #define WMP4WARP_FSM_LOAD_L             (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_fsm_load)))
 #define WMP4WARP_FSM_LOAD_CONF_L        (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_fsm_load_conf)))
+#define WMP4WARP_FSM_LOAD_FRAG_L        (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_fsm_load_frag)))
+#define WMP4WARP_FSM_LOAD_ACK_L         (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_fsm_load_ack)))
 #define WMP4WARP_FSM_DEL_L              (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_fsm_del)))
 #define WMP4WARP_FSM_DEL_CONF_L         (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_fsm_del_conf)))
 #define WMP4WARP_TS_REQ_L               (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)))
@@ -131,6 +246,28 @@ struct wmp4warp {
 #define WMP4WARP_RUN_ABS_CONF_L         (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_run_abs_conf)))
 #define WMP4WARP_READ_VAR_L             (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_read_var)))
 #define WMP4WARP_READ_VAR_REP_L         (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_read_var_rep)))
+#define WMP4WARP_READ_VARS_L            (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_read_vars)))
+#define WMP4WARP_READ_VARS_REP_L        (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_var_set)))
+#define WMP4WARP_SUBSCRIBE_L            (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_subscribe)))
+#define WMP4WARP_SUBSCRIBE_CONF_L       (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_subscribe_conf)))
+#define WMP4WARP_TELEMETRY_L            (MAC_HEADER_L + (sizeof(struct wmp4warp_header_common)) + (sizeof(struct wmp4warp_header_var_set)))
+
+
+/* CRC-32 (reflected, polynomial 0xEDB88320) of an FSM image, checked by the board
+ * against image_crc once all the fragments of a transfer are in */
+static inline uint32_t wmp4warp_crc32(const uint8_t *data, size_t len)
+{
+        uint32_t crc = 0xFFFFFFFF;
+        int k;
+
+        while (len--) {
+                crc ^= *data++;
+                for (k = 0; k < 8; k++) {
+                        crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+                }
+        }
 
+        return ~crc;
+}
 
 #endif /* _WMP4WARP_H_ */
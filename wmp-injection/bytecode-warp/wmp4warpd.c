@@ -0,0 +1,924 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <pcap/pcap.h>
+#include <sys/types.h>
+#ifdef __APPLE__
+#include <net/ethernet.h>
+#else
+#include <netinet/ether.h>
+#endif
+#include <arpa/inet.h>
+#include <string.h>
+
+#include "wmp4warp.h"
+
+/* ******************
+ * wmp4warp daemon
+ *
+ * Keeps one pcap session on the interface towards the boards and the
+ * warplist name-to-MAC table in memory, and serves commands received as
+ * text lines on a local stream socket:
+ *
+ *   <tag> FSM_LOAD <warp> <fsmid> <fsmfile>
+ *   <tag> FSM_DEL <warp> <fsmid>
+ *   <tag> RUN <warp> <fsmid> <us>
+ *   <tag> RUN_ABS <warp> <fsmid> <ts>
+ *   <tag> TS_REQ <warp>
+ *   <tag> READ_VAR <warp> <var_id>
+ *   <tag> RELOAD
+ *
+ * Identifiers are the ones of the wmp4warp command line (-l, -d, -r).
+ * Every command is answered by one line starting with the same tag,
+ * "<tag> OK ..." or "<tag> ERR ...", so a client may pipeline as many
+ * commands as it wants. Each frame carries a sequence number that the
+ * board echoes. The board does not recognise a frame sent twice, so only
+ * TS_REQ and READ_VAR are sent again after the timeout; the other commands
+ * are answered "ERR timeout" once all the retries would have elapsed, and
+ * the client has to check the board before trying again. A byte code too
+ * large for one frame goes as FSM_LOAD_FRAG fragments, acknowledged and
+ * sent again from the first one missing like wmp4warp -m does.
+ * usage: ./wmp4warpd -i eth1 -1 00:11:22:33:44:55 -S /tmp/wmp4warpd.sock
+ * ***************** */
+
+#define WMP4WARPD_SOCKET        "/tmp/wmp4warpd.sock"
+
+#define MAX_CLIENTS             16
+#define MAX_LINE_LENGTH         1024
+
+/* in flight requests, indexed by the low bits of their sequence number */
+#define MAX_PENDING             256
+
+struct client {
+        int fd;
+        char line[MAX_LINE_LENGTH];
+        size_t line_l;
+};
+
+struct pending {
+        int in_use;
+        uint16_t seq;
+        uint16_t cmd_wait;
+        int client;
+        char tag[32];
+        char warp_name[32];
+        uint8_t warp_mac_addr[6];
+        uint8_t frame[MAX_FRAME_LENGTH];
+        uint32_t frame_l;
+        uint64_t deadline;
+        int tries;
+        int resend;
+
+        /* FSM_LOAD cut in fragments, frame holds the headers of the next one */
+        uint8_t image[WMP4WARP_FSM_IMAGE_MAX_SIZE];
+        uint16_t image_l;
+        uint16_t frag_size;
+        uint16_t num_frags;
+        uint16_t base;          /* first fragment not acknowledged */
+        uint16_t next;          /* next fragment to send */
+};
+
+struct wmp4warpd {
+        char *out_interface_name;
+        uint8_t local_mac_addr[6];
+        char *socket_name;
+        char *warplist_name;
+        unsigned int timeout_ms;
+        int retries;
+
+        pcap_t *pcap;
+
+        struct warpinfo *warplist;
+        uint32_t warp_counter;
+
+        int listen_fd;
+        struct client clients[MAX_CLIENTS];
+
+        struct pending pending[MAX_PENDING];
+        uint16_t next_seq;
+        unsigned int in_flight;
+
+        unsigned long sent, retransmitted, answered, timed_out, unexpected;
+};
+
+static volatile sig_atomic_t stop;
+
+void static usage()
+{
+        fprintf(stdout, "----------------------\n");
+        fprintf(stdout, "wmp4warpd -i <int_name> -1 <MAC addr int> [-SftR]\n");
+        fprintf(stdout, "       -h    		: Print this help text\n");
+        fprintf(stdout, "       -i <int_name>   : int_name is the name of the output interface\n");
+        fprintf(stdout, "       -1 <MAC addr>   : source MAC address\n");
+        fprintf(stdout, "       -S <path>       : local socket for commands (default %s)\n", WMP4WARPD_SOCKET);
+        fprintf(stdout, "       -f <warplist>   : WARP list written by wmp4warp -e (default %s)\n", WARP_LIST_FILE_NAME);
+        fprintf(stdout, "       -t <ms>         : time to wait for an answer before sending again (default 100)\n");
+        fprintf(stdout, "       -R <n>          : retransmissions of TS_REQ, READ_VAR and FSM_LOAD fragments before a timeout (default 3)\n");
+        fprintf(stdout, "----------------------\n");
+}
+
+static void handle_signal(int sig)
+{
+        stop = 1;
+}
+
+static uint64_t now_ms()
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void client_close(struct wmp4warpd *w4wd, int client)
+{
+        int i;
+
+        close(w4wd->clients[client].fd);
+        w4wd->clients[client].fd = -1;
+
+        /* answers still in flight are dropped when they arrive, the slot may go to another client */
+        for (i = 0; i < MAX_PENDING; i++) {
+                if (w4wd->pending[i].in_use && w4wd->pending[i].client == client)
+                        w4wd->pending[i].client = -1;
+        }
+}
+
+static void client_reply(struct wmp4warpd *w4wd, int client, const char *fmt, ...)
+        __attribute__((format(printf, 3, 4)));
+
+static void client_reply(struct wmp4warpd *w4wd, int client, const char *fmt, ...)
+{
+        char line[MAX_LINE_LENGTH];
+        va_list ap;
+        int len;
+
+        if (client < 0 || w4wd->clients[client].fd < 0)
+                return;
+
+        va_start(ap, fmt);
+        len = vsnprintf(line, sizeof(line) - 1, fmt, ap);
+        va_end(ap);
+
+        if (len < 0)
+                return;
+        if (len > sizeof(line) - 2)
+                len = sizeof(line) - 2;
+        line[len++] = '\n';
+
+        /* replies are short, a client that does not read them is dropped */
+        if (send(w4wd->clients[client].fd, line, len, MSG_NOSIGNAL | MSG_DONTWAIT) != len)
+                client_close(w4wd, client);
+}
+
+static void free_warplist(struct warpinfo *warplist, uint32_t warp_counter)
+{
+        uint32_t c;
+
+        for (c = 0; c < warp_counter; c++)
+                free(warplist[c].name);
+        free(warplist);
+}
+
+static int load_warplist(struct wmp4warpd *w4wd)
+{
+        char *file_buf = NULL;
+        size_t len = 0;
+        uint32_t warpid;
+        uint32_t c = 0;
+        unsigned int mac[6];
+        int k;
+        char warpname[1024];
+        struct warpinfo *warplist = NULL;
+        FILE *warp_list_file = fopen(w4wd->warplist_name, "r");
+
+        if (!warp_list_file) {
+                fprintf(stderr, "%s does not exist (run wmp4warp -e first)\n", w4wd->warplist_name);
+                return -1;
+        }
+
+        while (getline(&file_buf, &len, warp_list_file) != -1) {
+                if (sscanf(file_buf, "warp%u:%02X:%02X:%02X:%02X:%02X:%02X",
+                    &warpid, &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]) != 7)
+                        continue;
+
+                warplist = realloc(warplist, sizeof(struct warpinfo) * (c + 1));
+                if (!warplist) {
+                        fprintf(stderr, "Memory allocation error\n");
+                        exit(-1);
+                }
+
+                sprintf(warpname, "warp%u", warpid);
+                warplist[c].name = strdup(warpname);
+                for (k = 0; k < 6; k++)
+                        warplist[c].mac_addr[k] = mac[k];
+                c++;
+        }
+
+        free(file_buf);
+        fclose(warp_list_file);
+
+        /* in flight requests hold their own copy of the name */
+        free_warplist(w4wd->warplist, w4wd->warp_counter);
+        w4wd->warplist = warplist;
+        w4wd->warp_counter = c;
+
+        return c;
+}
+
+static struct warpinfo *find_warp(struct wmp4warpd *w4wd, const char *name)
+{
+        uint32_t c;
+
+        for (c = 0; c < w4wd->warp_counter; c++) {
+                if (!strcmp(name, w4wd->warplist[c].name))
+                        return &w4wd->warplist[c];
+        }
+
+        return NULL;
+}
+
+static int hex_to_bin(const char *hex, size_t l, uint8_t *bc, size_t *counter, size_t size)
+{
+        unsigned int byte;
+        size_t k;
+
+        if (l % 2 || *counter + l / 2 > size)
+                return -1;
+
+        for (k = 0; k < l; k += 2) {
+                if (sscanf(&hex[k], "%2x", &byte) != 1)
+                        return -1;
+                bc[(*counter)++] = byte;
+        }
+
+        return 0;
+}
+
+/*
+ * Same conversion as print_fsm_bin() in wmp4warp.c, done in memory: tags
+ * 000004 and 000010 are followed by one halfword, tag 000006 by the
+ * transitions up to '$', comments and empty lines are skipped.
+ */
+static int fsm_text_to_bin(const char *filename, uint8_t *bc, size_t size)
+{
+        char line[256];
+        size_t counter = 0;
+        size_t l;
+        FILE *in_f = fopen(filename, "r");
+
+        if (!in_f)
+                return -1;
+
+        while (fgets(line, sizeof(line), in_f)) {
+                if (line[0] == '#' || line[0] == '\n' || line[0] == '\r')
+                        continue;
+
+                l = strcspn(line, "\r\n");
+                if (hex_to_bin(line, l, bc, &counter, size) < 0)
+                        goto error;
+
+                if (!strncmp(line, "000004", 6) || !strncmp(line, "000010", 6)) {
+                        if (!fgets(line, sizeof(line), in_f) || hex_to_bin(line, 4, bc, &counter, size) < 0)
+                                goto error;
+                } else if (!strncmp(line, "000006", 6)) {
+                        if (!fgets(line, sizeof(line), in_f))
+                                goto error;
+                        l = strcspn(line, "$\r\n");
+                        if (hex_to_bin(line, l, bc, &counter, size) < 0)
+                                goto error;
+                }
+        }
+
+        fclose(in_f);
+        return counter;
+
+error:
+        fclose(in_f);
+        return -1;
+}
+
+static struct pending *pending_alloc(struct wmp4warpd *w4wd)
+{
+        struct pending *p = &w4wd->pending[w4wd->next_seq % MAX_PENDING];
+
+        /* sequence numbers are handed out in order, so the next slot is the oldest one */
+        if (p->in_use)
+                return NULL;
+
+        memset(p, 0, sizeof(*p));
+        p->in_use = 1;
+        p->seq = w4wd->next_seq++;
+        w4wd->in_flight++;
+
+        return p;
+}
+
+static void pending_free(struct wmp4warpd *w4wd, struct pending *p)
+{
+        p->in_use = 0;
+        w4wd->in_flight--;
+}
+
+/* Sends the fragments of p from p->next on, keeping at most
+ * WMP4WARP_FSM_LOAD_WINDOW of them past the first one not acknowledged. */
+static int send_fragments(struct wmp4warpd *w4wd, struct pending *p)
+{
+        struct wmp4warp_header_fsm_load_frag *frag_hdr = (struct wmp4warp_header_fsm_load_frag *)
+                (p->frame + sizeof(struct packet_header) + sizeof(struct wmp4warp_header_common));
+        uint8_t *frag = (uint8_t *) frag_hdr + sizeof(*frag_hdr);
+        uint16_t seq;
+
+        while (p->next < p->num_frags && p->next < p->base + WMP4WARP_FSM_LOAD_WINDOW) {
+                seq = p->next;
+                frag_hdr->frag_seq = seq;
+                frag_hdr->frag_l = seq == p->num_frags - 1 ? p->image_l - seq * p->frag_size : p->frag_size;
+                memcpy(frag, p->image + seq * p->frag_size, frag_hdr->frag_l);
+
+                if (pcap_inject(w4wd->pcap, p->frame, WMP4WARP_FSM_LOAD_FRAG_L + frag_hdr->frag_l) == -1) {
+                        fprintf(stderr, "pcap_inject: %s\n", pcap_geterr(w4wd->pcap));
+                        return -1;
+                }
+                p->next++;
+        }
+
+        p->deadline = now_ms() + w4wd->timeout_ms;
+        return 0;
+}
+
+static int send_frame(struct wmp4warpd *w4wd, struct pending *p)
+{
+        /* the board keeps the fragments it has, so sending again starts at the first one missing */
+        if (p->num_frags) {
+                p->next = p->base;
+                p->tries++;
+                return send_fragments(w4wd, p);
+        }
+
+        if (pcap_inject(w4wd->pcap, p->frame, p->frame_l) == -1) {
+                fprintf(stderr, "pcap_inject: %s\n", pcap_geterr(w4wd->pcap));
+                return -1;
+        }
+
+        /* a command that is not sent again gets the time of all the retries at once */
+        if (p->resend) {
+                p->deadline = now_ms() + w4wd->timeout_ms;
+                p->tries++;
+        } else {
+                p->deadline = now_ms() + (uint64_t)w4wd->timeout_ms * (w4wd->retries + 1);
+                p->tries = w4wd->retries + 1;
+        }
+
+        return 0;
+}
+
+static void handle_command(struct wmp4warpd *w4wd, int client, char *line)
+{
+        char *argv[8];
+        int argc = 0;
+        char *tok, *save;
+        struct warpinfo *warp;
+        struct pending *p;
+        struct packet_header *mac_header;
+        struct wmp4warp_header_common *w4w_hdr_cmn;
+        uint8_t *payload;
+        uint16_t cmd;
+
+        for (tok = strtok_r(line, " \t", &save); tok && argc < 8; tok = strtok_r(NULL, " \t", &save))
+                argv[argc++] = tok;
+
+        if (argc == 0)
+                return;
+
+        if (argc < 2) {
+                client_reply(w4wd, client, "%s ERR missing command", argv[0]);
+                return;
+        }
+
+        if (!strcmp(argv[1], "RELOAD")) {
+                if (load_warplist(w4wd) < 0)
+                        client_reply(w4wd, client, "%s ERR cannot read %s", argv[0], w4wd->warplist_name);
+                else
+                        client_reply(w4wd, client, "%s OK RELOAD %u", argv[0], w4wd->warp_counter);
+                return;
+        }
+
+        if (!strcmp(argv[1], "FSM_LOAD") && argc == 5) {
+                cmd = WMP4WARP_FSM_LOAD;
+        } else if (!strcmp(argv[1], "FSM_DEL") && argc == 4) {
+                cmd = WMP4WARP_FSM_DEL;
+        } else if (!strcmp(argv[1], "RUN") && argc == 5) {
+                cmd = WMP4WARP_RUN;
+        } else if (!strcmp(argv[1], "RUN_ABS") && argc == 5) {
+                cmd = WMP4WARP_RUN_ABS;
+        } else if (!strcmp(argv[1], "TS_REQ") && argc == 3) {
+                cmd = WMP4WARP_TS_REQ;
+        } else if (!strcmp(argv[1], "READ_VAR") && argc == 4) {
+                cmd = WMP4WARP_READ_VAR;
+        } else {
+                client_reply(w4wd, client, "%s ERR bad command", argv[0]);
+                return;
+        }
+
+        warp = find_warp(w4wd, argv[2]);
+        if (!warp) {
+                client_reply(w4wd, client, "%s ERR unknown WARP %s", argv[0], argv[2]);
+                return;
+        }
+
+        p = pending_alloc(w4wd);
+        if (!p) {
+                client_reply(w4wd, client, "%s ERR busy", argv[0]);
+                return;
+        }
+
+        snprintf(p->tag, sizeof(p->tag), "%s", argv[0]);
+        p->client = client;
+        snprintf(p->warp_name, sizeof(p->warp_name), "%s", warp->name);
+        memcpy(p->warp_mac_addr, warp->mac_addr, sizeof(p->warp_mac_addr));
+
+        mac_header = (struct packet_header *) p->frame;
+        memcpy(mac_header->mac_dst, warp->mac_addr, sizeof(mac_header->mac_dst));
+        memcpy(mac_header->mac_src, w4wd->local_mac_addr, sizeof(mac_header->mac_src));
+        mac_header->ether_type = htons(WMP4WARP_ETHER_TYPE);
+        w4w_hdr_cmn = (struct wmp4warp_header_common *) (p->frame + sizeof(struct packet_header));
+        w4w_hdr_cmn->cmd_id = cmd;
+        w4w_hdr_cmn->seq = p->seq;
+        memcpy(w4w_hdr_cmn->mac_addr, w4wd->local_mac_addr, sizeof(w4w_hdr_cmn->mac_addr));
+        payload = p->frame + sizeof(struct packet_header) + sizeof(struct wmp4warp_header_common);
+
+        switch (cmd) {
+        case WMP4WARP_FSM_LOAD: {
+                struct wmp4warp_header_fsm_load *fsm_load_hdr = (struct wmp4warp_header_fsm_load *) payload;
+                struct wmp4warp_header_fsm_load_frag *frag_hdr = (struct wmp4warp_header_fsm_load_frag *) payload;
+                int fsm_size = fsm_text_to_bin(argv[4], p->image, sizeof(p->image));
+
+                if (fsm_size < 0) {
+                        client_reply(w4wd, client, "%s ERR cannot convert %s (at most %d bytes)", argv[0], argv[4],
+                                WMP4WARP_FSM_IMAGE_MAX_SIZE);
+                        pending_free(w4wd, p);
+                        return;
+                }
+
+                if (WMP4WARP_FSM_LOAD_L + fsm_size <= MAX_FRAME_LENGTH) {
+                        fsm_load_hdr->fsm_id = atoi(argv[3]) - 1;
+                        fsm_load_hdr->fsm_l = fsm_size;
+                        memcpy(payload + sizeof(*fsm_load_hdr), p->image, fsm_size);
+                        p->frame_l = WMP4WARP_FSM_LOAD_L + fsm_size;
+                        p->cmd_wait = WMP4WARP_FSM_LOAD_CONF;
+                        break;
+                }
+
+                /* the board tells transfers apart by xfer_id, keep it away from those of an earlier run */
+                p->image_l = fsm_size;
+                p->frag_size = MAX_FRAME_LENGTH - WMP4WARP_FSM_LOAD_FRAG_L;
+                p->num_frags = (p->image_l + p->frag_size - 1) / p->frag_size;
+                w4w_hdr_cmn->cmd_id = WMP4WARP_FSM_LOAD_FRAG;
+                frag_hdr->fsm_id = atoi(argv[3]) - 1;
+                frag_hdr->xfer_id = (uint16_t)(getpid() ^ time(NULL)) + p->seq;
+                frag_hdr->image_l = p->image_l;
+                frag_hdr->frag_size = p->frag_size;
+                frag_hdr->image_crc = wmp4warp_crc32(p->image, p->image_l);
+                p->cmd_wait = WMP4WARP_FSM_LOAD_ACK;
+                p->resend = 1;
+                break;
+        }
+
+        case WMP4WARP_FSM_DEL: {
+                struct wmp4warp_header_fsm_del *fsm_del_hdr = (struct wmp4warp_header_fsm_del *) payload;
+
+                fsm_del_hdr->fsm_id = atoi(argv[3]);
+                p->frame_l = WMP4WARP_FSM_DEL_L;
+                p->cmd_wait = WMP4WARP_FSM_DEL_CONF;
+                break;
+        }
+
+        case WMP4WARP_RUN: {
+                struct wmp4warp_header_run *run_hdr = (struct wmp4warp_header_run *) payload;
+
+                run_hdr->fsm_id = atoi(argv[3]) - 1;
+                run_hdr->ts = strtoull(argv[4], NULL, 10);
+                p->frame_l = WMP4WARP_RUN_L;
+                p->cmd_wait = WMP4WARP_RUN_CONF;
+                break;
+        }
+
+        case WMP4WARP_RUN_ABS: {
+                struct wmp4warp_header_run_abs *run_hdr = (struct wmp4warp_header_run_abs *) payload;
+
+                run_hdr->fsm_id = atoi(argv[3]) - 1;
+                run_hdr->ts = strtoull(argv[4], NULL, 10);
+                p->frame_l = WMP4WARP_RUN_ABS_L;
+                p->cmd_wait = WMP4WARP_RUN_ABS_CONF;
+                break;
+        }
+
+        case WMP4WARP_TS_REQ:
+                p->frame_l = WMP4WARP_TS_REQ_L;
+                p->cmd_wait = WMP4WARP_TS_REP;
+                p->resend = 1;
+                break;
+
+        case WMP4WARP_READ_VAR: {
+                struct wmp4warp_header_read_var *read_hdr = (struct wmp4warp_header_read_var *) payload;
+
+                read_hdr->var_id = atoi(argv[3]) - 1;
+                p->frame_l = WMP4WARP_READ_VAR_L;
+                p->cmd_wait = WMP4WARP_READ_VAR_REP;
+                p->resend = 1;
+                break;
+        }
+        }
+
+        if (send_frame(w4wd, p) < 0) {
+                client_reply(w4wd, client, "%s ERR send failed", p->tag);
+                pending_free(w4wd, p);
+                return;
+        }
+        w4wd->sent++;
+}
+
+static void resp_handler(u_char *user, const struct pcap_pkthdr *h, const u_char *bytes)
+{
+        struct wmp4warpd *w4wd = (struct wmp4warpd *) user;
+        struct packet_header *mac_header = (struct packet_header *) (bytes);
+        struct wmp4warp_header_common *w4w_hdr_cmn =
+                (struct wmp4warp_header_common *) (bytes + sizeof(struct packet_header));
+        const u_char *payload = bytes + sizeof(struct packet_header) + sizeof(struct wmp4warp_header_common);
+        struct pending *p;
+
+        if (h->caplen < sizeof(struct packet_header) + sizeof(struct wmp4warp_header_common)) {
+                w4wd->unexpected++;
+                return;
+        }
+
+        p = &w4wd->pending[w4w_hdr_cmn->seq % MAX_PENDING];
+
+        /* late answers to a retransmitted or timed out request end up here */
+        if (!p->in_use || p->seq != w4w_hdr_cmn->seq || p->cmd_wait != w4w_hdr_cmn->cmd_id ||
+            memcmp(mac_header->mac_src, p->warp_mac_addr, sizeof(p->warp_mac_addr))) {
+                w4wd->unexpected++;
+                return;
+        }
+
+        switch (w4w_hdr_cmn->cmd_id) {
+        case WMP4WARP_FSM_LOAD_CONF: {
+                const struct wmp4warp_header_fsm_load_conf *conf = (const void *) payload;
+
+                client_reply(w4wd, p->client, "%s OK %s FSM_LOAD %d", p->tag, p->warp_name, conf->fsm_id + 1);
+                break;
+        }
+
+        case WMP4WARP_FSM_LOAD_ACK: {
+                const struct wmp4warp_header_fsm_load_ack *ack = (const void *) payload;
+                const struct wmp4warp_header_fsm_load_frag *frag_hdr = (const void *)
+                        (p->frame + sizeof(struct packet_header) + sizeof(struct wmp4warp_header_common));
+
+                if (h->caplen < WMP4WARP_FSM_LOAD_ACK_L || ack->xfer_id != frag_hdr->xfer_id) {
+                        w4wd->unexpected++;
+                        return;
+                }
+
+                if (ack->status == WMP4WARP_FSM_LOAD_PENDING) {
+                        /* acks of a window may be reordered, the first fragment missing only moves forward */
+                        if (ack->next_seq > p->base && ack->next_seq <= p->num_frags) {
+                                p->base = ack->next_seq;
+                                p->tries = 1;
+                                if (send_fragments(w4wd, p) < 0) {
+                                        client_reply(w4wd, p->client, "%s ERR send failed", p->tag);
+                                        pending_free(w4wd, p);
+                                }
+                        }
+                        return;
+                }
+
+                if (ack->status == WMP4WARP_FSM_LOAD_DONE)
+                        client_reply(w4wd, p->client, "%s OK %s FSM_LOAD %d", p->tag, p->warp_name, ack->fsm_id + 1);
+                else
+                        client_reply(w4wd, p->client, "%s ERR %s FSM_LOAD %s", p->tag, p->warp_name,
+                                ack->status == WMP4WARP_FSM_LOAD_BAD_CRC ? "bad CRC" : "rejected");
+                break;
+        }
+
+        case WMP4WARP_FSM_DEL_CONF: {
+                const struct wmp4warp_header_fsm_del_conf *conf = (const void *) payload;
+
+                client_reply(w4wd, p->client, "%s OK %s FSM_DEL %d", p->tag, p->warp_name, conf->fsm_id);
+                break;
+        }
+
+        case WMP4WARP_TS_REP: {
+                const struct wmp4warp_header_ts_rep *rep = (const void *) payload;
+
+                client_reply(w4wd, p->client, "%s OK %s TS %llu", p->tag, p->warp_name,
+                        (unsigned long long)rep->ts);
+                break;
+        }
+
+        case WMP4WARP_RUN_CONF:
+        case WMP4WARP_RUN_ABS_CONF: {
+                const struct wmp4warp_header_run_conf *conf = (const void *) payload;
+
+                client_reply(w4wd, p->client, "%s OK %s %s %d %llu", p->tag, p->warp_name,
+                        w4w_hdr_cmn->cmd_id == WMP4WARP_RUN_CONF ? "RUN" : "RUN_ABS",
+                        conf->fsm_id + 1, (unsigned long long)conf->ts);
+                break;
+        }
+
+        case WMP4WARP_READ_VAR_REP: {
+                const struct wmp4warp_header_read_var_rep *rep = (const void *) payload;
+
+                client_reply(w4wd, p->client, "%s OK %s READ_VAR %u %hu", p->tag, p->warp_name,
+                        rep->var_id + 1, rep->var_value);
+                break;
+        }
+        }
+
+        w4wd->answered++;
+        pending_free(w4wd, p);
+}
+
+/* Retransmits expired requests that can be sent again, times out the
+ * others, and returns the time to the next deadline. */
+static int check_timeouts(struct wmp4warpd *w4wd)
+{
+        uint64_t now = now_ms();
+        uint64_t next = now + 1000;
+        struct pending *p;
+        int i;
+
+        if (!w4wd->in_flight)
+                return -1;
+
+        for (i = 0; i < MAX_PENDING; i++) {
+                p = &w4wd->pending[i];
+                if (!p->in_use)
+                        continue;
+
+                if (p->deadline <= now) {
+                        if (p->tries > w4wd->retries || p->client < 0) {
+                                client_reply(w4wd, p->client, "%s ERR timeout", p->tag);
+                                w4wd->timed_out++;
+                                pending_free(w4wd, p);
+                                continue;
+                        }
+                        if (send_frame(w4wd, p) < 0) {
+                                client_reply(w4wd, p->client, "%s ERR send failed", p->tag);
+                                pending_free(w4wd, p);
+                                continue;
+                        }
+                        w4wd->retransmitted++;
+                }
+
+                if (p->deadline < next)
+                        next = p->deadline;
+        }
+
+        return next > now ? next - now : 0;
+}
+
+static void handle_client(struct wmp4warpd *w4wd, int client)
+{
+        struct client *cl = &w4wd->clients[client];
+        char *start, *end;
+        ssize_t n;
+
+        n = read(cl->fd, cl->line + cl->line_l, sizeof(cl->line) - 1 - cl->line_l);
+        if (n <= 0) {
+                if (n < 0 && (errno == EAGAIN || errno == EINTR))
+                        return;
+                client_close(w4wd, client);
+                return;
+        }
+        cl->line_l += n;
+        cl->line[cl->line_l] = '\0';
+
+        start = cl->line;
+        while ((end = strchr(start, '\n'))) {
+                *end = '\0';
+                if (end > start && end[-1] == '\r')
+                        end[-1] = '\0';
+                handle_command(w4wd, client, start);
+                if (cl->fd < 0)
+                        return;
+                start = end + 1;
+        }
+
+        cl->line_l -= start - cl->line;
+        memmove(cl->line, start, cl->line_l);
+
+        if (cl->line_l == sizeof(cl->line) - 1) {
+                client_reply(w4wd, client, "- ERR line too long");
+                cl->line_l = 0;
+        }
+}
+
+static void accept_client(struct wmp4warpd *w4wd)
+{
+        int fd = accept(w4wd->listen_fd, NULL, NULL);
+        int i;
+
+        if (fd < 0)
+                return;
+
+        for (i = 0; i < MAX_CLIENTS; i++) {
+                if (w4wd->clients[i].fd < 0) {
+                        w4wd->clients[i].fd = fd;
+                        w4wd->clients[i].line_l = 0;
+                        return;
+                }
+        }
+
+        fprintf(stderr, "Too many clients\n");
+        close(fd);
+}
+
+static int open_socket(const char *name)
+{
+        struct sockaddr_un addr;
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+        if (fd < 0) {
+                perror("socket");
+                exit(1);
+        }
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, name, sizeof(addr.sun_path) - 1);
+        unlink(name);
+
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, MAX_CLIENTS) < 0) {
+                perror(name);
+                exit(1);
+        }
+
+        return fd;
+}
+
+int main (int argc, char **argv)
+{
+        int c, i, n;
+        char errbuf[PCAP_ERRBUF_SIZE];
+        struct ether_addr *macaddr;
+        struct bpf_program fp;
+        static char pcap_filter_str[1024];
+        static struct wmp4warpd w4wd;
+        struct pollfd fds[MAX_CLIENTS + 2];
+        int client_of[MAX_CLIENTS + 2];
+        int pcap_fd, timeout, nfds;
+
+        w4wd.out_interface_name = "eth1";
+        w4wd.socket_name = WMP4WARPD_SOCKET;
+        w4wd.warplist_name = WARP_LIST_FILE_NAME;
+        w4wd.timeout_ms = 100;
+        w4wd.retries = 3;
+
+        while ((c = getopt(argc, argv, "i:1:S:f:t:R:h")) != -1) {
+                switch (c) {
+                case 'i':
+                        w4wd.out_interface_name = optarg;
+                break;
+
+                case '1':
+                        macaddr = ether_aton(optarg);
+                        if (!macaddr) {
+                                fprintf(stderr, "Invalid MAC address %s\n", optarg);
+                                exit(1);
+                        }
+                        memcpy(w4wd.local_mac_addr, macaddr->ether_addr_octet,
+                                sizeof(w4wd.local_mac_addr));
+                break;
+
+                case 'S':
+                        w4wd.socket_name = optarg;
+                break;
+
+                case 'f':
+                        w4wd.warplist_name = optarg;
+                break;
+
+                case 't':
+                        w4wd.timeout_ms = atoi(optarg);
+                break;
+
+                case 'R':
+                        w4wd.retries = atoi(optarg);
+                break;
+
+                case 'h':
+                        usage();
+                        exit(1);
+                break;
+
+                default:
+                        usage();
+                        exit(1);
+                break;
+                }
+        }
+
+        if (load_warplist(&w4wd) < 0)
+                exit(1);
+        fprintf(stdout, "%u WARP boards in %s\n", w4wd.warp_counter, w4wd.warplist_name);
+
+        w4wd.pcap = pcap_open_live(w4wd.out_interface_name, MAX_FRAME_LENGTH, 1, 10, errbuf);
+        if (!w4wd.pcap) {
+                fprintf(stderr, "%s\n", errbuf);
+                exit(1);
+        }
+
+        sprintf(pcap_filter_str, "(ether proto " WMP4WARP_ETHER_TYPE_STR ") and (ether dst %02x:%02x:%02x:%02x:%02x:%02x)",
+            w4wd.local_mac_addr[0], w4wd.local_mac_addr[1], w4wd.local_mac_addr[2],
+            w4wd.local_mac_addr[3], w4wd.local_mac_addr[4], w4wd.local_mac_addr[5]);
+
+        if (pcap_compile(w4wd.pcap, &fp, pcap_filter_str, 0, PCAP_NETMASK_UNKNOWN) == -1) {
+                fprintf(stderr, "Error calling pcap_compile\n");
+                exit(-1);
+        }
+
+        if (pcap_setfilter(w4wd.pcap, &fp) == -1) {
+                fprintf(stderr, "Error calling pcap_setfilter\n");
+                exit(-1);
+        }
+        pcap_freecode(&fp);
+
+        if (pcap_setnonblock(w4wd.pcap, 1, errbuf) == -1) {
+                fprintf(stderr, "%s\n", errbuf);
+                exit(-1);
+        }
+
+        pcap_fd = pcap_get_selectable_fd(w4wd.pcap);
+        if (pcap_fd < 0) {
+                fprintf(stderr, "%s cannot be polled\n", w4wd.out_interface_name);
+                exit(-1);
+        }
+
+        for (i = 0; i < MAX_CLIENTS; i++)
+                w4wd.clients[i].fd = -1;
+        w4wd.listen_fd = open_socket(w4wd.socket_name);
+
+        signal(SIGINT, handle_signal);
+        signal(SIGTERM, handle_signal);
+
+        fprintf(stdout, "Listening on %s, commands on %s\n", w4wd.out_interface_name, w4wd.socket_name);
+        fflush(stdout);
+
+        while (!stop) {
+                nfds = 0;
+                fds[nfds].fd = pcap_fd;
+                fds[nfds].events = POLLIN;
+                client_of[nfds++] = -1;
+                fds[nfds].fd = w4wd.listen_fd;
+                fds[nfds].events = POLLIN;
+                client_of[nfds++] = -1;
+                for (i = 0; i < MAX_CLIENTS; i++) {
+                        if (w4wd.clients[i].fd < 0)
+                                continue;
+                        fds[nfds].fd = w4wd.clients[i].fd;
+                        fds[nfds].events = POLLIN;
+                        client_of[nfds++] = i;
+                }
+
+                timeout = check_timeouts(&w4wd);
+                /* some capture devices only deliver packets on their own timeout */
+                if (w4wd.in_flight && (timeout < 0 || timeout > 10))
+                        timeout = 10;
+
+                n = poll(fds, nfds, timeout);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        perror("poll");
+                        break;
+                }
+
+                if (w4wd.in_flight || (fds[0].revents & POLLIN))
+                        pcap_dispatch(w4wd.pcap, -1, resp_handler, (u_char *)&w4wd);
+
+                if (fds[1].revents & POLLIN)
+                        accept_client(&w4wd);
+
+                for (i = 2; i < nfds; i++) {
+                        if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+                                handle_client(&w4wd, client_of[i]);
+                }
+        }
+
+        fprintf(stdout, "%lu sent, %lu retransmitted, %lu answered, %lu timed out, %lu unexpected\n",
+                w4wd.sent, w4wd.retransmitted, w4wd.answered, w4wd.timed_out, w4wd.unexpected);
+
+        close(w4wd.listen_fd);
+        unlink(w4wd.socket_name);
+        pcap_close(w4wd.pcap);
+        free_warplist(w4wd.warplist, w4wd.warp_counter);
+
+        return 0;
+}
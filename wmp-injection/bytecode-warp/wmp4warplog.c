@@ -0,0 +1,473 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
+
+/* ******************
+ * WARP event log receiver
+ *
+ * Pulls the event log of a board running the WARPNet WLAN Exp node with
+ * NODE_LOG_STREAM_START. The board sends the log from its main loop, a
+ * few numbered packets at a time, and never has more than a window of
+ * packets unacknowledged. Every packet received is acknowledged with the
+ * number of packets received in order and a bitmap of the ones received
+ * after the first gap, so the board resends only the missing packets.
+ * The log bytes are written to the output file in order, as received by
+ * NODE_LOG_GET_EVENTS.
+ * usage: ./wmp4warplog -a 10.0.0.1 -o log.bin
+ * ***************** */
+
+/* WARPNet transport */
+#define WN_PAYLOAD_PAD_NBYTES           2
+#define WN_TRANSPORT_HDR_L              12
+#define WN_CMD_HDR_L                    8
+#define WN_ARGS_OFFSET                  (WN_PAYLOAD_PAD_NBYTES + WN_TRANSPORT_HDR_L + WN_CMD_HDR_L)
+#define WN_PKTTYPE_HTON_MSG             1
+#define WN_TRANSPORT_ROBUST             0x1
+#define WN_BROADCAST_ID                 0xFFFF
+#define WN_HOST_ID                      0xFFFE
+#define WN_NODE_GRP                     0x00
+#define WN_UNICAST_PORT                 9000
+#define WN_MAX_PACKET_L                 1514
+
+/* WLAN Exp node commands (wlan_exp_node.h) */
+#define NODE_LOG_STREAM_START           59
+#define NODE_LOG_STREAM_ACK             60
+#define NODE_LOG_STREAM_STOP            61
+#define NODE_LOG_STREAM_DATA            62
+
+#define NODE_LOG_STREAM_MAX_WINDOW      32
+#define NODE_LOG_STREAM_FLAG_OVERWRITTEN 0x80000000
+
+#define DATA_ARGS                       6
+
+struct pending_pkt {
+        int valid;
+        uint32_t size;
+        uint8_t data[WN_MAX_PACKET_L];
+};
+
+struct wmp4warplog {
+        int fd;
+        struct sockaddr_in node_addr;
+        uint16_t node_id;
+        uint16_t seq;
+
+        uint32_t buffer_id;
+        uint32_t first_event_id;
+        uint32_t num_events;
+        uint32_t window;
+        uint32_t budget;
+        unsigned int ack_every;
+        unsigned int timeout_ms;
+        int retries;
+
+        FILE *out;
+
+        int started;
+        uint32_t num_pkts;
+        uint32_t delivered;
+        struct pending_pkt pending[NODE_LOG_STREAM_MAX_WINDOW];
+        unsigned int unacked;
+
+        unsigned long received, duplicates, out_of_order, acks, bytes;
+        int overwritten;
+};
+
+void static usage()
+{
+        fprintf(stdout, "----------------------\n");
+        fprintf(stdout, "wmp4warplog -a <node IP> -o <file> [-pnBecwbkt]\n");
+        fprintf(stdout, "       -h    		: Print this help text\n");
+        fprintf(stdout, "       -a <IP>         : IP address of the node\n");
+        fprintf(stdout, "       -p <port>       : WARPNet unicast port of the node (default %d)\n", WN_UNICAST_PORT);
+        fprintf(stdout, "       -n <node>       : WARPNet node ID (default broadcast)\n");
+        fprintf(stdout, "       -o <file>       : output file for the log bytes\n");
+        fprintf(stdout, "       -B <id>         : buffer ID (default 1)\n");
+        fprintf(stdout, "       -e <event_id>   : first event (default 0, the oldest in the log)\n");
+        fprintf(stdout, "       -c <events>     : number of events (default all)\n");
+        fprintf(stdout, "       -w <packets>    : packets in flight (default: node default)\n");
+        fprintf(stdout, "       -b <packets>    : packets the node sends per poll (default: node default)\n");
+        fprintf(stdout, "       -k <packets>    : acknowledge every k packets received in order (default 4)\n");
+        fprintf(stdout, "       -t <ms>         : silence before acknowledging again or restarting (default 20)\n");
+        fprintf(stdout, "----------------------\n");
+}
+
+static uint64_t now_ms()
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+        p[0] = v >> 8;
+        p[1] = v;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+        p[0] = v >> 24;
+        p[1] = v >> 16;
+        p[2] = v >> 8;
+        p[3] = v;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+        return (p[0] << 8) | p[1];
+}
+
+static int send_cmd(struct wmp4warplog *w4wl, uint32_t cmd, const uint32_t *args, int num_args, int robust)
+{
+        uint8_t pkt[WN_ARGS_OFFSET + 16 * 4];
+        uint8_t *hdr = pkt + WN_PAYLOAD_PAD_NBYTES;
+        uint16_t args_l = num_args * 4;
+        int i;
+
+        memset(pkt, 0, sizeof(pkt));
+
+        put_u16(hdr, w4wl->node_id);
+        put_u16(hdr + 2, WN_HOST_ID);
+        hdr[5] = WN_PKTTYPE_HTON_MSG;
+        put_u16(hdr + 6, WN_CMD_HDR_L + args_l);
+        put_u16(hdr + 8, w4wl->seq++);
+        put_u16(hdr + 10, robust ? WN_TRANSPORT_ROBUST : 0);
+
+        put_u32(hdr + WN_TRANSPORT_HDR_L, (WN_NODE_GRP << 24) | cmd);
+        put_u16(hdr + WN_TRANSPORT_HDR_L + 4, args_l);
+        put_u16(hdr + WN_TRANSPORT_HDR_L + 6, num_args);
+
+        for (i = 0; i < num_args; i++)
+                put_u32(pkt + WN_ARGS_OFFSET + i * 4, args[i]);
+
+        if (sendto(w4wl->fd, pkt, WN_ARGS_OFFSET + args_l, 0,
+                   (struct sockaddr *)&w4wl->node_addr, sizeof(w4wl->node_addr)) < 0) {
+                perror("sendto");
+                return -1;
+        }
+
+        return 0;
+}
+
+static int send_start(struct wmp4warplog *w4wl)
+{
+        uint32_t args[6] = { w4wl->buffer_id, 0, w4wl->first_event_id, w4wl->num_events, w4wl->window, w4wl->budget };
+
+        return send_cmd(w4wl, NODE_LOG_STREAM_START, args, 6, 1);
+}
+
+static int send_ack(struct wmp4warplog *w4wl)
+{
+        uint32_t args[3] = { w4wl->buffer_id, w4wl->delivered, 0 };
+        int i;
+
+        for (i = 0; i < 32; i++) {
+                uint32_t seq = w4wl->delivered + 1 + i;
+
+                if (w4wl->pending[seq % NODE_LOG_STREAM_MAX_WINDOW].valid)
+                        args[2] |= 1u << i;
+        }
+
+        w4wl->unacked = 0;
+        w4wl->acks++;
+
+        return send_cmd(w4wl, NODE_LOG_STREAM_ACK, args, 3, 0);
+}
+
+static int deliver(struct wmp4warplog *w4wl)
+{
+        struct pending_pkt *p;
+
+        for (;;) {
+                p = &w4wl->pending[w4wl->delivered % NODE_LOG_STREAM_MAX_WINDOW];
+                if (!p->valid)
+                        break;
+
+                if (p->size && fwrite(p->data, p->size, 1, w4wl->out) != 1) {
+                        perror("fwrite");
+                        return -1;
+                }
+
+                w4wl->bytes += p->size;
+                p->valid = 0;
+                w4wl->delivered++;
+                w4wl->unacked++;
+        }
+
+        return 0;
+}
+
+/* returns 1 if an acknowledgement is due */
+static int handle_data(struct wmp4warplog *w4wl, const uint8_t *args, size_t args_l)
+{
+        uint32_t flags, seq, num_pkts, size;
+        struct pending_pkt *p;
+
+        if (args_l < DATA_ARGS * 4)
+                return 0;
+
+        if (get_u32(args) != w4wl->buffer_id)
+                return 0;
+
+        flags = get_u32(args + 4);
+        seq = get_u32(args + 8);
+        num_pkts = get_u32(args + 12);
+        size = get_u32(args + 20);
+
+        if (size > args_l - DATA_ARGS * 4 || size > WN_MAX_PACKET_L)
+                return 0;
+
+        w4wl->received++;
+        w4wl->started = 1;
+        w4wl->num_pkts = num_pkts;
+
+        if (flags & NODE_LOG_STREAM_FLAG_OVERWRITTEN)
+                w4wl->overwritten = 1;
+
+        if (seq < w4wl->delivered || seq >= num_pkts) {
+                /* our acknowledgement got lost */
+                w4wl->duplicates++;
+                return 1;
+        }
+
+        if (seq - w4wl->delivered >= NODE_LOG_STREAM_MAX_WINDOW)
+                return 0;
+
+        p = &w4wl->pending[seq % NODE_LOG_STREAM_MAX_WINDOW];
+        if (p->valid) {
+                w4wl->duplicates++;
+                return 1;
+        }
+
+        p->valid = 1;
+        p->size = size;
+        memcpy(p->data, args + DATA_ARGS * 4, size);
+
+        if (seq != w4wl->delivered) {
+                /* tell the node about the gap right away */
+                w4wl->out_of_order++;
+                return 1;
+        }
+
+        if (deliver(w4wl))
+                exit(EXIT_FAILURE);
+
+        return w4wl->delivered == w4wl->num_pkts || w4wl->unacked >= w4wl->ack_every;
+}
+
+static void handle_packet(struct wmp4warplog *w4wl, const uint8_t *pkt, size_t pkt_l)
+{
+        uint32_t cmd;
+        uint16_t args_l;
+
+        if (pkt_l < WN_ARGS_OFFSET)
+                return;
+
+        cmd = get_u32(pkt + WN_PAYLOAD_PAD_NBYTES + WN_TRANSPORT_HDR_L) & 0xFFFFFF;
+        args_l = get_u16(pkt + WN_PAYLOAD_PAD_NBYTES + WN_TRANSPORT_HDR_L + 4);
+
+        if (args_l > pkt_l - WN_ARGS_OFFSET)
+                return;
+
+        switch (cmd) {
+        case NODE_LOG_STREAM_START:
+                if (args_l < 16 || get_u32(pkt + WN_ARGS_OFFSET) != 0) {
+                        fprintf(stderr, "The node refused the stream\n");
+                        exit(EXIT_FAILURE);
+                }
+                if (!w4wl->started) {
+                        w4wl->started = 1;
+                        w4wl->num_pkts = get_u32(pkt + WN_ARGS_OFFSET + 4);
+                        fprintf(stderr, "Stream of %u bytes in %u packets from event %u\n",
+                                get_u32(pkt + WN_ARGS_OFFSET + 8), w4wl->num_pkts,
+                                get_u32(pkt + WN_ARGS_OFFSET + 12));
+                }
+        break;
+
+        case NODE_LOG_STREAM_DATA:
+                if (handle_data(w4wl, pkt + WN_ARGS_OFFSET, args_l))
+                        send_ack(w4wl);
+        break;
+
+        default:
+        break;
+        }
+}
+
+int main(int argc, char *argv[])
+{
+        struct wmp4warplog w4wl;
+        uint8_t pkt[WN_MAX_PACKET_L + 64];
+        char *out_name = NULL;
+        char *node_ip = NULL;
+        uint64_t start_ms, last_rx_ms, done_ms = 0;
+        int tries = 0;
+        int opt;
+
+        memset(&w4wl, 0, sizeof(w4wl));
+        w4wl.node_id = WN_BROADCAST_ID;
+        w4wl.buffer_id = 1;
+        w4wl.num_events = 0xFFFFFFFF;
+        w4wl.ack_every = 4;
+        w4wl.timeout_ms = 20;
+        w4wl.retries = 50;
+        w4wl.node_addr.sin_family = AF_INET;
+        w4wl.node_addr.sin_port = htons(WN_UNICAST_PORT);
+
+        while ((opt = getopt(argc, argv, "ha:p:n:o:B:e:c:w:b:k:t:")) != -1) {
+                switch (opt) {
+                case 'h':
+                        usage();
+                        exit(EXIT_SUCCESS);
+                case 'a':
+                        node_ip = optarg;
+                break;
+                case 'p':
+                        w4wl.node_addr.sin_port = htons(atoi(optarg));
+                break;
+                case 'n':
+                        w4wl.node_id = strtoul(optarg, NULL, 0);
+                break;
+                case 'o':
+                        out_name = optarg;
+                break;
+                case 'B':
+                        w4wl.buffer_id = strtoul(optarg, NULL, 0);
+                break;
+                case 'e':
+                        w4wl.first_event_id = strtoul(optarg, NULL, 0);
+                break;
+                case 'c':
+                        w4wl.num_events = strtoul(optarg, NULL, 0);
+                break;
+                case 'w':
+                        w4wl.window = strtoul(optarg, NULL, 0);
+                break;
+                case 'b':
+                        w4wl.budget = strtoul(optarg, NULL, 0);
+                break;
+                case 'k':
+                        w4wl.ack_every = atoi(optarg);
+                break;
+                case 't':
+                        w4wl.timeout_ms = atoi(optarg);
+                break;
+                default:
+                        usage();
+                        exit(EXIT_FAILURE);
+                }
+        }
+
+        if (!node_ip || !out_name || w4wl.ack_every == 0 || w4wl.timeout_ms == 0) {
+                usage();
+                exit(EXIT_FAILURE);
+        }
+
+        if (inet_pton(AF_INET, node_ip, &w4wl.node_addr.sin_addr) != 1) {
+                fprintf(stderr, "Invalid node address %s\n", node_ip);
+                exit(EXIT_FAILURE);
+        }
+
+        w4wl.out = fopen(out_name, "wb");
+        if (!w4wl.out) {
+                perror(out_name);
+                exit(EXIT_FAILURE);
+        }
+
+        w4wl.fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (w4wl.fd < 0) {
+                perror("socket");
+                exit(EXIT_FAILURE);
+        }
+
+        if (send_start(&w4wl))
+                exit(EXIT_FAILURE);
+
+        start_ms = last_rx_ms = now_ms();
+
+        for (;;) {
+                struct pollfd pfd = { .fd = w4wl.fd, .events = POLLIN };
+                int done = w4wl.started && w4wl.delivered == w4wl.num_pkts;
+                uint64_t now;
+                ssize_t len;
+
+                if (done && !done_ms) {
+                        done_ms = now_ms();
+                        /* the last acknowledgement may have been sent already; it costs nothing to repeat it */
+                        if (w4wl.num_pkts)
+                                send_ack(&w4wl);
+                }
+
+                if (poll(&pfd, 1, w4wl.timeout_ms) < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        perror("poll");
+                        exit(EXIT_FAILURE);
+                }
+
+                now = now_ms();
+
+                if (pfd.revents & POLLIN) {
+                        len = recv(w4wl.fd, pkt, sizeof(pkt), 0);
+                        if (len < 0) {
+                                perror("recv");
+                                exit(EXIT_FAILURE);
+                        }
+                        last_rx_ms = now;
+                        tries = 0;
+                        handle_packet(&w4wl, pkt, len);
+                        continue;
+                }
+
+                /* stay around a little so a lost final acknowledgement can be repeated */
+                if (done) {
+                        if (now - done_ms >= 5 * w4wl.timeout_ms)
+                                break;
+                        continue;
+                }
+
+                if (now - last_rx_ms < w4wl.timeout_ms)
+                        continue;
+
+                if (++tries > w4wl.retries) {
+                        fprintf(stderr, "No answer from %s, giving up at packet %u\n", node_ip, w4wl.delivered);
+                        exit(EXIT_FAILURE);
+                }
+
+                /* nothing heard: the start or an acknowledgement was lost */
+                if (w4wl.started)
+                        send_ack(&w4wl);
+                else
+                        send_start(&w4wl);
+
+                last_rx_ms = now;
+        }
+
+        fclose(w4wl.out);
+        close(w4wl.fd);
+
+        fprintf(stderr, "%lu bytes in %u packets, %lu received, %lu duplicates, %lu out of order, %lu acks, %llu ms\n",
+                w4wl.bytes, w4wl.num_pkts, w4wl.received, w4wl.duplicates, w4wl.out_of_order, w4wl.acks,
+                (unsigned long long)(now_ms() - start_ms));
+
+        if (w4wl.overwritten)
+                fprintf(stderr, "WARNING: the first events were overwritten during the transfer\n");
+
+        return 0;
+}